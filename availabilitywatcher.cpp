@@ -0,0 +1,194 @@
+#include <QDebug>
+#include <QSet>
+#include <QTimer>
+#include "availabilitywatcher.h"
+#include "programmegridloader.h"
+#include "tvkaistaclient.h"
+
+/* Tallenteen saatavuus tarkistetaan hetki ohjelman päättymisen jälkeen. Jos tallenne ei
+   ole vielä valmis, tarkistusta yritetään uudelleen yhä harvemmin. */
+static const int CheckDelay = 10 * 60;
+static const int RetryInterval = 15 * 60;
+static const int BatchWindow = 5 * 60;
+static const int MaxAttempts = 6;
+static const int MaxAge = 2 * 24 * 60 * 60;
+
+static QDateTime endDateTime(const Programme &programme)
+{
+    return programme.startDateTime.addSecs(qMax(0, programme.duration));
+}
+
+AvailabilityWatcher::AvailabilityWatcher(TvkaistaClient *client, QObject *parent) :
+    QObject(parent), m_client(client), m_loader(new ProgrammeGridLoader(client, this)),
+    m_timer(new QTimer(this))
+{
+    m_timer->setSingleShot(true);
+    connect(m_timer, SIGNAL(timeout()), SLOT(check()));
+    connect(m_loader, SIGNAL(programmesLoaded(int,QList<Programme>)), SLOT(programmesLoaded(int,QList<Programme>)));
+    connect(m_loader, SIGNAL(finished()), SLOT(loadFinished()));
+}
+
+void AvailabilityWatcher::watch(const Programme &programme)
+{
+    if (programme.id < 0 || programme.channelId < 0 || !programme.startDateTime.isValid()) {
+        return;
+    }
+
+    QDateTime now = QDateTime::currentDateTime();
+    QDateTime end = endDateTime(programme);
+
+    /* Päättyneitä ja jo saatavilla olevia ohjelmia ei tarvitse seurata. */
+    if (end.secsTo(now) > MaxAge || (end < now && isAvailable(programme, m_client->format()))) {
+        return;
+    }
+
+    if (m_programmes.contains(programme.id)) {
+        m_programmes[programme.id].programme = programme;
+        return;
+    }
+
+    WatchedProgramme watched;
+    watched.programme = programme;
+    watched.checkDateTime = qMax(end.addSecs(CheckDelay), now);
+    watched.attempts = 0;
+    m_programmes.insert(programme.id, watched);
+    scheduleCheck();
+}
+
+void AvailabilityWatcher::watchProgrammes(const QList<Programme> &programmes)
+{
+    int count = programmes.size();
+
+    for (int i = 0; i < count; i++) {
+        watch(programmes.at(i));
+    }
+}
+
+void AvailabilityWatcher::unwatch(int programmeId)
+{
+    m_programmes.remove(programmeId);
+}
+
+bool AvailabilityWatcher::isWatched(int programmeId) const
+{
+    return m_programmes.contains(programmeId);
+}
+
+bool AvailabilityWatcher::isAvailable(const Programme &programme, int format)
+{
+    /* Tulevilla ohjelmilla kaikki muotoliput ovat päällä. */
+    return (programme.flags & (1 << format)) == 0;
+}
+
+void AvailabilityWatcher::check()
+{
+    if (m_loader->isLoading()) {
+        return;
+    }
+
+    /* Samaan aikaan erääntyvät tarkistukset kootaan yhdeksi listaushauksi kanavaa kohden. */
+    QDateTime limit = QDateTime::currentDateTime().addSecs(BatchWindow);
+    QMap<QDate, QSet<int> > channelIds;
+    QList<WatchedProgramme> programmes = m_programmes.values();
+    int count = programmes.size();
+
+    for (int i = 0; i < count; i++) {
+        if (programmes.at(i).checkDateTime <= limit) {
+            Programme programme = programmes.at(i).programme;
+            channelIds[programme.startDateTime.date()].insert(programme.channelId);
+        }
+    }
+
+    m_pendingDates.clear();
+    QList<QDate> dates = channelIds.keys();
+
+    for (int i = 0; i < dates.size(); i++) {
+        QList<int> ids = channelIds.value(dates.at(i)).toList();
+
+        for (int j = 0; j < ids.size(); j++) {
+            m_pendingDates[dates.at(i)].append(Channel(ids.at(j), QString()));
+        }
+    }
+
+    loadNextDate();
+}
+
+void AvailabilityWatcher::programmesLoaded(int channelId, const QList<Programme> &programmes)
+{
+    Q_UNUSED(channelId);
+    QDateTime now = QDateTime::currentDateTime();
+    int format = m_client->format();
+    int count = programmes.size();
+
+    for (int i = 0; i < count; i++) {
+        Programme programme = programmes.at(i);
+
+        if (!m_programmes.contains(programme.id) || endDateTime(programme) > now ||
+            !isAvailable(programme, format)) {
+            continue;
+        }
+
+        qDebug() << "AVAILABLE" << programme.id << programme.title;
+        m_programmes.remove(programme.id);
+        emit programmeAvailable(programme);
+    }
+}
+
+void AvailabilityWatcher::loadFinished()
+{
+    /* Tarkistetut ohjelmat, jotka eivät vielä ole saatavilla, siirretään myöhemmäksi. */
+    QDateTime now = QDateTime::currentDateTime();
+    QDateTime limit = now.addSecs(BatchWindow);
+    QDate date = m_loader->date();
+    QList<int> ids = m_programmes.keys();
+
+    for (int i = 0; i < ids.size(); i++) {
+        WatchedProgramme &watched = m_programmes[ids.at(i)];
+
+        if (watched.checkDateTime > limit || watched.programme.startDateTime.date() != date) {
+            continue;
+        }
+
+        if (++watched.attempts >= MaxAttempts) {
+            m_programmes.remove(ids.at(i));
+            continue;
+        }
+
+        watched.checkDateTime = now.addSecs(RetryInterval * watched.attempts);
+    }
+
+    loadNextDate();
+}
+
+void AvailabilityWatcher::scheduleCheck()
+{
+    if (m_programmes.isEmpty() || m_loader->isLoading() || !m_pendingDates.isEmpty()) {
+        return;
+    }
+
+    QDateTime next;
+    QList<WatchedProgramme> programmes = m_programmes.values();
+    int count = programmes.size();
+
+    for (int i = 0; i < count; i++) {
+        if (next.isNull() || programmes.at(i).checkDateTime < next) {
+            next = programmes.at(i).checkDateTime;
+        }
+    }
+
+    /* Ajastin rajoitetaan tuntiin, koska kone voi olla välillä lepotilassa. */
+    int secs = qBound(0, QDateTime::currentDateTime().secsTo(next), 3600);
+    m_timer->start(secs * 1000);
+}
+
+void AvailabilityWatcher::loadNextDate()
+{
+    if (m_pendingDates.isEmpty()) {
+        scheduleCheck();
+        return;
+    }
+
+    QDate date = m_pendingDates.begin().key();
+    QList<Channel> channels = m_pendingDates.take(date);
+    m_loader->load(channels, date, true);
+}
@@ -0,0 +1,50 @@
+#ifndef AVAILABILITYWATCHER_H
+#define AVAILABILITYWATCHER_H
+
+#include <QDate>
+#include <QMap>
+#include <QObject>
+#include "channel.h"
+#include "programme.h"
+
+class QTimer;
+class ProgrammeGridLoader;
+class TvkaistaClient;
+
+struct WatchedProgramme
+{
+    Programme programme;
+    QDateTime checkDateTime;
+    int attempts;
+};
+
+class AvailabilityWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    AvailabilityWatcher(TvkaistaClient *client, QObject *parent = 0);
+    void watch(const Programme &programme);
+    void watchProgrammes(const QList<Programme> &programmes);
+    void unwatch(int programmeId);
+    bool isWatched(int programmeId) const;
+    static bool isAvailable(const Programme &programme, int format);
+
+signals:
+    void programmeAvailable(const Programme &programme);
+
+private slots:
+    void check();
+    void programmesLoaded(int channelId, const QList<Programme> &programmes);
+    void loadFinished();
+
+private:
+    void scheduleCheck();
+    void loadNextDate();
+    TvkaistaClient *m_client;
+    ProgrammeGridLoader *m_loader;
+    QTimer *m_timer;
+    QMap<int, WatchedProgramme> m_programmes;
+    QMap<QDate, QList<Channel> > m_pendingDates;
+};
+
+#endif // AVAILABILITYWATCHER_H
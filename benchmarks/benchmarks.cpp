@@ -0,0 +1,256 @@
+#include <QBuffer>
+#include <QDir>
+#include <QSettings>
+#include <QtTest>
+#include "cache.h"
+#include "channelfeedparser.h"
+#include "fixtures.h"
+#include "historymanager.h"
+#include "programmefeedparser.h"
+#include "programmetablemodel.h"
+#include "programmetableparser.h"
+
+/* Tulokset saa koneluettavina valitsimilla -xml tai -xunitxml, esim.
+   ./benchmarks -xml -o benchmarks.xml */
+
+class Benchmarks : public QObject
+{
+    Q_OBJECT
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+    void programmeTableParser_data();
+    void programmeTableParser();
+    void programmeFeedParser_data();
+    void programmeFeedParser();
+    void channelFeedParser();
+    void cacheProgrammes_data();
+    void cacheProgrammes();
+    void cachePlaylist_data();
+    void cachePlaylist();
+    void setProgrammes_data();
+    void setProgrammes();
+    void setSeasonPasses_data();
+    void setSeasonPasses();
+
+private:
+    QDir m_dir;
+    QSettings *m_settings;
+    HistoryManager *m_historyManager;
+};
+
+static bool removeDirectory(const QDir &dir)
+{
+    QFileInfoList entries = dir.entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot);
+
+    for (int i = 0; i < entries.size(); i++) {
+        QFileInfo info = entries.at(i);
+
+        if (info.isDir()) {
+            removeDirectory(QDir(info.filePath()));
+        }
+        else {
+            QFile::remove(info.filePath());
+        }
+    }
+
+    return dir.rmdir(dir.absolutePath());
+}
+
+void Benchmarks::initTestCase()
+{
+    m_dir = QDir(QDir::temp().filePath(QString("tvkaista-benchmarks-%1").arg(QCoreApplication::applicationPid())));
+    QVERIFY(m_dir.mkpath(m_dir.absolutePath()));
+    m_settings = new QSettings(m_dir.filePath("settings.ini"), QSettings::IniFormat);
+    m_historyManager = new HistoryManager(m_settings);
+}
+
+void Benchmarks::cleanupTestCase()
+{
+    delete m_historyManager;
+    delete m_settings;
+    removeDirectory(m_dir);
+}
+
+void Benchmarks::programmeTableParser_data()
+{
+    QTest::addColumn<int>("programmesPerDay");
+    QTest::newRow("normal") << 40;
+    QTest::newRow("dense") << 200;
+}
+
+void Benchmarks::programmeTableParser()
+{
+    QFETCH(int, programmesPerDay);
+    QDate date(2011, 3, 16);
+    QByteArray page = Fixtures::weekPage(date, programmesPerDay);
+    int count = 0;
+
+    QBENCHMARK {
+        QBuffer buffer(&page);
+        buffer.open(QIODevice::ReadOnly);
+        ProgrammeTableParser parser;
+        parser.setRequestedDate(date);
+        parser.setRequestedChannelId(1000);
+        parser.parse(&buffer);
+        count = parser.requestedProgrammes().size();
+    }
+
+    QCOMPARE(count, programmesPerDay);
+}
+
+void Benchmarks::programmeFeedParser_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("playlist") << 500;
+    QTest::newRow("search") << 5000;
+}
+
+void Benchmarks::programmeFeedParser()
+{
+    QFETCH(int, count);
+    QByteArray feed = Fixtures::programmeFeed(count);
+    bool ok = false;
+    int parsed = 0;
+
+    QBENCHMARK {
+        QBuffer buffer(&feed);
+        buffer.open(QIODevice::ReadOnly);
+        ProgrammeFeedParser parser;
+        ok = parser.parse(&buffer);
+        parsed = parser.programmes().size();
+    }
+
+    QVERIFY(ok);
+    QCOMPARE(parsed, count);
+}
+
+void Benchmarks::channelFeedParser()
+{
+    QByteArray feed = Fixtures::channelFeed(100);
+    int count = 0;
+
+    QBENCHMARK {
+        QBuffer buffer(&feed);
+        buffer.open(QIODevice::ReadOnly);
+        ChannelFeedParser parser;
+        parser.parse(&buffer);
+        count = parser.channels().size();
+    }
+
+    QCOMPARE(count, 100);
+}
+
+void Benchmarks::cacheProgrammes_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("day") << 48;
+    QTest::newRow("dense day") << 200;
+}
+
+void Benchmarks::cacheProgrammes()
+{
+    /* Tallennus ja luku edestakaisin, mukaan lukien kirjoitussäikeen tyhjennys. */
+    QFETCH(int, count);
+    QDate date(2011, 3, 16);
+    QList<Programme> programmes = Fixtures::programmes(count, 1000, QDateTime(date, QTime(6, 0)));
+    QDateTime now = QDateTime::currentDateTime();
+    Cache cache;
+    cache.setDirectory(QDir(m_dir.filePath(QString("cache-programmes-%1").arg(count))));
+    QList<Programme> loaded;
+    bool ok = false;
+    int age;
+
+    QBENCHMARK {
+        cache.saveProgrammes(1000, date, now, now.addDays(1), programmes);
+        cache.flush();
+        loaded = cache.loadProgrammes(1000, date, ok, age);
+    }
+
+    QVERIFY(ok);
+    QCOMPARE(loaded.size(), count);
+}
+
+void Benchmarks::cachePlaylist_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+}
+
+void Benchmarks::cachePlaylist()
+{
+    QFETCH(int, count);
+    QList<Programme> programmes = Fixtures::programmes(count, 1000, QDateTime(QDate(2011, 1, 1), QTime(0, 0)));
+    QDateTime now = QDateTime::currentDateTime();
+    Cache cache;
+    cache.setDirectory(QDir(m_dir.filePath(QString("cache-playlist-%1").arg(count))));
+    QList<Programme> loaded;
+    bool ok = false;
+    int age;
+
+    QBENCHMARK {
+        cache.savePlaylist(now, programmes);
+        cache.flush();
+        loaded = cache.loadPlaylist(ok, age);
+    }
+
+    QVERIFY(ok);
+    QCOMPARE(loaded.size(), count);
+}
+
+void Benchmarks::setProgrammes_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::addColumn<int>("sortKey");
+    QTest::newRow("1k") << 1000 << 0;
+    QTest::newRow("10k") << 10000 << 0;
+    QTest::newRow("100k") << 100000 << 0;
+    QTest::newRow("1k sorted by time") << 1000 << 1;
+    QTest::newRow("10k sorted by time") << 10000 << 1;
+    QTest::newRow("100k sorted by time") << 100000 << 1;
+    QTest::newRow("100k sorted by title") << 100000 << 2;
+}
+
+void Benchmarks::setProgrammes()
+{
+    QFETCH(int, count);
+    QFETCH(int, sortKey);
+    QList<Programme> programmes = Fixtures::programmes(count, 1000, QDateTime(QDate(2011, 1, 1), QTime(0, 0)));
+    ProgrammeTableModel model(m_historyManager, true);
+    model.setSortKey(sortKey, false);
+
+    /* Ensimmäinen kierros lisää rivit, seuraavat korvaavat saman kokoisen listan
+       kuten listauksen päivitys näkymässä. */
+    QBENCHMARK {
+        model.setProgrammes(programmes);
+    }
+
+    QCOMPARE(model.programmeCount(), count);
+}
+
+void Benchmarks::setSeasonPasses_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("100k") << 100000;
+}
+
+void Benchmarks::setSeasonPasses()
+{
+    QFETCH(int, count);
+    QList<Programme> programmes = Fixtures::programmes(count, 1000, QDateTime(QDate(2011, 1, 1), QTime(0, 0)));
+    QMap<QString, int> seasonPasses = Fixtures::seasonPasses(30);
+    ProgrammeTableModel model(m_historyManager, true);
+    model.setProgrammes(programmes);
+
+    QBENCHMARK {
+        model.setSeasonPasses(seasonPasses);
+    }
+
+    QCOMPARE(model.programmeCount(), count);
+}
+
+QTEST_MAIN(Benchmarks)
+#include "benchmarks.moc"
@@ -0,0 +1,40 @@
+# -------------------------------------------------
+# Suorituskykytestit: qmake && make && ./benchmarks -xml -o benchmarks.xml
+# -------------------------------------------------
+QT += core \
+    gui \
+    xml \
+    network
+CONFIG += qtestlib
+TARGET = benchmarks
+TEMPLATE = app
+INCLUDEPATH += ..
+DEPENDPATH += ..
+SOURCES += benchmarks.cpp \
+    fixtures.cpp \
+    ../channel.cpp \
+    ../programme.cpp \
+    ../thumbnail.cpp \
+    ../htmlparser.cpp \
+    ../programmetableparser.cpp \
+    ../programmefeedparser.cpp \
+    ../channelfeedparser.cpp \
+    ../cache.cpp \
+    ../cacheindex.cpp \
+    ../cachewriter.cpp \
+    ../posterpack.cpp \
+    ../descriptionstore.cpp \
+    ../historyentry.cpp \
+    ../historymanager.cpp \
+    ../networktracer.cpp \
+    ../metrics.cpp \
+    ../programmetablemodel.cpp
+HEADERS += fixtures.h \
+    ../cachewriter.h \
+    ../networktracer.h \
+    ../metrics.h \
+    ../programmetablemodel.h
+benchmark.target = benchmark
+benchmark.commands = ./$$TARGET -xml -o benchmarks.xml
+benchmark.depends = $$TARGET
+QMAKE_EXTRA_TARGETS += benchmark
@@ -0,0 +1,134 @@
+#include <QStringList>
+#include "fixtures.h"
+
+static const int TitleCount = 200;
+static const int DescriptionCount = 500;
+
+static QString title(int index)
+{
+    return QString("Ohjelma %1").arg(index % TitleCount);
+}
+
+static QString description(int index)
+{
+    /* Palvelimen kuvaukset ovat tyypillisesti muutaman lauseen mittaisia, ja uusinnoilla
+       on sama kuvaus kuin alkuperäisellä jaksolla. */
+    return QString::fromUtf8("Jakson %1 kuvaus. Sarjan henkilöt joutuvat pulaan, kun "
+                             "vanha tuttu palaa kaupunkiin ja tuo mukanaan ikäviä uutisia.")
+            .arg(index % DescriptionCount);
+}
+
+static QByteArray escaped(const QString &s)
+{
+    QString t = s;
+    t.replace('&', "&amp;").replace('<', "&lt;").replace('>', "&gt;");
+    return t.toUtf8();
+}
+
+QList<Programme> Fixtures::programmes(int count, int channelId, const QDateTime &start)
+{
+    QList<Programme> programmes;
+
+    for (int i = 0; i < count; i++) {
+        Programme programme;
+        programme.id = 1000000 + i;
+        programme.title = title(i);
+        programme.description = description(i);
+        programme.startDateTime = start.addSecs(i * 1800);
+        programme.channelId = channelId;
+        programme.flags = i % 16;
+        programme.duration = 1800;
+        programmes.append(programme);
+    }
+
+    return programmes;
+}
+
+QMap<QString, int> Fixtures::seasonPasses(int count)
+{
+    QMap<QString, int> seasonPasses;
+
+    for (int i = 0; i < count; i++) {
+        seasonPasses.insert(title(i * 7), 800000 + i);
+    }
+
+    return seasonPasses;
+}
+
+QByteArray Fixtures::weekPage(const QDate &requestedDate, int programmesPerDay)
+{
+    QByteArray page;
+    page.append("<html><head><title>tvkaista</title></head><body>\n");
+    page.append(QString("<div id=\"toolbarcalendar\"><a href=\"#\">%1.%2.</a></div>\n")
+                .arg(requestedDate.day()).arg(requestedDate.month()).toUtf8());
+    page.append("<div id=\"channelboard\"><table><tr>\n");
+    int interval = 24 * 60 / qMax(1, programmesPerDay);
+
+    for (int day = 0; day < 7; day++) {
+        page.append("<td><table class=\"day\">\n");
+
+        for (int i = 0; i < programmesPerDay; i++) {
+            int minutes = i * interval;
+            int index = day * programmesPerDay + i;
+            page.append("<tr class=\"infobox\"><td class=\"programtime\">");
+            page.append(QString("%1.%2").arg(minutes / 60).arg(minutes % 60, 2, 10, QChar('0')).toUtf8());
+            page.append(QString("</td><td><span id=\"pid%1\" class=\"programme nof%2\">")
+                        .arg(2000000 + index).arg(index % 4).toUtf8());
+            page.append(escaped(title(index)));
+            page.append("</span><span class=\"information\">");
+            page.append(escaped(description(index)));
+            page.append("</span></td></tr>\n");
+        }
+
+        page.append("</table></td>\n");
+    }
+
+    page.append("</tr></table></div>\n</body></html>\n");
+    return page;
+}
+
+QByteArray Fixtures::programmeFeed(int count)
+{
+    static const char *monthNames[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    QByteArray feed;
+    feed.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<rss version=\"2.0\" xmlns:media=\"http://search.yahoo.com/mrss/\">\n"
+                "<channel><title>tvkaista</title>\n");
+    QDateTime start(QDate(2011, 3, 1), QTime(6, 0), Qt::UTC);
+
+    for (int i = 0; i < count; i++) {
+        QDateTime dateTime = start.addSecs(i * 1800);
+        QDate date = dateTime.date();
+        feed.append("<item><title>");
+        feed.append(escaped(title(i)));
+        feed.append(QString("</title><link>http://tvkaista.fi/search/?findid=%1</link>").arg(3000000 + i).toUtf8());
+        feed.append("<description>");
+        feed.append(escaped(description(i)));
+        feed.append(QString("</description><source url=\"http://tvkaista.fi/feed/channels/%1/flv.mediarss\">Kanava</source>")
+                    .arg(1000 + i % 20).toUtf8());
+        feed.append(QString("<pubDate>%1 %2 %3 %4 +0000</pubDate>")
+                    .arg(date.day()).arg(monthNames[date.month() - 1]).arg(date.year())
+                    .arg(dateTime.time().toString("hh:mm:ss")).toUtf8());
+        feed.append("<media:group><media:content duration=\"1800\" url=\"http://tvkaista.fi/x.flv\"/>"
+                    "<media:thumbnail url=\"http://tvkaista.fi/x.jpg\" time=\"0:05:00\"/></media:group>");
+        feed.append("</item>\n");
+    }
+
+    feed.append("</channel></rss>\n");
+    return feed;
+}
+
+QByteArray Fixtures::channelFeed(int count)
+{
+    QByteArray feed;
+    feed.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<rss version=\"2.0\"><channel><title>tvkaista</title>\n");
+
+    for (int i = 0; i < count; i++) {
+        feed.append(QString("<item><title>Kanava %1</title><link>http://www.tvkaista.fi/feed/channels/%2</link></item>\n")
+                    .arg(i).arg(1000 + i).toUtf8());
+    }
+
+    feed.append("</channel></rss>\n");
+    return feed;
+}
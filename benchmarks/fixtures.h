@@ -0,0 +1,23 @@
+#ifndef FIXTURES_H
+#define FIXTURES_H
+
+#include <QByteArray>
+#include <QDate>
+#include <QList>
+#include <QMap>
+#include "programme.h"
+
+/* Testiaineisto luodaan ohjelmallisesti, jotta tulokset ovat toistettavia eikä
+   tunnuksia tai palvelimen sivuja tarvitse tallentaa versionhallintaan. Rakenne
+   vastaa palvelimen viikkonäkymää ja syötteitä siltä osin kuin jäsentimet niitä lukevat. */
+
+namespace Fixtures
+{
+    QList<Programme> programmes(int count, int channelId, const QDateTime &start);
+    QMap<QString, int> seasonPasses(int count);
+    QByteArray weekPage(const QDate &requestedDate, int programmesPerDay);
+    QByteArray programmeFeed(int count);
+    QByteArray channelFeed(int count);
+}
+
+#endif // FIXTURES_H
@@ -1,14 +1,91 @@
 #include <QDebug>
+#include <QRegExp>
 #include <QXmlStreamWriter>
+#include <QtConcurrentRun>
+#include <cstdio>
 #include "cache.h"
+#include "cachewriter.h"
+#include "descriptionstore.h"
+#include "metrics.h"
+#include "posterpack.h"
+#include "profiler.h"
 
-Cache::Cache()
+static bool replaceFile(const QString &tempFilename, const QString &filename)
 {
+#ifdef Q_OS_WIN
+    QFile::remove(filename);
+    return QFile::rename(tempFilename, filename);
+#else
+    /* rename() korvaa vanhan tiedoston atomisesti. */
+    return ::rename(QFile::encodeName(tempFilename).constData(), QFile::encodeName(filename).constData()) == 0;
+#endif
+}
+
+/* Kirjaa latauksen osuman tai ohituksen luokittain, kun lataava funktio palaa. */
+class CacheLookup
+{
+public:
+    CacheLookup(const char *cacheClass, const bool &ok) : m_cacheClass(cacheClass), m_ok(ok) {}
+
+    ~CacheLookup()
+    {
+        Metrics::instance()->increment(QString(m_ok ? "tvkaista_cache_hits_total{class=\"%1\"}" :
+                                                      "tvkaista_cache_misses_total{class=\"%1\"}").arg(m_cacheClass));
+    }
+
+private:
+    const char *m_cacheClass;
+    const bool &m_ok;
+};
+
+/* Cache on säieturvallinen: indeksiä ja pakkatiedostoja suojaa m_mutex, tiedostoja
+   avainkohtaiset luku- ja kirjoituslukot ja viimeisin virhe on säiekohtainen.
+   Tiedostolukkoa ei saa ottaa m_mutexin ollessa lukittuna. */
+
+/* Tätä lyhyemmät kuvaukset tallennetaan suoraan listaukseen. */
+static const int MinReferencedDescriptionLength = 64;
+
+ProgrammeCacheResult::ProgrammeCacheResult() : channelId(-1), ok(false), age(INT_MAX)
+{
+}
+
+Cache::Cache() : m_mutex(QMutex::Recursive), m_writer(new CacheWriter(this)), m_maxBytes(0)
+{
+    for (int i = 0; i < 3; i++) {
+        m_maxTypeBytes[i] = 0;
+        m_evictionCutoff[i] = 0;
+    }
+
+    m_writer->start(QThread::LowPriority);
+}
+
+Cache::~Cache()
+{
+    delete m_writer;
+    qDeleteAll(m_posterPacks);
+    qDeleteAll(m_descriptionStores);
 }
 
 void Cache::setDirectory(const QDir &dir)
 {
+    /* Ei säieturvallinen: kutsutaan ennen kuin välimuistia käytetään muista säikeistä. */
+    m_writer->flush();
+    QMutexLocker locker(&m_mutex);
     m_dir = dir;
+    qDeleteAll(m_posterPacks);
+    m_posterPacks.clear();
+    qDeleteAll(m_descriptionStores);
+    m_descriptionStores.clear();
+    m_scanQueue.clear();
+
+    for (int i = 0; i < 3; i++) {
+        m_evictionQueue[i].clear();
+    }
+
+    /* Jos indeksiä ei ole, olemassa olevat tiedostot lisätään siihen vähitellen. */
+    if (!m_index.load(m_dir.filePath("cache-index.dat")) || !m_index.isScanned()) {
+        m_scanQueue.append(QString());
+    }
 }
 
 QDir Cache::directory() const
@@ -18,13 +95,22 @@ QDir Cache::directory() const
 
 QString Cache::lastError() const
 {
-    return m_lastError;
+    return m_lastError.hasLocalData() ? *m_lastError.localData() : QString();
 }
 
 QList<Channel> Cache::loadChannels(bool &ok)
 {
+    CacheLookup lookup("channels", ok);
     QList<Channel> channels;
     QString filename = buildChannelsXmlFilename();
+    CacheWriteJob job;
+
+    if (m_writer->pendingJob(filename, job)) {
+        ok = job.type == 1;
+        return job.channels;
+    }
+
+    QReadLocker locker(fileLock(filename));
     QFile file(filename);
 
     if (!file.open(QIODevice::ReadOnly)) {
@@ -32,274 +118,1143 @@ QList<Channel> Cache::loadChannels(bool &ok)
         return channels;
     }
 
-    qDebug() << "READ" << filename;
-    QXmlStreamReader reader(&file);
+    qDebug() << "READ" << filename;
+    QXmlStreamReader reader(&file);
+
+    if (!reader.readNextStartElement() || reader.name() != "channels") {
+        ok = false;
+        file.close();
+        return channels;
+    }
+
+    while (reader.readNextStartElement()) {
+        if (reader.name() != "channel") {
+            reader.skipCurrentElement();
+        }
+
+        QXmlStreamAttributes attrs = reader.attributes();
+        Channel channel;
+        channel.id = attrs.value("id").toString().toInt(&ok);
+
+        if (!ok) {
+            continue;
+        }
+
+        channel.name = attrs.value("name").toString();
+        channels.append(channel);
+        reader.skipCurrentElement();
+    }
+
+    ok = true;
+    return channels;
+}
+
+bool Cache::saveChannels(const QList<Channel> &channels)
+{
+    CacheWriteJob job;
+    job.type = 1;
+    job.filename = buildChannelsXmlFilename();
+    job.channels = channels;
+    m_writer->enqueue(job);
+    return true;
+}
+
+QList<Programme> Cache::loadProgrammes(int channelId, const QDate &date, bool &ok, int &age)
+{
+    CacheLookup lookup("listings", ok);
+    QList<Programme> programmes;
+    QString filename = buildProgrammesXmlFilename(channelId, date);
+    CacheWriteJob job;
+    age = INT_MAX;
+
+    if (m_writer->pendingJob(filename, job)) {
+        return pendingProgrammes(job, channelId, ok, age);
+    }
+
+    QReadLocker locker(fileLock(filename));
+    QFile file(filename);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        ok = false;
+        return programmes;
+    }
+
+    qDebug() << "READ" << filename;
+    programmes = readProgrammeFeed(&file, date.toString("yyyy-MM"), channelId, ok, age);
+    qint64 size = file.size();
+    file.close();
+    locker.unlock();
+
+    if (ok) {
+        touch(filename, size);
+    }
+
+    return programmes;
+}
+
+QFuture<ProgrammeCacheResult> Cache::loadProgrammesAsync(int channelId, const QDate &date)
+{
+    return QtConcurrent::run(this, &Cache::loadProgrammesResult, channelId, date);
+}
+
+bool Cache::saveProgrammes(int channelId, const QDate &date, const QDateTime &updateDateTime,
+                           const QDateTime &expireDateTime, const QList<Programme> programmes)
+{
+    enqueueProgrammeFeed(buildProgrammesXmlFilename(channelId, date), updateDateTime,
+                         expireDateTime, programmes);
+    return true;
+}
+
+QList<Programme> Cache::loadPlaylist(bool &ok, int &age)
+{
+    CacheLookup lookup("feeds", ok);
+    QList<Programme> programmes;
+    QString filename = buildPlaylistXmlFilename();
+    CacheWriteJob job;
+    age = INT_MAX;
+
+    if (m_writer->pendingJob(filename, job)) {
+        return pendingProgrammes(job, -1, ok, age);
+    }
+
+    QReadLocker locker(fileLock(filename));
+    QFile file(filename);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        ok = false;
+        return programmes;
+    }
+
+    qDebug() << "READ" << filename;
+    programmes = readProgrammeFeed(&file, QString(), -1, ok, age);
+    file.close();
+    return programmes;
+}
+
+QFuture<ProgrammeCacheResult> Cache::loadPlaylistAsync()
+{
+    return QtConcurrent::run(this, &Cache::loadPlaylistResult);
+}
+
+bool Cache::savePlaylist(const QDateTime &updateDateTime, QList<Programme>programmes)
+{
+    enqueueProgrammeFeed(buildPlaylistXmlFilename(), updateDateTime, QDateTime(), programmes);
+    return true;
+}
+
+bool Cache::removePlaylist()
+{
+    enqueueRemove(buildPlaylistXmlFilename());
+    return true;
+}
+
+QList<Programme> Cache::loadSeasonPasses(bool &ok, int &age)
+{
+    CacheLookup lookup("feeds", ok);
+    QList<Programme> programmes;
+    QString filename = buildSeasonPassesXmlFilename();
+    CacheWriteJob job;
+    age = INT_MAX;
+
+    if (m_writer->pendingJob(filename, job)) {
+        return pendingProgrammes(job, -1, ok, age);
+    }
+
+    QReadLocker locker(fileLock(filename));
+    QFile file(filename);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        ok = false;
+        return programmes;
+    }
+
+    qDebug() << "READ" << filename;
+    programmes = readProgrammeFeed(&file, QString(), -1, ok, age);
+    file.close();
+    return programmes;
+}
+
+QFuture<ProgrammeCacheResult> Cache::loadSeasonPassesAsync()
+{
+    return QtConcurrent::run(this, &Cache::loadSeasonPassesResult);
+}
+
+bool Cache::saveSeasonPasses(const QDateTime &updateDateTime, QList<Programme>programmes)
+{
+    enqueueProgrammeFeed(buildSeasonPassesXmlFilename(), updateDateTime, QDateTime(), programmes);
+    return true;
+}
+
+bool Cache::removeSeasonPasses()
+{
+    enqueueRemove(buildSeasonPassesXmlFilename());
+    return true;
+}
+
+bool Cache::hasPoster(const Programme &programme)
+{
+    CacheWriteJob job;
+
+    if (m_writer->pendingJob(buildPosterFilename(programme), job)) {
+        return job.type == 3;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    PosterPack *pack = posterPack(programme.startDateTime.toString("yyyy-MM"), false);
+    return pack != 0 && pack->contains(programme.id);
+}
+
+QString Cache::loadDescription(const Programme &programme)
+{
+    bool ok;
+    return loadDescription(programme, ok);
+}
+
+QString Cache::loadDescription(const Programme &programme, bool &ok)
+{
+    /* Avaimen alussa on sanakirjan kuukausi (yyyy-MM) ja perässä kuvauksen tiiviste. */
+    if (!programme.description.isEmpty() || programme.descriptionKey.size() <= 7) {
+        ok = true;
+        return programme.description;
+    }
+
+    return readDescription(QString::fromAscii(programme.descriptionKey.left(7)),
+                           programme.descriptionKey.mid(7), ok);
+}
+
+void Cache::storeDescriptions(QList<Programme> &programmes)
+{
+    /* Verkosta haettujen listojen kuvaukset siirretään ohjelman kuukauden sanakirjaan, jotta
+       malleihin päätyy vain avain. Kuvaus luetaan sanakirjasta, kun ohjelma valitaan. */
+    int count = programmes.size();
+
+    for (int i = 0; i < count; i++) {
+        Programme &programme = programmes[i];
+
+        if (programme.description.size() < MinReferencedDescriptionLength ||
+            !programme.startDateTime.isValid()) {
+            continue;
+        }
+
+        QString month = programme.startDateTime.toString("yyyy-MM");
+        QByteArray key = insertDescription(month, programme.description);
+
+        if (!key.isEmpty()) {
+            programme.descriptionKey = month.toAscii() + key;
+            programme.description.clear();
+        }
+    }
+}
+
+QByteArray Cache::loadPoster(const Programme &programme)
+{
+    CacheWriteJob job;
+
+    bool ok = false;
+    CacheLookup lookup("posters", ok);
+
+    if (m_writer->pendingJob(buildPosterFilename(programme), job)) {
+        ok = !job.data.isEmpty();
+        return job.data;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    PosterPack *pack = posterPack(programme.startDateTime.toString("yyyy-MM"), false);
+
+    if (pack == 0 || !pack->contains(programme.id)) {
+        return QByteArray();
+    }
+
+    QByteArray data = pack->read(programme.id);
+    touch(buildPosterFilename(programme), data.size());
+    ok = !data.isEmpty();
+    return data;
+}
+
+bool Cache::savePoster(const Programme &programme, const QByteArray &data)
+{
+    CacheWriteJob job;
+    job.type = 3;
+    job.filename = buildPosterFilename(programme);
+    job.programme = programme;
+    job.data = data;
+    m_writer->enqueue(job);
+    return true;
+}
+
+QList<Thumbnail> Cache::loadThumbnails(const Programme &programme, bool &ok)
+{
+    CacheLookup lookup("thumbnails", ok);
+    QList<Thumbnail> thumbnails;
+    QString filename = buildThumbnailsXmlFilename(programme);
+    CacheWriteJob job;
+
+    if (m_writer->pendingJob(filename, job)) {
+        ok = job.type == 4;
+        return job.thumbnails;
+    }
+
+    QReadLocker locker(fileLock(filename));
+    QFile file(filename);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        ok = false;
+        return thumbnails;
+    }
+
+    qDebug() << "READ" << filename;
+    QXmlStreamReader reader(&file);
+
+    if (!reader.readNextStartElement() || reader.name() != "thumbnails") {
+        ok = false;
+        file.close();
+        return thumbnails;
+    }
+
+    while (reader.readNextStartElement()) {
+        if (reader.name() != "thumbnail") {
+            reader.skipCurrentElement();
+            continue;
+        }
+
+        QXmlStreamAttributes attrs = reader.attributes();
+        Thumbnail thumbnail(QUrl(attrs.value("url").toString()),
+                            QTime::fromString(attrs.value("time").toString(), "hh:mm:ss"));
+
+        if (thumbnail.url.isValid() && thumbnail.time.isValid()) {
+            thumbnails.append(thumbnail);
+        }
+
+        reader.skipCurrentElement();
+    }
+
+    ok = !reader.hasError();
+    qint64 size = file.size();
+    file.close();
+    locker.unlock();
+
+    if (ok) {
+        touch(filename, size);
+    }
+
+    return thumbnails;
+}
+
+bool Cache::saveThumbnails(const Programme &programme, const QList<Thumbnail> &thumbnails)
+{
+    CacheWriteJob job;
+    job.type = 4;
+    job.filename = buildThumbnailsXmlFilename(programme);
+    job.thumbnails = thumbnails;
+    m_writer->enqueue(job);
+    return true;
+}
+
+QByteArray Cache::loadThumbnail(const Programme &programme, const QTime &time)
+{
+    QString filename = buildThumbnailFilename(programme, time);
+    CacheWriteJob job;
+
+    if (m_writer->pendingJob(filename, job)) {
+        return job.data;
+    }
+
+    QReadLocker locker(fileLock(filename));
+    QFile file(filename);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    qDebug() << "READ" << filename;
+    QByteArray data = file.readAll();
+    file.close();
+    locker.unlock();
+    touch(filename, data.size());
+    return data;
+}
+
+bool Cache::saveThumbnail(const Programme &programme, const QTime &time, const QByteArray &data)
+{
+    CacheWriteJob job;
+    job.type = 5;
+    job.filename = buildThumbnailFilename(programme, time);
+    job.data = data;
+    m_writer->enqueue(job);
+    return true;
+}
+
+void Cache::flush()
+{
+    m_writer->flush();
+}
+
+void Cache::setLimits(qint64 maxBytes, qint64 maxListingBytes, qint64 maxPosterBytes, qint64 maxThumbnailBytes)
+{
+    m_maxBytes = maxBytes;
+    m_maxTypeBytes[0] = maxListingBytes;
+    m_maxTypeBytes[1] = maxPosterBytes;
+    m_maxTypeBytes[2] = maxThumbnailBytes;
+}
+
+qint64 Cache::bytesUsed() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_index.totalBytes();
+}
+
+bool Cache::isScanned() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_scanQueue.isEmpty();
+}
+
+bool Cache::scanDirectory(int maxDirectories)
+{
+    /* Suoritetaan CacheManagerin taustasäikeessä. Hakemisto luetaan ennen m_mutexin lukitsemista,
+       jotta muut säikeet eivät odota levyä. */
+    for (int n = 0; n < maxDirectories; n++) {
+        QString path;
+
+        {
+            QMutexLocker locker(&m_mutex);
+
+            if (m_scanQueue.isEmpty()) {
+                break;
+            }
+
+            path = m_scanQueue.first();
+        }
+
+        QDir dir(path.isEmpty() ? m_dir.path() : m_dir.filePath(path));
+        QFileInfoList entries = dir.entryInfoList(QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+        int count = entries.size();
+        QMutexLocker locker(&m_mutex);
+        m_scanQueue.removeFirst();
+
+        for (int i = 0; i < count; i++) {
+            QFileInfo info = entries.at(i);
+            QString relativePath = m_dir.relativeFilePath(info.filePath());
+
+            if (info.isDir()) {
+                m_scanQueue.append(relativePath);
+                continue;
+            }
+
+            if (info.fileName() == "posters.pack") {
+                PosterPack *pack = posterPack(path, false);
+                QList<int> ids = pack != 0 ? pack->ids() : QList<int>();
+
+                for (int j = 0; j < ids.size(); j++) {
+                    QString posterPath = QString("%1/i%2.jpg").arg(path).arg(ids.at(j));
+
+                    if (!m_index.contains(posterPath)) {
+                        m_index.insert(posterPath, 1, pack->size(ids.at(j)), info.lastModified().toTime_t());
+                    }
+                }
+
+                continue;
+            }
+
+            int type = CacheIndex::typeForFilename(relativePath);
+
+            if (type >= 0 && !m_index.contains(relativePath)) {
+                m_index.insert(relativePath, type, info.size(), info.lastModified().toTime_t());
+            }
+        }
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    if (m_scanQueue.isEmpty()) {
+        m_index.setScanned(true);
+        return false;
+    }
+
+    return true;
+}
+
+bool Cache::isOverLimit() const
+{
+    QMutexLocker locker(&m_mutex);
+    return typeToEvict(1.0) >= 0;
+}
+
+bool Cache::collectGarbage(int maxRemovals)
+{
+    /* Suoritetaan CacheManagerin taustasäikeessä. Poistettavat valitaan m_mutexin alla, mutta
+       tiedostot poistetaan ja sanakirjan listaukset luetaan vasta lukon vapauttamisen jälkeen. */
+    QStringList removals;
+    QString compactMonth;
+    QString compactPackMonth;
+    bool exhausted = false;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        int removed = 0;
+
+        /* Poistetaan kunnes käyttö on 90 % rajasta, jotta siivous ei käynnisty jokaisesta tallennuksesta. */
+        while (removed < maxRemovals) {
+            int type = typeToEvict(0.9);
+
+            if (type < 0) {
+                break;
+            }
+
+            if (m_evictionQueue[type].isEmpty()) {
+                m_evictionQueue[type] = m_index.leastRecentlyUsed(type, 256);
+
+                if (m_evictionQueue[type].isEmpty()) {
+                    exhausted = true;
+                    break;
+                }
+
+                m_evictionCutoff[type] = m_index.entry(m_evictionQueue[type].last()).accessTime;
+            }
+
+            QString path = m_evictionQueue[type].takeFirst();
+
+            /* Tiedostoa on voitu käyttää jonon muodostamisen jälkeen. */
+            if (!m_index.contains(path) || m_index.entry(path).accessTime > m_evictionCutoff[type]) {
+                continue;
+            }
+
+            qDebug() << "REMOVE" << path;
+
+            if (type == 0 && QFileInfo(path).fileName() == "descriptions.dat") {
+                /* Sanakirjaa käyttävät listaukset haetaan uudelleen, kun kuvausta ei löydy. */
+                removeDescriptionStore(path.section('/', 0, 0));
+            }
+            else if (type == 1 && path.count('/') == 1) {
+                removePackedPoster(path);
+            }
+            else {
+                removals.append(path);
+
+                if (type == 0) {
+                    m_compactMonths.insert(path.section('/', 0, 0));
+                }
+            }
+
+            m_index.remove(path);
+            removed++;
+        }
+
+        /* Sanakirjoja ja pakkatiedostoja tiivistetään yksi kerrallaan, jotta vaihe pysyy lyhyenä. */
+        if (!m_compactMonths.isEmpty()) {
+            compactMonth = *m_compactMonths.begin();
+            m_compactMonths.remove(compactMonth);
+        }
+        else if (!m_compactPacks.isEmpty()) {
+            compactPackMonth = *m_compactPacks.begin();
+            m_compactPacks.remove(compactPackMonth);
+        }
+    }
+
+    for (int i = 0; i < removals.size(); i++) {
+        removeFile(removals.at(i));
+    }
+
+    if (!compactMonth.isEmpty()) {
+        compactDescriptionStore(compactMonth);
+    }
+
+    if (!compactPackMonth.isEmpty()) {
+        compactPosterPack(compactPackMonth);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    return !exhausted && typeToEvict(0.9) >= 0;
+}
+
+void Cache::removeFile(const QString &path)
+{
+    /* Kutsutaan ilman m_mutexia, koska tiedostolukkoa ei saa ottaa m_mutexin ollessa lukittuna. */
+    QString filename = m_dir.filePath(path);
+    CacheWriteJob job;
+
+    {
+        QWriteLocker locker(fileLock(filename));
+
+        /* Jonossa oleva tallennus kirjoittaa tiedoston uudelleen ja lisää sen takaisin indeksiin. */
+        if (m_writer->pendingJob(filename, job)) {
+            return;
+        }
+
+        QFile::remove(filename);
+    }
+
+    /* Tyhjät kanava- ja kuukausihakemistot poistetaan. */
+    QString dirPath = QFileInfo(path).path();
+
+    if (dirPath.contains('/') && m_dir.rmdir(dirPath)) {
+        QString month = QFileInfo(dirPath).path();
+        QMutexLocker locker(&m_mutex);
+
+        /* Kuvaussanakirja poistetaan kuukauden viimeisen kanavahakemiston mukana. */
+        if (QDir(m_dir.filePath(month)).entryList(QDir::Dirs | QDir::NoDotAndDotDot).isEmpty()) {
+            removeDescriptionStore(month);
+        }
+
+        m_dir.rmdir(month);
+    }
+}
+
+bool Cache::saveIndex()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_index.isDirty()) {
+        return true;
+    }
+
+    if (!m_dir.exists()) {
+        m_dir.mkpath(m_dir.path());
+    }
+
+    return m_index.save(m_dir.filePath("cache-index.dat"));
+}
+
+QString Cache::buildChannelsXmlFilename() const
+{
+    return m_dir.filePath("channels.xml");
+}
+
+QString Cache::buildProgrammesXmlFilename(int channelId, const QDate &date) const
+{
+    QString path = QString("%1/%2/p%2-%3.xml").arg(
+            date.toString("yyyy-MM")).arg(channelId).arg(date.toString("yyyy-MM-dd"));
+
+    return m_dir.filePath(path);
+}
+
+QString Cache::buildPlaylistXmlFilename() const
+{
+    return m_dir.filePath("playlist.xml");
+}
+
+QString Cache::buildSeasonPassesXmlFilename() const
+{
+    return m_dir.filePath("season-passes.xml");
+}
+
+QString Cache::buildPosterFilename(const Programme &programme) const
+{
+    /* Kuvat ovat kuukauden pakkatiedostossa. Nimeä käytetään välimuistin indeksissä. */
+    QString path = QString("%1/i%2.jpg").arg(programme.startDateTime.toString("yyyy-MM")).arg(programme.id);
+    return m_dir.filePath(path);
+}
+
+PosterPack* Cache::posterPack(const QString &month, bool create)
+{
+    if (m_posterPacks.value(month) != 0) {
+        return m_posterPacks.value(month);
+    }
+
+    QDir dir(m_dir.filePath(month));
 
-    if (!reader.readNextStartElement() || reader.name() != "channels") {
-        ok = false;
-        file.close();
-        return channels;
+    /* Puuttuvaa kuukautta ei tarkisteta uudelleen ennen kuin sille tallennetaan kuva. */
+    if (!create && m_posterPacks.contains(month)) {
+        return 0;
     }
 
-    while (reader.readNextStartElement()) {
-        if (reader.name() != "channel") {
-            reader.skipCurrentElement();
+    if (!dir.exists()) {
+        if (!create) {
+            m_posterPacks.insert(month, 0);
+            return 0;
         }
 
-        QXmlStreamAttributes attrs = reader.attributes();
-        Channel channel;
-        channel.id = attrs.value("id").toString().toInt(&ok);
+        dir.mkpath(dir.path());
+    }
 
-        if (!ok) {
-            continue;
-        }
+    PosterPack *pack = new PosterPack(dir.filePath("posters"));
 
-        channel.name = attrs.value("name").toString();
-        channels.append(channel);
-        reader.skipCurrentElement();
+    if (!pack->open()) {
+        setLastError(pack->lastError());
+        qWarning() << pack->lastError();
+        delete pack;
+        m_posterPacks.insert(month, 0);
+        return 0;
     }
 
-    ok = true;
-    return channels;
+    if (!pack->isMigrated()) {
+        migratePosters(month, pack);
+    }
+
+    m_posterPacks.insert(month, pack);
+    return pack;
 }
 
-bool Cache::saveChannels(const QList<Channel> &channels)
+void Cache::migratePosters(const QString &month, PosterPack *pack)
 {
-    QString filename = buildChannelsXmlFilename();
-    QDir dir(QFileInfo(filename).absolutePath());
+    /* Aiemmat versiot tallensivat jokaisen kuvan omaan tiedostoonsa kanavahakemistoon. */
+    QDir monthDir(m_dir.filePath(month));
+    QStringList channelDirs = monthDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    int channelCount = channelDirs.size();
+
+    for (int i = 0; i < channelCount; i++) {
+        QDir dir(monthDir.filePath(channelDirs.at(i)));
+        QFileInfoList files = dir.entryInfoList(QStringList() << "i*.jpg", QDir::Files);
+        int count = files.size();
+
+        for (int j = 0; j < count; j++) {
+            QFileInfo info = files.at(j);
+            bool ok;
+            int id = info.baseName().mid(1).toInt(&ok);
+            QFile file(info.filePath());
+
+            if (!ok || !file.open(QIODevice::ReadOnly)) {
+                continue;
+            }
 
-    if (!dir.exists()) {
-        dir.mkpath(dir.path());
-    }
+            QByteArray data = file.readAll();
+            file.close();
 
-    qDebug() << "WRITE" << filename;
-    QFile file(filename);
+            if (!pack->contains(id) && !pack->append(id, data)) {
+                continue;
+            }
 
-    if (!file.open(QIODevice::WriteOnly)) {
-        m_lastError = file.errorString();
-        return false;
+            m_index.remove(m_dir.relativeFilePath(info.filePath()));
+            m_index.insert(QString("%1/i%2.jpg").arg(month).arg(id), 1, data.size(),
+                           info.lastModified().toTime_t());
+            file.remove();
+        }
     }
 
-    QXmlStreamWriter writer(&file);
-    writer.setAutoFormatting(true);
-    writer.writeStartDocument();
-    writer.writeStartElement("channels");
-    int count = channels.size();
+    pack->setMigrated(true);
+}
 
-    for (int i = 0; i < count; i++) {
-        Channel channel = channels.at(i);
-        writer.writeStartElement("channel");
-        writer.writeAttribute("id", QString::number(channel.id));
-        writer.writeAttribute("name", channel.name);
-        writer.writeEndElement();
+void Cache::removePackedPoster(const QString &path)
+{
+    PosterPack *pack = posterPack(path.section('/', 0, 0), false);
+    int id = QFileInfo(path).baseName().mid(1).toInt();
+
+    if (pack == 0 || !pack->remove(id)) {
+        return;
     }
 
-    writer.writeEndElement();
-    writer.writeEndDocument();
-    file.close();
-    return true;
+    /* Pakkatiedosto kirjoitetaan uudelleen, kun yli puolet siitä on poistettuja kuvia. */
+    if (pack->deadBytes() > pack->fileSize() / 2) {
+        m_compactPacks.insert(path.section('/', 0, 0));
+    }
 }
 
-QList<Programme> Cache::loadProgrammes(int channelId, const QDate &date, bool &ok, int &age)
+void Cache::compactPosterPack(const QString &month)
 {
-    QList<Programme> programmes;
-    QString filename = buildProgrammesXmlFilename(channelId, date);
-    QFile file(filename);
-    age = INT_MAX;
+    QMutexLocker locker(&m_mutex);
+    PosterPack *pack = posterPack(month, false);
 
-    if (!file.open(QIODevice::ReadOnly)) {
-        ok = false;
-        return programmes;
+    if (pack == 0 || pack->deadBytes() <= pack->fileSize() / 2) {
+        return;
     }
 
-    qDebug() << "READ" << filename;
-    programmes = readProgrammeFeed(&file, channelId, ok, age);
-    file.close();
-    return programmes;
+    qDebug() << "COMPACT" << month;
+
+    if (!pack->compact()) {
+        qWarning() << pack->lastError();
+    }
 }
 
-bool Cache::saveProgrammes(int channelId, const QDate &date, const QDateTime &updateDateTime,
-                           const QDateTime &expireDateTime, const QList<Programme> programmes)
+DescriptionStore* Cache::descriptionStore(const QString &month, bool create)
 {
-    QString filename = buildProgrammesXmlFilename(channelId, date);
-    QDir dir(QFileInfo(filename).absolutePath());
+    if (m_descriptionStores.value(month) != 0) {
+        return m_descriptionStores.value(month);
+    }
+
+    QString filename = m_dir.filePath(month + "/descriptions.dat");
+
+    if (!create && !QFile::exists(filename)) {
+        return 0;
+    }
+
+    QDir dir(m_dir.filePath(month));
 
     if (!dir.exists()) {
         dir.mkpath(dir.path());
     }
 
-    qDebug() << "WRITE" << filename;
-    QFile file(filename);
+    DescriptionStore *store = new DescriptionStore(filename);
 
-    if (!file.open(QIODevice::WriteOnly)) {
-        m_lastError = file.errorString();
-        return false;
+    /* Vioittunut sanakirja poistetaan. Siihen viittaavat listaukset eivät enää lataudu
+       välimuistista, joten ne haetaan uudelleen verkosta. */
+    if (!store->open()) {
+        setLastError(store->lastError());
+        qWarning() << store->lastError();
+        delete store;
+        removeDescriptionStore(month);
+        return 0;
     }
 
-    writeProgrammeFeed(&file, updateDateTime, expireDateTime, programmes);
-    file.close();
-    return true;
+    m_descriptionStores.insert(month, store);
+    return store;
 }
 
-QList<Programme> Cache::loadPlaylist(bool &ok, int &age)
+void Cache::removeDescriptionStore(const QString &month)
 {
-    QList<Programme> programmes;
-    QString filename = buildPlaylistXmlFilename();
-    QFile file(filename);
-    age = INT_MAX;
+    delete m_descriptionStores.take(month);
+    m_index.remove(month + "/descriptions.dat");
+    QString filename = m_dir.filePath(month + "/descriptions.dat");
 
-    if (!file.open(QIODevice::ReadOnly)) {
-        ok = false;
-        return programmes;
+    if (QFile::exists(filename)) {
+        qDebug() << "REMOVE" << filename;
+        QFile::remove(filename);
     }
-
-    qDebug() << "READ" << filename;
-    programmes = readProgrammeFeed(&file, -1, ok, age);
-    file.close();
-    return programmes;
 }
 
-bool Cache::savePlaylist(const QDateTime &updateDateTime, QList<Programme>programmes)
+void Cache::compactDescriptionStore(const QString &month)
 {
-    QString filename = buildPlaylistXmlFilename();
-    QDir dir(QFileInfo(filename).absolutePath());
+    /* Listaukset luetaan ennen m_mutexin lukitsemista. Läpikäynnin aikana kirjoitettujen
+       listausten kuvaukset ovat sanakirjan uusissa avaimissa, joten ne säilyvät. */
+    QSet<QByteArray> keys;
+    QRegExp refPattern("ref=\"([0-9a-f]+)\"");
+    QDir monthDir(m_dir.filePath(month));
+    QStringList channelDirs = monthDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+
+    for (int i = 0; i < channelDirs.size(); i++) {
+        QDir channelDir(monthDir.filePath(channelDirs.at(i)));
+        QStringList names = channelDir.entryList(QStringList() << "p*.xml", QDir::Files);
+
+        for (int j = 0; j < names.size(); j++) {
+            QString filename = m_dir.filePath(QString("%1/%2/%3").arg(month, channelDirs.at(i), names.at(j)));
+            QFile file(filename);
+            QReadLocker locker(fileLock(filename));
+
+            if (!file.open(QIODevice::ReadOnly)) {
+                continue;
+            }
 
-    if (!dir.exists()) {
-        dir.mkpath(dir.path());
+            QString content = QString::fromUtf8(file.readAll());
+            file.close();
+            locker.unlock();
+            int pos = 0;
+
+            while ((pos = refPattern.indexIn(content, pos)) >= 0) {
+                keys.insert(QByteArray::fromHex(refPattern.cap(1).toAscii()));
+                pos += refPattern.matchedLength();
+            }
+        }
     }
 
-    qDebug() << "WRITE" << filename;
-    QFile file(filename);
+    QMutexLocker locker(&m_mutex);
+    DescriptionStore *store = descriptionStore(month, false);
 
-    if (!file.open(QIODevice::WriteOnly)) {
-        m_lastError = file.errorString();
-        return false;
+    if (store == 0) {
+        return;
     }
 
-    writeProgrammeFeed(&file, updateDateTime, QDateTime(), programmes);
-    file.close();
-    return true;
+    QString path = month + "/descriptions.dat";
+    qDebug() << "COMPACT" << path;
+
+    if (!store->compact(keys)) {
+        qWarning() << store->lastError();
+        removeDescriptionStore(month);
+        return;
+    }
+
+    if (m_index.contains(path)) {
+        m_index.insert(path, 0, store->fileSize(), m_index.entry(path).accessTime);
+    }
 }
 
-bool Cache::removePlaylist()
+bool Cache::hasDescription(const QString &month, const QByteArray &key)
 {
-    QString filename = buildPlaylistXmlFilename();
-    qDebug() << "REMOVE" << filename;
-    return QFile(filename).remove();
+    QMutexLocker locker(&m_mutex);
+    DescriptionStore *store = descriptionStore(month, false);
+    return store != 0 && store->contains(key);
 }
 
-QList<Programme> Cache::loadSeasonPasses(bool &ok, int &age)
+QString Cache::readDescription(const QString &month, const QByteArray &key, bool &ok)
 {
-    QList<Programme> programmes;
-    QString filename = buildSeasonPassesXmlFilename();
-    QFile file(filename);
-    age = INT_MAX;
+    QMutexLocker locker(&m_mutex);
+    DescriptionStore *store = descriptionStore(month, false);
 
-    if (!file.open(QIODevice::ReadOnly)) {
+    if (store == 0) {
         ok = false;
-        return programmes;
+        return QString();
     }
 
-    qDebug() << "READ" << filename;
-    programmes = readProgrammeFeed(&file, -1, ok, age);
-    file.close();
-    return programmes;
+    QString description = store->read(key, ok);
+
+    if (ok) {
+        touch(m_dir.filePath(month + "/descriptions.dat"), store->fileSize());
+    }
+
+    return description;
 }
 
-bool Cache::saveSeasonPasses(const QDateTime &updateDateTime, QList<Programme>programmes)
+QByteArray Cache::insertDescription(const QString &month, const QString &description)
 {
-    QString filename = buildSeasonPassesXmlFilename();
-    QDir dir(QFileInfo(filename).absolutePath());
+    QMutexLocker locker(&m_mutex);
+    DescriptionStore *store = descriptionStore(month, true);
 
-    if (!dir.exists()) {
-        dir.mkpath(dir.path());
+    if (store == 0) {
+        return QByteArray();
     }
 
-    qDebug() << "WRITE" << filename;
-    QFile file(filename);
+    QByteArray key = store->insert(description);
+    touch(m_dir.filePath(month + "/descriptions.dat"), store->fileSize());
+    return key;
+}
 
-    if (!file.open(QIODevice::WriteOnly)) {
-        m_lastError = file.errorString();
-        return false;
-    }
+QString Cache::buildThumbnailsXmlFilename(const Programme &programme) const
+{
+    /* Kuvakaappaukset tallennetaan samaan kuukausihakemistoon kuin ohjelmakuvat,
+       joten ne vanhenevat ja poistetaan samalla tavalla. */
+    QString path = QString("%1/%2/t%3.xml").arg(
+            programme.startDateTime.toString("yyyy-MM")).arg(programme.channelId).arg(programme.id);
 
-    writeProgrammeFeed(&file, updateDateTime, QDateTime(), programmes);
-    file.close();
-    return true;
+    return m_dir.filePath(path);
 }
 
-bool Cache::removeSeasonPasses()
+QString Cache::buildThumbnailFilename(const Programme &programme, const QTime &time) const
 {
-    QString filename = buildSeasonPassesXmlFilename();
-    qDebug() << "REMOVE" << filename;
-    return QFile(filename).remove();
+    QString path = QString("%1/%2/t%3-%4.png").arg(
+            programme.startDateTime.toString("yyyy-MM")).arg(programme.channelId).arg(programme.id)
+            .arg(time.toString("hhmmss"));
+
+    return m_dir.filePath(path);
+}
+
+void Cache::touch(const QString &filename, qint64 size)
+{
+    QMutexLocker locker(&m_mutex);
+    QString path = m_dir.relativeFilePath(filename);
+    int type = CacheIndex::typeForFilename(path);
+
+    if (type >= 0) {
+        m_index.touch(path, type, size);
+    }
 }
 
-QImage Cache::loadPoster(const Programme &programme)
+QList<Programme> Cache::pendingProgrammes(const CacheWriteJob &job, int channelId, bool &ok, int &age)
 {
-    QString filename = buildPosterFilename(programme);
+    QList<Programme> programmes;
+    QDateTime now = QDateTime::currentDateTime();
 
-    if (!QFileInfo(filename).exists()) {
-        return QImage();
+    if (job.type != 2 || (!job.expireDateTime.isNull() && job.expireDateTime < now)) {
+        ok = false;
+        return programmes;
     }
 
-    qDebug() << "READ" << filename;
-    return QImage(filename);
+    if (!job.updateDateTime.isNull()) {
+        age = job.updateDateTime.secsTo(now);
+    }
+
+    programmes = job.programmes;
+    int count = programmes.size();
+
+    for (int i = 0; i < count; i++) {
+        if (programmes.at(i).channelId < 0) {
+            programmes[i].channelId = channelId;
+        }
+    }
+
+    ok = true;
+    return programmes;
 }
 
-bool Cache::savePoster(const Programme &programme, const QByteArray &data)
+void Cache::enqueueProgrammeFeed(const QString &filename, const QDateTime &updateDateTime,
+                                 const QDateTime &expireDateTime, const QList<Programme> &programmes)
+{
+    CacheWriteJob job;
+    job.type = 2;
+    job.filename = filename;
+    job.updateDateTime = updateDateTime;
+    job.expireDateTime = expireDateTime;
+    job.programmes = programmes;
+    m_writer->enqueue(job);
+}
+
+void Cache::enqueueRemove(const QString &filename)
+{
+    CacheWriteJob job;
+    job.type = 0;
+    job.filename = filename;
+    m_writer->enqueue(job);
+}
+
+void Cache::writeJob(const CacheWriteJob &job)
 {
-    QString filename = buildPosterFilename(programme);
-    QDir dir(QFileInfo(filename).absolutePath());
+    PROFILE_ZONE("Cache::writeJob");
+    /* Suoritetaan CacheWriter-säikeessä. */
+    if (job.type == 0) {
+        qDebug() << "REMOVE" << job.filename;
+        QWriteLocker locker(fileLock(job.filename));
+        QFile::remove(job.filename);
+        return;
+    }
+
+    if (job.type == 3) {
+        QMutexLocker locker(&m_mutex);
+        PosterPack *pack = posterPack(job.programme.startDateTime.toString("yyyy-MM"), true);
+
+        if (pack == 0 || !pack->append(job.programme.id, job.data)) {
+            qWarning() << "Cannot save poster" << job.programme.id;
+            return;
+        }
+
+        touch(job.filename, job.data.size());
+        return;
+    }
+
+    QDir dir(QFileInfo(job.filename).absolutePath());
 
     if (!dir.exists()) {
         dir.mkpath(dir.path());
     }
 
-    qDebug() << "WRITE" << filename;
-    QFile file(filename);
+    qDebug() << "WRITE" << job.filename;
+    QFile file(job.filename + ".tmp");
 
     if (!file.open(QIODevice::WriteOnly)) {
-        return false;
+        qWarning() << file.errorString();
+        return;
     }
 
-    file.write(data);
-    return true;
+    if (job.type == 1) {
+        writeChannels(&file, job.channels);
+    }
+    else if (job.type == 2) {
+        /* Päiväkohtaisten listausten kuvaukset tallennetaan kuukauden sanakirjaan. */
+        QString relativePath = m_dir.relativeFilePath(job.filename);
+        QString month = relativePath.contains('/') ? relativePath.section('/', 0, 0) : QString();
+        writeProgrammeFeed(&file, month, job.updateDateTime, job.expireDateTime, job.programmes);
+    }
+    else if (job.type == 4) {
+        writeThumbnails(&file, job.thumbnails);
+    }
+    else {
+        file.write(job.data);
+    }
+
+    qint64 size = file.size();
+    file.close();
+    QWriteLocker locker(fileLock(job.filename));
+
+    /* Tiedosto kirjoitetaan ensin väliaikaiseen tiedostoon, jotta keskeytynyt
+       tallennus ei jätä puolikasta tiedostoa. */
+    if (file.error() != QFile::NoError || !replaceFile(file.fileName(), job.filename)) {
+        qWarning() << "Cannot write" << job.filename << file.errorString();
+        file.remove();
+        return;
+    }
+
+    locker.unlock();
+
+    touch(job.filename, size);
 }
 
-QString Cache::buildChannelsXmlFilename() const
+ProgrammeCacheResult Cache::loadProgrammesResult(int channelId, const QDate &date)
 {
-    return m_dir.filePath("channels.xml");
+    ProgrammeCacheResult result;
+    result.channelId = channelId;
+    result.date = date;
+    result.programmes = loadProgrammes(channelId, date, result.ok, result.age);
+    return result;
 }
 
-QString Cache::buildProgrammesXmlFilename(int channelId, const QDate &date) const
+ProgrammeCacheResult Cache::loadPlaylistResult()
 {
-    QString path = QString("%1/%2/p%2-%3.xml").arg(
-            date.toString("yyyy-MM")).arg(channelId).arg(date.toString("yyyy-MM-dd"));
+    ProgrammeCacheResult result;
+    result.programmes = loadPlaylist(result.ok, result.age);
+    return result;
+}
 
-    return m_dir.filePath(path);
+ProgrammeCacheResult Cache::loadSeasonPassesResult()
+{
+    ProgrammeCacheResult result;
+    result.programmes = loadSeasonPasses(result.ok, result.age);
+    return result;
 }
 
-QString Cache::buildPlaylistXmlFilename() const
+QReadWriteLock* Cache::fileLock(const QString &filename)
 {
-    return m_dir.filePath("playlist.xml");
+    /* Tiedostot jaetaan kiinteään määrään lukkoja nimen tiivisteen perusteella. */
+    return &m_fileLocks[qHash(filename) % 16];
 }
 
-QString Cache::buildSeasonPassesXmlFilename() const
+void Cache::setLastError(const QString &error)
 {
-    return m_dir.filePath("season-passes.xml");
+    if (!m_lastError.hasLocalData()) {
+        m_lastError.setLocalData(new QString());
+    }
+
+    *m_lastError.localData() = error;
 }
 
-QString Cache::buildPosterFilename(const Programme &programme) const
+void Cache::writeChannels(QIODevice *device, const QList<Channel> &channels)
 {
-    QString path = QString("%1/%2/i%3.jpg").arg(
-            programme.startDateTime.toString("yyyy-MM")).arg(programme.channelId).arg(programme.id);
+    QXmlStreamWriter writer(device);
+    writer.setAutoFormatting(true);
+    writer.writeStartDocument();
+    writer.writeStartElement("channels");
+    int count = channels.size();
 
-    return m_dir.filePath(path);
+    for (int i = 0; i < count; i++) {
+        Channel channel = channels.at(i);
+        writer.writeStartElement("channel");
+        writer.writeAttribute("id", QString::number(channel.id));
+        writer.writeAttribute("name", channel.name);
+        writer.writeEndElement();
+    }
+
+    writer.writeEndElement();
+    writer.writeEndDocument();
+}
+
+void Cache::writeThumbnails(QIODevice *device, const QList<Thumbnail> &thumbnails)
+{
+    QXmlStreamWriter writer(device);
+    writer.setAutoFormatting(true);
+    writer.writeStartDocument();
+    writer.writeStartElement("thumbnails");
+    int count = thumbnails.size();
+
+    for (int i = 0; i < count; i++) {
+        Thumbnail thumbnail = thumbnails.at(i);
+        writer.writeStartElement("thumbnail");
+        writer.writeAttribute("time", thumbnail.time.toString("hh:mm:ss"));
+        writer.writeAttribute("url", thumbnail.url.toString());
+        writer.writeEndElement();
+    }
+
+    writer.writeEndElement();
+    writer.writeEndDocument();
+}
+
+int Cache::typeToEvict(double factor) const
+{
+    for (int i = 0; i < 3; i++) {
+        if (m_maxTypeBytes[i] > 0 && m_index.bytesUsed(i) > m_maxTypeBytes[i] * factor) {
+            return i;
+        }
+    }
+
+    if (m_maxBytes <= 0 || m_index.totalBytes() <= m_maxBytes * factor) {
+        return -1;
+    }
+
+    /* Koko välimuisti on liian suuri: poistetaan siitä luokasta, joka on suhteessa
+       kiintiöönsä suurin. */
+    int type = -1;
+    double maxRatio = 0;
+
+    for (int i = 0; i < 3; i++) {
+        qint64 limit = m_maxTypeBytes[i] > 0 ? m_maxTypeBytes[i] : m_maxBytes;
+        double ratio = (double)m_index.bytesUsed(i) / limit;
+
+        if (m_index.bytesUsed(i) > 0 && ratio > maxRatio) {
+            type = i;
+            maxRatio = ratio;
+        }
+    }
+
+    return type;
 }
 
-QList<Programme> Cache::readProgrammeFeed(QIODevice *device, int channelId, bool &ok, int &age)
+QList<Programme> Cache::readProgrammeFeed(QIODevice *device, const QString &month, int channelId, bool &ok, int &age)
 {
+    PROFILE_ZONE("Cache::readProgrammeFeed");
     QList<Programme> programmes;
     QXmlStreamReader reader(device);
 
@@ -375,7 +1330,22 @@ QList<Programme> Cache::readProgrammeFeed(QIODevice *device, int channelId, bool
                 programme.title = reader.readElementText();
             }
             else if (reader.name() == "description") {
+                QString ref = reader.attributes().value("ref").toString();
                 programme.description = reader.readElementText();
+
+                /* Sanakirjassa olevat kuvaukset luetaan vasta, kun niitä tarvitaan. Jos viitattu
+                   kuvaus puuttuu sanakirjasta, listaus haetaan uudelleen verkosta. */
+                if (!ref.isEmpty() && !month.isEmpty()) {
+                    QByteArray key = QByteArray::fromHex(ref.toAscii());
+
+                    if (!hasDescription(month, key)) {
+                        qWarning() << "Missing description" << ref << "in" << month;
+                        ok = false;
+                        return QList<Programme>();
+                    }
+
+                    programme.descriptionKey = month.toAscii() + key;
+                }
             }
         }
 
@@ -386,7 +1356,7 @@ QList<Programme> Cache::readProgrammeFeed(QIODevice *device, int channelId, bool
     return programmes;
 }
 
-void Cache::writeProgrammeFeed(QIODevice *device, const QDateTime &updateDateTime,
+void Cache::writeProgrammeFeed(QIODevice *device, const QString &month, const QDateTime &updateDateTime,
                                const QDateTime &expireDateTime, QList<Programme>programmes)
 {
     QXmlStreamWriter writer(device);
@@ -427,7 +1397,23 @@ void Cache::writeProgrammeFeed(QIODevice *device, const QDateTime &updateDateTim
         }
 
         writer.writeTextElement("title", programme.title);
-        writer.writeTextElement("description", programme.description);
+        QByteArray key;
+
+        if (programme.description.isEmpty()) {
+            programme.description = loadDescription(programme);
+        }
+
+        if (!month.isEmpty() && programme.description.size() >= MinReferencedDescriptionLength) {
+            key = insertDescription(month, programme.description);
+        }
+
+        if (!key.isEmpty()) {
+            writer.writeEmptyElement("description");
+            writer.writeAttribute("ref", QString::fromAscii(key.toHex()));
+        }
+        else {
+            writer.writeTextElement("description", programme.description);
+        }
         writer.writeEndElement();
     }
 
@@ -2,43 +2,127 @@
 #define CACHE_H
 
 #include <QDir>
-#include <QImage>
+#include <QFuture>
+#include <QHash>
 #include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QSet>
+#include <QStringList>
+#include <QThreadStorage>
+#include "cacheindex.h"
 #include "channel.h"
 #include "programme.h"
+#include "thumbnail.h"
+
+class CacheWriter;
+class DescriptionStore;
+class PosterPack;
+struct CacheWriteJob;
+
+struct ProgrammeCacheResult
+{
+    ProgrammeCacheResult();
+    int channelId;
+    QDate date;
+    QList<Programme> programmes;
+    bool ok;
+    int age;
+};
 
 class Cache
 {
 public:
     Cache();
+    ~Cache();
     void setDirectory(const QDir &dir);
     QDir directory() const;
     QString lastError() const;
     QList<Channel> loadChannels(bool &ok);
     bool saveChannels(const QList<Channel> &channels);
     QList<Programme> loadProgrammes(int channelId, const QDate &date, bool &ok, int &age);
+    QFuture<ProgrammeCacheResult> loadProgrammesAsync(int channelId, const QDate &date);
     bool saveProgrammes(int channelId, const QDate &date, const QDateTime &updateDateTime,
                         const QDateTime &expireDateTime, const QList<Programme> programmes);
     QList<Programme> loadPlaylist(bool &ok, int &age);
+    QFuture<ProgrammeCacheResult> loadPlaylistAsync();
     bool savePlaylist(const QDateTime &updateDateTime, const QList<Programme> programmes);
     bool removePlaylist();
     QList<Programme> loadSeasonPasses(bool &ok, int &age);
+    QFuture<ProgrammeCacheResult> loadSeasonPassesAsync();
     bool saveSeasonPasses(const QDateTime &updateDateTime, const QList<Programme> programmes);
     bool removeSeasonPasses();
-    QImage loadPoster(const Programme &programme);
+    bool hasPoster(const Programme &programme);
+    QString loadDescription(const Programme &programme);
+    QString loadDescription(const Programme &programme, bool &ok);
+    void storeDescriptions(QList<Programme> &programmes);
+    QByteArray loadPoster(const Programme &programme);
     bool savePoster(const Programme &programme, const QByteArray &data);
+    QList<Thumbnail> loadThumbnails(const Programme &programme, bool &ok);
+    bool saveThumbnails(const Programme &programme, const QList<Thumbnail> &thumbnails);
+    QByteArray loadThumbnail(const Programme &programme, const QTime &time);
+    bool saveThumbnail(const Programme &programme, const QTime &time, const QByteArray &data);
+    void flush();
+    void setLimits(qint64 maxBytes, qint64 maxListingBytes, qint64 maxPosterBytes, qint64 maxThumbnailBytes);
+    qint64 bytesUsed() const;
+    bool isScanned() const;
+    bool scanDirectory(int maxDirectories);
+    bool isOverLimit() const;
+    bool collectGarbage(int maxRemovals);
+    bool saveIndex();
 
 private:
+    friend class CacheWriter;
+    void writeJob(const CacheWriteJob &job);
+    QList<Programme> pendingProgrammes(const CacheWriteJob &job, int channelId, bool &ok, int &age);
+    void enqueueProgrammeFeed(const QString &filename, const QDateTime &updateDateTime,
+                              const QDateTime &expireDateTime, const QList<Programme> &programmes);
+    void enqueueRemove(const QString &filename);
+    ProgrammeCacheResult loadProgrammesResult(int channelId, const QDate &date);
+    ProgrammeCacheResult loadPlaylistResult();
+    ProgrammeCacheResult loadSeasonPassesResult();
+    QReadWriteLock* fileLock(const QString &filename);
+    void setLastError(const QString &error);
+    void writeChannels(QIODevice *device, const QList<Channel> &channels);
+    void writeThumbnails(QIODevice *device, const QList<Thumbnail> &thumbnails);
     QString buildChannelsXmlFilename() const;
     QString buildProgrammesXmlFilename(int channelId, const QDate &date) const;
     QString buildPlaylistXmlFilename() const;
     QString buildSeasonPassesXmlFilename() const;
     QString buildPosterFilename(const Programme &programme) const;
-    QList<Programme> readProgrammeFeed(QIODevice *device, int channelId, bool &ok, int &age);
-    void writeProgrammeFeed(QIODevice *device, const QDateTime &updateDateTime,
+    PosterPack* posterPack(const QString &month, bool create);
+    void migratePosters(const QString &month, PosterPack *pack);
+    void removePackedPoster(const QString &path);
+    void compactPosterPack(const QString &month);
+    DescriptionStore* descriptionStore(const QString &month, bool create);
+    void removeDescriptionStore(const QString &month);
+    void compactDescriptionStore(const QString &month);
+    void removeFile(const QString &path);
+    bool hasDescription(const QString &month, const QByteArray &key);
+    QString readDescription(const QString &month, const QByteArray &key, bool &ok);
+    QByteArray insertDescription(const QString &month, const QString &description);
+    QString buildThumbnailsXmlFilename(const Programme &programme) const;
+    QString buildThumbnailFilename(const Programme &programme, const QTime &time) const;
+    QList<Programme> readProgrammeFeed(QIODevice *device, const QString &month, int channelId, bool &ok, int &age);
+    void touch(const QString &filename, qint64 size);
+    int typeToEvict(double factor) const;
+    void writeProgrammeFeed(QIODevice *device, const QString &month, const QDateTime &updateDateTime,
                             const QDateTime &expireDateTime, const QList<Programme> programmes);
     QDir m_dir;
-    QString m_lastError;
+    QThreadStorage<QString*> m_lastError;
+    QReadWriteLock m_fileLocks[16];
+    mutable QMutex m_mutex;
+    CacheWriter *m_writer;
+    QHash<QString, PosterPack*> m_posterPacks;
+    QHash<QString, DescriptionStore*> m_descriptionStores;
+    QSet<QString> m_compactMonths;
+    QSet<QString> m_compactPacks;
+    CacheIndex m_index;
+    QStringList m_scanQueue;
+    QStringList m_evictionQueue[3];
+    quint32 m_evictionCutoff[3];
+    qint64 m_maxBytes;
+    qint64 m_maxTypeBytes[3];
 };
 
 #endif // CACHE_H
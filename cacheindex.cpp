@@ -0,0 +1,221 @@
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include "cacheindex.h"
+
+/* Indeksitiedoston rakenne: otsake (quint32 "TVCI", quint8 versio, quint8 läpikäyty)
+   ja sen perässä tietueita (QString polku, quint8 tyyppi, quint32 koko, quint32 käyttöaika).
+
+   Tyypit: 0 = ohjelmatiedot, 1 = ohjelmakuvat, 2 = kuvakaappaukset */
+
+static const quint32 IndexMagic = 0x54564349;
+static const quint8 IndexVersion = 1;
+
+CacheIndex::CacheIndex() : m_scanned(false), m_dirty(false)
+{
+    m_bytes[0] = m_bytes[1] = m_bytes[2] = 0;
+}
+
+bool CacheIndex::load(const QString &filename)
+{
+    clear();
+    QFile file(filename);
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    qDebug() << "READ" << filename;
+    QDataStream stream(&file);
+    quint32 magic;
+    quint8 version;
+    quint8 scanned;
+    stream >> magic >> version >> scanned;
+
+    if (magic != IndexMagic || version != IndexVersion) {
+        return false;
+    }
+
+    while (!stream.atEnd()) {
+        QString path;
+        CacheIndexEntry entry;
+        stream >> path >> entry.type >> entry.size >> entry.accessTime;
+
+        if (stream.status() != QDataStream::Ok || entry.type > 2) {
+            clear();
+            return false;
+        }
+
+        m_entries.insert(path, entry);
+        m_bytes[entry.type] += entry.size;
+    }
+
+    m_scanned = scanned != 0;
+    m_dirty = false;
+    return true;
+}
+
+bool CacheIndex::save(const QString &filename)
+{
+    QString tempFilename = filename + ".tmp";
+    QFile file(tempFilename);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+
+    qDebug() << "WRITE" << filename;
+    QDataStream stream(&file);
+    stream << IndexMagic << IndexVersion << (quint8)(m_scanned ? 1 : 0);
+    QHash<QString, CacheIndexEntry>::const_iterator i = m_entries.constBegin();
+
+    while (i != m_entries.constEnd()) {
+        stream << i.key() << i.value().type << i.value().size << i.value().accessTime;
+        ++i;
+    }
+
+    file.close();
+
+    if (stream.status() != QDataStream::Ok) {
+        file.remove();
+        return false;
+    }
+
+    QFile::remove(filename);
+
+    if (!file.rename(filename)) {
+        return false;
+    }
+
+    m_dirty = false;
+    return true;
+}
+
+void CacheIndex::clear()
+{
+    m_entries.clear();
+    m_bytes[0] = m_bytes[1] = m_bytes[2] = 0;
+    m_scanned = false;
+    m_dirty = true;
+}
+
+bool CacheIndex::contains(const QString &path) const
+{
+    return m_entries.contains(path);
+}
+
+CacheIndexEntry CacheIndex::entry(const QString &path) const
+{
+    CacheIndexEntry entry;
+    entry.type = 0;
+    entry.size = 0;
+    entry.accessTime = 0;
+    return m_entries.value(path, entry);
+}
+
+void CacheIndex::touch(const QString &path, int type, qint64 size)
+{
+    insert(path, type, size, QDateTime::currentDateTime().toTime_t());
+}
+
+void CacheIndex::insert(const QString &path, int type, qint64 size, uint accessTime)
+{
+    if (type < 0 || type > 2) {
+        return;
+    }
+
+    remove(path);
+    CacheIndexEntry entry;
+    entry.type = type;
+    entry.size = qMin(size, (qint64)0xffffffff);
+    entry.accessTime = accessTime;
+    m_entries.insert(path, entry);
+    m_bytes[type] += entry.size;
+    m_dirty = true;
+}
+
+void CacheIndex::remove(const QString &path)
+{
+    if (!m_entries.contains(path)) {
+        return;
+    }
+
+    CacheIndexEntry entry = m_entries.take(path);
+    m_bytes[entry.type] -= entry.size;
+    m_dirty = true;
+}
+
+qint64 CacheIndex::bytesUsed(int type) const
+{
+    return type >= 0 && type <= 2 ? m_bytes[type] : 0;
+}
+
+qint64 CacheIndex::totalBytes() const
+{
+    return m_bytes[0] + m_bytes[1] + m_bytes[2];
+}
+
+QStringList CacheIndex::leastRecentlyUsed(int type, int count) const
+{
+    /* Pidetään kirjaa vain count vanhimmasta, jotta koko indeksiä ei tarvitse järjestää. */
+    QMap<quint32, QString> oldest;
+    QHash<QString, CacheIndexEntry>::const_iterator i = m_entries.constBegin();
+
+    while (i != m_entries.constEnd()) {
+        if (i.value().type == type &&
+            (oldest.size() < count || i.value().accessTime < (oldest.end() - 1).key())) {
+            oldest.insertMulti(i.value().accessTime, i.key());
+
+            if (oldest.size() > count) {
+                oldest.erase(oldest.end() - 1);
+            }
+        }
+
+        ++i;
+    }
+
+    return oldest.values();
+}
+
+bool CacheIndex::isScanned() const
+{
+    return m_scanned;
+}
+
+void CacheIndex::setScanned(bool scanned)
+{
+    m_scanned = scanned;
+    m_dirty = true;
+}
+
+bool CacheIndex::isDirty() const
+{
+    return m_dirty;
+}
+
+int CacheIndex::typeForFilename(const QString &filename)
+{
+    /* p<kanava>-<pvm>.xml, descriptions.dat, i<id>.jpg, t<id>.xml ja t<id>-<aika>.png
+       kuukausihakemistoissa. Kuvaussanakirja lasketaan listausten kokoon.
+       Juurihakemiston tiedostoja (kanavat, lista, sarjat) ei poisteta. */
+    if (!filename.contains('/')) {
+        return -1;
+    }
+
+    QString name = QFileInfo(filename).fileName();
+
+    if ((name.startsWith('p') && name.endsWith(".xml")) || name == "descriptions.dat") {
+        return 0;
+    }
+    else if (name.startsWith('i') && name.endsWith(".jpg")) {
+        return 1;
+    }
+    else if (name.startsWith('t') && (name.endsWith(".xml") || name.endsWith(".png"))) {
+        return 2;
+    }
+
+    return -1;
+}
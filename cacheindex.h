@@ -0,0 +1,41 @@
+#ifndef CACHEINDEX_H
+#define CACHEINDEX_H
+
+#include <QHash>
+#include <QStringList>
+
+struct CacheIndexEntry
+{
+    quint8 type;
+    quint32 size;
+    quint32 accessTime;
+};
+
+class CacheIndex
+{
+public:
+    CacheIndex();
+    bool load(const QString &filename);
+    bool save(const QString &filename);
+    void clear();
+    bool contains(const QString &path) const;
+    CacheIndexEntry entry(const QString &path) const;
+    void touch(const QString &path, int type, qint64 size);
+    void insert(const QString &path, int type, qint64 size, uint accessTime);
+    void remove(const QString &path);
+    qint64 bytesUsed(int type) const;
+    qint64 totalBytes() const;
+    QStringList leastRecentlyUsed(int type, int count) const;
+    bool isScanned() const;
+    void setScanned(bool scanned);
+    bool isDirty() const;
+    static int typeForFilename(const QString &filename);
+
+private:
+    QHash<QString, CacheIndexEntry> m_entries;
+    qint64 m_bytes[3];
+    bool m_scanned;
+    bool m_dirty;
+};
+
+#endif // CACHEINDEX_H
@@ -0,0 +1,85 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QTimer>
+#include <QtConcurrentRun>
+#include "cache.h"
+#include "cachemanager.h"
+
+static const int IdleInterval = 60000;
+static const int BusyInterval = 200;
+static const int MaxDeferral = 5000;
+
+CacheManager::CacheManager(Cache *cache, QObject *parent) :
+    QObject(parent), m_cache(cache), m_timer(new QTimer(this)), m_watcher(new QFutureWatcher<bool>(this)),
+    m_collecting(false)
+{
+    connect(m_timer, SIGNAL(timeout()), SLOT(collect()));
+    connect(m_watcher, SIGNAL(finished()), SLOT(collectFinished()));
+}
+
+void CacheManager::start()
+{
+    m_timer->start(BusyInterval);
+}
+
+void CacheManager::stop()
+{
+    m_timer->stop();
+    m_watcher->waitForFinished();
+    m_cache->flush();
+    m_cache->saveIndex();
+}
+
+void CacheManager::collect()
+{
+    /* Edellisen vaiheen on valmistuttava ennen seuraavaa. */
+    if (m_watcher->isRunning()) {
+        return;
+    }
+
+    /* Työ tehdään pieninä paloina silloin, kun käyttöliittymällä ei ole muuta tekemistä.
+       Jatkuvasti kiireinen tapahtumasilmukka saa lykätä työtä enintään MaxDeferral ms. */
+    if (QCoreApplication::hasPendingEvents()) {
+        if (!m_deferTimer.isValid()) {
+            m_deferTimer.start();
+            m_timer->setInterval(BusyInterval);
+        }
+
+        if (m_deferTimer.elapsed() < MaxDeferral) {
+            return;
+        }
+    }
+
+    m_deferTimer.invalidate();
+
+    /* Läpikäynti, poistot ja tiivistykset tehdään taustasäikeessä, jotta ne eivät pysäytä
+       käyttöliittymää. */
+    m_watcher->setFuture(QtConcurrent::run(this, &CacheManager::collectStep));
+}
+
+void CacheManager::collectFinished()
+{
+    m_timer->setInterval(m_watcher->result() ? BusyInterval : IdleInterval);
+}
+
+bool CacheManager::collectStep()
+{
+    /* Suoritetaan taustasäikeessä. Palauttaa true, jos työtä on vielä jäljellä. */
+    if (!m_cache->isScanned()) {
+        m_cache->scanDirectory(1);
+        return true;
+    }
+
+    if (m_collecting || m_cache->isOverLimit()) {
+        m_collecting = m_cache->collectGarbage(50);
+
+        if (m_collecting) {
+            return true;
+        }
+
+        qDebug() << "Cache size" << m_cache->bytesUsed();
+    }
+
+    m_cache->saveIndex();
+    return false;
+}
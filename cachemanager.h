@@ -0,0 +1,32 @@
+#ifndef CACHEMANAGER_H
+#define CACHEMANAGER_H
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QObject>
+
+class QTimer;
+class Cache;
+
+class CacheManager : public QObject
+{
+    Q_OBJECT
+public:
+    CacheManager(Cache *cache, QObject *parent = 0);
+    void start();
+    void stop();
+
+private slots:
+    void collect();
+    void collectFinished();
+
+private:
+    bool collectStep();
+    Cache *m_cache;
+    QTimer *m_timer;
+    QFutureWatcher<bool> *m_watcher;
+    QElapsedTimer m_deferTimer;
+    bool m_collecting;
+};
+
+#endif // CACHEMANAGER_H
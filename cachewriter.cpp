@@ -0,0 +1,102 @@
+#include "cache.h"
+#include "cachewriter.h"
+#include "networktracer.h"
+
+/* Tyypit: 0 = poisto, 1 = kanavat, 2 = ohjelmatiedot, 3 = ohjelmakuva,
+   4 = kuvakaappauslista, 5 = kuvakaappaus */
+
+CacheWriteJob::CacheWriteJob() : type(-1), sequence(0)
+{
+}
+
+CacheWriter::CacheWriter(Cache *cache, QObject *parent) :
+    QThread(parent), m_cache(cache), m_sequence(0), m_busy(false), m_stopped(false)
+{
+}
+
+CacheWriter::~CacheWriter()
+{
+    stop();
+}
+
+void CacheWriter::enqueue(const CacheWriteJob &job)
+{
+    QMutexLocker locker(&m_mutex);
+
+    /* Saman tiedoston aiempi tallennus korvataan uudella, jos sitä ei ole vielä kirjoitettu. */
+    if (!m_queue.contains(job.filename)) {
+        m_queue.append(job.filename);
+    }
+
+    CacheWriteJob queuedJob = job;
+    queuedJob.sequence = ++m_sequence;
+    m_pending.insert(job.filename, queuedJob);
+    m_jobCondition.wakeOne();
+}
+
+bool CacheWriter::pendingJob(const QString &filename, CacheWriteJob &job)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_pending.contains(filename)) {
+        return false;
+    }
+
+    job = m_pending.value(filename);
+    return true;
+}
+
+void CacheWriter::flush()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (isRunning() && (!m_queue.isEmpty() || m_busy)) {
+        m_doneCondition.wait(&m_mutex);
+    }
+}
+
+void CacheWriter::stop()
+{
+    m_mutex.lock();
+    m_stopped = true;
+    m_jobCondition.wakeOne();
+    m_mutex.unlock();
+    wait();
+}
+
+void CacheWriter::run()
+{
+    m_mutex.lock();
+
+    forever {
+        while (m_queue.isEmpty() && !m_stopped) {
+            m_jobCondition.wait(&m_mutex);
+        }
+
+        /* Jonossa olevat tallennukset kirjoitetaan ennen lopetusta. */
+        if (m_queue.isEmpty()) {
+            break;
+        }
+
+        /* Työ pysyy m_pending-taulussa kirjoituksen ajan, jotta lukijat saavat sen sieltä. */
+        CacheWriteJob job = m_pending.value(m_queue.takeFirst());
+        m_busy = true;
+        m_mutex.unlock();
+
+        qint64 start = NetworkTracer::instance()->timestamp();
+        m_cache->writeJob(job);
+        NetworkTracer::instance()->traceCacheWrite(job.filename, start);
+
+        m_mutex.lock();
+        m_busy = false;
+
+        if (m_pending.value(job.filename).sequence == job.sequence) {
+            m_pending.remove(job.filename);
+        }
+
+        m_doneCondition.wakeAll();
+    }
+
+    m_doneCondition.wakeAll();
+    m_mutex.unlock();
+}
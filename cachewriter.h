@@ -0,0 +1,57 @@
+#ifndef CACHEWRITER_H
+#define CACHEWRITER_H
+
+#include <QDateTime>
+#include <QMap>
+#include <QMutex>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+#include "channel.h"
+#include "programme.h"
+#include "thumbnail.h"
+
+class Cache;
+
+struct CacheWriteJob
+{
+    CacheWriteJob();
+    int type;
+    QString filename;
+    QDateTime updateDateTime;
+    QDateTime expireDateTime;
+    QList<Channel> channels;
+    QList<Programme> programmes;
+    QList<Thumbnail> thumbnails;
+    Programme programme;
+    QByteArray data;
+    quint64 sequence;
+};
+
+class CacheWriter : public QThread
+{
+    Q_OBJECT
+public:
+    CacheWriter(Cache *cache, QObject *parent = 0);
+    ~CacheWriter();
+    void enqueue(const CacheWriteJob &job);
+    bool pendingJob(const QString &filename, CacheWriteJob &job);
+    void flush();
+    void stop();
+
+protected:
+    void run();
+
+private:
+    Cache *m_cache;
+    QMutex m_mutex;
+    QWaitCondition m_jobCondition;
+    QWaitCondition m_doneCondition;
+    QMap<QString, CacheWriteJob> m_pending;
+    QStringList m_queue;
+    quint64 m_sequence;
+    bool m_busy;
+    bool m_stopped;
+};
+
+#endif // CACHEWRITER_H
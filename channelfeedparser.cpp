@@ -1,8 +1,10 @@
 #include <QDebug>
 #include "channelfeedparser.h"
+#include "profiler.h"
 
 bool ChannelFeedParser::parse(QIODevice *device)
 {
+    PROFILE_ZONE("ChannelFeedParser::parse");
     m_reader.setDevice(device);
     m_channels.clear();
 
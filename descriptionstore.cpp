@@ -0,0 +1,270 @@
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QMap>
+#include "descriptionstore.h"
+
+/* Ohjelmakuvaukset tallennetaan sisällön tiivisteen perusteella, jolloin uusinnat ja
+   jaksot, joilla on sama kuvaus, vievät levyltä ja muistista tilaa vain kerran.
+
+   descriptions.dat: otsake (quint32 "TVDS", quint8 versio) ja sen perässä tietueita
+   (8 tavun avain, quint32 koko, UTF-8-teksti). Avain on SHA-1-tiivisteen alku.
+   Tiedostoon vain lisätään, joten kesken jäänyt viimeinen tietue katkaistaan pois.
+   Luettu teksti tarkistetaan avainta vasten, ja käyttämättömät tietueet poistetaan
+   kirjoittamalla tiedosto uudelleen compact()-funktiolla. */
+
+static const quint32 StoreMagic = 0x54564453;
+static const quint8 StoreVersion = 1;
+static const qint64 StoreHeaderSize = 5;
+static const int KeySize = 8;
+static const qint64 RecordHeaderSize = KeySize + 4;
+
+DescriptionStore::DescriptionStore(const QString &filename) :
+    m_filename(filename), m_strings(1024 * 1024)
+{
+}
+
+DescriptionStore::~DescriptionStore()
+{
+    close();
+}
+
+bool DescriptionStore::open()
+{
+    m_file.setFileName(m_filename);
+
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    QDataStream stream(&m_file);
+
+    if (m_file.size() == 0) {
+        stream << StoreMagic << StoreVersion;
+        m_file.flush();
+        return true;
+    }
+
+    quint32 magic;
+    quint8 version;
+    stream >> magic >> version;
+
+    if (magic != StoreMagic || version != StoreVersion) {
+        m_error = "Invalid description store";
+        m_file.close();
+        return false;
+    }
+
+    return loadRecords();
+}
+
+void DescriptionStore::close()
+{
+    m_file.close();
+    m_entries.clear();
+    m_strings.clear();
+    m_newKeys.clear();
+}
+
+QString DescriptionStore::lastError() const
+{
+    return m_error;
+}
+
+bool DescriptionStore::contains(const QByteArray &key) const
+{
+    return m_entries.contains(key);
+}
+
+QString DescriptionStore::read(const QByteArray &key, bool &ok)
+{
+    /* Välimuistista palautettu merkkijono jakaa datansa kaikkien saman kuvauksen kanssa. */
+    QString *cached = m_strings.object(key);
+
+    if (cached != 0) {
+        ok = true;
+        return *cached;
+    }
+
+    ok = false;
+
+    if (!m_entries.contains(key)) {
+        return QString();
+    }
+
+    DescriptionStoreEntry entry = m_entries.value(key);
+    QByteArray data;
+
+    if (m_file.seek(entry.offset)) {
+        data = m_file.read(entry.size);
+    }
+
+    /* Vioittunut tietue poistetaan, jotta sitä käyttävät listaukset haetaan uudelleen. */
+    if ((quint32)data.size() != entry.size ||
+        QCryptographicHash::hash(data, QCryptographicHash::Sha1).left(KeySize) != key) {
+        m_error = QString("Invalid description record in %1").arg(m_filename);
+        qWarning() << m_error;
+        m_entries.remove(key);
+        return QString();
+    }
+
+    QString description = QString::fromUtf8(data);
+    m_strings.insert(key, new QString(description), description.size());
+    ok = true;
+    return description;
+}
+
+QByteArray DescriptionStore::insert(const QString &description)
+{
+    QByteArray k = key(description);
+
+    if (m_entries.contains(k)) {
+        m_newKeys.insert(k);
+        return k;
+    }
+
+    if (!m_file.isOpen()) {
+        return QByteArray();
+    }
+
+    QByteArray data = description.toUtf8();
+    qint64 pos = m_file.size();
+
+    if (!m_file.seek(pos)) {
+        m_error = m_file.errorString();
+        return QByteArray();
+    }
+
+    QDataStream stream(&m_file);
+    m_file.write(k);
+    stream << (quint32)data.size();
+
+    if (m_file.write(data) != data.size() || !m_file.flush()) {
+        m_error = m_file.errorString();
+        m_file.resize(pos);
+        return QByteArray();
+    }
+
+    DescriptionStoreEntry entry;
+    entry.offset = pos + RecordHeaderSize;
+    entry.size = data.size();
+    m_entries.insert(k, entry);
+    m_newKeys.insert(k);
+    return k;
+}
+
+qint64 DescriptionStore::fileSize() const
+{
+    return m_file.size();
+}
+
+bool DescriptionStore::compact(const QSet<QByteArray> &keys)
+{
+    /* Säilytetään listauksissa viitatut ja edellisen tiivistyksen jälkeen lisätyt kuvaukset,
+       koska niitä käyttävä listaus voi olla vielä kirjoittamatta levylle. */
+    QMap<qint64, QByteArray> order;
+    qint64 liveBytes = StoreHeaderSize;
+    QHash<QByteArray, DescriptionStoreEntry>::const_iterator i = m_entries.constBegin();
+
+    while (i != m_entries.constEnd()) {
+        if (keys.contains(i.key()) || m_newKeys.contains(i.key())) {
+            order.insert(i.value().offset, i.key());
+            liveBytes += RecordHeaderSize + i.value().size;
+        }
+
+        ++i;
+    }
+
+    /* Kirjoitetaan uudelleen vasta, kun yli puolet tiedostosta on käyttämätöntä. */
+    if (liveBytes > m_file.size() / 2) {
+        return true;
+    }
+
+    QFile tempFile(m_filename + ".tmp");
+
+    if (!tempFile.open(QIODevice::WriteOnly)) {
+        m_error = tempFile.errorString();
+        return false;
+    }
+
+    qDebug() << "WRITE" << tempFile.fileName();
+    QDataStream stream(&tempFile);
+    stream << StoreMagic << StoreVersion;
+    QList<QByteArray> liveKeys = order.values();
+    int count = liveKeys.size();
+
+    for (int j = 0; j < count; j++) {
+        DescriptionStoreEntry entry = m_entries.value(liveKeys.at(j));
+
+        if (!m_file.seek(entry.offset)) {
+            continue;
+        }
+
+        QByteArray data = m_file.read(entry.size);
+        tempFile.write(liveKeys.at(j));
+        stream << (quint32)data.size();
+        tempFile.write(data);
+    }
+
+    tempFile.close();
+
+    if (stream.status() != QDataStream::Ok || tempFile.error() != QFile::NoError) {
+        m_error = tempFile.errorString();
+        tempFile.remove();
+        return false;
+    }
+
+    /* Muistissa olevat listaukset viittaavat istunnon aikana lisättyihin kuvauksiin,
+       joten ne säilytetään myös seuraavissa tiivistyksissä. */
+    QSet<QByteArray> newKeys = m_newKeys;
+    close();
+    QFile::remove(m_filename);
+
+    if (!QFile::rename(tempFile.fileName(), m_filename)) {
+        m_error = "Cannot rename description store";
+        return false;
+    }
+
+    bool ok = open();
+    m_newKeys = newKeys;
+    return ok;
+}
+
+QByteArray DescriptionStore::key(const QString &description)
+{
+    return QCryptographicHash::hash(description.toUtf8(), QCryptographicHash::Sha1).left(KeySize);
+}
+
+bool DescriptionStore::loadRecords()
+{
+    qint64 fileSize = m_file.size();
+    qint64 pos = StoreHeaderSize;
+    QDataStream stream(&m_file);
+
+    while (pos + RecordHeaderSize <= fileSize) {
+        m_file.seek(pos);
+        QByteArray k = m_file.read(KeySize);
+        quint32 size;
+        stream >> size;
+
+        if (k.size() != KeySize || stream.status() != QDataStream::Ok ||
+            pos + RecordHeaderSize + size > fileSize) {
+            break;
+        }
+
+        DescriptionStoreEntry entry;
+        entry.offset = pos + RecordHeaderSize;
+        entry.size = size;
+        m_entries.insert(k, entry);
+        pos += RecordHeaderSize + size;
+    }
+
+    if (pos < fileSize) {
+        qWarning() << "Truncating" << m_filename << "at" << pos;
+        m_file.resize(pos);
+    }
+
+    qDebug() << "READ" << m_filename << m_entries.size();
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef DESCRIPTIONSTORE_H
+#define DESCRIPTIONSTORE_H
+
+#include <QByteArray>
+#include <QCache>
+#include <QFile>
+#include <QHash>
+#include <QSet>
+
+struct DescriptionStoreEntry
+{
+    qint64 offset;
+    quint32 size;
+};
+
+class DescriptionStore
+{
+public:
+    DescriptionStore(const QString &filename);
+    ~DescriptionStore();
+    bool open();
+    void close();
+    QString lastError() const;
+    bool contains(const QByteArray &key) const;
+    QString read(const QByteArray &key, bool &ok);
+    QByteArray insert(const QString &description);
+    qint64 fileSize() const;
+    bool compact(const QSet<QByteArray> &keys);
+    static QByteArray key(const QString &description);
+
+private:
+    bool loadRecords();
+    QString m_filename;
+    QFile m_file;
+    QHash<QByteArray, DescriptionStoreEntry> m_entries;
+    QCache<QByteArray, QString> m_strings;
+    QSet<QByteArray> m_newKeys;
+    QString m_error;
+};
+
+#endif // DESCRIPTIONSTORE_H
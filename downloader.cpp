@@ -4,11 +4,14 @@
 #include <QNetworkReply>
 #include <QUrl>
 #include "downloader.h"
+#include "metrics.h"
+#include "tsindexer.h"
 #include "tvkaistaclient.h"
 
 Downloader::Downloader(TvkaistaClient *client, QObject *parent) :
-    QObject(parent), m_client(client), m_reply(0), m_byteOffset(0),
-    m_bytesReceived(0), m_bytesTotal(-1), m_finished(false)
+    QObject(parent), m_client(client), m_reply(0), m_indexer(0),
+    m_filenameFromReply(false), m_indexEnabled(false), m_byteOffset(0),
+    m_bytesReceived(0), m_bytesTotal(-1), m_lastProgress(0), m_finished(false)
 {
     m_buf = new char[4096];
 }
@@ -16,6 +19,7 @@ Downloader::Downloader(TvkaistaClient *client, QObject *parent) :
 Downloader::~Downloader()
 {
     delete m_buf;
+    delete m_indexer;
 }
 
 void Downloader::start(const QUrl &url)
@@ -29,6 +33,8 @@ void Downloader::start(const QUrl &url)
     }
 
     m_reply = m_client->sendRequest(request);
+    m_timer.start();
+    m_lastProgress = 0;
     connect(m_reply, SIGNAL(readyRead()), SLOT(replyReadyRead()));
     connect(m_reply, SIGNAL(finished()), SLOT(replyFinished()));
     connect(m_reply, SIGNAL(downloadProgress(qint64,qint64)), SLOT(replyDownloadProgress(qint64,qint64)));
@@ -44,6 +50,10 @@ void Downloader::abort()
     m_reply->abort();
     m_reply->deleteLater();
     m_reply = 0;
+
+    if (m_indexer != 0) {
+        m_indexer->close(false);
+    }
 }
 
 QString Downloader::lastError() const
@@ -61,6 +71,11 @@ qint64 Downloader::bytesTotal() const
     return m_bytesTotal;
 }
 
+qint64 Downloader::msecsSinceProgress() const
+{
+    return m_reply == 0 ? 0 : m_timer.elapsed() - m_lastProgress;
+}
+
 bool Downloader::hasError() const
 {
     return !m_error.isEmpty();
@@ -81,6 +96,12 @@ QString Downloader::filename() const
     return m_filename;
 }
 
+QString Downloader::openedFilename() const
+{
+    /* Tyhjä, kunnes ladattavaa tiedostoa on avattu kirjoitettavaksi. */
+    return m_file.fileName();
+}
+
 void Downloader::setFilenameFromReply(bool filenameFromReply)
 {
     m_filenameFromReply = filenameFromReply;
@@ -101,6 +122,16 @@ int Downloader::byteOffset() const
     return m_byteOffset;
 }
 
+void Downloader::setIndexEnabled(bool indexEnabled)
+{
+    m_indexEnabled = indexEnabled;
+}
+
+bool Downloader::isIndexEnabled() const
+{
+    return m_indexEnabled;
+}
+
 void Downloader::replyReadyRead()
 {
     if (!m_file.isOpen()) {
@@ -132,6 +163,17 @@ void Downloader::replyReadyRead()
                 return;
             }
         }
+
+        if (m_indexEnabled) {
+            /* Hakemisto rakennetaan sitä mukaa kuin tavuja saapuu, jotta tiedostoa ei
+               tarvitse lukea uudelleen latauksen jälkeen. */
+            delete m_indexer;
+            m_indexer = new TsIndexer;
+
+            if (!m_indexer->open(TsIndexer::indexFilename(m_filename), m_byteOffset)) {
+                qWarning() << m_indexer->lastError();
+            }
+        }
     }
 
     int len = m_reply->read(m_buf, 4096);
@@ -143,8 +185,16 @@ void Downloader::replyReadyRead()
             break;
         }
 
+        if (m_indexer != 0) {
+            m_indexer->parse(m_buf, len);
+        }
+
         len = m_reply->read(m_buf, 4096);
     }
+
+    /* Paikallinen HTTP-palvelin lukee tiedostoa latauksen aikana. */
+    m_file.flush();
+    emit progress();
 }
 
 void Downloader::replyFinished()
@@ -152,7 +202,16 @@ void Downloader::replyFinished()
     m_file.close();
     m_finished = true;
 
+    if (m_indexer != 0) {
+        m_indexer->close(m_error.isEmpty());
+    }
+
     if (m_error.isEmpty()) {
+        /* Nopeus lasketaan vain tällä kertaa ladatuista tavuista, jatketun latauksen alkuosa ei kuulu siihen. */
+        qint64 bytes = m_bytesReceived - m_byteOffset;
+        qint64 elapsed = qMax(Q_INT64_C(1), m_timer.elapsed());
+        Metrics::instance()->increment("tvkaista_download_bytes_total", bytes);
+        Metrics::instance()->observe("tvkaista_download_throughput_kbps", bytes * 1000.0 / 1024 / elapsed);
         emit finished();
     }
 }
@@ -161,6 +220,8 @@ void Downloader::replyDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
 {
     m_bytesReceived = m_byteOffset + bytesReceived;
     m_bytesTotal = m_byteOffset + bytesTotal;
+    m_lastProgress = m_timer.elapsed();
+    emit progress();
 }
 
 void Downloader::replyNetworkError(QNetworkReply::NetworkError error)
@@ -1,11 +1,13 @@
 #ifndef DOWNLOADER_H
 #define DOWNLOADER_H
 
+#include <QElapsedTimer>
 #include <QFile>
 #include <QObject>
 #include <QNetworkReply>
 #include <QUrl>
 
+class TsIndexer;
 class TvkaistaClient;
 
 class Downloader : public QObject
@@ -19,18 +21,23 @@ public:
     QString lastError() const;
     qint64 bytesReceived() const;
     qint64 bytesTotal() const;
+    qint64 msecsSinceProgress() const;
     bool hasError() const;
     bool isFinished() const;
     void setFilename(const QString &filename);
     QString filename() const;
+    QString openedFilename() const;
     void setFilenameFromReply(bool filenameFromReply);
     bool isFilenameFromReply() const;
     void setByteOffset(int byteOffset);
     int byteOffset() const;
+    void setIndexEnabled(bool indexEnabled);
+    bool isIndexEnabled() const;
 
 signals:
     void finished();
     void networkError();
+    void progress();
 
 private slots:
     void replyReadyRead();
@@ -43,14 +50,18 @@ private:
     void appendSuffixToFilenameAndCreateDir();
     TvkaistaClient *m_client;
     QNetworkReply *m_reply;
+    TsIndexer *m_indexer;
     char *m_buf;
     QFile m_file;
     QString m_error;
     QString m_filename;
     bool m_filenameFromReply;
+    bool m_indexEnabled;
     qint64 m_byteOffset;
     qint64 m_bytesReceived;
     qint64 m_bytesTotal;
+    QElapsedTimer m_timer;
+    qint64 m_lastProgress;
     bool m_finished;
 };
 
@@ -7,9 +7,14 @@
 #include <QXmlStreamWriter>
 #include "mainwindow.h"
 #include "downloader.h"
+#include "profiler.h"
+#include "tsindexer.h"
 #include "tvkaistaclient.h"
 #include "downloadtablemodel.h"
 
+/* Näin pitkään ilman uusia tavuja ollut lataus katsotaan jumittuneeksi. */
+static const int StallTimeout = 30 * 1000;
+
 DownloadTableModel::DownloadTableModel(QSettings *settings, QObject *parent) :
     QAbstractTableModel(parent), m_settings(settings), m_timer(new QTimer(this)),
     m_fileSystemWatcher(new QFileSystemWatcher(this))
@@ -149,6 +154,7 @@ int DownloadTableModel::download(const Programme &programme, int format, const Q
     Downloader *downloader = new Downloader(m_client, this);
     downloader->setFilename(QFileInfo(QString("%1/%2").arg(dirPath, filenameFormat)).absoluteFilePath());
     downloader->setFilenameFromReply(filenameFromReply);
+    downloader->setIndexEnabled(format == 3);
     downloader->start(url);
     connect(downloader, SIGNAL(finished()), SLOT(downloaderFinished()));
     connect(downloader, SIGNAL(networkError()), SLOT(networkError()));
@@ -262,8 +268,41 @@ int DownloadTableModel::programmeId(int index) const
     return m_downloads.at(index).programmeId;
 }
 
+int DownloadTableModel::rowForProgramme(int programmeId) const
+{
+    int count = m_downloads.size();
+
+    for (int i = 0; i < count; i++) {
+        if (m_downloads.at(i).programmeId == programmeId) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int DownloadTableModel::downloadingRowForProgramme(int programmeId) const
+{
+    int count = m_downloads.size();
+
+    for (int i = 0; i < count; i++) {
+        if (m_downloads.at(i).programmeId == programmeId && m_downloads.at(i).status == 0 &&
+            m_downloads.at(i).downloader != 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+Downloader* DownloadTableModel::downloader(int index) const
+{
+    return m_downloads.at(index).downloader;
+}
+
 bool DownloadTableModel::load()
 {
+    PROFILE_ZONE("DownloadTableModel::load");
     m_downloads.clear();
     QString dirPath = QFileInfo(m_settings->fileName()).path();
     QString filename = QString("%1/downloads.xml").arg(dirPath);
@@ -376,6 +415,7 @@ bool DownloadTableModel::save()
 void DownloadTableModel::updateDownloadProgress()
 {
     int count = m_downloads.size();
+    QSet<Downloader*> downloaders;
 
     for (int i = 0; i < count; i++) {
         FileDownload download = m_downloads.at(i);
@@ -387,6 +427,15 @@ void DownloadTableModel::updateDownloadProgress()
         Downloader *downloader = download.downloader;
         qint64 received = downloader->bytesReceived();
         qint64 total = downloader->bytesTotal();
+        downloaders.insert(downloader);
+
+        if (downloader->msecsSinceProgress() < StallTimeout) {
+            m_stalledDownloaders.remove(downloader);
+        }
+        else if (!m_stalledDownloaders.contains(downloader)) {
+            m_stalledDownloaders.insert(downloader);
+            emit downloadStalled(i);
+        }
 
         if (received <= 0) {
             continue;
@@ -406,6 +455,8 @@ void DownloadTableModel::updateDownloadProgress()
         QModelIndex modelIndex = index(i, 0, QModelIndex());
         emit dataChanged(modelIndex, modelIndex);
     }
+
+    m_stalledDownloaders.intersect(downloaders);
 }
 
 void DownloadTableModel::downloaderFinished()
@@ -423,6 +474,13 @@ void DownloadTableModel::downloaderFinished()
                 download.downloader = 0;
                 download.status = 1;
                 download.description = trUtf8("Valmis");
+                int errors;
+
+                if (videoFormat(i) == 3 && TsIndexer::verify(download.filename, errors) && errors > 0) {
+                    qWarning() << "TS errors" << download.filename << errors;
+                    download.description = trUtf8("Valmis (%1 virhettä)").arg(errors);
+                }
+
                 m_downloads.replace(i, download);
                 m_fileSystemWatcher->addPath(download.filename);
                 QModelIndex modelIndex = index(i, 0, QModelIndex());
@@ -491,6 +549,7 @@ int DownloadTableModel::tryResumeDownload(int programmeId, const QUrl &url)
             downloader->setFilename(download.filename);
             downloader->setFilenameFromReply(false);
             downloader->setByteOffset(QFileInfo(download.filename).size());
+            downloader->setIndexEnabled(videoFormat(i) == 3);
             downloader->start(url);
             connect(downloader, SIGNAL(finished()), SLOT(downloaderFinished()));
             connect(downloader, SIGNAL(networkError()), SLOT(networkError()));
@@ -4,6 +4,7 @@
 #include <QAbstractTableModel>
 #include <QFileSystemWatcher>
 #include <QDateTime>
+#include <QSet>
 #include <QUrl>
 #include "programme.h"
 
@@ -57,11 +58,15 @@ public:
     int status(int index) const;
     int videoFormat(int index) const;
     int programmeId(int index) const;
+    int rowForProgramme(int programmeId) const;
+    int downloadingRowForProgramme(int programmeId) const;
+    Downloader* downloader(int index) const;
     bool load();
     bool save();
 
 signals:
     void downloadStatusChanged(int index);
+    void downloadStalled(int index);
 
 private slots:
     void updateDownloadProgress();
@@ -79,6 +84,7 @@ private:
     QList<FileDownload> m_downloads;
     QTimer *m_timer;
     QFileSystemWatcher *m_fileSystemWatcher;
+    QSet<Downloader*> m_stalledDownloaders;
 };
 
 #endif // DOWNLOADTABLEMODEL_H
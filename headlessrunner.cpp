@@ -0,0 +1,525 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkProxy>
+#include <QNetworkReply>
+#include <QSettings>
+#include <QTextStream>
+#include <QTimer>
+#include <stdio.h>
+#include "availabilitywatcher.h"
+#include "cache.h"
+#include "downloadtablemodel.h"
+#include "headlessrunner.h"
+#include "mainwindow.h"
+#include "programmefeedparser.h"
+#include "programmegridloader.h"
+#include "tvkaistaclient.h"
+
+/* Komentorivitila ilman ikkunoita, esim. cron-ajoihin. Asetukset, välimuisti ja
+   latauslista ovat samat kuin graafisessa käyttöliittymässä. Listaussivu sisältää
+   viikon ohjelmat, joten synkronoinnissa haetaan vain joka seitsemäs päivä. */
+
+static const int MaxParallelDownloads = 2;
+static const int StreamTimeout = 60 * 1000;
+
+static void print(const QString &s)
+{
+    fprintf(stdout, "%s\n", s.toLocal8Bit().constData());
+    fflush(stdout);
+}
+
+static void printError(const QString &s)
+{
+    fprintf(stderr, "%s\n", s.toLocal8Bit().constData());
+}
+
+static QString field(const QString &s)
+{
+    QString simplified = s;
+    simplified.replace('\t', ' ');
+    simplified.replace('\n', ' ');
+    simplified.replace('\r', ' ');
+    return simplified;
+}
+
+HeadlessRunner::HeadlessRunner(QSettings *settings, QObject *parent) :
+    QObject(parent), m_settings(settings), m_client(new TvkaistaClient(this)), m_cache(new Cache),
+    m_downloadTableModel(new DownloadTableModel(settings, this)),
+    m_loader(new ProgrammeGridLoader(m_client, this)), m_streamTimer(new QTimer(this)),
+    m_command(0), m_format(-1), m_running(0), m_failures(0), m_seasonPasses(false)
+{
+    m_resolving.id = -1;
+    m_client->setCache(m_cache);
+    m_downloadTableModel->setClient(m_client);
+    m_streamTimer->setSingleShot(true);
+    m_streamTimer->setInterval(StreamTimeout);
+
+    connect(m_client, SIGNAL(channelsFetched(QList<Channel>)), SLOT(channelsFetched(QList<Channel>)));
+    connect(m_client, SIGNAL(loggedIn()), SLOT(loggedIn()));
+    connect(m_client, SIGNAL(streamUrlFetched(Programme,int,QUrl)), SLOT(streamUrlFetched(Programme,int,QUrl)));
+    connect(m_client, SIGNAL(streamNotFound()), SLOT(streamFailed()));
+    connect(m_client, SIGNAL(loginError()), SLOT(loginError()));
+    connect(m_client, SIGNAL(networkError()), SLOT(networkError()));
+    connect(m_loader, SIGNAL(channelFailed(int)), SLOT(channelFailed(int)));
+    connect(m_loader, SIGNAL(finished()), SLOT(loadFinished()));
+    connect(m_streamTimer, SIGNAL(timeout()), SLOT(streamFailed()));
+    connect(m_downloadTableModel, SIGNAL(downloadStatusChanged(int)), SLOT(downloadStatusChanged(int)));
+}
+
+bool HeadlessRunner::parseArguments(const QStringList &arguments)
+{
+    QDate today = QDate::currentDate();
+    m_fromDate = today;
+    m_toDate = today;
+    int count = arguments.size();
+
+    for (int i = 1; i < count; i++) {
+        QString arg = arguments.at(i);
+        QString value = i + 1 < count ? arguments.at(i + 1) : QString();
+
+        if (arg == "--headless" || arg == "-d" || arg == "--debug") {
+            continue;
+        }
+        else if (m_command == 0 && arg == "sync") {
+            m_command = 1;
+        }
+        else if (m_command == 0 && arg == "download") {
+            m_command = 2;
+        }
+        else if (m_command == 0 && arg == "export") {
+            m_command = 3;
+        }
+        else if (arg == "--from" || arg == "--to") {
+            QDate date = QDate::fromString(value, Qt::ISODate);
+
+            if (!date.isValid()) {
+                return false;
+            }
+
+            if (arg == "--from") {
+                m_fromDate = date;
+            }
+            else {
+                m_toDate = date;
+            }
+
+            i++;
+        }
+        else if (arg == "--channels") {
+            QStringList ids = value.split(',', QString::SkipEmptyParts);
+
+            for (int j = 0; j < ids.size(); j++) {
+                bool ok;
+                m_channelIds.append(ids.at(j).toInt(&ok));
+
+                if (!ok) {
+                    return false;
+                }
+            }
+
+            i++;
+        }
+        else if (arg == "--format") {
+            bool ok;
+            m_format = value.toInt(&ok);
+
+            if (!ok || m_format < 0 || m_format >= MainWindow::videoFormats().size()) {
+                return false;
+            }
+
+            i++;
+        }
+        else if (arg == "--output" && !value.isEmpty()) {
+            m_outputFilename = value;
+            i++;
+        }
+        else if (m_command == 2 && arg == "--season-passes") {
+            m_seasonPasses = true;
+        }
+        else if (m_command == 2) {
+            bool ok;
+            m_programmeIds.append(arg.toInt(&ok));
+
+            if (!ok) {
+                return false;
+            }
+        }
+        else {
+            return false;
+        }
+    }
+
+    if (m_command == 2 && m_programmeIds.isEmpty() && !m_seasonPasses) {
+        return false;
+    }
+
+    return m_command != 0 && m_fromDate <= m_toDate;
+}
+
+QString HeadlessRunner::usage()
+{
+    return "       tvkaistagui --headless [-d] sync [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--channels ID,...]\n"
+           "       tvkaistagui --headless [-d] download [--format 0-3] [--season-passes] [ID...]\n"
+           "       tvkaistagui --headless [-d] export [--from YYYY-MM-DD] [--to YYYY-MM-DD] [--channels ID,...]\n"
+           "                                          [--output FILE]\n";
+}
+
+void HeadlessRunner::start()
+{
+    loadSettings();
+
+    if (m_command == 3) {
+        finish(exportListings() ? 0 : 1);
+        return;
+    }
+
+    if (!m_client->isValidUsernameAndPassword()) {
+        printError(QString("Username or password is not set in %1").arg(m_settings->fileName()));
+        finish(1);
+        return;
+    }
+
+    if (m_command == 1) {
+        m_client->sendChannelRequest();
+    }
+    else {
+        m_downloadTableModel->load();
+        m_client->sendLoginRequest();
+    }
+}
+
+void HeadlessRunner::loadSettings()
+{
+    m_settings->beginGroup("client");
+    QString cacheDirPath = m_settings->value("cacheDir").toString();
+
+    if (cacheDirPath.isEmpty()) {
+        cacheDirPath = QString("%1/cache").arg(QFileInfo(m_settings->fileName()).path());
+    }
+
+    if (m_format < 0) {
+        m_format = qBound(0, m_settings->value("format", 1).toInt(), MainWindow::videoFormats().size() - 1);
+    }
+
+    m_client->setUsername(m_settings->value("username").toString());
+    m_client->setPassword(MainWindow::decodePassword(m_settings->value("password").toString()));
+    m_client->setCookies(m_settings->value("cookies").toByteArray());
+    m_client->setFormat(m_format);
+    m_client->setServer(m_settings->value("server").toString());
+
+    m_settings->beginGroup("proxy");
+    QNetworkProxy proxy;
+    proxy.setHostName(m_settings->value("host").toString());
+    proxy.setPort(qBound(0, m_settings->value("port", 8080).toInt(), 65535));
+    proxy.setType(proxy.hostName().isEmpty() ? QNetworkProxy::NoProxy : QNetworkProxy::HttpProxy);
+    m_client->setProxy(proxy);
+    m_settings->endGroup();
+
+    qint64 mb = 1024 * 1024;
+    m_cache->setLimits(qMax(0, m_settings->value("cacheSize", 500).toInt()) * mb,
+                       qMax(0, m_settings->value("cacheListingsSize", 100).toInt()) * mb,
+                       qMax(0, m_settings->value("cachePostersSize", 250).toInt()) * mb,
+                       qMax(0, m_settings->value("cacheThumbnailsSize", 250).toInt()) * mb);
+    m_settings->endGroup();
+    m_cache->setDirectory(QDir(cacheDirPath));
+
+    bool ok;
+    QList<Channel> channels = m_cache->loadChannels(ok);
+
+    for (int i = 0; i < channels.size(); i++) {
+        m_channelNames.insert(channels.at(i).id, channels.at(i).name);
+    }
+}
+
+void HeadlessRunner::channelsFetched(const QList<Channel> &channels)
+{
+    m_channels.clear();
+
+    for (int i = 0; i < channels.size(); i++) {
+        if (m_channelIds.isEmpty() || m_channelIds.contains(channels.at(i).id)) {
+            m_channels.append(channels.at(i));
+        }
+    }
+
+    /* Haettu päivä on viikon keskellä, joten päivät valitaan kolmen päivän päästä alusta. */
+    for (QDate date = m_fromDate.addDays(3); date.addDays(-3) <= m_toDate; date = date.addDays(7)) {
+        m_dates.append(date);
+    }
+
+    syncNextDate();
+}
+
+void HeadlessRunner::syncNextDate()
+{
+    if (m_dates.isEmpty()) {
+        finish(m_failures > 0 ? 1 : 0);
+        return;
+    }
+
+    QDate date = m_dates.takeFirst();
+    print(QString("Syncing %1 channels, %2 - %3").arg(m_channels.size())
+          .arg(date.addDays(-3).toString(Qt::ISODate), date.addDays(3).toString(Qt::ISODate)));
+    m_loader->load(m_channels, date, true);
+}
+
+void HeadlessRunner::channelFailed(int channelId)
+{
+    printError(QString("Cannot load listing: %1 %2").arg(channelId).arg(m_channelNames.value(channelId)));
+    m_failures++;
+}
+
+void HeadlessRunner::loadFinished()
+{
+    syncNextDate();
+}
+
+void HeadlessRunner::loggedIn()
+{
+    if (m_command != 2) {
+        return;
+    }
+
+    for (int i = 0; i < m_programmeIds.size(); i++) {
+        Programme programme;
+        programme.id = m_programmeIds.at(i);
+        QNetworkReply *reply = m_client->sendDetailedFeedRequest(programme);
+        connect(reply, SIGNAL(finished()), SLOT(feedRequestFinished()));
+        m_feedReplies.insert(reply, programme.id);
+    }
+
+    /* Sarjojen lista haetaan erillisenä pyyntönä, jotta osoitteiden selvittäminen
+       TvkaistaClientin omalla pyynnöllä ei keskeytä sitä. Tunnisteena on -1. */
+    if (m_seasonPasses) {
+        QNetworkReply *reply = m_client->sendSeasonPassFeedRequest(false);
+        connect(reply, SIGNAL(finished()), SLOT(feedRequestFinished()));
+        m_feedReplies.insert(reply, -1);
+    }
+}
+
+void HeadlessRunner::queueSeasonPasses(const QList<Programme> &programmes)
+{
+    /* Ladataan päättyneet ja saatavilla olevat ohjelmat, joita ei ole vielä ladattu. */
+    QDateTime now = QDateTime::currentDateTime();
+
+    for (int i = 0; i < programmes.size(); i++) {
+        Programme programme = programmes.at(i);
+        int row = m_downloadTableModel->rowForProgramme(programme.id);
+
+        if (programme.startDateTime.addSecs(qMax(0, programme.duration)) > now ||
+            !AvailabilityWatcher::isAvailable(programme, m_format) ||
+            (row >= 0 && m_downloadTableModel->status(row) == 1)) {
+            continue;
+        }
+
+        queueDownload(programme);
+    }
+}
+
+void HeadlessRunner::feedRequestFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || !m_feedReplies.contains(reply)) {
+        return;
+    }
+
+    int programmeId = m_feedReplies.take(reply);
+    reply->deleteLater();
+    ProgrammeFeedParser parser;
+
+    if (programmeId < 0) {
+        if (reply->error() != QNetworkReply::NoError || !parser.parse(reply)) {
+            printError("Cannot load season passes");
+            m_failures++;
+        }
+        else {
+            m_cache->saveSeasonPasses(QDateTime::currentDateTime(), parser.programmes());
+            queueSeasonPasses(parser.programmes());
+        }
+    }
+    else if (reply->error() != QNetworkReply::NoError || !parser.parse(reply) || parser.programmes().isEmpty()) {
+        printError(QString("Programme %1 not found").arg(programmeId));
+        m_failures++;
+    }
+    else {
+        queueDownload(parser.programmes().first());
+    }
+
+    resolveNextStream();
+}
+
+void HeadlessRunner::queueDownload(const Programme &programme)
+{
+    for (int i = 0; i < m_queue.size(); i++) {
+        if (m_queue.at(i).id == programme.id) {
+            return;
+        }
+    }
+
+    m_queue.append(programme);
+}
+
+void HeadlessRunner::resolveNextStream()
+{
+    /* Osoitteet selvitetään yksi kerrallaan, koska TvkaistaClient käsittelee vain yhtä pyyntöä. */
+    if (m_resolving.id >= 0 || m_running >= MaxParallelDownloads) {
+        return;
+    }
+
+    if (m_queue.isEmpty()) {
+        if (m_running == 0 && m_feedReplies.isEmpty()) {
+            finish(m_failures > 0 ? 1 : 0);
+        }
+
+        return;
+    }
+
+    m_resolving = m_queue.takeFirst();
+    m_streamTimer->start();
+    m_client->sendStreamRequest(m_resolving);
+}
+
+void HeadlessRunner::streamUrlFetched(const Programme &programme, int format, const QUrl &url)
+{
+    m_streamTimer->stop();
+    m_resolving.id = -1;
+    int row = m_downloadTableModel->download(programme, format, m_channelNames.value(programme.channelId), url);
+    m_running++;
+    print(QString("Downloading %1 %2 -> %3").arg(programme.id).arg(programme.title,
+                                                   m_downloadTableModel->filename(row)));
+    m_downloadTableModel->save();
+    resolveNextStream();
+}
+
+void HeadlessRunner::streamFailed()
+{
+    if (m_resolving.id < 0) {
+        return;
+    }
+
+    printError(QString("Stream not found: %1 %2").arg(m_resolving.id).arg(m_resolving.title));
+    m_streamTimer->stop();
+    m_resolving.id = -1;
+    m_failures++;
+    resolveNextStream();
+}
+
+void HeadlessRunner::downloadStatusChanged(int index)
+{
+    int status = m_downloadTableModel->status(index);
+
+    if (status == 1) {
+        print(QString("Finished %1").arg(m_downloadTableModel->filename(index)));
+    }
+    else if (status == 3) {
+        printError(QString("Download failed: %1").arg(m_downloadTableModel->title(index)));
+        m_failures++;
+    }
+    else {
+        return;
+    }
+
+    m_running--;
+    m_downloadTableModel->save();
+    resolveNextStream();
+}
+
+void HeadlessRunner::loginError()
+{
+    printError("Login failed");
+    finish(1);
+}
+
+void HeadlessRunner::networkError()
+{
+    printError(QString("Network error: %1").arg(m_client->lastError()));
+
+    if (m_command == 2 && m_resolving.id >= 0) {
+        streamFailed();
+        return;
+    }
+
+    finish(1);
+}
+
+bool HeadlessRunner::exportListings()
+{
+    bool ok;
+    QList<Channel> channels = m_cache->loadChannels(ok);
+
+    if (!ok) {
+        printError("No channels in cache, run sync first");
+        return false;
+    }
+
+    QFile file;
+
+    if (m_outputFilename.isEmpty()) {
+        file.open(stdout, QIODevice::WriteOnly);
+    }
+    else {
+        file.setFileName(m_outputFilename);
+
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            printError(file.errorString());
+            return false;
+        }
+    }
+
+    /* Sarkaimin erotellut sarakkeet: ohjelma, kanava, alkuaika, kesto, nimi ja kuvaus. */
+    QTextStream out(&file);
+    out.setCodec("UTF-8");
+    int missing = 0;
+
+    for (QDate date = m_fromDate; date <= m_toDate; date = date.addDays(1)) {
+        for (int i = 0; i < channels.size(); i++) {
+            if (!m_channelIds.isEmpty() && !m_channelIds.contains(channels.at(i).id)) {
+                continue;
+            }
+
+            int age;
+            QList<Programme> programmes = m_cache->loadProgrammes(channels.at(i).id, date, ok, age);
+
+            if (!ok) {
+                missing++;
+                continue;
+            }
+
+            for (int j = 0; j < programmes.size(); j++) {
+                Programme programme = programmes.at(j);
+                out << programme.id << '\t' << field(channels.at(i).name) << '\t'
+                    << programme.startDateTime.toString(Qt::ISODate) << '\t' << programme.duration << '\t'
+                    << field(programme.title) << '\t' << field(m_cache->loadDescription(programme)) << '\n';
+            }
+        }
+    }
+
+    out.flush();
+
+    if (missing > 0) {
+        printError(QString("%1 listings not in cache").arg(missing));
+    }
+
+    return true;
+}
+
+void HeadlessRunner::finish(int exitCode)
+{
+    m_streamTimer->stop();
+    m_loader->abort();
+
+    if (m_command == 2) {
+        m_downloadTableModel->abortAllDownloads();
+        m_downloadTableModel->save();
+    }
+
+    m_settings->beginGroup("client");
+    m_settings->setValue("cookies", m_client->cookies());
+    m_settings->endGroup();
+    m_cache->flush();
+    m_cache->saveIndex();
+    QCoreApplication::exit(exitCode);
+}
@@ -0,0 +1,81 @@
+#ifndef HEADLESSRUNNER_H
+#define HEADLESSRUNNER_H
+
+#include <QDate>
+#include <QMap>
+#include <QObject>
+#include <QStringList>
+#include <QUrl>
+#include "channel.h"
+#include "programme.h"
+
+class QNetworkReply;
+class QSettings;
+class QTimer;
+class Cache;
+class DownloadTableModel;
+class ProgrammeGridLoader;
+class TvkaistaClient;
+
+class HeadlessRunner : public QObject
+{
+    Q_OBJECT
+public:
+    HeadlessRunner(QSettings *settings, QObject *parent = 0);
+    bool parseArguments(const QStringList &arguments);
+    static QString usage();
+
+public slots:
+    void start();
+
+private slots:
+    void channelsFetched(const QList<Channel> &channels);
+    void loadFinished();
+    void loggedIn();
+    void channelFailed(int channelId);
+    void feedRequestFinished();
+    void streamUrlFetched(const Programme &programme, int format, const QUrl &url);
+    void streamFailed();
+    void downloadStatusChanged(int index);
+    void loginError();
+    void networkError();
+
+private:
+    void loadSettings();
+    void syncNextDate();
+    void queueSeasonPasses(const QList<Programme> &programmes);
+    void queueDownload(const Programme &programme);
+    void resolveNextStream();
+    bool exportListings();
+    void finish(int exitCode);
+    QSettings *m_settings;
+    TvkaistaClient *m_client;
+    Cache *m_cache;
+    DownloadTableModel *m_downloadTableModel;
+    ProgrammeGridLoader *m_loader;
+    QTimer *m_streamTimer;
+    QList<Channel> m_channels;
+    QList<int> m_channelIds;
+    QList<int> m_programmeIds;
+    QList<QDate> m_dates;
+    QList<Programme> m_queue;
+    QMap<QNetworkReply*, int> m_feedReplies;
+    QMap<int, QString> m_channelNames;
+    Programme m_resolving;
+    QString m_outputFilename;
+    QDate m_fromDate;
+    QDate m_toDate;
+
+    /**
+      * 1 = listausten synkronointi
+      * 2 = ohjelmien lataus
+      * 3 = listausten vienti
+     */
+    int m_command;
+    int m_format;
+    int m_running;
+    int m_failures;
+    bool m_seasonPasses;
+};
+
+#endif // HEADLESSRUNNER_H
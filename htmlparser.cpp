@@ -1,6 +1,7 @@
 #include <QDebug>
 #include <QIODevice>
 #include "htmlparser.h"
+#include "profiler.h"
 
 HtmlParser::HtmlParser() : m_parseContent(false),
     m_codec(QTextCodec::codecForLocale()), m_buf(new char[4096]), m_x(0)
@@ -14,6 +15,7 @@ HtmlParser::~HtmlParser()
 
 bool HtmlParser::parse(QIODevice *device)
 {
+    PROFILE_ZONE("HtmlParser::parse");
     m_len = device->read(m_buf, 4096);
 
     while (m_len > 0) {
@@ -0,0 +1,143 @@
+#include <QBuffer>
+#include <QDebug>
+#include <QImageReader>
+#include <QMetaType>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include "cache.h"
+#include "imageloader.h"
+
+class ImageDecodeTask : public QRunnable
+{
+public:
+    ImageDecodeTask(ImageLoader *loader, const QString &key, const QByteArray &data, Cache *cache,
+                    const Programme &programme, const QTime &time, const QSize &maxSize) :
+        m_loader(loader), m_key(key), m_data(data), m_cache(cache), m_programme(programme), m_time(time),
+        m_maxSize(maxSize)
+    {
+    }
+
+    void run()
+    {
+        /* Välimuistissa oleva kuva luetaan vasta tässä säikeessä, jotta levyn lukeminen
+           ei pysäytä käyttöliittymää. Cache on säieturvallinen. Kuvakaappaus tunnistetaan
+           ajasta, ilman aikaa luetaan ohjelmakuva. */
+        if (m_cache != 0 && m_time.isValid()) {
+            m_data = m_cache->loadThumbnail(m_programme, m_time);
+        }
+        else if (m_cache != 0) {
+            m_data = m_cache->loadPoster(m_programme);
+        }
+
+        QImage image;
+
+        if (!m_data.isEmpty()) {
+            QBuffer buffer(&m_data);
+            buffer.open(QIODevice::ReadOnly);
+            image = ImageLoader::decode(&buffer, m_maxSize);
+        }
+
+        /* Tulos toimitetaan jonotettuna pääsäikeeseen. */
+        QMetaObject::invokeMethod(m_loader, "decodeFinished", Qt::QueuedConnection,
+                                  Q_ARG(QString, m_key), Q_ARG(QImage, image));
+    }
+
+private:
+    ImageLoader *m_loader;
+    QString m_key;
+    QByteArray m_data;
+    Cache *m_cache;
+    Programme m_programme;
+    QTime m_time;
+    QSize m_maxSize;
+};
+
+ImageLoader::ImageLoader(QObject *parent) :
+    QObject(parent), m_threadPool(new QThreadPool(this))
+{
+    qRegisterMetaType<QImage>("QImage");
+    m_threadPool->setMaxThreadCount(qMax(1, QThread::idealThreadCount() - 1));
+    m_cache.setMaxCost(16384);
+}
+
+ImageLoader::~ImageLoader()
+{
+    m_threadPool->waitForDone();
+}
+
+void ImageLoader::setMaxCacheSize(int kilobytes)
+{
+    m_cache.setMaxCost(kilobytes);
+}
+
+int ImageLoader::maxCacheSize() const
+{
+    return m_cache.maxCost();
+}
+
+QImage ImageLoader::image(const QString &key) const
+{
+    QImage *image = m_cache.object(key);
+    return image != 0 ? *image : QImage();
+}
+
+void ImageLoader::loadData(const QString &key, const QByteArray &data, const QSize &maxSize)
+{
+    start(key, data, 0, Programme(), QTime(), maxSize);
+}
+
+void ImageLoader::loadPoster(const QString &key, Cache *cache, const Programme &programme, const QSize &maxSize)
+{
+    start(key, QByteArray(), cache, programme, QTime(), maxSize);
+}
+
+void ImageLoader::loadThumbnail(const QString &key, Cache *cache, const Programme &programme, const QTime &time,
+                                const QSize &maxSize)
+{
+    start(key, QByteArray(), cache, programme, time, maxSize);
+}
+
+void ImageLoader::start(const QString &key, const QByteArray &data, Cache *cache, const Programme &programme,
+                        const QTime &time, const QSize &maxSize)
+{
+    if (m_pending.contains(key)) {
+        return;
+    }
+
+    m_pending.insert(key);
+    m_threadPool->start(new ImageDecodeTask(this, key, data, cache, programme, time, maxSize));
+}
+
+QImage ImageLoader::decode(QIODevice *device, const QSize &maxSize)
+{
+    QImageReader reader(device);
+    QSize size = reader.size();
+
+    /* Kuva puretaan suoraan näyttökokoon. JPEG-kuvilla tämä on huomattavasti
+       nopeampaa kuin täysikokoisen kuvan pienentäminen jälkikäteen. */
+    if (maxSize.isValid() && size.isValid() &&
+        (size.width() > maxSize.width() || size.height() > maxSize.height())) {
+        size.scale(maxSize, Qt::KeepAspectRatio);
+        reader.setScaledSize(size);
+    }
+
+    QImage image = reader.read();
+
+    if (image.isNull()) {
+        qWarning() << reader.errorString();
+    }
+
+    return image;
+}
+
+void ImageLoader::decodeFinished(const QString &key, const QImage &image)
+{
+    m_pending.remove(key);
+
+    if (!image.isNull()) {
+        m_cache.insert(key, new QImage(image), qMax(1, image.byteCount() / 1024));
+    }
+
+    emit imageLoaded(key, image);
+}
@@ -0,0 +1,44 @@
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <QCache>
+#include <QImage>
+#include <QObject>
+#include <QSet>
+#include <QSize>
+#include <QTime>
+#include "programme.h"
+
+class QThreadPool;
+class Cache;
+
+class ImageLoader : public QObject
+{
+    Q_OBJECT
+public:
+    ImageLoader(QObject *parent = 0);
+    ~ImageLoader();
+    void setMaxCacheSize(int kilobytes);
+    int maxCacheSize() const;
+    QImage image(const QString &key) const;
+    void loadData(const QString &key, const QByteArray &data, const QSize &maxSize);
+    void loadPoster(const QString &key, Cache *cache, const Programme &programme, const QSize &maxSize);
+    void loadThumbnail(const QString &key, Cache *cache, const Programme &programme, const QTime &time,
+                       const QSize &maxSize);
+    static QImage decode(QIODevice *device, const QSize &maxSize);
+
+signals:
+    void imageLoaded(const QString &key, const QImage &image);
+
+private slots:
+    void decodeFinished(const QString &key, const QImage &image);
+
+private:
+    void start(const QString &key, const QByteArray &data, Cache *cache, const Programme &programme,
+               const QTime &time, const QSize &maxSize);
+    QThreadPool *m_threadPool;
+    QCache<QString, QImage> m_cache;
+    QSet<QString> m_pending;
+};
+
+#endif // IMAGELOADER_H
@@ -1,10 +1,17 @@
 #include <QApplication>
+#include <QDir>
 #include <QFileInfo>
 #include <QLocale>
+#include <QTimer>
 #include <QTranslator>
 #include <stdio.h>
 #include <stdlib.h>
+#include "headlessrunner.h"
 #include "mainwindow.h"
+#include "metrics.h"
+#include "networktracer.h"
+#include "profiler.h"
+#include "replaynetworkaccessmanager.h"
 
 void handleMessage(QtMsgType type, const char *msg, bool printDebugMessages)
 {
@@ -34,8 +41,50 @@ void debugMessageHandler(QtMsgType type, const char *msg)
     handleMessage(type, msg, true);
 }
 
+int runHeadless(int argc, char *argv[])
+{
+    /* Komentorivitila käyttää QCoreApplicationia, joten ikkunointia ei ladata lainkaan. */
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("TVkaistaGUI");
+
+    QSettings settings(QSettings::IniFormat, QSettings::UserScope,
+                       QCoreApplication::applicationName(),
+                       QCoreApplication::applicationName());
+
+    NetworkTracer::instance();
+    Metrics::instance();
+    QStringList arguments = app.arguments();
+
+    if (arguments.contains("-d") || arguments.contains("--debug")) {
+        qInstallMsgHandler(debugMessageHandler);
+    }
+    else {
+        qInstallMsgHandler(defaultMessageHandler);
+    }
+
+    HeadlessRunner runner(&settings);
+
+    if (!runner.parseArguments(arguments)) {
+        fprintf(stderr, "Usage:\n%s", qPrintable(HeadlessRunner::usage()));
+        return 1;
+    }
+
+    QTimer::singleShot(0, &runner, SLOT(start()));
+    return app.exec();
+}
+
 int main(int argc, char *argv[])
 {
+    for (int i = 1; i < argc; i++) {
+        if (qstrcmp(argv[i], "--headless") == 0) {
+            return runHeadless(argc, argv);
+        }
+    }
+
+#ifdef TVKAISTAGUI_PROFILER
+    Profiler::initialize();
+    QString profileFilename = "tvkaistagui.folded";
+#endif
     QApplication app(argc, argv);
     app.setApplicationName("TVkaistaGUI");
 
@@ -46,6 +95,16 @@ int main(int argc, char *argv[])
     QStringList arguments = app.arguments();
     int count = arguments.size();
     bool invalidArgs = false;
+    ReplayNetworkAccessManager *networkAccessManager = 0;
+    int latency = -1;
+    int bandwidth = 0;
+    QString traceFilename;
+    QString metricsFilename;
+    int metricsInterval = 60;
+
+    /* Seuranta ja mittarit luodaan ennen muita säikeitä. */
+    NetworkTracer::instance();
+    Metrics::instance();
 
     qInstallMsgHandler(defaultMessageHandler);
 
@@ -78,16 +137,100 @@ int main(int argc, char *argv[])
             settings.endGroup();
             settings.endGroup();
         }
+        else if (arg == "--record" || arg == "--replay") {
+            if (i + 1 >= count) {
+                invalidArgs = true;
+                continue;
+            }
+
+            /* Verkkoliikenne tallennetaan hakemistoon tai toistetaan siitä ilman yhteyttä palvelimeen. */
+            if (networkAccessManager == 0) {
+                networkAccessManager = new ReplayNetworkAccessManager();
+            }
+
+            QDir dir(arguments.at(++i));
+
+            if (arg == "--record") {
+                networkAccessManager->setRecordDirectory(dir);
+            }
+            else {
+                networkAccessManager->setReplayDirectory(dir);
+            }
+        }
+        else if (arg == "--trace") {
+            if (i + 1 >= count) {
+                invalidArgs = true;
+                continue;
+            }
+
+            /* Pyyntöjen vaiheet tallennetaan lopetettaessa Chromen trace_event-muodossa. */
+            traceFilename = arguments.at(++i);
+            NetworkTracer::instance()->setEnabled(true);
+        }
+        else if (arg == "--metrics") {
+            if (i + 1 >= count) {
+                invalidArgs = true;
+                continue;
+            }
+
+            /* Mittarit kirjoitetaan säännöllisesti JSON-muodossa (.json) tai Prometheus-tekstimuodossa. */
+            metricsFilename = arguments.at(++i);
+        }
+        else if (arg == "--metrics-interval") {
+            bool ok = false;
+            metricsInterval = i + 1 < count ? arguments.at(++i).toInt(&ok) : -1;
+
+            if (!ok || metricsInterval <= 0) {
+                invalidArgs = true;
+                continue;
+            }
+        }
+#ifdef TVKAISTAGUI_PROFILER
+        else if (arg == "--profile") {
+            if (i + 1 >= count) {
+                invalidArgs = true;
+                continue;
+            }
+
+            profileFilename = arguments.at(++i);
+        }
+#endif
+        else if (arg == "--latency" || arg == "--bandwidth") {
+            bool ok = false;
+            int value = i + 1 < count ? arguments.at(++i).toInt(&ok) : -1;
+
+            if (!ok || value < 0) {
+                invalidArgs = true;
+                continue;
+            }
+
+            if (arg == "--latency") {
+                latency = value;
+            }
+            else {
+                bandwidth = value * 1024;
+            }
+        }
         else {
             invalidArgs = true;
         }
     }
 
     if (invalidArgs) {
-        fprintf(stderr, "Usage: tvkaistagui [-d|--debug]");
+        fprintf(stderr, "Usage: tvkaistagui [-d|--debug] [-p|--http-proxy HOST:PORT]\n"
+                        "                   [--record DIR|--replay DIR [--latency MS] [--bandwidth KB/S]]\n"
+                        "                   [--trace FILE] [--metrics FILE [--metrics-interval SECS]]\n"
+                        "%s", qPrintable(HeadlessRunner::usage()));
         return 1;
     }
 
+    Metrics::instance()->setDumpFile(metricsFilename, metricsInterval * 1000);
+
+    if (networkAccessManager != 0) {
+        networkAccessManager->setLatency(latency);
+        networkAccessManager->setBandwidth(bandwidth);
+    }
+
 #ifdef TVKAISTAGUI_TRANSLATIONS_DIR
     QString translationsDir = TVKAISTAGUI_TRANSLATIONS_DIR;
 #else
@@ -98,7 +241,19 @@ int main(int argc, char *argv[])
     QTranslator qtTranslator;
     qtTranslator.load("qt_" + QLocale::system().name(), translationsDir);
     app.installTranslator(&qtTranslator);
-    MainWindow window;
+    MainWindow window(networkAccessManager);
     window.show();
-    return app.exec();
+    int result = app.exec();
+
+    if (!traceFilename.isEmpty()) {
+        NetworkTracer::instance()->writeChromeTrace(traceFilename);
+    }
+
+    Metrics::instance()->dump();
+
+#ifdef TVKAISTAGUI_PROFILER
+    Profiler::dump(profileFilename);
+#endif
+
+    return result;
 }
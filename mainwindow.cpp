@@ -8,25 +8,66 @@
 #include <QMessageBox>
 #include <QMovie>
 #include <QNetworkProxy>
+#include <QNetworkReply>
 #include <QPainter>
 #include <QProcess>
+#include <QSet>
 #include <QSignalMapper>
 #include <QTimer>
 #include "aboutdialog.h"
+#include "availabilitywatcher.h"
 #include "cache.h"
+#include "cachemanager.h"
 #include "downloader.h"
 #include "downloaddelegate.h"
 #include "downloadtablemodel.h"
 #include "historymanager.h"
+#include "imageloader.h"
+#include "metrics.h"
+#include "networktracedock.h"
+#include "playlisteditor.h"
+#include "posterprefetcher.h"
+#include "profiler.h"
 #include "programmefeedparser.h"
+#include "programmegridloader.h"
+#include "programmegridwindow.h"
 #include "programmetablemodel.h"
+#include "tsindexer.h"
 #include "tvkaistaclient.h"
 #include "screenshotwindow.h"
+#include "serverprober.h"
+#include "sessionmanager.h"
 #include "settingsdialog.h"
+#include "statisticsdialog.h"
+#include "streamserver.h"
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
-MainWindow::MainWindow(QWidget *parent) :
+static const int MaxAutoDownloadAttempts = 5;
+
+static QSet<int> programmeIds(const QList<Programme> &programmes)
+{
+    QSet<int> ids;
+    int count = programmes.size();
+
+    for (int i = 0; i < count; i++) {
+        ids.insert(programmes.at(i).id);
+    }
+
+    return ids;
+}
+
+static void recordFirstListing()
+{
+    /* Aika lasketaan ohjelman käynnistyksestä ensimmäiseen näytettyyn listaukseen. */
+    Metrics *metrics = Metrics::instance();
+
+    if (!metrics->values().contains("tvkaista_time_to_first_listing_ms")) {
+        metrics->setValue("tvkaista_time_to_first_listing_ms", metrics->uptime());
+    }
+}
+
+MainWindow::MainWindow(QNetworkAccessManager *networkAccessManager, QWidget *parent) :
     QMainWindow(parent), ui(new Ui::MainWindow),
     m_settings(QSettings::IniFormat, QSettings::UserScope,
                    QCoreApplication::applicationName(),
@@ -39,11 +80,26 @@ MainWindow::MainWindow(QWidget *parent) :
     m_playlistTableModel(new ProgrammeTableModel(m_historyManager, true, this)),
     m_seasonPassesTableModel(new ProgrammeTableModel(m_historyManager, true, this)),
     m_currentTableModel(m_programmeListTableModel),
-    m_cache(new Cache), m_settingsDialog(0), m_screenshotWindow(0),
+    m_cache(new Cache), m_cacheManager(new CacheManager(m_cache, this)), m_settingsDialog(0), m_screenshotWindow(0),
+    m_programmeGridWindow(0), m_networkTraceDock(0), m_statisticsDialog(0),
+    m_streamServer(new StreamServer(this)),
+    m_imageLoader(new ImageLoader(this)),
+    m_posterPrefetcher(new PosterPrefetcher(m_client, m_imageLoader, this)),
+    m_availabilityWatcher(new AvailabilityWatcher(m_client, this)),
+    m_playlistEditor(new PlaylistEditor(m_client, this)),
+    m_serverProber(new ServerProber(m_client, &m_settings, this)),
+    m_descriptionLoader(new ProgrammeGridLoader(m_client, this)),
+    m_programmeLoadWatcher(new QFutureWatcher<ProgrammeCacheResult>(this)),
     m_currentChannelId(-1), m_searchIcon(":/images/list-22x22.png"),
-    m_downloading(false), m_currentView(0)
+    m_downloading(false), m_programmeLoadRefresh(false), m_autoDownload(false), m_currentView(0),
+    m_failedEdits(0), m_seasonPassesEdited(false)
 {
     ui->setupUi(this);
+
+    if (networkAccessManager != 0) {
+        m_client->setNetworkAccessManager(networkAccessManager);
+    }
+
     m_client->setCache(m_cache);
     m_downloadTableModel->setClient(m_client);
     ui->calendarWidget->setFirstDayOfWeek(Qt::Monday);
@@ -57,6 +113,7 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->downloadsTableView->setItemDelegateForColumn(0, new DownloadDelegate(this));
     ui->downloadsTableView->viewport()->installEventFilter(this);
     ui->programmeTableView->setModel(m_programmeListTableModel);
+    m_posterPrefetcher->setView(ui->programmeTableView);
     ui->channelListWidget->addAction(ui->actionRefreshChannels);
     ui->channelListWidget->setContextMenuPolicy(Qt::ActionsContextMenu);
     ui->calendarWidget->addAction(ui->actionCurrentDay);
@@ -72,9 +129,6 @@ MainWindow::MainWindow(QWidget *parent) :
     m_loadMovie->setFileName(":/images/load-32x32.gif");
     m_loadLabel = new QLabel(this);
     m_loadLabel->setMinimumSize(47, 32);
-    m_posterTimer = new QTimer(this);
-    m_posterTimer->setSingleShot(false);
-    connect(m_posterTimer, SIGNAL(timeout()), SLOT(posterTimeout()));
     QAction *searchAction = new QAction(this);
     searchAction->setText(trUtf8("Hae"));
     m_searchToolButton = new QToolButton(this);
@@ -102,6 +156,9 @@ MainWindow::MainWindow(QWidget *parent) :
     painter.fillRect(m_noPosterImage.rect(), QBrush(ui->descriptionTextEdit->palette().color(QPalette::Base)));
     painter.end();
 
+    /* Kuvan ympärille piirretään addBorderToPoster()-funktiossa 4 pikselin reunus. */
+    m_posterPrefetcher->setPosterSize(m_noPosterImage.size() - QSize(8, 8));
+
     m_formatComboBox->addItems(videoFormats());
 
     ui->actionProgrammeList->setChecked(true);
@@ -144,6 +201,8 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->actionQuit, SIGNAL(triggered()), SLOT(close()));
     connect(ui->actionDownloads, SIGNAL(triggered()), SLOT(toggleDownloadsDockWidget()));
     connect(ui->actionShortcuts, SIGNAL(triggered()), SLOT(toggleShortcutsDockWidget()));
+    connect(ui->actionNetworkTrace, SIGNAL(triggered()), SLOT(toggleNetworkTraceDockWidget()));
+    connect(ui->actionStatistics, SIGNAL(triggered()), SLOT(openStatisticsDialog()));
     connect(ui->actionRefresh, SIGNAL(triggered()), SLOT(refreshProgrammes()));
     connect(ui->actionRefreshButton, SIGNAL(triggered()), SLOT(refreshProgrammes()));
     connect(ui->actionCurrentDay, SIGNAL(triggered()), SLOT(goToCurrentDay()));
@@ -153,6 +212,7 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(ui->actionWatch, SIGNAL(triggered()), SLOT(watchProgramme()));    
     connect(ui->actionDownload, SIGNAL(triggered()), SLOT(downloadProgramme()));
     connect(ui->actionScreenshots, SIGNAL(triggered()), SLOT(openScreenshotWindow()));
+    connect(ui->actionProgrammeGrid, SIGNAL(triggered()), SLOT(openProgrammeGridWindow()));
     connect(ui->actionProgrammeList, SIGNAL(triggered()), SLOT(showProgrammeList()));
     connect(ui->actionProgrammeListButton, SIGNAL(triggered()), SLOT(showProgrammeList()));
     connect(ui->actionSearchResults, SIGNAL(triggered()), SLOT(showSearchResults()));
@@ -186,18 +246,39 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(m_searchToolButton, SIGNAL(clicked()), SLOT(search()));
     connect(m_client, SIGNAL(channelsFetched(QList<Channel>)), SLOT(channelsFetched(QList<Channel>)));
     connect(m_client, SIGNAL(programmesFetched(int,QDate,QList<Programme>)), SLOT(programmesFetched(int,QDate,QList<Programme>)));
-    connect(m_client, SIGNAL(posterFetched(Programme,QImage)), SLOT(posterFetched(Programme,QImage)));
+    connect(m_descriptionLoader, SIGNAL(programmesLoaded(int,QList<Programme>)),
+            SLOT(descriptionListingLoaded(int,QList<Programme>)));
+    connect(m_programmeLoadWatcher, SIGNAL(finished()), SLOT(programmesLoaded()));
+    connect(m_availabilityWatcher, SIGNAL(programmeAvailable(Programme)), SLOT(programmeAvailable(Programme)));
+    connect(m_imageLoader, SIGNAL(imageLoaded(QString,QImage)), SLOT(imageLoaded(QString,QImage)));
     connect(m_client, SIGNAL(streamUrlFetched(Programme,int,QUrl)), SLOT(streamUrlFetched(Programme,int,QUrl)));
     connect(m_client, SIGNAL(searchResultsFetched(QList<Programme>)), SLOT(searchResultsFetched(QList<Programme>)));
     connect(m_client, SIGNAL(playlistFetched(QList<Programme>)), SLOT(playlistFetched(QList<Programme>)));
     connect(m_client, SIGNAL(seasonPassListFetched(QList<Programme>)), SLOT(seasonPassListFetched(QList<Programme>)));
     connect(m_client, SIGNAL(seasonPassIndexFetched(QMap<QString,int>)), SLOT(seasonPassIndexFetched(QMap<QString,int>)));
-    connect(m_client, SIGNAL(editRequestFinished(int,bool)), SLOT(editRequestFinished(int, bool)));
+    connect(m_playlistEditor, SIGNAL(editFinished(int,Programme,bool)), SLOT(editFinished(int,Programme,bool)));
+    connect(m_playlistEditor, SIGNAL(finished()), SLOT(editsFinished()));
+    connect(m_playlistEditor, SIGNAL(playlistReconciled(QList<Programme>)), SLOT(playlistReconciled(QList<Programme>)));
+    connect(m_playlistEditor, SIGNAL(seasonPassesReconciled(QList<Programme>,QMap<QString,int>)),
+            SLOT(seasonPassesReconciled(QList<Programme>,QMap<QString,int>)));
     connect(m_client, SIGNAL(networkError()), SLOT(networkError()));
     connect(m_client, SIGNAL(loginError()), SLOT(loginError()));
     connect(m_client, SIGNAL(streamNotFound()), SLOT(streamNotFound()));
     connect(m_downloadTableModel, SIGNAL(downloadStatusChanged(int)), SLOT(downloadStatusChanged(int)));
 
+    /* Valitun ohjelman tallenteen osoite selvitetään hetken viiveellä, kun valinta on asettunut. */
+    m_streamResolveTimer = new QTimer(this);
+    m_streamResolveTimer->setSingleShot(true);
+    m_streamResolveTimer->setInterval(500);
+    connect(m_streamResolveTimer, SIGNAL(timeout()), SLOT(resolveStreamUrl()));
+
+    m_autoDownloadReply = 0;
+    m_autoDownloadAttempts = 0;
+    m_autoDownloadTimer = new QTimer(this);
+    m_autoDownloadTimer->setSingleShot(true);
+    m_autoDownloadTimer->setInterval(5000);
+    connect(m_autoDownloadTimer, SIGNAL(timeout()), SLOT(startAutoDownload()));
+
     QAction *action = new QAction(this);
     action->setShortcut(Qt::Key_F2);
     connect(action, SIGNAL(triggered()), ui->programmeTableView, SLOT(setFocus()));
@@ -278,6 +359,7 @@ MainWindow::MainWindow(QWidget *parent) :
     m_cache->setDirectory(QDir(cacheDirPath));
     m_formatComboBox->setCurrentIndex(format);
     loadClientSettings();
+    m_cacheManager->start();
     setFormat(format);
     m_historyManager->load();
 
@@ -313,6 +395,20 @@ MainWindow::MainWindow(QWidget *parent) :
     addServer(trUtf8("Saksa"), "8031916+6913675");
     addServer(trUtf8("Yhdysvallat"), "7064662+909967");
 
+    /* Palvelinten nopeus mitataan taustalla, ja nopein merkitään valikkoon. */
+    ui->menuServer->addSeparator();
+    QAction *probeAction = ui->menuServer->addAction(trUtf8("&Mittaa palvelinten nopeus"));
+    m_autoServerAction = ui->menuServer->addAction(trUtf8("&Valitse nopein automaattisesti"));
+    m_autoServerAction->setCheckable(true);
+    m_settings.beginGroup("client");
+    m_autoServerAction->setChecked(m_settings.value("autoServer", false).toBool());
+    m_settings.endGroup();
+    connect(probeAction, SIGNAL(triggered()), m_serverProber, SLOT(probe()));
+    connect(m_serverProber, SIGNAL(serverProbed(QString)), SLOT(updateServerActions()));
+    connect(m_serverProber, SIGNAL(finished()), SLOT(serverProbeFinished()));
+    connect(m_downloadTableModel, SIGNAL(downloadStalled(int)), m_serverProber, SLOT(downloadStalled()));
+    updateServerActions();
+
     QString version = m_settings.value("version").toString();
 
     if (version.isEmpty() || version < "1.1.2") {
@@ -379,6 +475,7 @@ void MainWindow::closeEvent(QCloseEvent *e)
         }
     }
 
+    m_cacheManager->stop();
     m_settings.setValue("version", APP_VERSION);
 
     m_settings.beginGroup("mainWindow");
@@ -406,6 +503,7 @@ void MainWindow::closeEvent(QCloseEvent *e)
     m_settings.setValue("cookies", m_client->cookies());
     m_settings.setValue("format", m_formatComboBox->currentIndex());
     m_settings.setValue("server", m_client->server());
+    m_settings.setValue("autoServer", m_autoServerAction->isChecked());
     m_settings.endGroup();
 
     m_downloadTableModel->abortAllDownloads();
@@ -468,15 +566,10 @@ void MainWindow::programmeSelectionChanged()
     bool posterVisible = m_settings.value("posterVisible", true).toBool();
     m_settings.endGroup();
     m_posterImage = m_noPosterImage;
-    m_posterTimer->stop();
+    m_posterPrefetcher->setEnabled(posterVisible);
 
     if (m_currentProgramme.id >= 0 && (m_currentProgramme.flags & 0x08) == 0 && posterVisible) {
-        if (m_client->isRequestUnfinished()) {
-            m_posterTimer->start(500);
-        }
-        else {
-            fetchPoster();
-        }
+        fetchPoster();
     }
 
     /* Ohjelmaa ei voi poistaa sarjoista, jos season pass id:tä ei ole haettu. */
@@ -486,6 +579,7 @@ void MainWindow::programmeSelectionChanged()
     ui->addToPlaylistPushButton->setEnabled(true);
     ui->actionAddToPlaylist->setEnabled(true);
     updateDescription();
+    m_streamResolveTimer->start();
 }
 
 void MainWindow::downloadSelectionChanged()
@@ -626,6 +720,26 @@ void MainWindow::watchProgramme()
         return;
     }
 
+    /* Jos ohjelmaa ladataan parhaillaan, toistetaan se latautuvasta tiedostosta
+       paikallisen HTTP-palvelimen kautta, jolloin samaa dataa ei siirretä kahdesti. */
+    int row = m_downloadTableModel->downloadingRowForProgramme(m_currentProgramme.id);
+
+    if (row >= 0 && m_downloadTableModel->videoFormat(row) == m_formatComboBox->currentIndex() &&
+        m_streamServer->start()) {
+        m_settings.beginGroup("mediaPlayer");
+        QString command = m_settings.value("stream").toString();
+        m_settings.endGroup();
+
+        if (command.isEmpty()) {
+            command = defaultStreamPlayerCommand();
+        }
+
+        addHistoryEntry(m_currentProgramme.id);
+        startMediaPlayer(command, m_streamServer->url(m_downloadTableModel->downloader(row)).toString(),
+                         m_downloadTableModel->videoFormat(row));
+        return;
+    }
+
     m_downloading = false;
     m_client->sendStreamRequest(m_currentProgramme);
     startLoadingAnimation();
@@ -658,6 +772,7 @@ void MainWindow::openScreenshotWindow()
     if (m_screenshotWindow == 0) {
         m_screenshotWindow = new ScreenshotWindow(&m_settings, this);
         m_screenshotWindow->setClient(m_client);
+        m_screenshotWindow->setImageLoader(m_imageLoader);
     }
     else {
         m_screenshotWindow->activateWindow();
@@ -667,6 +782,114 @@ void MainWindow::openScreenshotWindow()
     m_screenshotWindow->show();
 }
 
+void MainWindow::openProgrammeGridWindow()
+{
+    if (m_programmeGridWindow == 0) {
+        m_programmeGridWindow = new ProgrammeGridWindow(m_client, &m_settings, this);
+        connect(m_programmeGridWindow, SIGNAL(programmeActivated(int,QDate,int)),
+                SLOT(gridProgrammeActivated(int,QDate,int)));
+    }
+    else {
+        m_programmeGridWindow->activateWindow();
+    }
+
+    m_programmeGridWindow->setChannels(m_channels);
+    m_programmeGridWindow->fetchProgrammes(m_currentDate.isValid() ? m_currentDate : QDate::currentDate(), false);
+    m_programmeGridWindow->show();
+}
+
+void MainWindow::gridProgrammeActivated(int channelId, const QDate &date, int programmeId)
+{
+    Q_UNUSED(programmeId);
+    int count = m_channels.size();
+
+    for (int i = 0; i < count; i++) {
+        if (m_channels.at(i).id == channelId) {
+            m_currentDate = date;
+            selectChannel(i);
+            activateWindow();
+            return;
+        }
+    }
+}
+
+void MainWindow::programmeAvailable(const Programme &programme)
+{
+    updateProgrammeFlags(programme);
+
+    if (m_autoDownload && m_downloadTableModel->rowForProgramme(programme.id) < 0) {
+        m_autoDownloadQueue.append(programme);
+        startAutoDownload();
+    }
+}
+
+void MainWindow::startAutoDownload()
+{
+    /* Osoite haetaan erillisellä pyynnöllä, joten käyttäjän omat pyynnöt eivät keskeytä sitä.
+       Ohjelma pysyy jonossa, kunnes sen lataus on käynnistetty. */
+    if (m_autoDownloadQueue.isEmpty() || m_autoDownloadReply != 0) {
+        return;
+    }
+
+    m_autoDownloadReply = m_client->sendStreamUrlRequest(m_autoDownloadQueue.first(), m_client->format(),
+                                                         m_client->server());
+    m_autoDownloadReply->setProperty("format", m_client->format());
+    connect(m_autoDownloadReply, SIGNAL(finished()), SLOT(autoDownloadUrlFetched()));
+}
+
+void MainWindow::autoDownloadUrlFetched()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || reply != m_autoDownloadReply || m_autoDownloadQueue.isEmpty()) {
+        return;
+    }
+
+    m_autoDownloadReply = 0;
+    reply->deleteLater();
+    QUrl url = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    bool redirected = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 302;
+    bool done = true;
+
+    if (redirected && url.path().startsWith("/login")) {
+        /* Yritetään uudelleen, kun istunto on uusittu. */
+        m_client->session()->renew(reply);
+        done = false;
+    }
+    else if (redirected) {
+        Programme programme = m_autoDownloadQueue.takeFirst();
+
+        if (m_downloadTableModel->rowForProgramme(programme.id) < 0) {
+            m_downloadTableModel->download(programme, reply->property("format").toInt(),
+                                           m_channelMap.value(programme.channelId), url);
+            ui->downloadsTableView->resizeColumnToContents(0);
+            ui->downloadsTableView->resizeRowsToContents();
+        }
+    }
+    else if (reply->error() == QNetworkReply::NoError || reply->error() == QNetworkReply::ContentNotFoundError) {
+        qDebug() << "Auto download not found" << m_autoDownloadQueue.first().id;
+        m_autoDownloadQueue.removeFirst();
+    }
+    else {
+        done = false;
+    }
+
+    /* Muut virheet yritetään uudelleen, joten ohjelma jää jonon alkuun. Yritykset rajoitetaan,
+       jotta jatkuvasti epäonnistuva ohjelma ei estä muiden ohjelmien latausta. */
+    if (done) {
+        m_autoDownloadAttempts = 0;
+    }
+    else if (++m_autoDownloadAttempts >= MaxAutoDownloadAttempts) {
+        qWarning() << "Auto download failed" << m_autoDownloadQueue.first().id << reply->errorString();
+        m_autoDownloadQueue.removeFirst();
+        m_autoDownloadAttempts = 0;
+    }
+
+    if (!m_autoDownloadQueue.isEmpty() && !m_autoDownloadTimer->isActive()) {
+        m_autoDownloadTimer->start();
+    }
+}
+
 void MainWindow::openSettingsDialog()
 {
     if (m_settingsDialog != 0) {
@@ -790,6 +1013,8 @@ void MainWindow::removeDownload()
             if (file.exists() && !file.remove()) {
                 qWarning() << file.errorString();
             }
+
+            QFile::remove(TsIndexer::indexFilename(filename));
         }
     }
 
@@ -937,6 +1162,7 @@ void MainWindow::showSeasonPasses()
 
 bool MainWindow::setCurrentView(int view)
 {
+    PROFILE_ZONE("MainWindow::setCurrentView");
     if (m_currentView == view) {
         return false;
     }
@@ -1011,6 +1237,30 @@ void MainWindow::toggleShortcutsDockWidget()
     ui->shortcutsDockWidget->setVisible(!ui->shortcutsDockWidget->isVisible());
 }
 
+void MainWindow::toggleNetworkTraceDockWidget()
+{
+    /* Seuranta on käytössä vain, kun paneeli on näkyvissä tai ohjelma on käynnistetty valitsimella --trace. */
+    if (m_networkTraceDock == 0) {
+        m_networkTraceDock = new NetworkTraceDock(this);
+        addDockWidget(Qt::BottomDockWidgetArea, m_networkTraceDock);
+        m_networkTraceDock->show();
+        return;
+    }
+
+    m_networkTraceDock->setVisible(!m_networkTraceDock->isVisible());
+}
+
+void MainWindow::openStatisticsDialog()
+{
+    if (m_statisticsDialog == 0) {
+        m_statisticsDialog = new StatisticsDialog(this);
+    }
+
+    m_statisticsDialog->show();
+    m_statisticsDialog->raise();
+    m_statisticsDialog->activateWindow();
+}
+
 void MainWindow::selectChannel(int index)
 {
     if (index < 0 || index >= m_channels.size()) {
@@ -1047,42 +1297,49 @@ void MainWindow::setFocusToDownloadsList()
 
 void MainWindow::addToPlaylist()
 {
-    if (m_currentProgramme.id < 0) {
-        return;
-    }
+    QList<Programme> programmes = selectedProgrammes();
+    int type = m_currentView == 2 ? 2 : 1;
+    int count = programmes.size();
 
-    if (m_currentView == 2) {
-        m_client->sendPlaylistRemoveRequest(m_currentProgramme.id);
-        m_playlistTableModel->setRemovedByProgrammeId(m_currentProgramme.id);
-    }
-    else {
-        m_client->sendPlaylistAddRequest(m_currentProgramme.id);
+    /* Näkymä päivitetään heti. Epäonnistuneet muokkaukset perutaan editFinished():ssä. */
+    applyEdits(type, programmes, false);
+
+    for (int i = 0; i < count; i++) {
+        m_playlistEditor->edit(type, programmes.at(i));
     }
 
-    ui->addToPlaylistPushButton->setEnabled(false);
-    ui->actionAddToPlaylist->setEnabled(false);
-    m_cache->removePlaylist();
-    startLoadingAnimation();
+    if (count > 0) {
+        startLoadingAnimation();
+    }
 }
 
 void MainWindow::addToSeasonPass()
 {
-    if (m_currentProgramme.id < 0) {
-        return;
-    }
+    QList<Programme> programmes = selectedProgrammes();
+    int type = m_currentView == 3 ? 4 : 3;
+    QList<Programme> edited;
+    QSet<int> seasonPassIds;
+    int count = programmes.size();
 
-    if (m_currentView == 3) {
-        m_client->sendSeasonPassRemoveRequest(m_currentProgramme.seasonPassId);
-        m_seasonPassesTableModel->setRemovedBySeasonPassId(m_currentProgramme.seasonPassId);
-    }
-    else {
-        m_client->sendSeasonPassAddRequest(m_currentProgramme.id);
+    for (int i = 0; i < count; i++) {
+        Programme programme = programmes.at(i);
+
+        /* Sarja poistetaan vain kerran, vaikka siitä olisi valittu useampi jakso. */
+        if (type == 4 && (programme.seasonPassId < 0 || seasonPassIds.contains(programme.seasonPassId))) {
+            continue;
+        }
+
+        seasonPassIds.insert(programme.seasonPassId);
+        edited.append(programme);
+        m_playlistEditor->edit(type, programme);
+        m_seasonPassesEdited = true;
     }
 
-    ui->addToSeasonPassPushButton->setEnabled(false);
-    ui->actionAddToSeasonPass->setEnabled(false);
-    m_cache->removeSeasonPasses();
-    startLoadingAnimation();
+    applyEdits(type, edited, false);
+
+    if (m_seasonPassesEdited) {
+        startLoadingAnimation();
+    }
 }
 
 void MainWindow::removeHistoryEntry()
@@ -1184,6 +1441,53 @@ void MainWindow::setCurrentServer(int index)
     m_client->setServer(m_serverActions.at(index)->data().toString());
 }
 
+void MainWindow::resolveStreamUrl()
+{
+    QDateTime end = m_currentProgramme.startDateTime.addSecs(qMax(0, m_currentProgramme.duration));
+
+    if (m_currentProgramme.id >= 0 && end < QDateTime::currentDateTime() &&
+        AvailabilityWatcher::isAvailable(m_currentProgramme, m_client->format())) {
+        m_client->resolveStreamUrl(m_currentProgramme);
+    }
+}
+
+void MainWindow::updateServerActions()
+{
+    int fastest = m_serverProber->fastestServer();
+    int count = m_serverActions.size();
+
+    for (int i = 0; i < count; i++) {
+        QAction *action = m_serverActions.at(i);
+        ServerProbeResult result = m_serverProber->lastResult(action->data().toString());
+        QString text = QString("&%1 %2").arg(i + 1).arg(m_serverNames.at(i));
+
+        if (result.rtt >= 0) {
+            text.append(trUtf8(" (%1 ms, %2 kt/s)").arg(result.rtt).arg(qRound(result.throughput)));
+        }
+        else if (result.dateTime.isValid()) {
+            text.append(trUtf8(" (ei vastausta)"));
+        }
+
+        if (i == fastest) {
+            text.append(trUtf8(" - nopein"));
+        }
+
+        action->setText(text);
+    }
+}
+
+void MainWindow::serverProbeFinished()
+{
+    updateServerActions();
+    int fastest = m_serverProber->fastestServer();
+
+    if (m_autoServerAction->isChecked() && fastest >= 0 &&
+        m_serverActions.at(fastest)->data().toString() != m_client->server()) {
+        qDebug() << "Fastest server" << m_serverActions.at(fastest)->data().toString();
+        setCurrentServer(fastest);
+    }
+}
+
 void MainWindow::channelsFetched(const QList<Channel> &channels)
 {
     m_channels = channels;
@@ -1206,6 +1510,8 @@ void MainWindow::programmesFetched(int channelId, const QDate &date, const QList
     }
     else {
         m_programmeListTableModel->setProgrammes(programmes);
+        m_serverProber->setProgrammes(programmes);
+        recordFirstListing();
     }
 
     stopLoadingAnimation();
@@ -1215,13 +1521,35 @@ void MainWindow::programmesFetched(int channelId, const QDate &date, const QList
     scrollProgrammes();
 }
 
-void MainWindow::posterFetched(const Programme &programme, const QImage &poster)
+void MainWindow::descriptionListingLoaded(int channelId, const QList<Programme> &programmes)
 {
-    if (m_currentProgramme.id != programme.id) {
+    if (m_currentView != 0 || channelId != m_currentChannelId || m_descriptionLoader->date() != m_currentDate ||
+        programmes.isEmpty()) {
         return;
     }
 
-    m_posterImage = poster;
+    int programmeId = m_currentProgramme.id;
+    m_programmeListTableModel->setProgrammes(programmes);
+
+    /* Valitaan sama ohjelma uudelleen, jolloin kuvaus päivittyy. */
+    for (int i = 0; i < m_programmeListTableModel->programmeCount(); i++) {
+        if (m_programmeListTableModel->programme(i).id == programmeId) {
+            QModelIndex index = m_programmeListTableModel->index(i, 0, QModelIndex());
+            ui->programmeTableView->selectionModel()->select(
+                    index, QItemSelectionModel::ClearAndSelect | QItemSelectionModel::Rows);
+            ui->programmeTableView->setCurrentIndex(index);
+            break;
+        }
+    }
+}
+
+void MainWindow::imageLoaded(const QString &key, const QImage &image)
+{
+    if (image.isNull() || key != PosterPrefetcher::posterKey(m_currentProgramme)) {
+        return;
+    }
+
+    m_posterImage = image;
     addBorderToPoster();
     updateDescription();
 }
@@ -1229,26 +1557,34 @@ void MainWindow::posterFetched(const Programme &programme, const QImage &poster)
 void MainWindow::streamUrlFetched(const Programme &programme, int format, const QUrl &url)
 {
     stopLoadingAnimation();
+    m_settings.beginGroup("mediaPlayer");
+    QString command = m_settings.value("stream").toString();
+    bool keepStreams = m_settings.value("keepStreams", false).toBool();
+    m_settings.endGroup();
+
+    /* Katsottava ohjelma voidaan samalla tallentaa, jolloin soitin lukee latautuvaa
+       tiedostoa paikallisen HTTP-palvelimen kautta. */
+    bool keep = !m_downloading && keepStreams && m_streamServer->start();
+    int row = -1;
 
-    if (m_downloading) {
-        int row = m_downloadTableModel->download(
+    if (m_downloading || keep) {
+        row = m_downloadTableModel->download(
                 programme, format, m_channelMap.value(programme.channelId), url);
         ui->downloadsTableView->resizeColumnToContents(0);
         ui->downloadsTableView->resizeRowsToContents();
         ui->downloadsTableView->scrollTo(m_downloadTableModel->index(row, 0, QModelIndex()));
         downloadSelectionChanged();
     }
-    else {
+
+    if (!m_downloading) {
         addHistoryEntry(programme.id);
-        m_settings.beginGroup("mediaPlayer");
-        QString command = m_settings.value("stream").toString();
-        m_settings.endGroup();
 
         if (command.isEmpty()) {
             command = defaultStreamPlayerCommand();
         }
 
-        startMediaPlayer(command, url.toString(), format);
+        QString urlString = keep ? m_streamServer->url(m_downloadTableModel->downloader(row)).toString() : url.toString();
+        startMediaPlayer(command, urlString, format);
     }
 }
 
@@ -1298,71 +1634,76 @@ void MainWindow::seasonPassIndexFetched(const QMap<QString, int> &seasonPasses)
     stopLoadingAnimation();
 }
 
-void MainWindow::editRequestFinished(int type, bool ok)
+void MainWindow::editFinished(int type, const Programme &programme, bool ok)
 {
-    QString text;
+    if (ok) {
+        return;
+    }
 
-    if (type == 1) { /* Ohjelma lisätty listaan. */
-        if (ok) {
-            fetchPlaylist(true);
-            text = trUtf8("Ohjelma on lisätty katselulistaan.");
-        }
-        else {
-            stopLoadingAnimation();
-            text = trUtf8("Ohjelma on jo aiemmin lisätty katselulistaan.");
-        }
+    m_failedEdits++;
+
+    /* Sarjan poistoa ei voi perua paikallisesti, koska poistetut jaksot eivät ole tallessa. */
+    if (type == 4) {
+        m_seasonPassesEdited = true;
     }
-    else if (type == 2) { /* Ohjelma poistettu listasta. */
-        if (ok) {
-            fetchPlaylist(true);
-            text = trUtf8("Ohjelma on poistettu katselulistasta.");
-        }
-        else {
-            stopLoadingAnimation();
-            text = trUtf8("Ohjelman poistaminen epäonnistui.");
-        }
+    else {
+        applyEdits(type, QList<Programme>() << programme, true);
     }
-    else if (type == 3) { /* Ohjelma lisätty sarjoihin. */
-        if (ok) {
-            fetchSeasonPasses(true);
-            text = trUtf8("Ohjelma on lisätty suosikkisarjoihin.");
-        }
-        else {
-            stopLoadingAnimation();
-            text = trUtf8("Ohjelma on jo aiemmin lisätty suosikkisarjoihin.");
-        }
+}
+
+void MainWindow::editsFinished()
+{
+    stopLoadingAnimation();
+
+    /* Lisätyn sarjan jaksot ja tunnisteet saadaan vasta palvelimelta. */
+    if (m_seasonPassesEdited) {
+        m_seasonPassesEdited = false;
+        QTimer::singleShot(2000, m_playlistEditor, SLOT(reconcile()));
     }
-    else if (type == 4) { /* Ohjelma poistettu sarjoista. */
-        if (ok) {
-            fetchSeasonPasses(true);
-            text = trUtf8("Ohjelma on poistettu suosikkisarjoista.");
-        }
-        else {
-            stopLoadingAnimation();
-            text = trUtf8("Ohjelman poistaminen epäonnistui.");
-        }
+
+    if (m_failedEdits == 0) {
+        return;
     }
 
-    if (!text.isEmpty()) {
-        QMessageBox msgBox(this);
-        msgBox.setWindowTitle(windowTitle());
-        msgBox.setIcon(QMessageBox::Information);
-        msgBox.setText(text);
-        msgBox.setStandardButtons(QMessageBox::Ok);
-        msgBox.exec();
+    QMessageBox msgBox(this);
+    msgBox.setWindowTitle(windowTitle());
+    msgBox.setIcon(QMessageBox::Information);
+    msgBox.setText(trUtf8("%1 muokkausta epäonnistui. Muutokset on peruttu.").arg(m_failedEdits));
+    msgBox.setStandardButtons(QMessageBox::Ok);
+    m_failedEdits = 0;
+    msgBox.exec();
+}
+
+void MainWindow::playlistReconciled(const QList<Programme> &programmes)
+{
+    if (!m_playlistEditor->isIdle()) {
+        return;
+    }
+
+    m_cache->savePlaylist(QDateTime::currentDateTime(), programmes);
+
+    if (programmeIds(programmes) != programmeIds(m_playlistTableModel->programmes())) {
+        qDebug() << "Playlist changed on server";
+        updatePlaylist(programmes);
     }
 }
 
-void MainWindow::posterTimeout()
+void MainWindow::seasonPassesReconciled(const QList<Programme> &programmes, const QMap<QString, int> &seasonPasses)
 {
-    if (m_client->isRequestUnfinished()) {
+    if (!m_playlistEditor->isIdle()) {
         return;
     }
 
-    m_posterTimer->stop();
+    if (programmeIds(programmes) != programmeIds(m_seasonPassesTableModel->programmes())) {
+        qDebug() << "Season passes changed on server";
+        updateSeasonPasses(programmes);
+    }
+
+    m_seasonPassesTableModel->setSeasonPasses(seasonPasses);
+    m_cache->saveSeasonPasses(QDateTime::currentDateTime(), m_seasonPassesTableModel->programmes());
 
-    if (fetchPoster()) {
-        updateDescription();
+    if (m_currentView == 3) {
+        programmeSelectionChanged();
     }
 }
 
@@ -1402,6 +1743,9 @@ void MainWindow::loginError()
 void MainWindow::streamNotFound()
 {
     stopLoadingAnimation();
+
+    /* Tulevan ohjelman saatavuutta seurataan, jotta se voidaan päivittää listaan. */
+    m_availabilityWatcher->watch(m_currentProgramme);
     QMessageBox msgBox(this);
     msgBox.setWindowTitle(windowTitle());
     msgBox.setIcon(QMessageBox::Information);
@@ -1429,19 +1773,30 @@ void MainWindow::fetchChannels(bool refresh)
 
 void MainWindow::fetchProgrammes(int channelId, const QDate &date, bool refresh)
 {
+    PROFILE_ZONE("MainWindow::fetchProgrammes");
     if (channelId < 0 || date.isNull()) {
         return;
     }
 
-    bool ok;
-    int age;
-    QList<Programme> programmes = m_cache->loadProgrammes(channelId, date, ok, age);
+    /* Välimuistitiedosto luetaan taustasäikeessä. Uusi pyyntö korvaa kesken olevan. */
+    m_programmeLoadRefresh = refresh;
+    m_programmeLoadWatcher->setFuture(m_cache->loadProgrammesAsync(channelId, date));
+}
+
+void MainWindow::programmesLoaded()
+{
+    PROFILE_ZONE("MainWindow::programmesLoaded");
+    ProgrammeCacheResult result = m_programmeLoadWatcher->result();
+    int channelId = result.channelId;
+    QDate date = result.date;
+    QList<Programme> programmes = result.programmes;
+    bool ok = result.ok;
 
     if (programmes.isEmpty()) {
         ok = false;
     }
 
-    if (ok && (!refresh || age < 30)) {
+    if (ok && (!m_programmeLoadRefresh || result.age < 30)) {
         m_currentChannelId = channelId;
         m_currentDate = date;
 
@@ -1450,6 +1805,8 @@ void MainWindow::fetchProgrammes(int channelId, const QDate &date, bool refresh)
         }
 
         m_programmeListTableModel->setProgrammes(programmes);
+        m_serverProber->setProgrammes(programmes);
+        recordFirstListing();
         updateWindowTitle();
         updateCalendar();
         scrollProgrammes();
@@ -1513,17 +1870,16 @@ void MainWindow::fetchSeasonPasses(bool refresh)
 
 bool MainWindow::fetchPoster()
 {
-    m_posterImage = m_cache->loadPoster(m_currentProgramme);
+    m_posterImage = m_imageLoader->image(PosterPrefetcher::posterKey(m_currentProgramme));
+    m_posterPrefetcher->fetch(m_currentProgramme);
 
     if (m_posterImage.isNull()) {
-        m_client->sendPosterRequest(m_currentProgramme);
+        /* Kuva näytetään imageLoaded()-slotissa, kun se on haettu ja purettu. */
         m_posterImage = m_noPosterImage;
         return false;
     }
-    else {
-        addBorderToPoster();
-    }
 
+    addBorderToPoster();
     return true;
 }
 
@@ -1549,6 +1905,15 @@ void MainWindow::loadClientSettings()
 
     m_client->setProxy(proxy);
     m_settings.endGroup();
+
+    m_autoDownload = m_settings.value("autoDownloadAvailable", false).toBool();
+
+    /* Välimuistin koko ja kiintiöt megatavuina, 0 = ei rajaa */
+    qint64 mb = 1024 * 1024;
+    m_cache->setLimits(qMax(0, m_settings.value("cacheSize", 500).toInt()) * mb,
+                       qMax(0, m_settings.value("cacheListingsSize", 100).toInt()) * mb,
+                       qMax(0, m_settings.value("cachePostersSize", 250).toInt()) * mb,
+                       qMax(0, m_settings.value("cacheThumbnailsSize", 250).toInt()) * mb);
     m_settings.endGroup();
 }
 
@@ -1561,6 +1926,8 @@ void MainWindow::addServer(const QString &name, const QString &serverId)
     action->setChecked(m_client->server() == serverId);
     action->setData(serverId);
     m_serverActions.append(action);
+    m_serverNames.append(name);
+    m_serverProber->addServer(serverId);
     m_serverSignalMapper->setMapping(action, index);
     connect(action, SIGNAL(triggered()), m_serverSignalMapper, SLOT(map()));
     ui->menuServer->addAction(action);
@@ -1654,6 +2021,7 @@ void MainWindow::updateChannelList()
 
 void MainWindow::updateDescription()
 {
+    PROFILE_ZONE("MainWindow::updateDescription");
     QString html("<p><b>");
     html.append(Qt::escape(m_currentProgramme.title));
     html.append("</b> ");
@@ -1667,9 +2035,20 @@ void MainWindow::updateDescription()
 
     html.append("</p>");
     html.append("</p><p>");
-    html.append(Qt::escape(m_currentProgramme.description));
+    bool ok;
+    html.append(Qt::escape(m_cache->loadDescription(m_currentProgramme, ok)));
     html.append("</p>");
 
+    /* Kuvaus puuttuu välimuistin sanakirjasta, joten näkyvä listaus haetaan kerran uudelleen
+       verkosta. Haku ei keskeytä asiakkaan muita pyyntöjä. */
+    QString listingKey = QString("%1-%2").arg(m_currentChannelId).arg(m_currentDate.toString(Qt::ISODate));
+
+    if (!ok && m_currentView == 0 && m_currentProgramme.channelId == m_currentChannelId &&
+        !m_descriptionRefetches.contains(listingKey)) {
+        m_descriptionRefetches.insert(listingKey);
+        m_descriptionLoader->load(QList<Channel>() << Channel(m_currentChannelId, QString()), m_currentDate, true);
+    }
+
     if (m_currentProgramme.id >= 0 && (m_currentProgramme.flags & 0x08) == 0) {
         ui->descriptionTextEdit->document()->addResource(QTextDocument::ImageResource, QUrl("poster.jpg"), m_posterImage);
         html.prepend("<img style=\"float: right\" src=\"poster.jpg\" />");
@@ -1742,8 +2121,126 @@ void MainWindow::updateCalendar()
     }
 }
 
+void MainWindow::applyEdits(int type, const QList<Programme> &editedProgrammes, bool undo)
+{
+    /* Kaikki valitut ohjelmat muokataan yhdellä lataus- ja tallennuskerralla. */
+    if (editedProgrammes.isEmpty()) {
+        return;
+    }
+
+    bool playlist = (type == 1 || type == 2);
+    bool add = (type == 1 || type == 3) != undo;
+    bool ok;
+    int age;
+    QList<Programme> programmes = playlist ? m_cache->loadPlaylist(ok, age) : m_cache->loadSeasonPasses(ok, age);
+
+    /* Jos listaa ei ole välimuistissa, se haetaan kokonaan, kun näkymä avataan seuraavan kerran. */
+    if (!ok) {
+        if (playlist) {
+            m_cache->removePlaylist();
+        }
+        else {
+            m_cache->removeSeasonPasses();
+        }
+
+        return;
+    }
+
+    QSet<int> ids = programmeIds(editedProgrammes);
+    QSet<int> seasonPassIds;
+    int count = editedProgrammes.size();
+
+    for (int i = 0; i < count; i++) {
+        seasonPassIds.insert(editedProgrammes.at(i).seasonPassId);
+    }
+
+    for (int i = programmes.size() - 1; i >= 0; i--) {
+        Programme p = programmes.at(i);
+
+        if (ids.contains(p.id) || (type == 4 && !undo && seasonPassIds.contains(p.seasonPassId))) {
+            programmes.removeAt(i);
+        }
+    }
+
+    if (add) {
+        programmes.append(editedProgrammes);
+    }
+
+    if (playlist) {
+        m_cache->savePlaylist(QDateTime::currentDateTime(), programmes);
+        updatePlaylist(programmes);
+    }
+    else {
+        m_cache->saveSeasonPasses(QDateTime::currentDateTime(), programmes);
+        updateSeasonPasses(programmes);
+    }
+}
+
+void MainWindow::updateProgrammeFlags(const Programme &programme)
+{
+    /* Tallenne tuli saataville, joten ohjelman muotoliput päivitetään kaikkiin malleihin ja
+       välimuistissa oleviin listoihin. Päiväkohtainen listaus on jo tallennettu uudelleen. */
+    m_programmeListTableModel->updateFlags(programme.id, programme.flags);
+    m_searchResultsTableModel->updateFlags(programme.id, programme.flags);
+    m_playlistTableModel->updateFlags(programme.id, programme.flags);
+    m_seasonPassesTableModel->updateFlags(programme.id, programme.flags);
+
+    if (m_currentProgramme.id == programme.id) {
+        m_currentProgramme.flags = programme.flags;
+    }
+
+    for (int type = 0; type < 2; type++) {
+        bool ok;
+        int age;
+        QList<Programme> programmes = type == 0 ? m_cache->loadPlaylist(ok, age) : m_cache->loadSeasonPasses(ok, age);
+        bool changed = false;
+
+        for (int i = 0; ok && i < programmes.size(); i++) {
+            if (programmes.at(i).id == programme.id) {
+                programmes[i].flags = programme.flags;
+                changed = true;
+            }
+        }
+
+        if (!changed) {
+            continue;
+        }
+
+        /* Tallennusaika säilytetään, jotta päivitys ei saa vanhaa listaa näyttämään tuoreelta. */
+        QDateTime updateDateTime = QDateTime::currentDateTime().addSecs(-age);
+
+        if (type == 0) {
+            m_cache->savePlaylist(updateDateTime, programmes);
+        }
+        else {
+            m_cache->saveSeasonPasses(updateDateTime, programmes);
+        }
+    }
+}
+
+QList<Programme> MainWindow::selectedProgrammes() const
+{
+    QList<Programme> programmes;
+    QModelIndexList rows = ui->programmeTableView->selectionModel()->selectedRows(0);
+
+    if (m_currentTableModel->programmeCount() == 0) {
+        return programmes;
+    }
+
+    for (int i = 0; i < rows.size(); i++) {
+        Programme programme = m_currentTableModel->programme(rows.at(i).row());
+
+        if (programme.id >= 0) {
+            programmes.append(programme);
+        }
+    }
+
+    return programmes;
+}
+
 void MainWindow::updatePlaylist(const QList<Programme> &programmes)
 {
+    m_availabilityWatcher->watchProgrammes(programmes);
     bool scroll = m_playlistTableModel->programmeCount() != programmes.size();
 
     if (programmes.isEmpty()) {
@@ -1765,6 +2262,7 @@ void MainWindow::updatePlaylist(const QList<Programme> &programmes)
 
 void MainWindow::updateSeasonPasses(const QList<Programme> &programmes)
 {
+    m_availabilityWatcher->watchProgrammes(programmes);
     bool scroll = m_seasonPassesTableModel->programmeCount() != programmes.size();
 
     if (programmes.isEmpty()) {
@@ -1965,7 +2463,8 @@ void MainWindow::startMediaPlayer(const QString &command, const QString &filenam
     m_settings.endGroup();
     QString proxyOptions;
 
-    if (!proxyHost.isEmpty()) {
+    /* Paikallista HTTP-palvelinta ei käytetä välityspalvelimen kautta. */
+    if (!proxyHost.isEmpty() && !filename.startsWith("http://127.0.0.1:")) {
         proxyOptions = QString("--http-proxy '%1:%2'").arg(proxyHost).arg(proxyPort);
     }
 
@@ -2,7 +2,9 @@
 #define MAINWINDOW_H
 
 #include <QDate>
+#include <QFutureWatcher>
 #include <QMainWindow>
+#include <QSet>
 #include <QSettings>
 #include "channel.h"
 #include "programme.h"
@@ -13,23 +15,38 @@ namespace Ui {
 
 class QComboBox;
 class QLabel;
+class QNetworkAccessManager;
+class QNetworkReply;
 class QToolButton;
 class QSignalMapper;
+class QTimer;
+class AvailabilityWatcher;
 class Cache;
+class CacheManager;
 class DownloadTableModel;
 class HistoryManager;
+class ImageLoader;
+class NetworkTraceDock;
+class PlaylistEditor;
+class PosterPrefetcher;
+class ProgrammeGridLoader;
+class ProgrammeGridWindow;
 class ProgrammeFeedParser;
 class ProgrammeTableModel;
 class ScreenshotWindow;
+class ServerProber;
 class SettingsDialog;
+class StatisticsDialog;
+class StreamServer;
 class TvkaistaClient;
+struct ProgrammeCacheResult;
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    MainWindow(QWidget *parent = 0);
+    MainWindow(QNetworkAccessManager *networkAccessManager = 0, QWidget *parent = 0);
     ~MainWindow();
     static QString encodePassword(const QString &password);
     static QString decodePassword(const QString &password);
@@ -59,6 +76,11 @@ private slots:
     void watchProgramme();
     void downloadProgramme();
     void openScreenshotWindow();
+    void openProgrammeGridWindow();
+    void gridProgrammeActivated(int channelId, const QDate &date, int programmeId);
+    void programmeAvailable(const Programme &programme);
+    void startAutoDownload();
+    void autoDownloadUrlFetched();
     void openSettingsDialog();
     void settingsAccepted();
     void openAboutDialog();
@@ -82,6 +104,8 @@ private slots:
     bool setCurrentView(int view);
     void toggleDownloadsDockWidget();
     void toggleShortcutsDockWidget();
+    void toggleNetworkTraceDockWidget();
+    void openStatisticsDialog();
     void selectChannel(int index);
     void setFocusToCalendar();
     void setFocusToChannelList();
@@ -93,16 +117,23 @@ private slots:
     void copyMiroFeedUrl();
     void copyItunesFeedUrl();
     void setCurrentServer(int index);
+    void updateServerActions();
+    void serverProbeFinished();
+    void resolveStreamUrl();
     void channelsFetched(const QList<Channel> &channels);
     void programmesFetched(int channelId, const QDate &date, const QList<Programme> &programmes);
-    void posterFetched(const Programme &programme, const QImage &poster);
+    void programmesLoaded();
+    void descriptionListingLoaded(int channelId, const QList<Programme> &programmes);
+    void imageLoaded(const QString &key, const QImage &image);
     void streamUrlFetched(const Programme &programme, int format, const QUrl &url);
     void searchResultsFetched(const QList<Programme> &programmes);
     void playlistFetched(const QList<Programme> &programmes);
     void seasonPassListFetched(const QList<Programme> &programmes);
     void seasonPassIndexFetched(const QMap<QString, int> &seasonPasses);
-    void editRequestFinished(int type, bool ok);
-    void posterTimeout();
+    void editFinished(int type, const Programme &programme, bool ok);
+    void editsFinished();
+    void playlistReconciled(const QList<Programme> &programmes);
+    void seasonPassesReconciled(const QList<Programme> &programmes, const QMap<QString, int> &seasonPasses);
     void downloadStatusChanged(int index);
     void networkError();
     void loginError();
@@ -125,6 +156,9 @@ private:
     void updateCalendar();
     void updatePlaylist(const QList<Programme> &programmes);
     void updateSeasonPasses(const QList<Programme> &programmes);
+    void applyEdits(int type, const QList<Programme> &programmes, bool undo);
+    void updateProgrammeFlags(const Programme &programme);
+    QList<Programme> selectedProgrammes() const;
     void resumeDownloadAt(int row);
     void setFormat(int format);
     void scrollProgrammes();
@@ -143,7 +177,6 @@ private:
     QComboBox *m_searchComboBox;
     QLabel *m_loadLabel;
     QMovie *m_loadMovie;
-    QTimer *m_posterTimer;
     QToolButton *m_searchToolButton;
     QSettings m_settings;
     TvkaistaClient *m_client;
@@ -155,13 +188,33 @@ private:
     ProgrammeTableModel *m_seasonPassesTableModel;
     ProgrammeTableModel *m_currentTableModel;
     Cache *m_cache;
+    CacheManager *m_cacheManager;
     SettingsDialog *m_settingsDialog;
     ScreenshotWindow *m_screenshotWindow;
+    ProgrammeGridWindow *m_programmeGridWindow;
+    NetworkTraceDock *m_networkTraceDock;
+    StatisticsDialog *m_statisticsDialog;
+    StreamServer *m_streamServer;
+    ImageLoader *m_imageLoader;
+    PosterPrefetcher *m_posterPrefetcher;
+    AvailabilityWatcher *m_availabilityWatcher;
+    PlaylistEditor *m_playlistEditor;
+    ServerProber *m_serverProber;
+    ProgrammeGridLoader *m_descriptionLoader;
+    QFutureWatcher<ProgrammeCacheResult> *m_programmeLoadWatcher;
     QList<Channel> m_channels;
+    QList<Programme> m_autoDownloadQueue;
     QList<QAction*> m_serverActions;
+    QStringList m_serverNames;
+    QAction *m_autoServerAction;
+    QTimer *m_streamResolveTimer;
+    QTimer *m_autoDownloadTimer;
+    QNetworkReply *m_autoDownloadReply;
+    int m_autoDownloadAttempts;
     QSignalMapper *m_serverSignalMapper;
     QMap<int, QString> m_channelMap;
     QStringList m_searchHistory;
+    QSet<QString> m_descriptionRefetches;
     QString m_searchPhrase;
     QDateTime m_lastRefreshTime;
     int m_currentChannelId;
@@ -172,7 +225,11 @@ private:
     QIcon m_searchIcon;
     QDate m_formattedDate;
     bool m_downloading;
+    bool m_programmeLoadRefresh;
+    bool m_autoDownload;
     int m_currentView;
+    int m_failedEdits;
+    bool m_seasonPassesEdited;
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,312 @@
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTimer>
+#include "metrics.h"
+
+/* Ajonaikaiset mittarit: laskurit, arvot ja histogrammit. Nimet ovat Prometheus-muotoisia,
+   ja nimen perään voi lisätä nimiöt aaltosulkeisiin, esim. tvkaista_cache_hits_total{class="posters"}.
+   Välimuistia luetaan taustasäikeistä, joten kaikki päivitykset tehdään lukon alla.
+   Histogrammien lokerot ovat kiinteät ja kattavat sekä millisekunnit että kilotavut sekunnissa. */
+
+static const double BucketBounds[] = {
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000
+};
+
+static const int BucketCount = sizeof(BucketBounds) / sizeof(BucketBounds[0]);
+
+static QString baseName(const QString &name)
+{
+    return name.section('{', 0, 0);
+}
+
+static QString labels(const QString &name)
+{
+    int i = name.indexOf('{');
+    return i < 0 ? QString() : name.mid(i + 1, name.length() - i - 2);
+}
+
+static QString withLabels(const QString &name, const QString &labels, const QString &extra = QString())
+{
+    QStringList list;
+
+    if (!labels.isEmpty()) {
+        list.append(labels);
+    }
+
+    if (!extra.isEmpty()) {
+        list.append(extra);
+    }
+
+    return list.isEmpty() ? name : QString("%1{%2}").arg(name, list.join(","));
+}
+
+static QString jsonString(const QString &s)
+{
+    QString escaped = s;
+    escaped.replace('\\', "\\\\");
+    escaped.replace('"', "\\\"");
+    return QString("\"%1\"").arg(escaped);
+}
+
+MetricHistogram::MetricHistogram() :
+    count(0), sum(0), buckets(BucketCount + 1, 0)
+{
+}
+
+Metrics::Metrics() :
+    QObject(), m_dumpTimer(new QTimer(this))
+{
+    m_timer.start();
+    connect(m_dumpTimer, SIGNAL(timeout()), SLOT(dump()));
+}
+
+Metrics* Metrics::instance()
+{
+    /* Luodaan pääsäikeessä ennen muita säikeitä (main.cpp). */
+    static Metrics *metrics = 0;
+
+    if (metrics == 0) {
+        metrics = new Metrics();
+    }
+
+    return metrics;
+}
+
+QList<double> Metrics::bucketBounds()
+{
+    QList<double> bounds;
+
+    for (int i = 0; i < BucketCount; i++) {
+        bounds.append(BucketBounds[i]);
+    }
+
+    return bounds;
+}
+
+qint64 Metrics::uptime() const
+{
+    return m_timer.elapsed();
+}
+
+qint64 Metrics::timestamp() const
+{
+    return m_timer.nsecsElapsed() / 1000;
+}
+
+void Metrics::increment(const QString &name, qint64 value)
+{
+    QMutexLocker locker(&m_mutex);
+    m_counters[name] += value;
+}
+
+void Metrics::setValue(const QString &name, double value)
+{
+    QMutexLocker locker(&m_mutex);
+    m_values[name] = value;
+}
+
+void Metrics::observe(const QString &name, double value)
+{
+    int i = 0;
+
+    while (i < BucketCount && value > BucketBounds[i]) {
+        i++;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    MetricHistogram &histogram = m_histograms[name];
+    histogram.count++;
+    histogram.sum += value;
+    histogram.buckets[i]++;
+}
+
+void Metrics::observeElapsed(const QString &name, qint64 start)
+{
+    observe(name, (timestamp() - start) / 1000.0);
+}
+
+QMap<QString, qint64> Metrics::counters() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_counters;
+}
+
+QMap<QString, double> Metrics::values() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_values;
+}
+
+QMap<QString, MetricHistogram> Metrics::histograms() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_histograms;
+}
+
+double Metrics::quantile(const MetricHistogram &histogram, double q)
+{
+    /* Arvio on sen lokeron yläraja, johon kvantiili osuu. */
+    if (histogram.count == 0) {
+        return 0;
+    }
+
+    qint64 limit = qMax(Q_INT64_C(1), qint64(q * histogram.count + 0.5));
+    qint64 cumulative = 0;
+
+    for (int i = 0; i < BucketCount; i++) {
+        cumulative += histogram.buckets.at(i);
+
+        if (cumulative >= limit) {
+            return BucketBounds[i];
+        }
+    }
+
+    return BucketBounds[BucketCount - 1];
+}
+
+QString Metrics::toJson() const
+{
+    QMap<QString, qint64> counters = this->counters();
+    QMap<QString, double> values = this->values();
+    QMap<QString, MetricHistogram> histograms = this->histograms();
+    QStringList items;
+
+    QMapIterator<QString, qint64> i(counters);
+
+    while (i.hasNext()) {
+        i.next();
+        items.append(QString("    %1: %2").arg(jsonString(i.key())).arg(i.value()));
+    }
+
+    QString json = QString("{\n  \"uptime\": %1,\n  \"counters\": {\n%2\n  },\n").arg(uptime()).arg(items.join(",\n"));
+    items.clear();
+    QMapIterator<QString, double> j(values);
+
+    while (j.hasNext()) {
+        j.next();
+        items.append(QString("    %1: %2").arg(jsonString(j.key())).arg(j.value()));
+    }
+
+    json.append(QString("  \"values\": {\n%1\n  },\n").arg(items.join(",\n")));
+    items.clear();
+    QMapIterator<QString, MetricHistogram> k(histograms);
+
+    while (k.hasNext()) {
+        k.next();
+        MetricHistogram histogram = k.value();
+        QStringList buckets;
+
+        for (int l = 0; l < BucketCount; l++) {
+            buckets.append(QString("\"%1\": %2").arg(BucketBounds[l]).arg(histogram.buckets.at(l)));
+        }
+
+        buckets.append(QString("\"+Inf\": %1").arg(histogram.buckets.at(BucketCount)));
+        items.append(QString("    %1: {\"count\": %2, \"sum\": %3, \"buckets\": {%4}}")
+                     .arg(jsonString(k.key())).arg(histogram.count).arg(histogram.sum).arg(buckets.join(", ")));
+    }
+
+    json.append(QString("  \"histograms\": {\n%1\n  }\n}\n").arg(items.join(",\n")));
+    return json;
+}
+
+QString Metrics::toPrometheus() const
+{
+    QMap<QString, qint64> counters = this->counters();
+    QMap<QString, double> values = this->values();
+    QMap<QString, MetricHistogram> histograms = this->histograms();
+    QStringList lines;
+    QString previous;
+
+    QMapIterator<QString, qint64> i(counters);
+
+    while (i.hasNext()) {
+        i.next();
+
+        if (baseName(i.key()) != previous) {
+            previous = baseName(i.key());
+            lines.append(QString("# TYPE %1 counter").arg(previous));
+        }
+
+        lines.append(QString("%1 %2").arg(i.key()).arg(i.value()));
+    }
+
+    QMapIterator<QString, double> j(values);
+
+    while (j.hasNext()) {
+        j.next();
+
+        if (baseName(j.key()) != previous) {
+            previous = baseName(j.key());
+            lines.append(QString("# TYPE %1 gauge").arg(previous));
+        }
+
+        lines.append(QString("%1 %2").arg(j.key()).arg(j.value()));
+    }
+
+    QMapIterator<QString, MetricHistogram> k(histograms);
+
+    while (k.hasNext()) {
+        k.next();
+        QString name = baseName(k.key());
+        QString nameLabels = labels(k.key());
+        MetricHistogram histogram = k.value();
+        qint64 cumulative = 0;
+
+        if (name != previous) {
+            previous = name;
+            lines.append(QString("# TYPE %1 histogram").arg(name));
+        }
+
+        for (int l = 0; l < BucketCount; l++) {
+            cumulative += histogram.buckets.at(l);
+            lines.append(QString("%1 %2").arg(withLabels(name + "_bucket", nameLabels,
+                                                         QString("le=\"%1\"").arg(BucketBounds[l]))).arg(cumulative));
+        }
+
+        lines.append(QString("%1 %2").arg(withLabels(name + "_bucket", nameLabels, "le=\"+Inf\"")).arg(histogram.count));
+        lines.append(QString("%1 %2").arg(withLabels(name + "_sum", nameLabels)).arg(histogram.sum));
+        lines.append(QString("%1 %2").arg(withLabels(name + "_count", nameLabels)).arg(histogram.count));
+    }
+
+    return lines.join("\n") + "\n";
+}
+
+bool Metrics::writeFile(const QString &filename) const
+{
+    /* Tiedosto korvataan kokonaan kerralla, jotta sitä seuraava työkalu ei lue puolikasta. */
+    QString data = QFileInfo(filename).suffix() == "json" ? toJson() : toPrometheus();
+    QString tempFilename = filename + ".tmp";
+    QFile file(tempFilename);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Metrics:" << file.errorString();
+        return false;
+    }
+
+    qDebug() << "WRITE" << filename;
+    file.write(data.toUtf8());
+    file.close();
+    QFile::remove(filename);
+    return QFile::rename(tempFilename, filename);
+}
+
+void Metrics::setDumpFile(const QString &filename, int interval)
+{
+    m_dumpFilename = filename;
+
+    if (filename.isEmpty() || interval <= 0) {
+        m_dumpTimer->stop();
+        return;
+    }
+
+    m_dumpTimer->start(interval);
+}
+
+void Metrics::dump()
+{
+    if (!m_dumpFilename.isEmpty()) {
+        writeFile(m_dumpFilename);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QElapsedTimer>
+#include <QMap>
+#include <QMutex>
+#include <QObject>
+#include <QVector>
+
+class QTimer;
+
+struct MetricHistogram
+{
+    MetricHistogram();
+    qint64 count;
+    double sum;
+    QVector<qint64> buckets;
+};
+
+class Metrics : public QObject
+{
+    Q_OBJECT
+public:
+    static Metrics* instance();
+    static QList<double> bucketBounds();
+    qint64 uptime() const;
+    qint64 timestamp() const;
+    void increment(const QString &name, qint64 value = 1);
+    void setValue(const QString &name, double value);
+    void observe(const QString &name, double value);
+    void observeElapsed(const QString &name, qint64 start);
+    QMap<QString, qint64> counters() const;
+    QMap<QString, double> values() const;
+    QMap<QString, MetricHistogram> histograms() const;
+    static double quantile(const MetricHistogram &histogram, double q);
+    QString toJson() const;
+    QString toPrometheus() const;
+    bool writeFile(const QString &filename) const;
+    void setDumpFile(const QString &filename, int interval);
+
+public slots:
+    void dump();
+
+private:
+    Metrics();
+    QElapsedTimer m_timer;
+    QMap<QString, qint64> m_counters;
+    QMap<QString, double> m_values;
+    QMap<QString, MetricHistogram> m_histograms;
+    mutable QMutex m_mutex;
+    QTimer *m_dumpTimer;
+    QString m_dumpFilename;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,138 @@
+#include <QCoreApplication>
+#include <QHostAddress>
+#include <QStringList>
+#include <stdio.h>
+#include <stdlib.h>
+#include "mockserver.h"
+
+void handleMessage(QtMsgType type, const char *msg, bool printDebugMessages)
+{
+    switch (type) {
+    case QtDebugMsg:
+        if (printDebugMessages) fprintf(stderr, "%s\n", msg);
+        break;
+    case QtWarningMsg:
+        fprintf(stderr, "Warning: %s\n", msg);
+        break;
+    case QtCriticalMsg:
+        fprintf(stderr, "Critical: %s\n", msg);
+        break;
+    case QtFatalMsg:
+        fprintf(stderr, "Fatal: %s\n", msg);
+        abort();
+    }
+}
+
+void defaultMessageHandler(QtMsgType type, const char *msg)
+{
+    handleMessage(type, msg, false);
+}
+
+void debugMessageHandler(QtMsgType type, const char *msg)
+{
+    handleMessage(type, msg, true);
+}
+
+void printUsage()
+{
+    fprintf(stderr, "Usage: tvkaista-mockserver [options]\n"
+                    "  -d, --debug               print every request\n"
+                    "  --port PORT               listen on PORT (default 8080)\n"
+                    "  --password PASSWORD       accept only PASSWORD (default: any)\n"
+                    "  --channels N              number of channels (default 20)\n"
+                    "  --programmes-per-day N    programmes per channel and day (default 40)\n"
+                    "  --search-results N        maximum search results (default 500)\n"
+                    "  --file-size MB            size of each recording (default 100)\n"
+                    "  --latency MS              delay before each response\n"
+                    "  --bandwidth KB/S          throttle recording downloads\n"
+                    "  --error-rate PERCENT      answer 500 to this share of requests\n"
+                    "  --drop-rate PERCENT       close this share of connections mid-body\n"
+                    "  --session-timeout SECS    expire login sessions\n"
+                    "  --seed N                  random seed for fault injection\n"
+                    "\n"
+                    "Run the client with --http-proxy 127.0.0.1:PORT to use the server.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList arguments = app.arguments();
+    int count = arguments.size();
+    MockServer server;
+    int port = 8080;
+    uint seed = 1;
+
+    qInstallMsgHandler(defaultMessageHandler);
+
+    for (int i = 1; i < count; i++) {
+        QString arg = arguments.at(i);
+
+        if (arg == "-d" || arg == "--debug") {
+            qInstallMsgHandler(debugMessageHandler);
+            continue;
+        }
+
+        if (arg == "-h" || arg == "--help" || i + 1 >= count) {
+            printUsage();
+            return 1;
+        }
+
+        QString value = arguments.at(++i);
+        bool ok = true;
+
+        if (arg == "--password") {
+            server.setPassword(value);
+        }
+        else if (arg == "--port") {
+            port = value.toInt(&ok);
+        }
+        else if (arg == "--channels") {
+            server.data()->setChannelCount(value.toInt(&ok));
+        }
+        else if (arg == "--programmes-per-day") {
+            server.data()->setProgrammesPerDay(value.toInt(&ok));
+        }
+        else if (arg == "--search-results") {
+            server.setSearchResultCount(value.toInt(&ok));
+        }
+        else if (arg == "--file-size") {
+            server.setFileSize(value.toLongLong(&ok) * 1024 * 1024);
+        }
+        else if (arg == "--latency") {
+            server.setLatency(value.toInt(&ok));
+        }
+        else if (arg == "--bandwidth") {
+            server.setBandwidth(value.toInt(&ok) * 1024);
+        }
+        else if (arg == "--error-rate") {
+            server.setErrorRate(value.toInt(&ok));
+        }
+        else if (arg == "--drop-rate") {
+            server.setDropRate(value.toInt(&ok));
+        }
+        else if (arg == "--session-timeout") {
+            server.setSessionTimeout(value.toInt(&ok));
+        }
+        else if (arg == "--seed") {
+            seed = value.toUInt(&ok);
+        }
+        else {
+            ok = false;
+        }
+
+        if (!ok) {
+            printUsage();
+            return 1;
+        }
+    }
+
+    qsrand(seed);
+
+    if (!server.listen(QHostAddress::LocalHost, port)) {
+        fprintf(stderr, "Could not listen on port %d: %s\n", port, qPrintable(server.errorString()));
+        return 1;
+    }
+
+    fprintf(stderr, "Listening on 127.0.0.1:%d\n", port);
+    return app.exec();
+}
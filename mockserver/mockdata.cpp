@@ -0,0 +1,240 @@
+#include <QStringList>
+#include "mockdata.h"
+
+static const int FirstChannelId = 1000;
+static const int SeriesCount = 300;
+static const QDate Epoch(2000, 1, 1);
+
+static QByteArray escaped(const QString &s)
+{
+    QString t = s;
+    t.replace('&', "&amp;").replace('<', "&lt;").replace('>', "&gt;").replace('"', "&quot;");
+    return t.toUtf8();
+}
+
+static QByteArray rfc822DateTime(const QDateTime &dateTime)
+{
+    static const char *monthNames[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    QDateTime utc = dateTime.toUTC();
+    return QString("%1 %2 %3 %4 +0000").arg(utc.date().day()).arg(monthNames[utc.date().month() - 1])
+            .arg(utc.date().year()).arg(utc.time().toString("hh:mm:ss")).toAscii();
+}
+
+MockData::MockData() :
+    m_channelCount(20), m_programmesPerDay(40)
+{
+}
+
+void MockData::setChannelCount(int count)
+{
+    m_channelCount = qMax(1, count);
+}
+
+int MockData::channelCount() const
+{
+    return m_channelCount;
+}
+
+void MockData::setProgrammesPerDay(int count)
+{
+    m_programmesPerDay = qBound(1, count, 1440);
+}
+
+int MockData::programmesPerDay() const
+{
+    return m_programmesPerDay;
+}
+
+int MockData::channelId(int index) const
+{
+    return FirstChannelId + index;
+}
+
+int MockData::channelIndex(int channelId) const
+{
+    int index = channelId - FirstChannelId;
+    return index >= 0 && index < m_channelCount ? index : -1;
+}
+
+QString MockData::channelName(int index) const
+{
+    return QString("Kanava %1").arg(index + 1);
+}
+
+int MockData::programmeId(int channelIndex, const QDate &date, int slot) const
+{
+    int day = Epoch.daysTo(date);
+    return (day * m_channelCount + channelIndex) * m_programmesPerDay + slot + 1;
+}
+
+MockProgramme MockData::programme(int id) const
+{
+    int n = id - 1;
+    int slot = n % m_programmesPerDay;
+    n /= m_programmesPerDay;
+    int channelIndex = n % m_channelCount;
+    int day = n / m_channelCount;
+    int interval = 1440 / m_programmesPerDay;
+
+    /* Sama sarja toistuu kanavalla joka päivä samaan aikaan, jotta sarjoilla on jaksoja. */
+    int series = (channelIndex * 37 + slot * 11) % SeriesCount;
+    MockProgramme programme;
+    programme.id = id;
+    programme.channelId = channelId(channelIndex);
+    programme.title = QString("Sarja %1").arg(series + 1);
+    programme.description = QString::fromUtf8("Jakso %1. Sarjan henkilöt joutuvat pulaan, kun vanha "
+                                              "tuttu palaa kaupunkiin ja tuo mukanaan ikäviä uutisia.")
+                            .arg(day % 50 + 1);
+    programme.startDateTime = QDateTime(Epoch.addDays(day), QTime(6, 0)).addSecs(slot * interval * 60);
+    programme.duration = interval * 60;
+    return programme;
+}
+
+QList<MockProgramme> MockData::programmes(int channelId, const QDate &date) const
+{
+    QList<MockProgramme> programmes;
+    int index = channelIndex(channelId);
+
+    if (index < 0 || date < Epoch) {
+        return programmes;
+    }
+
+    for (int i = 0; i < m_programmesPerDay; i++) {
+        programmes.append(programme(programmeId(index, date, i)));
+    }
+
+    return programmes;
+}
+
+QList<MockProgramme> MockData::search(const QString &phrase, int maxResults) const
+{
+    QList<MockProgramme> results;
+    QDate today = QDate::currentDate();
+
+    /* Haku käy läpi neljän viikon tallenteet uusimmasta alkaen. */
+    for (int day = 0; day < 28; day++) {
+        for (int c = 0; c < m_channelCount; c++) {
+            QList<MockProgramme> programmes = this->programmes(channelId(c), today.addDays(-day));
+
+            for (int i = 0; i < programmes.size(); i++) {
+                if (results.size() >= maxResults) {
+                    return results;
+                }
+
+                if (programmes.at(i).title.contains(phrase, Qt::CaseInsensitive)) {
+                    results.append(programmes.at(i));
+                }
+            }
+        }
+    }
+
+    return results;
+}
+
+QByteArray MockData::channelFeed() const
+{
+    QByteArray feed;
+    feed.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<rss version=\"2.0\"><channel><title>tvkaista</title>\n");
+
+    for (int i = 0; i < m_channelCount; i++) {
+        feed.append(QString("<item><title>%1</title><link>http://www.tvkaista.fi/feed/channels/%2</link></item>\n")
+                    .arg(channelName(i)).arg(channelId(i)).toUtf8());
+    }
+
+    feed.append("</channel></rss>\n");
+    return feed;
+}
+
+QByteArray MockData::weekPage(int channelId, const QDate &date) const
+{
+    QDateTime now = QDateTime::currentDateTime();
+    QByteArray page;
+    page.append("<html><head><title>tvkaista</title></head><body>\n");
+    page.append(QString("<div id=\"toolbarcalendar\"><a href=\"#\">%1.%2.</a></div>\n")
+                .arg(date.day()).arg(date.month()).toUtf8());
+    page.append("<div id=\"channelboard\"><table><tr>\n");
+
+    for (int day = -3; day <= 3; day++) {
+        QList<MockProgramme> programmes = this->programmes(channelId, date.addDays(day));
+        page.append("<td><table class=\"day\">\n");
+
+        for (int i = 0; i < programmes.size(); i++) {
+            MockProgramme programme = programmes.at(i);
+            QString clazz = "programme";
+
+            if (programme.startDateTime.addSecs(programme.duration) > now) {
+                clazz.append(" upcoming");
+            }
+            else if (programme.id % 10 == 0) {
+                /* Osasta ohjelmista puuttuu jokin tallennemuoto. */
+                clazz.append(QString(" nof%1").arg(programme.id % 4));
+            }
+
+            page.append("<tr class=\"infobox\"><td class=\"programtime\">");
+            page.append(programme.startDateTime.toString("h.mm").toAscii());
+            page.append(QString("</td><td><span id=\"pid%1\" class=\"%2\">").arg(programme.id).arg(clazz).toUtf8());
+            page.append(escaped(programme.title));
+            page.append("</span><span class=\"information\">");
+            page.append(escaped(programme.description));
+            page.append("</span></td></tr>\n");
+        }
+
+        page.append("</table></td>\n");
+    }
+
+    page.append("</tr></table></div>\n</body></html>\n");
+    return page;
+}
+
+QByteArray MockData::programmeFeed(const QList<MockProgramme> &programmes) const
+{
+    QByteArray feed;
+    feed.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<rss version=\"2.0\" xmlns:media=\"http://search.yahoo.com/mrss/\">\n"
+                "<channel><title>tvkaista</title>\n");
+
+    for (int i = 0; i < programmes.size(); i++) {
+        MockProgramme programme = programmes.at(i);
+        feed.append("<item><title>");
+        feed.append(escaped(programme.title));
+        feed.append(QString("</title><link>http://tvkaista.fi/search/?findid=%1</link><description>").arg(programme.id).toUtf8());
+        feed.append(escaped(programme.description));
+        feed.append(QString("</description><source url=\"http://tvkaista.fi/feed/channels/%1/flv.mediarss\">%2</source>")
+                    .arg(programme.channelId).arg(channelName(channelIndex(programme.channelId))).toUtf8());
+        feed.append("<pubDate>").append(rfc822DateTime(programme.startDateTime)).append("</pubDate>");
+        feed.append(QString("<media:group><media:content duration=\"%1\" url=\"http://www.tvkaista.fi/video/%2.ts\"/>"
+                            "<media:thumbnail url=\"http://www.tvkaista.fi/feedbeta/programs/%2/metadata/thumbs/thumb-0001.png\" time=\"0:00:30\"/>"
+                            "</media:group></item>\n").arg(programme.duration).arg(programme.id).toUtf8());
+    }
+
+    feed.append("</channel></rss>\n");
+    return feed;
+}
+
+QByteArray MockData::seasonPassIndexFeed(const QList<QPair<int, QString> > &seasonPasses) const
+{
+    QByteArray feed;
+    feed.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<rss version=\"2.0\"><channel><title>tvkaista</title>\n");
+
+    for (int i = 0; i < seasonPasses.size(); i++) {
+        feed.append("<item><title>");
+        feed.append(escaped(seasonPasses.at(i).second));
+        feed.append(QString("</title><link>http://www.tvkaista.fi/feed/seasonpasses/%1</link></item>\n")
+                    .arg(seasonPasses.at(i).first).toUtf8());
+    }
+
+    feed.append("</channel></rss>\n");
+    return feed;
+}
+
+QByteArray MockData::frontPage(bool loggedIn) const
+{
+    if (loggedIn) {
+        return "<html><head><title>tvkaista</title></head><body><div id=\"user\">Kirjautunut</div></body></html>\n";
+    }
+
+    return "<html><head><title>tvkaista</title></head><body>"
+           "<form action=\"/login/\" method=\"post\"><input name=\"username\"/><input name=\"password\" type=\"password\"/></form>"
+           "</body></html>\n";
+}
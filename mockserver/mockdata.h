@@ -0,0 +1,49 @@
+#ifndef MOCKDATA_H
+#define MOCKDATA_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+struct MockProgramme
+{
+    int id;
+    int channelId;
+    QString title;
+    QString description;
+    QDateTime startDateTime;
+    int duration;
+};
+
+/* Synteettinen ohjelmatieto. Ohjelmien tunnisteet lasketaan päivästä, kanavasta ja
+   järjestysnumerosta, joten mikä tahansa tunniste voidaan purkaa takaisin ohjelmaksi
+   ilman tallennettua tilaa. */
+class MockData
+{
+public:
+    MockData();
+    void setChannelCount(int count);
+    int channelCount() const;
+    void setProgrammesPerDay(int count);
+    int programmesPerDay() const;
+    int channelId(int index) const;
+    int channelIndex(int channelId) const;
+    QString channelName(int index) const;
+    MockProgramme programme(int id) const;
+    QList<MockProgramme> programmes(int channelId, const QDate &date) const;
+    QList<MockProgramme> search(const QString &phrase, int maxResults) const;
+    QByteArray channelFeed() const;
+    QByteArray weekPage(int channelId, const QDate &date) const;
+    QByteArray programmeFeed(const QList<MockProgramme> &programmes) const;
+    QByteArray seasonPassIndexFeed(const QList<QPair<int, QString> > &seasonPasses) const;
+    QByteArray frontPage(bool loggedIn) const;
+
+private:
+    int programmeId(int channelIndex, const QDate &date, int slot) const;
+    int m_channelCount;
+    int m_programmesPerDay;
+};
+
+#endif // MOCKDATA_H
@@ -0,0 +1,564 @@
+#include <QDebug>
+#include <QRegExp>
+#include <QStringList>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+#include "mockserver.h"
+
+/* Palvelin toimii sekä tavallisena HTTP-palvelimena että välityspalvelimena, joten
+   ohjelma saadaan käyttämään sitä valitsimella --http-proxy 127.0.0.1:<portti>
+   ilman muutoksia palvelimen osoitteisiin. */
+
+static const int ChunkInterval = 50;
+static const int ChunkSize = 64 * 1024;
+static const int MaxWriteBuffer = 256 * 1024;
+static const int MaxRequestSize = 1024 * 1024;
+
+MockResponse::MockResponse() :
+    status(200), reason("OK"), videoId(-1), videoOffset(0), videoSize(0), drop(false)
+{
+}
+
+MockServer::MockServer(QObject *parent) :
+    QTcpServer(parent), m_fileSize(100 * 1024 * 1024), m_searchResultCount(500),
+    m_latency(0), m_bandwidth(0), m_errorRate(0), m_dropRate(0), m_sessionTimeout(0),
+    m_nextSeasonPassId(1), m_requestCount(0)
+{
+    connect(this, SIGNAL(newConnection()), SLOT(acceptConnection()));
+}
+
+MockData* MockServer::data()
+{
+    return &m_data;
+}
+
+void MockServer::setFileSize(qint64 bytes)
+{
+    m_fileSize = qMax(bytes, (qint64) 1);
+}
+
+void MockServer::setSearchResultCount(int count)
+{
+    m_searchResultCount = count;
+}
+
+void MockServer::setLatency(int msecs)
+{
+    m_latency = msecs;
+}
+
+int MockServer::latency() const
+{
+    return m_latency;
+}
+
+void MockServer::setBandwidth(int bytesPerSecond)
+{
+    m_bandwidth = bytesPerSecond;
+}
+
+int MockServer::bandwidth() const
+{
+    return m_bandwidth;
+}
+
+void MockServer::setErrorRate(int percent)
+{
+    m_errorRate = percent;
+}
+
+void MockServer::setDropRate(int percent)
+{
+    m_dropRate = percent;
+}
+
+void MockServer::setSessionTimeout(int secs)
+{
+    m_sessionTimeout = secs;
+}
+
+void MockServer::setPassword(const QString &password)
+{
+    m_password = password;
+}
+
+void MockServer::acceptConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+        new MockConnection(socket, this);
+    }
+}
+
+void MockServer::handleRequest(const MockRequest &request, MockResponse &response)
+{
+    QByteArray path = request.path;
+    m_requestCount++;
+
+    /* Välityspalvelimelle lähetetyssä pyynnössä on koko osoite. */
+    if (path.startsWith("http://")) {
+        int pos = path.indexOf('/', 7);
+        path = pos < 0 ? QByteArray("/") : path.mid(pos);
+    }
+
+    int pos = path.indexOf('?');
+
+    if (pos >= 0) {
+        path = path.left(pos);
+    }
+
+    qDebug() << m_requestCount << request.method << path;
+    response.drop = isFault(m_dropRate);
+
+    if (path == "/" && request.method == "GET") {
+        response.body = m_data.frontPage(isLoggedIn(request));
+        response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("text/html; charset=utf-8")));
+        return;
+    }
+
+    if (path == "/login/" && request.method == "POST") {
+        login(request, response);
+        return;
+    }
+
+    if (isFault(m_errorRate)) {
+        response.status = 500;
+        response.reason = "Internal Server Error";
+        response.body = "<html><body>Palvelinvirhe</body></html>\n";
+        return;
+    }
+
+    QRegExp videoRegexp("^/video/(\\d+)\\.ts$");
+
+    if (videoRegexp.indexIn(path) >= 0) {
+        handleVideoRequest(videoRegexp.cap(1).toInt(), request, response);
+        return;
+    }
+
+    if (path.startsWith("/feed/")) {
+        if (!isAuthorized(request)) {
+            response.status = 401;
+            response.reason = "Unauthorized";
+            response.headers.append(qMakePair(QByteArray("WWW-Authenticate"), QByteArray("Basic realm=\"tvkaista\"")));
+            return;
+        }
+
+        handleFeedRequest(path, request, response);
+        return;
+    }
+
+    if (path.startsWith("/recordings/") && !isLoggedIn(request)) {
+        redirect(response, "http://www.tvkaista.fi/login/", 302);
+        return;
+    }
+
+    QRegExp dateRegexp("^/recordings/date/(\\d{2})/(\\d{2})/(\\d{4})/(\\d+)/$");
+    QRegExp downloadRegexp("^/recordings/download/(\\d+)/");
+
+    if (dateRegexp.indexIn(path) >= 0) {
+        QDate date(dateRegexp.cap(3).toInt(), dateRegexp.cap(2).toInt(), dateRegexp.cap(1).toInt());
+        int channelId = dateRegexp.cap(4).toInt();
+
+        if (!date.isValid() || m_data.channelIndex(channelId) < 0) {
+            notFound(response);
+            return;
+        }
+
+        response.body = m_data.weekPage(channelId, date);
+        response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("text/html; charset=utf-8")));
+    }
+    else if (downloadRegexp.indexIn(path) >= 0) {
+        redirect(response, QString("http://www.tvkaista.fi/video/%1.ts").arg(downloadRegexp.cap(1)).toAscii(), 302);
+    }
+    else {
+        notFound(response);
+    }
+}
+
+bool MockServer::isLoggedIn(const MockRequest &request)
+{
+    QRegExp sessionRegexp("sessionid=([0-9a-f]+)");
+
+    if (sessionRegexp.indexIn(request.headers.value("cookie")) < 0) {
+        return false;
+    }
+
+    QByteArray session = sessionRegexp.cap(1).toAscii();
+
+    if (!m_sessions.contains(session)) {
+        return false;
+    }
+
+    /* Vanhentunut istunto pakottaa asiakkaan kirjautumaan uudelleen. */
+    if (m_sessionTimeout > 0 && m_sessions.value(session).secsTo(QDateTime::currentDateTime()) > m_sessionTimeout) {
+        m_sessions.remove(session);
+        return false;
+    }
+
+    return true;
+}
+
+bool MockServer::isAuthorized(const MockRequest &request)
+{
+    QByteArray authorization = request.headers.value("authorization");
+
+    if (!authorization.startsWith("Basic ")) {
+        return false;
+    }
+
+    QByteArray credentials = QByteArray::fromBase64(authorization.mid(6));
+    int pos = credentials.indexOf(':');
+    return pos > 0 && checkPassword(QString::fromUtf8(credentials.mid(pos + 1)));
+}
+
+bool MockServer::checkPassword(const QString &password) const
+{
+    return !password.isEmpty() && (m_password.isEmpty() || password == m_password);
+}
+
+void MockServer::login(const MockRequest &request, MockResponse &response)
+{
+    QString password;
+    QList<QByteArray> fields = request.body.split('&');
+
+    for (int i = 0; i < fields.size(); i++) {
+        if (fields.at(i).startsWith("password=")) {
+            password = QUrl::fromPercentEncoding(fields.at(i).mid(9));
+        }
+    }
+
+    response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("text/html; charset=utf-8")));
+
+    if (!checkPassword(password)) {
+        response.body = m_data.frontPage(false);
+        return;
+    }
+
+    QByteArray session = QByteArray::number(qrand(), 16) + QByteArray::number(m_requestCount, 16);
+    m_sessions.insert(session, QDateTime::currentDateTime());
+    response.headers.append(qMakePair(QByteArray("Set-Cookie"), "sessionid=" + session + "; path=/"));
+    response.body = m_data.frontPage(true);
+}
+
+void MockServer::handleFeedRequest(const QByteArray &path, const MockRequest &request, MockResponse &response)
+{
+    QRegExp detailedRegexp("^/feed/programs/(\\d+)/detailed\\.mediarss$");
+    QRegExp searchRegexp("^/feed/search/title/([^/]+)/flv\\.mediarss$");
+    QRegExp playlistRegexp("^/feed/playlist/(\\d+)/?$");
+    QRegExp seasonPassRegexp("^/feed/seasonpasses/(\\d+)/?$");
+    QList<MockProgramme> programmes;
+    int id = -1;
+
+    if (request.body.startsWith("id=")) {
+        id = request.body.mid(3).toInt();
+    }
+
+    response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("application/rss+xml; charset=utf-8")));
+
+    if (path == "/feed/channels/") {
+        response.body = m_data.channelFeed();
+    }
+    else if (detailedRegexp.indexIn(path) >= 0) {
+        programmes.append(m_data.programme(detailedRegexp.cap(1).toInt()));
+        response.body = m_data.programmeFeed(programmes);
+    }
+    else if (searchRegexp.indexIn(path) >= 0) {
+        QString phrase = QUrl::fromPercentEncoding(searchRegexp.cap(1).toAscii());
+        response.body = m_data.programmeFeed(m_data.search(phrase, m_searchResultCount));
+    }
+    else if (path == "/feed/playlist/standard.mediarss") {
+        for (int i = 0; i < m_playlist.size(); i++) {
+            programmes.append(m_data.programme(m_playlist.at(i)));
+        }
+
+        response.body = m_data.programmeFeed(programmes);
+    }
+    else if (path == "/feed/playlist/" && request.method == "POST" && id > 0) {
+        if (m_playlist.contains(id)) {
+            response.status = 409;
+            response.reason = "Conflict";
+            return;
+        }
+
+        m_playlist.append(id);
+        response.body = "OK";
+    }
+    else if (playlistRegexp.indexIn(path) >= 0 && request.method == "DELETE") {
+        m_playlist.removeAll(playlistRegexp.cap(1).toInt());
+        response.body = "OK";
+    }
+    else if (path == "/feed/seasonpasses/" && request.method == "GET") {
+        response.body = m_data.seasonPassIndexFeed(m_seasonPasses);
+    }
+    else if (path == "/feed/seasonpasses/" && request.method == "POST" && id > 0) {
+        QString title = m_data.programme(id).title;
+
+        for (int i = 0; i < m_seasonPasses.size(); i++) {
+            if (m_seasonPasses.at(i).second == title) {
+                response.status = 409;
+                response.reason = "Conflict";
+                return;
+            }
+        }
+
+        m_seasonPasses.append(qMakePair(m_nextSeasonPassId++, title));
+        response.body = "OK";
+    }
+    else if (seasonPassRegexp.indexIn(path) >= 0 && request.method == "DELETE") {
+        int seasonPassId = seasonPassRegexp.cap(1).toInt();
+
+        for (int i = m_seasonPasses.size() - 1; i >= 0; i--) {
+            if (m_seasonPasses.at(i).first == seasonPassId) {
+                m_seasonPasses.removeAt(i);
+            }
+        }
+
+        response.body = "OK";
+    }
+    else if (path == "/feed/seasonpasses/*/standard.mediarss") {
+        /* Sarjojen jaksot haetaan viikon ajalta kaikilta kanavilta. */
+        QDate today = QDate::currentDate();
+
+        for (int day = 0; day < 7; day++) {
+            for (int c = 0; c < m_data.channelCount(); c++) {
+                QList<MockProgramme> dayProgrammes = m_data.programmes(m_data.channelId(c), today.addDays(-day));
+
+                for (int i = 0; i < dayProgrammes.size(); i++) {
+                    for (int j = 0; j < m_seasonPasses.size(); j++) {
+                        if (dayProgrammes.at(i).title == m_seasonPasses.at(j).second) {
+                            programmes.append(dayProgrammes.at(i));
+                        }
+                    }
+                }
+            }
+        }
+
+        response.body = m_data.programmeFeed(programmes);
+    }
+    else {
+        response.headers.clear();
+        notFound(response);
+    }
+}
+
+void MockServer::handleVideoRequest(int programmeId, const MockRequest &request, MockResponse &response)
+{
+    MockProgramme programme = m_data.programme(programmeId);
+    QString filename = QString("%1_%2_%3_%4.ts").arg(programme.title, programme.startDateTime.toString("yyyy.MM.dd"),
+                                                     m_data.channelName(m_data.channelIndex(programme.channelId)))
+                       .arg(programmeId).replace(' ', '-');
+    QRegExp rangeRegexp("^bytes=(\\d+)-");
+    qint64 offset = 0;
+
+    if (rangeRegexp.indexIn(request.headers.value("range")) >= 0) {
+        offset = rangeRegexp.cap(1).toLongLong();
+
+        if (offset >= m_fileSize) {
+            response.status = 416;
+            response.reason = "Requested Range Not Satisfiable";
+            response.headers.append(qMakePair(QByteArray("Content-Range"), "bytes */" + QByteArray::number(m_fileSize)));
+            return;
+        }
+
+        response.status = 206;
+        response.reason = "Partial Content";
+        response.headers.append(qMakePair(QByteArray("Content-Range"), QString("bytes %1-%2/%3").arg(offset)
+                                          .arg(m_fileSize - 1).arg(m_fileSize).toAscii()));
+    }
+
+    response.headers.append(qMakePair(QByteArray("Content-Type"), QByteArray("video/mp2t")));
+    response.headers.append(qMakePair(QByteArray("Accept-Ranges"), QByteArray("bytes")));
+    response.headers.append(qMakePair(QByteArray("Content-Disposition"), "inline; filename=" + filename.toUtf8()));
+    response.videoId = programmeId;
+    response.videoOffset = offset;
+    response.videoSize = m_fileSize - offset;
+}
+
+void MockServer::redirect(MockResponse &response, const QByteArray &location, int status)
+{
+    response.status = status;
+    response.reason = status == 303 ? "See Other" : "Found";
+    response.headers.append(qMakePair(QByteArray("Location"), location));
+}
+
+void MockServer::notFound(MockResponse &response)
+{
+    response.status = 404;
+    response.reason = "Not Found";
+    response.body = "<html><body>Sivua ei löydy</body></html>\n";
+}
+
+bool MockServer::isFault(int percent) const
+{
+    return percent > 0 && qrand() % 100 < percent;
+}
+
+MockConnection::MockConnection(QTcpSocket *socket, MockServer *server) :
+    QObject(socket), m_socket(socket), m_server(server), m_timer(new QTimer(this)),
+    m_written(0), m_busy(false), m_keepAlive(true)
+{
+    m_timer->setInterval(ChunkInterval);
+    connect(m_socket, SIGNAL(readyRead()), SLOT(readRequest()));
+    connect(m_socket, SIGNAL(disconnected()), SLOT(socketDisconnected()));
+    connect(m_timer, SIGNAL(timeout()), SLOT(writeVideo()));
+}
+
+void MockConnection::readRequest()
+{
+    m_buffer.append(m_socket->readAll());
+
+    if (m_buffer.size() > MaxRequestSize) {
+        m_socket->abort();
+        return;
+    }
+
+    if (m_busy || !parseRequest()) {
+        return;
+    }
+
+    m_busy = true;
+    QTimer::singleShot(m_server->latency(), this, SLOT(respond()));
+}
+
+bool MockConnection::parseRequest()
+{
+    int end = m_buffer.indexOf("\r\n\r\n");
+
+    if (end < 0) {
+        return false;
+    }
+
+    QList<QByteArray> lines = m_buffer.left(end).split('\n');
+    QList<QByteArray> requestLine = lines.at(0).trimmed().split(' ');
+    MockRequest request;
+    request.method = requestLine.value(0);
+    request.path = requestLine.value(1);
+
+    for (int i = 1; i < lines.size(); i++) {
+        int pos = lines.at(i).indexOf(':');
+
+        if (pos > 0) {
+            request.headers.insert(lines.at(i).left(pos).trimmed().toLower(), lines.at(i).mid(pos + 1).trimmed());
+        }
+    }
+
+    int length = request.headers.value("content-length").toInt();
+
+    if (m_buffer.size() < end + 4 + length) {
+        return false;
+    }
+
+    request.body = m_buffer.mid(end + 4, length);
+    m_buffer.remove(0, end + 4 + length);
+    m_keepAlive = request.headers.value("connection").toLower() != "close" &&
+                  !requestLine.value(2).startsWith("HTTP/1.0");
+    m_request = request;
+    return true;
+}
+
+void MockConnection::respond()
+{
+    m_response = MockResponse();
+    m_server->handleRequest(m_request, m_response);
+    qint64 length = m_response.videoId >= 0 ? m_response.videoSize : m_response.body.size();
+    QByteArray head = QString("HTTP/1.1 %1 ").arg(m_response.status).toAscii() + m_response.reason + "\r\n";
+
+    for (int i = 0; i < m_response.headers.size(); i++) {
+        head.append(m_response.headers.at(i).first + ": " + m_response.headers.at(i).second + "\r\n");
+    }
+
+    head.append("Content-Length: " + QByteArray::number(length) + "\r\n");
+    head.append(m_keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    m_socket->write(head);
+    m_written = 0;
+
+    if (m_response.videoId >= 0) {
+        /* Video lähetetään paloina, jotta suuriakaan tiedostoja ei pidetä muistissa. */
+        if (m_server->bandwidth() > 0) {
+            m_timer->start();
+        }
+        else {
+            connect(m_socket, SIGNAL(bytesWritten(qint64)), SLOT(writeVideo()));
+        }
+
+        writeVideo();
+        return;
+    }
+
+    if (m_response.drop) {
+        m_socket->write(m_response.body.left(m_response.body.size() / 2));
+        m_socket->disconnectFromHost();
+        return;
+    }
+
+    m_socket->write(m_response.body);
+    finishResponse();
+}
+
+void MockConnection::writeVideo()
+{
+    qint64 limit = m_response.videoSize;
+
+    /* Katkaistava yhteys suljetaan puolivälissä. */
+    if (m_response.drop) {
+        limit /= 2;
+    }
+
+    qint64 len = qMin(limit - m_written, (qint64) ChunkSize);
+
+    if (m_server->bandwidth() > 0) {
+        len = qMin(len, qMax((qint64) m_server->bandwidth() * ChunkInterval / 1000, (qint64) 1));
+    }
+    else if (m_socket->bytesToWrite() > MaxWriteBuffer) {
+        return;
+    }
+
+    if (len > 0) {
+        /* Sisältö riippuu vain sijainnista tiedostossa, joten jatketut lataukset voi tarkistaa. */
+        QByteArray data(len, '\0');
+        qint64 offset = m_response.videoOffset + m_written;
+
+        for (qint64 i = 0; i < len; i++) {
+            data[(int) i] = (char) ((offset + i) & 0xFF);
+        }
+
+        m_socket->write(data);
+        m_written += len;
+    }
+
+    if (m_written < limit) {
+        return;
+    }
+
+    m_timer->stop();
+    disconnect(m_socket, SIGNAL(bytesWritten(qint64)), this, SLOT(writeVideo()));
+
+    if (m_response.drop) {
+        m_socket->disconnectFromHost();
+        return;
+    }
+
+    finishResponse();
+}
+
+void MockConnection::finishResponse()
+{
+    m_busy = false;
+
+    if (!m_keepAlive) {
+        m_socket->disconnectFromHost();
+        return;
+    }
+
+    /* Seuraava pyyntö voi olla jo puskurissa. */
+    if (!m_buffer.isEmpty()) {
+        readRequest();
+    }
+}
+
+void MockConnection::socketDisconnected()
+{
+    m_timer->stop();
+    m_socket->deleteLater();
+}
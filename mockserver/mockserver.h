@@ -0,0 +1,109 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QTcpServer>
+#include "mockdata.h"
+
+class QTcpSocket;
+class QTimer;
+
+struct MockRequest
+{
+    QByteArray method;
+    QByteArray path;
+    QHash<QByteArray, QByteArray> headers;
+    QByteArray body;
+};
+
+struct MockResponse
+{
+    MockResponse();
+    int status;
+    QByteArray reason;
+    QList<QPair<QByteArray, QByteArray> > headers;
+    QByteArray body;
+    int videoId;
+    qint64 videoOffset;
+    qint64 videoSize;
+    bool drop;
+};
+
+class MockServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    MockServer(QObject *parent = 0);
+    MockData* data();
+    void setFileSize(qint64 bytes);
+    void setSearchResultCount(int count);
+    void setLatency(int msecs);
+    int latency() const;
+    void setBandwidth(int bytesPerSecond);
+    int bandwidth() const;
+    void setErrorRate(int percent);
+    void setDropRate(int percent);
+    void setSessionTimeout(int secs);
+    void setPassword(const QString &password);
+    void handleRequest(const MockRequest &request, MockResponse &response);
+
+private slots:
+    void acceptConnection();
+
+private:
+    bool isLoggedIn(const MockRequest &request);
+    bool isAuthorized(const MockRequest &request);
+    bool checkPassword(const QString &password) const;
+    void login(const MockRequest &request, MockResponse &response);
+    void handleFeedRequest(const QByteArray &path, const MockRequest &request, MockResponse &response);
+    void handleVideoRequest(int programmeId, const MockRequest &request, MockResponse &response);
+    void redirect(MockResponse &response, const QByteArray &location, int status);
+    void notFound(MockResponse &response);
+    bool isFault(int percent) const;
+    MockData m_data;
+    QHash<QByteArray, QDateTime> m_sessions;
+    QList<int> m_playlist;
+    QList<QPair<int, QString> > m_seasonPasses;
+    QString m_password;
+    qint64 m_fileSize;
+    int m_searchResultCount;
+    int m_latency;
+    int m_bandwidth;
+    int m_errorRate;
+    int m_dropRate;
+    int m_sessionTimeout;
+    int m_nextSeasonPassId;
+    int m_requestCount;
+};
+
+class MockConnection : public QObject
+{
+    Q_OBJECT
+public:
+    MockConnection(QTcpSocket *socket, MockServer *server);
+
+private slots:
+    void readRequest();
+    void respond();
+    void writeVideo();
+    void socketDisconnected();
+
+private:
+    bool parseRequest();
+    void finishResponse();
+    QTcpSocket *m_socket;
+    MockServer *m_server;
+    QTimer *m_timer;
+    QByteArray m_buffer;
+    MockRequest m_request;
+    MockResponse m_response;
+    qint64 m_written;
+    bool m_busy;
+    bool m_keepAlive;
+};
+
+#endif // MOCKSERVER_H
@@ -0,0 +1,15 @@
+# -------------------------------------------------
+# Testipalvelin: qmake && make && ./tvkaista-mockserver --help
+# -------------------------------------------------
+QT += core \
+    network
+QT -= gui
+CONFIG += console
+CONFIG -= app_bundle
+TARGET = tvkaista-mockserver
+TEMPLATE = app
+SOURCES += main.cpp \
+    mockdata.cpp \
+    mockserver.cpp
+HEADERS += mockdata.h \
+    mockserver.h
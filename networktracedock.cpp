@@ -0,0 +1,171 @@
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QHideEvent>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QShowEvent>
+#include <QTableWidget>
+#include <QVBoxLayout>
+#include "networktracedock.h"
+#include "networktracer.h"
+
+static const int MaxRows = 500;
+
+static QString duration(qint64 start, qint64 end)
+{
+    if (start < 0 || end < 0) {
+        return QString();
+    }
+
+    return QString::number((end - start) / 1000.0, 'f', 1);
+}
+
+NetworkTraceDock::NetworkTraceDock(QWidget *parent) :
+    QDockWidget(trUtf8("Verkkoliikenne"), parent), m_tableWidget(new QTableWidget(this)),
+    m_tracerWasEnabled(false)
+{
+    setObjectName("networkTraceDockWidget");
+    QWidget *widget = new QWidget(this);
+    QVBoxLayout *layout = new QVBoxLayout(widget);
+    QHBoxLayout *buttonLayout = new QHBoxLayout();
+    QPushButton *clearButton = new QPushButton(trUtf8("&Tyhjennä"), widget);
+    QPushButton *saveButton = new QPushButton(trUtf8("T&allenna..."), widget);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(clearButton);
+    buttonLayout->addWidget(saveButton);
+    layout->addWidget(m_tableWidget);
+    layout->addLayout(buttonLayout);
+    setWidget(widget);
+
+    /* Ajat ovat millisekunteina. Odotus on aika pyynnöstä ensimmäiseen tavuun. */
+    m_tableWidget->setColumnCount(8);
+    m_tableWidget->setHorizontalHeaderLabels(QStringList() << trUtf8("Pyyntö") << trUtf8("Luokka")
+                                             << trUtf8("Tila") << trUtf8("Odotus") << trUtf8("Lataus")
+                                             << trUtf8("Jäsennys") << trUtf8("Yhteensä") << trUtf8("Tavuja"));
+    m_tableWidget->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_tableWidget->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_tableWidget->verticalHeader()->hide();
+    m_tableWidget->horizontalHeader()->setStretchLastSection(false);
+    m_tableWidget->setColumnWidth(0, 320);
+
+    connect(clearButton, SIGNAL(clicked()), SLOT(clear()));
+    connect(saveButton, SIGNAL(clicked()), SLOT(save()));
+    connect(NetworkTracer::instance(), SIGNAL(recordUpdated(int)), SLOT(recordUpdated(int)), Qt::QueuedConnection);
+}
+
+void NetworkTraceDock::showEvent(QShowEvent *e)
+{
+    QDockWidget::showEvent(e);
+
+    if (e->spontaneous()) {
+        return;
+    }
+
+    m_tracerWasEnabled = NetworkTracer::instance()->isEnabled();
+    NetworkTracer::instance()->setEnabled(true);
+    QList<TraceRecord> records = NetworkTracer::instance()->records();
+
+    /* Piilossa ollessa kirjatut pyynnöt lisätään taulukkoon. */
+    for (int i = qMax(0, records.size() - MaxRows); i < records.size(); i++) {
+        recordUpdated(records.at(i).id);
+    }
+}
+
+void NetworkTraceDock::hideEvent(QHideEvent *e)
+{
+    QDockWidget::hideEvent(e);
+
+    /* Seuranta jää päälle, jos se on käynnistetty valitsimella --trace. */
+    if (!e->spontaneous()) {
+        NetworkTracer::instance()->setEnabled(m_tracerWasEnabled);
+    }
+}
+
+void NetworkTraceDock::recordUpdated(int id)
+{
+    if (!isVisible()) {
+        return;
+    }
+
+    TraceRecord record = NetworkTracer::instance()->record(id);
+
+    if (record.id < 0) {
+        return;
+    }
+
+    int row;
+
+    if (m_rows.contains(id)) {
+        row = m_rows.value(id);
+    }
+    else {
+        /* Vanhimmat rivit poistetaan, jotta taulukko ei kasva rajatta. */
+        if (m_tableWidget->rowCount() >= MaxRows) {
+            m_tableWidget->removeRow(0);
+            QHash<int, int>::iterator i = m_rows.begin();
+
+            while (i != m_rows.end()) {
+                if (--i.value() < 0) {
+                    i = m_rows.erase(i);
+                }
+                else {
+                    ++i;
+                }
+            }
+        }
+
+        row = m_tableWidget->rowCount();
+        m_tableWidget->insertRow(row);
+        m_rows.insert(id, row);
+    }
+
+    qint64 end = qMax(record.finished, record.parseEnd);
+    QStringList texts;
+    texts << QString("%1 %2").arg(QString(record.method), record.url.toString())
+          << record.category
+          << (record.status > 0 ? QString::number(record.status) : QString())
+          << duration(record.queued, record.firstByte)
+          << duration(record.firstByte, record.finished)
+          << (record.parseEnd >= 0 ? duration(0, record.parseTime) : QString())
+          << duration(record.queued, end)
+          << (record.finished >= 0 ? QString::number(record.bytes) : QString());
+
+    for (int i = 0; i < texts.size(); i++) {
+        QTableWidgetItem *item = m_tableWidget->item(row, i);
+
+        if (item == 0) {
+            item = new QTableWidgetItem();
+            m_tableWidget->setItem(row, i, item);
+
+            if (i >= 2) {
+                item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            }
+        }
+
+        item->setText(texts.at(i));
+    }
+
+    m_tableWidget->item(row, 0)->setToolTip(record.url.toString());
+}
+
+void NetworkTraceDock::clear()
+{
+    NetworkTracer::instance()->clear();
+    m_tableWidget->setRowCount(0);
+    m_rows.clear();
+}
+
+void NetworkTraceDock::save()
+{
+    QString filename = QFileDialog::getSaveFileName(this, trUtf8("Tallenna"), "trace.json",
+                                                    trUtf8("Chrome trace (*.json)"));
+
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    if (!NetworkTracer::instance()->writeChromeTrace(filename)) {
+        QMessageBox::warning(this, windowTitle(), trUtf8("Tiedoston %1 tallennus epäonnistui.").arg(filename));
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef NETWORKTRACEDOCK_H
+#define NETWORKTRACEDOCK_H
+
+#include <QDockWidget>
+#include <QHash>
+
+class QTableWidget;
+
+class NetworkTraceDock : public QDockWidget
+{
+    Q_OBJECT
+public:
+    NetworkTraceDock(QWidget *parent = 0);
+
+protected:
+    void showEvent(QShowEvent *e);
+    void hideEvent(QHideEvent *e);
+
+private slots:
+    void recordUpdated(int id);
+    void clear();
+    void save();
+
+private:
+    QTableWidget *m_tableWidget;
+    QHash<int, int> m_rows;
+    bool m_tracerWasEnabled;
+};
+
+#endif // NETWORKTRACEDOCK_H
@@ -0,0 +1,288 @@
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QNetworkReply>
+#include <QStringList>
+#include "networktracer.h"
+
+/* Jokaisesta pyynnöstä kirjataan vaiheiden aikaleimat mikrosekunteina: jonoon asetus,
+   ensimmäinen tavu (otsakkeet saapuneet), valmistuminen sekä vastauksen jäsennys.
+   Paloina jäsennettävän vastauksen jäsennysajat lasketaan yhteen, joten parseTime ei
+   sisällä palojen välistä odotusta verkosta.
+   Qt 4 ei kerro, milloin pyyntö lähtee verkkoon, joten odotusaikaan sisältyy myös
+   QNetworkAccessManagerin yhteysjono. Välimuistin kirjoitukset kirjataan erikseen
+   kirjoitussäikeestä. */
+
+static const int MaxRecords = 5000;
+
+TraceRecord::TraceRecord() :
+    id(-1), queued(-1), firstByte(-1), finished(-1), parseStart(-1), parseEnd(-1),
+    parseTime(0), bytes(0), status(0)
+{
+}
+
+NetworkTracer::NetworkTracer() :
+    QObject(), m_nextId(1), m_enabled(false)
+{
+    m_timer.start();
+}
+
+NetworkTracer* NetworkTracer::instance()
+{
+    /* Luodaan pääsäikeessä ennen muita säikeitä (main.cpp). */
+    static NetworkTracer *tracer = 0;
+
+    if (tracer == 0) {
+        tracer = new NetworkTracer();
+    }
+
+    return tracer;
+}
+
+void NetworkTracer::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+}
+
+bool NetworkTracer::isEnabled() const
+{
+    return m_enabled;
+}
+
+qint64 NetworkTracer::timestamp() const
+{
+    return m_timer.nsecsElapsed() / 1000;
+}
+
+void NetworkTracer::traceRequest(QNetworkReply *reply, const QByteArray &method)
+{
+    if (!m_enabled || reply == 0) {
+        return;
+    }
+
+    TraceRecord record;
+    QString path = reply->url().path();
+    record.method = method;
+    record.url = reply->url();
+    record.queued = timestamp();
+    record.category = path.section('/', 1, 1);
+
+    if (record.category.isEmpty()) {
+        record.category = reply->url().host();
+    }
+
+    int id = addRecord(record);
+    m_mutex.lock();
+    m_replies.insert(reply, id);
+    m_mutex.unlock();
+    connect(reply, SIGNAL(metaDataChanged()), SLOT(replyMetaDataChanged()));
+    connect(reply, SIGNAL(downloadProgress(qint64,qint64)), SLOT(replyDownloadProgress(qint64,qint64)));
+    connect(reply, SIGNAL(finished()), SLOT(replyFinished()));
+    connect(reply, SIGNAL(destroyed(QObject*)), SLOT(replyDestroyed(QObject*)));
+    emit recordUpdated(id);
+}
+
+void NetworkTracer::traceParse(QNetworkReply *reply, qint64 elapsed)
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    TraceRecord *record = recordForReply(reply);
+
+    if (record == 0) {
+        return;
+    }
+
+    /* Kutsutaan jokaisen jäsennetyn palan jälkeen. Ensimmäinen pala aloittaa jäsennyksen. */
+    record->parseEnd = timestamp();
+    record->parseTime += elapsed;
+
+    if (record->parseStart < 0) {
+        record->parseStart = record->parseEnd - elapsed;
+    }
+
+    int id = record->id;
+    locker.unlock();
+    emit recordUpdated(id);
+}
+
+void NetworkTracer::traceCacheWrite(const QString &filename, qint64 start)
+{
+    if (!m_enabled) {
+        return;
+    }
+
+    /* Kutsutaan CacheWriter-säikeestä. */
+    TraceRecord record;
+    record.category = "cache";
+    record.method = "WRITE";
+    record.url = QUrl::fromLocalFile(filename);
+    record.queued = start;
+    record.finished = timestamp();
+    record.bytes = QFileInfo(filename).size();
+    emit recordUpdated(addRecord(record));
+}
+
+QList<TraceRecord> NetworkTracer::records() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_records;
+}
+
+TraceRecord NetworkTracer::record(int id) const
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_records.isEmpty()) {
+        return TraceRecord();
+    }
+
+    int index = id - m_records.first().id;
+    return index >= 0 && index < m_records.size() ? m_records.at(index) : TraceRecord();
+}
+
+void NetworkTracer::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_records.clear();
+}
+
+bool NetworkTracer::writeChromeTrace(const QString &filename) const
+{
+    /* Chromen trace_event-muoto: pyynnöt ovat sisäkkäisiä asynkronisia tapahtumia
+       ja välimuistin kirjoitukset omalla rivillään kestotapahtumia. */
+    QList<TraceRecord> records = this->records();
+    QFile file(filename);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot write trace" << filename << file.errorString();
+        return false;
+    }
+
+    qDebug() << "WRITE" << filename;
+    QStringList events;
+    events.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"network\"}}");
+    events.append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"cache writer\"}}");
+
+    for (int i = 0; i < records.size(); i++) {
+        TraceRecord record = records.at(i);
+        QString url = record.url.toString();
+        url.replace('\\', "\\\\").replace('"', "\\\"");
+
+        if (record.category == "cache") {
+            events.append(QString("{\"name\":\"write\",\"cat\":\"cache\",\"ph\":\"X\",\"pid\":1,\"tid\":2,"
+                                  "\"ts\":%1,\"dur\":%2,\"args\":{\"file\":\"%3\",\"bytes\":%4}}")
+                          .arg(record.queued).arg(record.finished - record.queued).arg(url).arg(record.bytes));
+            continue;
+        }
+
+        if (record.finished < 0) {
+            continue;
+        }
+
+        QString name = QString("%1 %2").arg(QString(record.method), record.url.path());
+        name.replace('\\', "\\\\").replace('"', "\\\"");
+        QString prefix = QString("\"cat\":\"%1\",\"pid\":1,\"tid\":1,\"id\":%2,").arg(record.category).arg(record.id);
+        qint64 firstByte = record.firstByte >= 0 ? record.firstByte : record.finished;
+        qint64 end = qMax(record.finished, record.parseEnd);
+        events.append(QString("{\"name\":\"%1\",%2\"ph\":\"b\",\"ts\":%3,\"args\":{\"url\":\"%4\",\"status\":%5,\"bytes\":%6}}")
+                      .arg(name, prefix).arg(record.queued).arg(url).arg(record.status).arg(record.bytes));
+        events.append(QString("{\"name\":\"wait\",%1\"ph\":\"b\",\"ts\":%2}").arg(prefix).arg(record.queued));
+        events.append(QString("{\"name\":\"wait\",%1\"ph\":\"e\",\"ts\":%2}").arg(prefix).arg(firstByte));
+        events.append(QString("{\"name\":\"download\",%1\"ph\":\"b\",\"ts\":%2}").arg(prefix).arg(firstByte));
+        events.append(QString("{\"name\":\"download\",%1\"ph\":\"e\",\"ts\":%2}").arg(prefix).arg(record.finished));
+
+        if (record.parseEnd >= 0) {
+            events.append(QString("{\"name\":\"parse\",%1\"ph\":\"b\",\"ts\":%2,\"args\":{\"parse_us\":%3}}")
+                          .arg(prefix).arg(record.parseStart).arg(record.parseTime));
+            events.append(QString("{\"name\":\"parse\",%1\"ph\":\"e\",\"ts\":%2}").arg(prefix).arg(record.parseEnd));
+        }
+
+        events.append(QString("{\"name\":\"%1\",%2\"ph\":\"e\",\"ts\":%3}").arg(name, prefix).arg(end));
+    }
+
+    QByteArray data = "{\"traceEvents\":[\n" + events.join(",\n").toUtf8() + "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return file.write(data) == data.size();
+}
+
+void NetworkTracer::replyMetaDataChanged()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    QMutexLocker locker(&m_mutex);
+    TraceRecord *record = recordForReply(reply);
+
+    if (record != 0 && record->firstByte < 0) {
+        record->firstByte = timestamp();
+        record->status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    }
+}
+
+void NetworkTracer::replyDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
+{
+    Q_UNUSED(bytesTotal);
+    QMutexLocker locker(&m_mutex);
+    TraceRecord *record = recordForReply(qobject_cast<QNetworkReply*>(sender()));
+
+    if (record != 0) {
+        record->bytes = bytesReceived;
+    }
+}
+
+void NetworkTracer::replyFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    QMutexLocker locker(&m_mutex);
+    TraceRecord *record = recordForReply(reply);
+
+    if (record == 0) {
+        return;
+    }
+
+    record->finished = timestamp();
+    record->status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (record->firstByte < 0) {
+        record->firstByte = record->finished;
+    }
+
+    int id = record->id;
+    locker.unlock();
+    emit recordUpdated(id);
+}
+
+void NetworkTracer::replyDestroyed(QObject *object)
+{
+    QMutexLocker locker(&m_mutex);
+    m_replies.remove(object);
+}
+
+int NetworkTracer::addRecord(const TraceRecord &record)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_records.size() >= MaxRecords) {
+        m_records.removeFirst();
+    }
+
+    m_records.append(record);
+    m_records.last().id = m_nextId;
+    return m_nextId++;
+}
+
+TraceRecord* NetworkTracer::recordForReply(QNetworkReply *reply)
+{
+    /* Kutsutaan m_mutex lukittuna. */
+    if (reply == 0 || !m_replies.contains(reply) || m_records.isEmpty()) {
+        return 0;
+    }
+
+    int index = m_replies.value(reply) - m_records.first().id;
+
+    if (index < 0 || index >= m_records.size()) {
+        return 0;
+    }
+
+    return &m_records[index];
+}
@@ -0,0 +1,67 @@
+#ifndef NETWORKTRACER_H
+#define NETWORKTRACER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QObject>
+#include <QUrl>
+
+class QNetworkReply;
+
+struct TraceRecord
+{
+    TraceRecord();
+    int id;
+    QString category;
+    QByteArray method;
+    QUrl url;
+    qint64 queued;
+    qint64 firstByte;
+    qint64 finished;
+    qint64 parseStart;
+    qint64 parseEnd;
+    qint64 parseTime;
+    qint64 bytes;
+    int status;
+};
+
+class NetworkTracer : public QObject
+{
+    Q_OBJECT
+public:
+    static NetworkTracer* instance();
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    qint64 timestamp() const;
+    void traceRequest(QNetworkReply *reply, const QByteArray &method);
+    void traceParse(QNetworkReply *reply, qint64 elapsed);
+    void traceCacheWrite(const QString &filename, qint64 start);
+    QList<TraceRecord> records() const;
+    TraceRecord record(int id) const;
+    void clear();
+    bool writeChromeTrace(const QString &filename) const;
+
+signals:
+    void recordUpdated(int id);
+
+private slots:
+    void replyMetaDataChanged();
+    void replyDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
+    void replyFinished();
+    void replyDestroyed(QObject *object);
+
+private:
+    NetworkTracer();
+    int addRecord(const TraceRecord &record);
+    TraceRecord* recordForReply(QNetworkReply *reply);
+    QElapsedTimer m_timer;
+    QList<TraceRecord> m_records;
+    QHash<QObject*, int> m_replies;
+    mutable QMutex m_mutex;
+    int m_nextId;
+    bool m_enabled;
+};
+
+#endif // NETWORKTRACER_H
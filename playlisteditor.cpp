@@ -0,0 +1,185 @@
+#include <QDebug>
+#include <QNetworkReply>
+#include <QTimer>
+#include "playlisteditor.h"
+#include "programmefeedparser.h"
+#include "sessionmanager.h"
+#include "tvkaistaclient.h"
+
+/* Muokkaukset lähetetään rinnakkain toisistaan riippumattomina pyyntöinä. Näkymä ja
+   välimuisti päivitetään jo ennen vastausta ja palautetaan, jos pyyntö epäonnistuu.
+
+   Muokkausten tyypit editFinished()-signaalissa:
+   1 = lisäys listaan, 2 = poisto listasta, 3 = lisäys sarjoihin, 4 = poisto sarjoista */
+
+static const int MaxParallelRequests = 6;
+static const int ReconcileInterval = 10 * 60 * 1000;
+
+PlaylistEditor::PlaylistEditor(TvkaistaClient *client, QObject *parent) :
+    QObject(parent), m_client(client), m_reconcileTimer(new QTimer(this)), m_seasonPassParts(0),
+    m_waitingForLogin(false)
+{
+    m_reconcileTimer->setInterval(ReconcileInterval);
+    connect(m_client->session(), SIGNAL(loggedIn()), SLOT(loginFinished()));
+    connect(m_client->session(), SIGNAL(loginFailed(QNetworkReply::NetworkError)), SLOT(loginFinished()));
+    connect(m_reconcileTimer, SIGNAL(timeout()), SLOT(reconcile()));
+    m_reconcileTimer->start();
+}
+
+void PlaylistEditor::edit(int type, const Programme &programme)
+{
+    PlaylistEdit edit;
+    edit.type = type;
+    edit.programme = programme;
+    edit.attempts = 0;
+    m_queue.append(edit);
+    sendRequests();
+}
+
+bool PlaylistEditor::isIdle() const
+{
+    return m_queue.isEmpty() && m_replies.isEmpty();
+}
+
+void PlaylistEditor::reconcile()
+{
+    /* Palvelimen tilaa ei verrata, kun omia muokkauksia on vielä kesken. */
+    if (!isIdle() || !m_feedReplies.isEmpty() || !m_client->isValidUsernameAndPassword()) {
+        return;
+    }
+
+    QNetworkReply *reply = m_client->sendPlaylistFeedRequest();
+    connect(reply, SIGNAL(finished()), SLOT(feedRequestFinished()));
+    m_feedReplies.insert(reply, 1);
+
+    reply = m_client->sendSeasonPassFeedRequest(false);
+    connect(reply, SIGNAL(finished()), SLOT(feedRequestFinished()));
+    m_feedReplies.insert(reply, 2);
+
+    reply = m_client->sendSeasonPassFeedRequest(true);
+    connect(reply, SIGNAL(finished()), SLOT(feedRequestFinished()));
+    m_feedReplies.insert(reply, 3);
+    m_seasonPassParts = 2;
+}
+
+void PlaylistEditor::sendRequests()
+{
+    if (m_waitingForLogin) {
+        return;
+    }
+
+    while (m_replies.size() < MaxParallelRequests && !m_queue.isEmpty()) {
+        PlaylistEdit edit = m_queue.takeFirst();
+        QNetworkReply *reply;
+
+        if (edit.type == 1 || edit.type == 2) {
+            reply = m_client->sendPlaylistEditRequest(edit.programme.id, edit.type == 1);
+        }
+        else {
+            reply = m_client->sendSeasonPassEditRequest(
+                    edit.type == 3 ? edit.programme.id : edit.programme.seasonPassId, edit.type == 3);
+        }
+
+        connect(reply, SIGNAL(finished()), SLOT(editRequestFinished()));
+        m_replies.insert(reply, edit);
+    }
+}
+
+void PlaylistEditor::editRequestFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || !m_replies.contains(reply)) {
+        return;
+    }
+
+    PlaylistEdit edit = m_replies.take(reply);
+    reply->deleteLater();
+    bool ok = reply->error() == QNetworkReply::NoError;
+    bool loginRedirect = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 302 &&
+                         reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl().path().startsWith("/login");
+
+    if (loginRedirect && edit.attempts == 0) {
+        /* Istunto on vanhentunut. Muokkaus lähetetään uudelleen yhteisen kirjautumisen jälkeen. */
+        edit.attempts++;
+        m_queue.prepend(edit);
+        m_waitingForLogin = true;
+        m_client->session()->renew(reply, this, SLOT(loginFinished()));
+        return;
+    }
+
+    /* Palvelin ei tehnyt muokkausta, jos se ohjaa yhä kirjautumissivulle. */
+    if (loginRedirect) {
+        ok = false;
+    }
+
+    if ((edit.type == 1 || edit.type == 3) && reply->error() == QNetworkReply::UnknownContentError) {
+        /* Ohjelma oli jo lisätty, joten paikallinen tila on oikea. */
+        ok = true;
+    }
+
+    if (!ok) {
+        qDebug() << "Edit failed" << edit.type << edit.programme.id << reply->errorString();
+    }
+
+    emit editFinished(edit.type, edit.programme, ok);
+    sendRequests();
+
+    if (isIdle()) {
+        emit finished();
+    }
+}
+
+void PlaylistEditor::loginFinished()
+{
+    if (m_waitingForLogin) {
+        m_waitingForLogin = false;
+        sendRequests();
+    }
+}
+
+void PlaylistEditor::feedRequestFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || !m_feedReplies.contains(reply)) {
+        return;
+    }
+
+    int type = m_feedReplies.take(reply);
+    reply->deleteLater();
+    bool ok = reply->error() == QNetworkReply::NoError &&
+              reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 302;
+
+    if (type == 3) {
+        m_seasonPassIndex = ok ? TvkaistaClient::parseSeasonPassIndex(reply, ok) : QMap<QString, int>();
+    }
+    else if (ok) {
+        ProgrammeFeedParser parser;
+        ok = parser.parse(reply);
+
+        if (ok && type == 1) {
+            emit playlistReconciled(parser.programmes());
+        }
+        else if (ok) {
+            m_seasonPassList = parser.programmes();
+        }
+    }
+
+    if (type == 1) {
+        return;
+    }
+
+    /* Sarjat päivitetään vasta, kun sekä lista että hakemisto on saatu. */
+    if (!ok) {
+        m_seasonPassParts = -1;
+    }
+    else if (m_seasonPassParts > 0 && --m_seasonPassParts == 0) {
+        emit seasonPassesReconciled(m_seasonPassList, m_seasonPassIndex);
+    }
+
+    if (!m_feedReplies.values().contains(2) && !m_feedReplies.values().contains(3)) {
+        m_seasonPassList.clear();
+        m_seasonPassIndex.clear();
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef PLAYLISTEDITOR_H
+#define PLAYLISTEDITOR_H
+
+#include <QMap>
+#include <QObject>
+#include "programme.h"
+
+class QNetworkReply;
+class QTimer;
+class TvkaistaClient;
+
+struct PlaylistEdit
+{
+    int type;
+    Programme programme;
+    int attempts;
+};
+
+class PlaylistEditor : public QObject
+{
+    Q_OBJECT
+public:
+    PlaylistEditor(TvkaistaClient *client, QObject *parent = 0);
+    void edit(int type, const Programme &programme);
+    bool isIdle() const;
+
+public slots:
+    void reconcile();
+
+signals:
+    void editFinished(int type, const Programme &programme, bool ok);
+    void finished();
+    void playlistReconciled(const QList<Programme> &programmes);
+    void seasonPassesReconciled(const QList<Programme> &programmes, const QMap<QString, int> &seasonPasses);
+
+private slots:
+    void sendRequests();
+    void editRequestFinished();
+    void feedRequestFinished();
+    void loginFinished();
+
+private:
+    TvkaistaClient *m_client;
+    QTimer *m_reconcileTimer;
+    QList<PlaylistEdit> m_queue;
+    QMap<QNetworkReply*, PlaylistEdit> m_replies;
+    QMap<QNetworkReply*, int> m_feedReplies;
+    QList<Programme> m_seasonPassList;
+    QMap<QString, int> m_seasonPassIndex;
+    int m_seasonPassParts;
+    bool m_waitingForLogin;
+};
+
+#endif // PLAYLISTEDITOR_H
@@ -0,0 +1,413 @@
+#include <QDataStream>
+#include <QDebug>
+#include <QMap>
+#include "posterpack.h"
+
+/* Kuukauden ohjelmakuvat tallennetaan yhteen tiedostoon, johon kuvia vain lisätään.
+
+   posters.pack: otsake (quint32 "TVPP", quint8 versio) ja sen perässä tietueita
+   (qint32 ohjelman id, quint32 koko, JPEG-data).
+
+   posters.idx: otsake (quint32 "TVPI", quint8 versio, quint8 liput) ja sen perässä tietueita
+   (qint32 ohjelman id, qint64 datan sijainti, quint32 koko). Koko 0 tarkoittaa poistettua
+   kuvaa. Jos hakemisto puuttuu tai on viallinen, se luodaan uudelleen pakkatiedostosta. */
+
+static const quint32 PackMagic = 0x54565050;
+static const quint32 IndexMagic = 0x54565049;
+static const quint8 PackVersion = 1;
+static const qint64 PackHeaderSize = 5;
+static const qint64 RecordHeaderSize = 8;
+
+PosterPack::PosterPack(const QString &path) :
+    m_path(path), m_map(0), m_mapSize(0), m_deadBytes(0), m_migrated(false)
+{
+}
+
+PosterPack::~PosterPack()
+{
+    close();
+}
+
+bool PosterPack::open()
+{
+    m_packFile.setFileName(m_path + ".pack");
+    m_indexFile.setFileName(m_path + ".idx");
+
+    if (!m_packFile.open(QIODevice::ReadWrite)) {
+        m_error = m_packFile.errorString();
+        return false;
+    }
+
+    QDataStream stream(&m_packFile);
+
+    if (m_packFile.size() == 0) {
+        stream << PackMagic << PackVersion;
+        m_packFile.flush();
+    }
+    else {
+        quint32 magic;
+        quint8 version;
+        stream >> magic >> version;
+
+        if (magic != PackMagic || version != PackVersion) {
+            m_error = "Invalid poster pack";
+            m_packFile.close();
+            return false;
+        }
+    }
+
+    if (!loadIndex() && !rebuildIndex()) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void PosterPack::close()
+{
+    unmap();
+    m_packFile.close();
+    m_indexFile.close();
+    m_entries.clear();
+    m_deadBytes = 0;
+}
+
+QString PosterPack::lastError() const
+{
+    return m_error;
+}
+
+bool PosterPack::contains(int id) const
+{
+    return m_entries.contains(id);
+}
+
+quint32 PosterPack::size(int id) const
+{
+    return m_entries.contains(id) ? m_entries.value(id).size : 0;
+}
+
+QList<int> PosterPack::ids() const
+{
+    return m_entries.keys();
+}
+
+QByteArray PosterPack::read(int id)
+{
+    if (!m_entries.contains(id)) {
+        return QByteArray();
+    }
+
+    PosterPackEntry entry = m_entries.value(id);
+    qint64 end = entry.offset + entry.size;
+
+    /* Uudet kuvat ovat kartoitetun alueen ulkopuolella, joten kartoitus uusitaan tarvittaessa. */
+    if (m_map == 0 || m_mapSize < end) {
+        unmap();
+        m_mapSize = m_packFile.size();
+        m_map = m_packFile.map(0, m_mapSize);
+
+        if (m_map == 0) {
+            m_mapSize = 0;
+        }
+    }
+
+    if (m_map != 0) {
+        return QByteArray(reinterpret_cast<const char*>(m_map) + entry.offset, entry.size);
+    }
+
+    if (!m_packFile.seek(entry.offset)) {
+        return QByteArray();
+    }
+
+    return m_packFile.read(entry.size);
+}
+
+bool PosterPack::append(int id, const QByteArray &data)
+{
+    if (!m_packFile.isOpen() || data.isEmpty()) {
+        return false;
+    }
+
+    qint64 pos = m_packFile.size();
+
+    if (!m_packFile.seek(pos)) {
+        m_error = m_packFile.errorString();
+        return false;
+    }
+
+    QDataStream stream(&m_packFile);
+    stream << (qint32)id << (quint32)data.size();
+
+    if (m_packFile.write(data) != data.size() || !m_packFile.flush()) {
+        m_error = m_packFile.errorString();
+        return false;
+    }
+
+    if (m_entries.contains(id)) {
+        m_deadBytes += m_entries.value(id).size + RecordHeaderSize;
+    }
+
+    PosterPackEntry entry;
+    entry.offset = pos + RecordHeaderSize;
+    entry.size = data.size();
+    m_entries.insert(id, entry);
+    return appendIndexRecord(id, entry.offset, entry.size);
+}
+
+bool PosterPack::remove(int id)
+{
+    if (!m_entries.contains(id)) {
+        return false;
+    }
+
+    m_deadBytes += m_entries.take(id).size + RecordHeaderSize;
+    return appendIndexRecord(id, 0, 0);
+}
+
+qint64 PosterPack::fileSize() const
+{
+    return m_packFile.size();
+}
+
+qint64 PosterPack::deadBytes() const
+{
+    return m_deadBytes;
+}
+
+bool PosterPack::compact()
+{
+    QString packFilename = m_path + ".pack";
+    QString indexFilename = m_path + ".idx";
+    QFile tempFile(packFilename + ".tmp");
+
+    if (!tempFile.open(QIODevice::WriteOnly)) {
+        m_error = tempFile.errorString();
+        return false;
+    }
+
+    qDebug() << "WRITE" << tempFile.fileName();
+    QDataStream stream(&tempFile);
+    stream << PackMagic << PackVersion;
+
+    /* Kuvat kopioidaan alkuperäisessä järjestyksessä. */
+    QMap<qint64, int> order;
+    QHash<int, PosterPackEntry>::const_iterator i = m_entries.constBegin();
+
+    while (i != m_entries.constEnd()) {
+        order.insert(i.value().offset, i.key());
+        ++i;
+    }
+
+    QHash<int, PosterPackEntry> entries;
+    QList<int> ids = order.values();
+    int count = ids.size();
+
+    for (int j = 0; j < count; j++) {
+        int id = ids.at(j);
+        QByteArray data = read(id);
+        PosterPackEntry entry;
+        entry.offset = tempFile.pos() + RecordHeaderSize;
+        entry.size = data.size();
+        stream << (qint32)id << (quint32)data.size();
+        tempFile.write(data);
+        entries.insert(id, entry);
+    }
+
+    tempFile.close();
+
+    if (stream.status() != QDataStream::Ok || tempFile.error() != QFile::NoError) {
+        m_error = tempFile.errorString();
+        tempFile.remove();
+        return false;
+    }
+
+    QHash<int, PosterPackEntry> oldEntries = m_entries;
+    m_entries = entries;
+
+    if (!writeIndex(indexFilename + ".tmp", ids)) {
+        m_entries = oldEntries;
+        tempFile.remove();
+        return false;
+    }
+
+    close();
+    QFile::remove(packFilename);
+    QFile::remove(indexFilename);
+
+    if (!QFile::rename(packFilename + ".tmp", packFilename) ||
+        !QFile::rename(indexFilename + ".tmp", indexFilename)) {
+        m_error = "Cannot rename poster pack";
+        return false;
+    }
+
+    return open();
+}
+
+bool PosterPack::isMigrated() const
+{
+    return m_migrated;
+}
+
+void PosterPack::setMigrated(bool migrated)
+{
+    m_migrated = migrated;
+
+    if (m_indexFile.isOpen() && m_indexFile.seek(5)) {
+        char flags = migrated ? 0x01 : 0x00;
+        m_indexFile.write(&flags, 1);
+        m_indexFile.flush();
+    }
+}
+
+bool PosterPack::loadIndex()
+{
+    if (!m_indexFile.open(QIODevice::ReadWrite)) {
+        return false;
+    }
+
+    QDataStream stream(&m_indexFile);
+    quint32 magic;
+    quint8 version;
+    quint8 flags;
+    stream >> magic >> version >> flags;
+
+    if (stream.status() != QDataStream::Ok || magic != IndexMagic || version != PackVersion) {
+        m_indexFile.close();
+        return false;
+    }
+
+    qint64 packSize = m_packFile.size();
+    qint64 liveBytes = 0;
+
+    while (!stream.atEnd()) {
+        qint32 id;
+        qint64 offset;
+        quint32 size;
+        stream >> id >> offset >> size;
+
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+
+        if (size == 0) {
+            m_entries.remove(id);
+            continue;
+        }
+
+        if (offset < PackHeaderSize + RecordHeaderSize || offset + size > packSize) {
+            m_entries.clear();
+            m_indexFile.close();
+            return false;
+        }
+
+        PosterPackEntry entry;
+        entry.offset = offset;
+        entry.size = size;
+        m_entries.insert(id, entry);
+    }
+
+    QHash<int, PosterPackEntry>::const_iterator i = m_entries.constBegin();
+
+    while (i != m_entries.constEnd()) {
+        liveBytes += i.value().size + RecordHeaderSize;
+        ++i;
+    }
+
+    m_deadBytes = packSize - PackHeaderSize - liveBytes;
+    m_migrated = (flags & 0x01) != 0;
+    return true;
+}
+
+bool PosterPack::rebuildIndex()
+{
+    qWarning() << "Rebuilding poster index" << m_path;
+    m_entries.clear();
+    qint64 packSize = m_packFile.size();
+    qint64 pos = PackHeaderSize;
+    QDataStream stream(&m_packFile);
+
+    /* Poistomerkinnät ovat vain hakemistossa, joten poistetut kuvat palautuvat. */
+    while (pos + RecordHeaderSize <= packSize && m_packFile.seek(pos)) {
+        qint32 id;
+        quint32 size;
+        stream >> id >> size;
+
+        if (stream.status() != QDataStream::Ok || pos + RecordHeaderSize + size > packSize) {
+            break;
+        }
+
+        PosterPackEntry entry;
+        entry.offset = pos + RecordHeaderSize;
+        entry.size = size;
+        m_entries.insert(id, entry);
+        pos += RecordHeaderSize + size;
+    }
+
+    qint64 liveBytes = 0;
+    QHash<int, PosterPackEntry>::const_iterator i = m_entries.constBegin();
+
+    while (i != m_entries.constEnd()) {
+        liveBytes += i.value().size + RecordHeaderSize;
+        ++i;
+    }
+
+    m_deadBytes = packSize - PackHeaderSize - liveBytes;
+    m_indexFile.close();
+
+    if (!writeIndex(m_indexFile.fileName(), m_entries.keys())) {
+        return false;
+    }
+
+    if (!m_indexFile.open(QIODevice::ReadWrite)) {
+        m_error = m_indexFile.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+bool PosterPack::writeIndex(const QString &filename, const QList<int> &ids)
+{
+    QFile file(filename);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_error = file.errorString();
+        return false;
+    }
+
+    qDebug() << "WRITE" << filename;
+    QDataStream stream(&file);
+    stream << IndexMagic << PackVersion << (quint8)(m_migrated ? 0x01 : 0x00);
+    int count = ids.size();
+
+    for (int i = 0; i < count; i++) {
+        PosterPackEntry entry = m_entries.value(ids.at(i));
+        stream << (qint32)ids.at(i) << entry.offset << entry.size;
+    }
+
+    file.close();
+    return stream.status() == QDataStream::Ok;
+}
+
+bool PosterPack::appendIndexRecord(int id, qint64 offset, quint32 size)
+{
+    if (!m_indexFile.isOpen() || !m_indexFile.seek(m_indexFile.size())) {
+        return false;
+    }
+
+    QDataStream stream(&m_indexFile);
+    stream << (qint32)id << offset << size;
+    m_indexFile.flush();
+    return stream.status() == QDataStream::Ok;
+}
+
+void PosterPack::unmap()
+{
+    if (m_map != 0) {
+        m_packFile.unmap(m_map);
+        m_map = 0;
+        m_mapSize = 0;
+    }
+}
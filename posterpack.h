@@ -0,0 +1,51 @@
+#ifndef POSTERPACK_H
+#define POSTERPACK_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+
+struct PosterPackEntry
+{
+    qint64 offset;
+    quint32 size;
+};
+
+class PosterPack
+{
+public:
+    PosterPack(const QString &path);
+    ~PosterPack();
+    bool open();
+    void close();
+    QString lastError() const;
+    bool contains(int id) const;
+    quint32 size(int id) const;
+    QList<int> ids() const;
+    QByteArray read(int id);
+    bool append(int id, const QByteArray &data);
+    bool remove(int id);
+    qint64 fileSize() const;
+    qint64 deadBytes() const;
+    bool compact();
+    bool isMigrated() const;
+    void setMigrated(bool migrated);
+
+private:
+    bool loadIndex();
+    bool rebuildIndex();
+    bool writeIndex(const QString &filename, const QList<int> &ids);
+    bool appendIndexRecord(int id, qint64 offset, quint32 size);
+    void unmap();
+    QString m_path;
+    QFile m_packFile;
+    QFile m_indexFile;
+    QHash<int, PosterPackEntry> m_entries;
+    QString m_error;
+    uchar *m_map;
+    qint64 m_mapSize;
+    qint64 m_deadBytes;
+    bool m_migrated;
+};
+
+#endif // POSTERPACK_H
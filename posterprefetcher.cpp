@@ -0,0 +1,303 @@
+#include <QDebug>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+#include <QScrollBar>
+#include <QTableView>
+#include <QTimer>
+#include "cache.h"
+#include "imageloader.h"
+#include "posterprefetcher.h"
+#include "programmetablemodel.h"
+#include "sessionmanager.h"
+#include "tvkaistaclient.h"
+
+static const int MaxParallelRequests = 3;
+static const int RowsAhead = 8;
+static const int FailureRetryDelay = 10 * 60;
+
+PosterPrefetcher::PosterPrefetcher(TvkaistaClient *client, ImageLoader *imageLoader, QObject *parent) :
+    QObject(parent), m_client(client), m_imageLoader(imageLoader), m_view(0),
+    m_timer(new QTimer(this)), m_currentId(-1), m_lastRow(-1), m_direction(1), m_enabled(true)
+{
+    m_timer->setSingleShot(true);
+    m_timer->setInterval(150);
+    connect(m_timer, SIGNAL(timeout()), SLOT(prefetch()));
+    connect(m_client->session(), SIGNAL(loggedIn()), SLOT(loginFinished()));
+    connect(m_client->session(), SIGNAL(loginFailed(QNetworkReply::NetworkError)), SLOT(loginFinished()));
+}
+
+void PosterPrefetcher::setView(QTableView *view)
+{
+    m_view = view;
+    connect(view->verticalScrollBar(), SIGNAL(valueChanged(int)), SLOT(viewScrolled()));
+}
+
+void PosterPrefetcher::setEnabled(bool enabled)
+{
+    m_enabled = enabled;
+
+    if (!enabled) {
+        abort();
+    }
+}
+
+bool PosterPrefetcher::isEnabled() const
+{
+    return m_enabled;
+}
+
+void PosterPrefetcher::setPosterSize(const QSize &size)
+{
+    /* Kuvat puretaan suoraan näyttökokoon. */
+    m_posterSize = size;
+}
+
+void PosterPrefetcher::fetch(const Programme &programme)
+{
+    m_currentId = programme.id;
+
+    if (!m_enabled || !isPosterNeeded(programme)) {
+        return;
+    }
+
+    if (!m_imageLoader->image(posterKey(programme)).isNull()) {
+        m_timer->start();
+        return;
+    }
+
+    if (m_client->cache()->hasPoster(programme)) {
+        loadPoster(programme);
+    }
+    else {
+        sendRequest(programme, false);
+    }
+
+    /* Seuraavat kuvat haetaan vasta, kun valinta on pysähtynyt hetkeksi. */
+    m_timer->start();
+}
+
+void PosterPrefetcher::abort()
+{
+    m_timer->stop();
+    m_loginQueue.clear();
+    QList<QNetworkReply*> replies = m_replies.keys();
+    m_replies.clear();
+
+    for (int i = 0; i < replies.size(); i++) {
+        replies.at(i)->abort();
+        replies.at(i)->deleteLater();
+    }
+}
+
+QString PosterPrefetcher::posterKey(const Programme &programme)
+{
+    return QString("i%1").arg(programme.id);
+}
+
+void PosterPrefetcher::viewScrolled()
+{
+    if (m_enabled) {
+        m_timer->start();
+    }
+}
+
+void PosterPrefetcher::prefetch()
+{
+    ProgrammeTableModel *model = m_view != 0 ? qobject_cast<ProgrammeTableModel*>(m_view->model()) : 0;
+
+    if (!m_enabled || model == 0 || model->programmeCount() == 0) {
+        return;
+    }
+
+    removeExpiredFailures();
+    int count = model->programmeCount();
+    int row = m_view->currentIndex().row();
+
+    if (row >= 0 && m_lastRow >= 0 && row != m_lastRow) {
+        m_direction = row > m_lastRow ? 1 : -1;
+    }
+
+    m_lastRow = row;
+    int first = qMax(0, m_view->rowAt(0));
+    int last = m_view->rowAt(m_view->viewport()->height() - 1);
+
+    if (last < 0) {
+        last = count - 1;
+    }
+
+    if (row < 0) {
+        row = m_direction > 0 ? first - 1 : last + 1;
+    }
+
+    /* Ensin valinnan kulkusuunnassa seuraavat rivit, sitten muut näkyvät rivit. */
+    QList<Programme> wanted;
+
+    for (int i = 1; i <= RowsAhead; i++) {
+        int index = row + i * m_direction;
+
+        if (index >= 0 && index < count) {
+            wanted.append(model->programme(index));
+        }
+    }
+
+    for (int i = first; i <= last && i < count; i++) {
+        wanted.append(model->programme(i));
+    }
+
+    QSet<int> wantedIds;
+    int wantedCount = wanted.size();
+
+    for (int i = 0; i < wantedCount; i++) {
+        wantedIds.insert(wanted.at(i).id);
+    }
+
+    /* Perutaan haut, jotka eivät enää osu näkymään tai sen lähelle. */
+    QList<QNetworkReply*> replies = m_replies.keys();
+
+    for (int i = 0; i < replies.size(); i++) {
+        QNetworkReply *reply = replies.at(i);
+        int id = m_replies.value(reply).id;
+
+        if (id != m_currentId && !wantedIds.contains(id)) {
+            m_replies.remove(reply);
+            reply->abort();
+            reply->deleteLater();
+        }
+    }
+
+    QSet<int> requestedIds;
+    QList<Programme> requested = m_replies.values();
+
+    for (int i = 0; i < requested.size(); i++) {
+        requestedIds.insert(requested.at(i).id);
+    }
+
+    /* Kirjautumista odottavat kuvat haetaan loginFinished()-slotissa. */
+    for (int i = 0; i < m_loginQueue.size(); i++) {
+        requestedIds.insert(m_loginQueue.at(i).id);
+    }
+
+    for (int i = 0; i < wantedCount; i++) {
+        Programme programme = wanted.at(i);
+
+        if (!isPosterNeeded(programme) || requestedIds.contains(programme.id) ||
+            !m_imageLoader->image(posterKey(programme)).isNull()) {
+            continue;
+        }
+
+        if (m_client->cache()->hasPoster(programme)) {
+            /* Levyllä oleva kuva puretaan valmiiksi muistiin. */
+            loadPoster(programme);
+        }
+        else if (m_replies.size() < MaxParallelRequests) {
+            sendRequest(programme, true);
+            requestedIds.insert(programme.id);
+        }
+    }
+}
+
+void PosterPrefetcher::requestFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || !m_replies.contains(reply)) {
+        return;
+    }
+
+    Programme programme = m_replies.take(reply);
+    reply->deleteLater();
+    QByteArray data = reply->readAll();
+    int status = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    QUrl location = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+
+    /* Kuva puretaan vasta ImageLoaderissa, joten tässä tarkistetaan vain JPEG-tunniste. */
+    if (reply->error() == QNetworkReply::NoError && status == 200 && data.startsWith("\xff\xd8")) {
+        m_client->cache()->savePoster(programme, data);
+        m_imageLoader->loadData(posterKey(programme), data, m_posterSize);
+    }
+    else if (status == 302 && location.path().startsWith("/login")) {
+        /* Istunto on vanhentunut. Kuva haetaan kerran uudelleen yhteisen kirjautumisen jälkeen. */
+        if (!m_loginRetried.contains(programme.id)) {
+            m_loginRetried.insert(programme.id, QDateTime::currentDateTime());
+            m_loginQueue.append(programme);
+            m_client->session()->renew(reply, this, SLOT(loginFinished()));
+        }
+    }
+    else if (status >= 400 || (status == 200 && reply->error() == QNetworkReply::NoError)) {
+        /* Palvelin vastasi virheellä tai kuva ei ole JPEG. Yritetään uudelleen vasta viiveen jälkeen. */
+        m_failed.insert(programme.id, QDateTime::currentDateTime());
+    }
+
+    if (!m_timer->isActive()) {
+        prefetch();
+    }
+}
+
+void PosterPrefetcher::loginFinished()
+{
+    QList<Programme> queue = m_loginQueue;
+    m_loginQueue.clear();
+
+    for (int i = 0; i < queue.size(); i++) {
+        if (m_enabled && isPosterNeeded(queue.at(i)) && m_imageLoader->image(posterKey(queue.at(i))).isNull()) {
+            sendRequest(queue.at(i), queue.at(i).id != m_currentId);
+        }
+    }
+}
+
+void PosterPrefetcher::sendRequest(const Programme &programme, bool lowPriority)
+{
+    QList<Programme> requested = m_replies.values();
+
+    for (int i = 0; i < requested.size(); i++) {
+        if (requested.at(i).id == programme.id) {
+            return;
+        }
+    }
+
+    QString urlString = QString("http://www.tvkaista.fi/resources/recordings/screengrabs/%1.jpg").arg(programme.id);
+    QNetworkRequest request((QUrl(urlString)));
+
+    if (lowPriority) {
+        request.setPriority(QNetworkRequest::LowPriority);
+    }
+
+    QNetworkReply *reply = m_client->sendRequest(request);
+    connect(reply, SIGNAL(finished()), SLOT(requestFinished()));
+    m_replies.insert(reply, programme);
+}
+
+void PosterPrefetcher::loadPoster(const Programme &programme)
+{
+    m_imageLoader->loadPoster(posterKey(programme), m_client->cache(), programme, m_posterSize);
+}
+
+bool PosterPrefetcher::isPosterNeeded(const Programme &programme) const
+{
+    if (programme.id < 0 || (programme.flags & 0x08) != 0) {
+        return false;
+    }
+
+    return !m_failed.contains(programme.id) ||
+           m_failed.value(programme.id).secsTo(QDateTime::currentDateTime()) >= FailureRetryDelay;
+}
+
+void PosterPrefetcher::removeExpiredFailures()
+{
+    /* Epäonnistumiset unohdetaan viiveen jälkeen, joten taulukot eivät kasva rajatta. */
+    QDateTime limit = QDateTime::currentDateTime().addSecs(-FailureRetryDelay);
+    QHash<int, QDateTime> *tables[] = { &m_failed, &m_loginRetried };
+
+    for (int i = 0; i < 2; i++) {
+        QHash<int, QDateTime>::iterator j = tables[i]->begin();
+
+        while (j != tables[i]->end()) {
+            if (j.value() <= limit) {
+                j = tables[i]->erase(j);
+            }
+            else {
+                ++j;
+            }
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef POSTERPREFETCHER_H
+#define POSTERPREFETCHER_H
+
+#include <QDateTime>
+#include <QHash>
+#include <QMap>
+#include <QObject>
+#include <QSet>
+#include <QSize>
+#include "programme.h"
+
+class QNetworkReply;
+class QTableView;
+class QTimer;
+class ImageLoader;
+class TvkaistaClient;
+
+class PosterPrefetcher : public QObject
+{
+    Q_OBJECT
+public:
+    PosterPrefetcher(TvkaistaClient *client, ImageLoader *imageLoader, QObject *parent = 0);
+    void setView(QTableView *view);
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    void setPosterSize(const QSize &size);
+    void fetch(const Programme &programme);
+    void abort();
+    static QString posterKey(const Programme &programme);
+
+private slots:
+    void viewScrolled();
+    void prefetch();
+    void requestFinished();
+    void loginFinished();
+
+private:
+    void sendRequest(const Programme &programme, bool lowPriority);
+    void loadPoster(const Programme &programme);
+    bool isPosterNeeded(const Programme &programme) const;
+    void removeExpiredFailures();
+    TvkaistaClient *m_client;
+    ImageLoader *m_imageLoader;
+    QTableView *m_view;
+    QTimer *m_timer;
+    QMap<QNetworkReply*, Programme> m_replies;
+    QHash<int, QDateTime> m_failed;
+    QList<Programme> m_loginQueue;
+    QHash<int, QDateTime> m_loginRetried;
+    QSize m_posterSize;
+    int m_currentId;
+    int m_lastRow;
+    int m_direction;
+    bool m_enabled;
+};
+
+#endif // POSTERPREFETCHER_H
@@ -0,0 +1,168 @@
+#include "profiler.h"
+
+#ifdef TVKAISTAGUI_PROFILER
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QMap>
+#include <QMutex>
+#include <QStringList>
+#include <QThreadStorage>
+
+/* Jokaisella säikeellä on oma rengaspuskurinsa, johon valmistuneet vyöhykkeet
+   kirjoitetaan ilman lukitusta. Puskurit säilyvät säikeen päättymisen jälkeen, jotta
+   ne voidaan purkaa lopetettaessa flamegraph.pl:n ymmärtämään folded-muotoon. */
+
+static const int RingSize = 16384;
+
+struct ProfilerEvent
+{
+    const char *name;
+    int depth;
+    qint64 start;
+    qint64 duration;
+};
+
+struct ProfilerThread
+{
+    ProfilerThread() : depth(0), count(0) {}
+    ProfilerEvent events[RingSize];
+    int depth;
+    quint64 count;
+};
+
+/* QThreadStorage poistaa säikeen lopussa vain tämän viitteen, ei puskuria. */
+struct ProfilerThreadRef
+{
+    ProfilerThread *thread;
+};
+
+struct ProfilerStackEntry
+{
+    QString path;
+    int depth;
+    qint64 duration;
+    qint64 childDuration;
+};
+
+static QElapsedTimer profilerTimer;
+static QMutex profilerMutex;
+static QList<ProfilerThread*> profilerThreads;
+static QThreadStorage<ProfilerThreadRef*> profilerThreadRefs;
+
+static ProfilerThread* currentThread()
+{
+    if (!profilerThreadRefs.hasLocalData()) {
+        ProfilerThreadRef *ref = new ProfilerThreadRef;
+        ref->thread = new ProfilerThread;
+        profilerThreadRefs.setLocalData(ref);
+        QMutexLocker locker(&profilerMutex);
+        profilerThreads.append(ref->thread);
+    }
+
+    return profilerThreadRefs.localData()->thread;
+}
+
+static void finishEntry(const ProfilerStackEntry &entry, QMap<QString, qint64> &folded)
+{
+    folded[entry.path] += qMax(entry.duration - entry.childDuration, (qint64) 0);
+}
+
+void Profiler::initialize()
+{
+    profilerTimer.start();
+}
+
+qint64 Profiler::timestamp()
+{
+    return profilerTimer.nsecsElapsed();
+}
+
+void Profiler::beginZone()
+{
+    currentThread()->depth++;
+}
+
+void Profiler::endZone(const char *name, qint64 start)
+{
+    ProfilerThread *thread = currentThread();
+    ProfilerEvent &event = thread->events[thread->count % RingSize];
+    event.name = name;
+    event.depth = --thread->depth;
+    event.start = start;
+    event.duration = timestamp() - start;
+    thread->count++;
+}
+
+bool Profiler::dump(const QString &filename)
+{
+    /* Kutsutaan lopetettaessa, kun muut säikeet eivät enää profiloi. */
+    QMap<QString, qint64> folded;
+    QMutexLocker locker(&profilerMutex);
+
+    for (int i = 0; i < profilerThreads.size(); i++) {
+        ProfilerThread *thread = profilerThreads.at(i);
+        quint64 first = thread->count > (quint64) RingSize ? thread->count - RingSize : 0;
+        QList<ProfilerStackEntry> stack;
+
+        /* Vyöhyke kirjataan vasta päättyessään, joten lapset ovat puskurissa ennen
+           vanhempaansa. Puskuri käydään läpi lopusta alkuun, jolloin vanhempi tulee
+           ensin. Puskurista jo poistuneet vanhemmat merkitään tuntemattomiksi. */
+        for (quint64 n = thread->count; n > first; n--) {
+            const ProfilerEvent &event = thread->events[(n - 1) % RingSize];
+
+            while (!stack.isEmpty() && stack.last().depth >= event.depth) {
+                finishEntry(stack.takeLast(), folded);
+            }
+
+            QString parentPath;
+
+            if (!stack.isEmpty() && stack.last().depth == event.depth - 1) {
+                stack.last().childDuration += event.duration;
+                parentPath = stack.last().path;
+            }
+            else if (!stack.isEmpty()) {
+                parentPath = stack.last().path + ";[unknown]";
+            }
+            else if (event.depth > 0) {
+                parentPath = "[unknown]";
+            }
+
+            ProfilerStackEntry entry;
+            entry.path = parentPath.isEmpty() ? QString(event.name) : parentPath + ";" + event.name;
+            entry.depth = event.depth;
+            entry.duration = event.duration;
+            entry.childDuration = 0;
+            stack.append(entry);
+        }
+
+        while (!stack.isEmpty()) {
+            finishEntry(stack.takeLast(), folded);
+        }
+    }
+
+    locker.unlock();
+    QFile file(filename);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot write profile" << filename << file.errorString();
+        return false;
+    }
+
+    /* Arvot ovat omaa aikaa mikrosekunteina. */
+    qDebug() << "WRITE" << filename;
+    QMap<QString, qint64>::const_iterator i = folded.constBegin();
+
+    while (i != folded.constEnd()) {
+        if (i.value() >= 1000) {
+            file.write(QString("%1 %2\n").arg(i.key()).arg(i.value() / 1000).toUtf8());
+        }
+
+        ++i;
+    }
+
+    return file.error() == QFile::NoError;
+}
+
+#endif // TVKAISTAGUI_PROFILER
@@ -0,0 +1,50 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/* Profilointi käännetään mukaan vain asetuksella "qmake CONFIG+=profiler". Muuten
+   PROFILE_ZONE-makrot eivät tuota koodia lainkaan. Vyöhykkeen nimen on oltava
+   merkkijonovakio, koska siitä tallennetaan vain osoitin. */
+
+#ifdef TVKAISTAGUI_PROFILER
+
+#include <QString>
+
+class Profiler
+{
+public:
+    static void initialize();
+    static qint64 timestamp();
+    static void beginZone();
+    static void endZone(const char *name, qint64 start);
+    static bool dump(const QString &filename);
+};
+
+class ProfilerZone
+{
+public:
+    ProfilerZone(const char *name) : m_name(name), m_start(Profiler::timestamp())
+    {
+        Profiler::beginZone();
+    }
+
+    ~ProfilerZone()
+    {
+        Profiler::endZone(m_name, m_start);
+    }
+
+private:
+    const char *m_name;
+    qint64 m_start;
+};
+
+#define PROFILE_ZONE_CONCAT2(a, b) a##b
+#define PROFILE_ZONE_CONCAT(a, b) PROFILE_ZONE_CONCAT2(a, b)
+#define PROFILE_ZONE(name) ProfilerZone PROFILE_ZONE_CONCAT(profilerZone, __LINE__)(name)
+
+#else
+
+#define PROFILE_ZONE(name)
+
+#endif // TVKAISTAGUI_PROFILER
+
+#endif // PROFILER_H
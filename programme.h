@@ -1,6 +1,7 @@
 #ifndef PROGRAMME_H
 #define PROGRAMME_H
 
+#include <QByteArray>
 #include <QString>
 #include <QDateTime>
 
@@ -11,6 +12,7 @@ public:
     int id;
     QString title;
     QString description;
+    QByteArray descriptionKey;
     QDateTime startDateTime;
     int channelId;
     int flags;
@@ -1,4 +1,5 @@
 #include <QDebug>
+#include "profiler.h"
 #include "programmefeedparser.h"
 
 ProgrammeFeedParser::ProgrammeFeedParser() : m_dateTimeRegexp("(\\d{1,2}) (\\w{3}) (\\d+) (\\d{2}):(\\d{2}):(\\d{2})"),
@@ -8,8 +9,10 @@ ProgrammeFeedParser::ProgrammeFeedParser() : m_dateTimeRegexp("(\\d{1,2}) (\\w{3
 
 bool ProgrammeFeedParser::parse(QIODevice *device)
 {
+    PROFILE_ZONE("ProgrammeFeedParser::parse");
     m_reader.setDevice(device);
     m_programmes.clear();
+    m_descriptions.clear();
 
     if (!m_reader.readNextStartElement()) {
         m_error = "Invalid programme feed";
@@ -69,7 +72,17 @@ void ProgrammeFeedParser::parseItemElement()
             programme.title = m_reader.readElementText();
         }
         else if (m_reader.name() == "description") {
-            programme.description = m_reader.readElementText();
+            /* Samat kuvaukset jakavat saman merkkijonon. */
+            QString description = m_reader.readElementText();
+            QSet<QString>::const_iterator i = m_descriptions.constFind(description);
+
+            if (i != m_descriptions.constEnd()) {
+                programme.description = *i;
+            }
+            else {
+                m_descriptions.insert(description);
+                programme.description = description;
+            }
         }
         else if (m_reader.qualifiedName() == "link") {
             programme.id = parseProgrammeId(m_reader.readElementText());
@@ -4,6 +4,7 @@
 #include <QDateTime>
 #include <QPair>
 #include <QRegExp>
+#include <QSet>
 #include <QUrl>
 #include <QXmlStreamReader>
 #include "programme.h"
@@ -30,6 +31,7 @@ private:
     QString m_error;
     QList<Programme> m_programmes;
     QList<Thumbnail> m_thumbnails;
+    QSet<QString> m_descriptions;
     QRegExp m_dateTimeRegexp;
     QRegExp m_timeRegexp;
 };
@@ -0,0 +1,205 @@
+#include <QDebug>
+#include <QNetworkReply>
+#include "cache.h"
+#include "networktracer.h"
+#include "programmegridloader.h"
+#include "programmetableparser.h"
+#include "sessionmanager.h"
+#include "tvkaistaclient.h"
+
+static const int MaxParallelRequests = 4;
+
+ProgrammeGridLoader::ProgrammeGridLoader(TvkaistaClient *client, QObject *parent) :
+    QObject(parent), m_client(client), m_remaining(0), m_refresh(false), m_loginSent(false),
+    m_waitingForLogin(false)
+{
+    connect(m_client->session(), SIGNAL(loggedIn()), SLOT(loginFinished()));
+    connect(m_client->session(), SIGNAL(loginFailed(QNetworkReply::NetworkError)), SLOT(loginFinished()));
+}
+
+ProgrammeGridLoader::~ProgrammeGridLoader()
+{
+    abort();
+}
+
+void ProgrammeGridLoader::load(const QList<Channel> &channels, const QDate &date, bool refresh)
+{
+    abort();
+    m_date = date;
+    m_refresh = refresh;
+    m_loginSent = false;
+    m_remaining = channels.size();
+
+    /* Kaikki kanavat luetaan välimuistista rinnakkain taustasäikeissä. Puuttuvat kanavat
+       haetaan verkosta sitä mukaa, kun välimuistin lukeminen valmistuu. */
+    for (int i = 0; i < channels.size(); i++) {
+        QFutureWatcher<ProgrammeCacheResult> *watcher = new QFutureWatcher<ProgrammeCacheResult>(this);
+        connect(watcher, SIGNAL(finished()), SLOT(cacheLoadFinished()));
+        watcher->setFuture(m_client->cache()->loadProgrammesAsync(channels.at(i).id, date));
+        m_watchers.append(watcher);
+    }
+
+    if (m_remaining == 0) {
+        emit finished();
+    }
+}
+
+void ProgrammeGridLoader::abort()
+{
+    m_waitingForLogin = false;
+    m_queue.clear();
+    m_remaining = 0;
+
+    for (int i = 0; i < m_watchers.size(); i++) {
+        m_watchers.at(i)->disconnect(this);
+        m_watchers.at(i)->deleteLater();
+    }
+
+    m_watchers.clear();
+    QList<QNetworkReply*> replies = m_parsers.keys();
+
+    for (int i = 0; i < replies.size(); i++) {
+        delete m_parsers.take(replies.at(i));
+        replies.at(i)->abort();
+        replies.at(i)->deleteLater();
+    }
+}
+
+bool ProgrammeGridLoader::isLoading() const
+{
+    return m_remaining > 0;
+}
+
+QDate ProgrammeGridLoader::date() const
+{
+    return m_date;
+}
+
+void ProgrammeGridLoader::cacheLoadFinished()
+{
+    QFutureWatcher<ProgrammeCacheResult> *watcher = static_cast<QFutureWatcher<ProgrammeCacheResult>*>(sender());
+
+    if (!m_watchers.removeOne(watcher)) {
+        return;
+    }
+
+    ProgrammeCacheResult result = watcher->result();
+    watcher->deleteLater();
+
+    if (result.ok && !result.programmes.isEmpty() && (!m_refresh || result.age < 30)) {
+        channelFinished(result.channelId, result.programmes);
+        return;
+    }
+
+    /* Vanhentunut listaus näytetään heti ja korvataan, kun uusi on haettu. */
+    if (!result.programmes.isEmpty()) {
+        emit programmesLoaded(result.channelId, result.programmes);
+    }
+
+    m_queue.append(result.channelId);
+    sendRequests();
+}
+
+void ProgrammeGridLoader::requestReadyRead()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply != 0 && m_parsers.contains(reply)) {
+        /* Jäsennysaika kirjataan paloittain, jotta verkon odotus ei näy jäsennyksenä. */
+        qint64 parseStart = NetworkTracer::instance()->timestamp();
+        m_parsers.value(reply)->parse(reply);
+        NetworkTracer::instance()->traceParse(reply, NetworkTracer::instance()->timestamp() - parseStart);
+    }
+}
+
+void ProgrammeGridLoader::requestFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || !m_parsers.contains(reply)) {
+        return;
+    }
+
+    ProgrammeTableParser *parser = m_parsers.take(reply);
+    int channelId = parser->requestedChannelId();
+    reply->deleteLater();
+
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 302) {
+        /* Istunto on vanhentunut. Odotetaan yhteistä kirjautumista kerran ja yritetään sitten uudelleen. */
+        if (!m_loginSent || m_waitingForLogin) {
+            m_loginSent = true;
+            m_waitingForLogin = true;
+            m_queue.prepend(channelId);
+            m_client->session()->renew(reply, this, SLOT(loginFinished()));
+        }
+        else {
+            emit channelFailed(channelId);
+            channelFinished(channelId, QList<Programme>());
+        }
+
+        delete parser;
+        return;
+    }
+
+    if (reply->error() != QNetworkReply::NoError || !parser->isValidResults()) {
+        qDebug() << "Cannot load listing" << channelId << reply->errorString();
+        emit channelFailed(channelId);
+        channelFinished(channelId, QList<Programme>());
+    }
+    else {
+        QList<Programme> programmes = parser->requestedProgrammes();
+        m_client->cache()->storeDescriptions(programmes);
+        channelFinished(channelId, programmes);
+        m_client->saveProgrammeWeek(channelId, parser);
+    }
+
+    delete parser;
+    sendRequests();
+}
+
+void ProgrammeGridLoader::sendRequests()
+{
+    if (!m_client->isValidUsernameAndPassword()) {
+        while (!m_queue.isEmpty()) {
+            int channelId = m_queue.takeFirst();
+            emit channelFailed(channelId);
+            channelFinished(channelId, QList<Programme>());
+        }
+
+        return;
+    }
+
+    if (m_waitingForLogin) {
+        return;
+    }
+
+    while (m_parsers.size() < MaxParallelRequests && !m_queue.isEmpty()) {
+        int channelId = m_queue.takeFirst();
+        ProgrammeTableParser *parser = new ProgrammeTableParser();
+        parser->setRequestedDate(m_date);
+        parser->setRequestedChannelId(channelId);
+        QNetworkReply *reply = m_client->sendListingRequest(channelId, m_date);
+        connect(reply, SIGNAL(readyRead()), SLOT(requestReadyRead()));
+        connect(reply, SIGNAL(finished()), SLOT(requestFinished()));
+        m_parsers.insert(reply, parser);
+    }
+}
+
+void ProgrammeGridLoader::loginFinished()
+{
+    if (m_waitingForLogin) {
+        m_waitingForLogin = false;
+        sendRequests();
+    }
+}
+
+void ProgrammeGridLoader::channelFinished(int channelId, const QList<Programme> &programmes)
+{
+    if (!programmes.isEmpty()) {
+        emit programmesLoaded(channelId, programmes);
+    }
+
+    if (m_remaining > 0 && --m_remaining == 0) {
+        emit finished();
+    }
+}
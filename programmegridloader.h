@@ -0,0 +1,52 @@
+#ifndef PROGRAMMEGRIDLOADER_H
+#define PROGRAMMEGRIDLOADER_H
+
+#include <QDate>
+#include <QFutureWatcher>
+#include <QMap>
+#include <QObject>
+#include "channel.h"
+#include "programme.h"
+
+class QNetworkReply;
+class ProgrammeTableParser;
+class TvkaistaClient;
+struct ProgrammeCacheResult;
+
+class ProgrammeGridLoader : public QObject
+{
+    Q_OBJECT
+public:
+    ProgrammeGridLoader(TvkaistaClient *client, QObject *parent = 0);
+    ~ProgrammeGridLoader();
+    void load(const QList<Channel> &channels, const QDate &date, bool refresh);
+    void abort();
+    bool isLoading() const;
+    QDate date() const;
+
+signals:
+    void programmesLoaded(int channelId, const QList<Programme> &programmes);
+    void channelFailed(int channelId);
+    void finished();
+
+private slots:
+    void cacheLoadFinished();
+    void requestReadyRead();
+    void requestFinished();
+    void sendRequests();
+    void loginFinished();
+
+private:
+    void channelFinished(int channelId, const QList<Programme> &programmes);
+    TvkaistaClient *m_client;
+    QList<QFutureWatcher<ProgrammeCacheResult>*> m_watchers;
+    QMap<QNetworkReply*, ProgrammeTableParser*> m_parsers;
+    QList<int> m_queue;
+    QDate m_date;
+    int m_remaining;
+    bool m_refresh;
+    bool m_loginSent;
+    bool m_waitingForLogin;
+};
+
+#endif // PROGRAMMEGRIDLOADER_H
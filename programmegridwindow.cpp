@@ -0,0 +1,174 @@
+#include <QAction>
+#include <QCloseEvent>
+#include <QHeaderView>
+#include <QLabel>
+#include <QMovie>
+#include <QSettings>
+#include <QTableWidget>
+#include <QToolBar>
+#include "programmegridloader.h"
+#include "programmegridwindow.h"
+#include "tvkaistaclient.h"
+
+/* Vuorokauden listaus voi jatkua yli puolenyön, joten sarakkeita on tavallista enemmän. */
+static const int HourCount = 30;
+
+ProgrammeGridWindow::ProgrammeGridWindow(TvkaistaClient *client, QSettings *settings, QWidget *parent) :
+    QMainWindow(parent), m_settings(settings), m_loader(new ProgrammeGridLoader(client, this)),
+    m_tableWidget(new QTableWidget(this))
+{
+    QToolBar *toolBar = addToolBar(trUtf8("Työkalurivi"));
+    toolBar->setMovable(false);
+    QAction *previousAction = toolBar->addAction(QIcon(":/images/go-previous-22x22.png"), trUtf8("Edellinen päivä"));
+    QAction *nextAction = toolBar->addAction(QIcon(":/images/go-next-22x22.png"), trUtf8("Seuraava päivä"));
+    QAction *refreshAction = toolBar->addAction(QIcon(":/images/refresh-22x22.png"), trUtf8("Päivitä"));
+    previousAction->setShortcut(QKeySequence("Alt+Left"));
+    nextAction->setShortcut(QKeySequence("Alt+Right"));
+    refreshAction->setShortcut(QKeySequence("F5"));
+
+    m_loadMovie = new QMovie(this);
+    m_loadMovie->setFileName(":/images/load-32x32.gif");
+    m_loadLabel = new QLabel(this);
+    m_loadLabel->setMinimumSize(47, 32);
+    QLabel *spacerLabel = new QLabel(this);
+    spacerLabel->setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Fixed);
+    toolBar->addWidget(spacerLabel);
+    toolBar->addWidget(m_loadLabel);
+
+    QStringList hourLabels;
+
+    for (int i = 0; i < HourCount; i++) {
+        hourLabels.append(QString("%1.00").arg(i % 24));
+    }
+
+    m_tableWidget->setColumnCount(HourCount);
+    m_tableWidget->setHorizontalHeaderLabels(hourLabels);
+    m_tableWidget->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_tableWidget->setWordWrap(true);
+    m_tableWidget->horizontalHeader()->setDefaultSectionSize(160);
+    m_tableWidget->verticalHeader()->setDefaultSectionSize(80);
+    setCentralWidget(m_tableWidget);
+
+    connect(previousAction, SIGNAL(triggered()), SLOT(goToPreviousDay()));
+    connect(nextAction, SIGNAL(triggered()), SLOT(goToNextDay()));
+    connect(refreshAction, SIGNAL(triggered()), SLOT(refresh()));
+    connect(m_tableWidget, SIGNAL(cellDoubleClicked(int,int)), SLOT(cellDoubleClicked(int,int)));
+    connect(m_loader, SIGNAL(programmesLoaded(int,QList<Programme>)), SLOT(programmesLoaded(int,QList<Programme>)));
+    connect(m_loader, SIGNAL(finished()), SLOT(loadFinished()));
+
+    settings->beginGroup("programmeGridWindow");
+    restoreGeometry(settings->value("geometry").toByteArray());
+    settings->endGroup();
+}
+
+void ProgrammeGridWindow::setChannels(const QList<Channel> &channels)
+{
+    m_channels = channels;
+    m_rows.clear();
+    QStringList channelNames;
+    int count = channels.size();
+
+    for (int i = 0; i < count; i++) {
+        m_rows.insert(channels.at(i).id, i);
+        channelNames.append(channels.at(i).name);
+    }
+
+    m_tableWidget->setRowCount(count);
+    m_tableWidget->setVerticalHeaderLabels(channelNames);
+}
+
+void ProgrammeGridWindow::fetchProgrammes(const QDate &date, bool refresh)
+{
+    if (date.isNull()) {
+        return;
+    }
+
+    m_date = date;
+    m_tableWidget->clearContents();
+    updateWindowTitle();
+    m_loadLabel->setMovie(m_loadMovie);
+    m_loadMovie->start();
+    m_loader->load(m_channels, date, refresh);
+}
+
+void ProgrammeGridWindow::closeEvent(QCloseEvent *e)
+{
+    m_settings->beginGroup("programmeGridWindow");
+    m_settings->setValue("geometry", saveGeometry());
+    m_settings->endGroup();
+    m_loader->abort();
+    loadFinished();
+    e->accept();
+}
+
+void ProgrammeGridWindow::programmesLoaded(int channelId, const QList<Programme> &programmes)
+{
+    if (!m_rows.contains(channelId)) {
+        return;
+    }
+
+    /* Rivi piirretään heti, kun kanavan listaus on saatu. */
+    int row = m_rows.value(channelId);
+    QStringList texts[HourCount];
+    QVariantList ids[HourCount];
+    QDateTime midnight(m_date, QTime(0, 0));
+    int count = programmes.size();
+
+    for (int i = 0; i < count; i++) {
+        Programme programme = programmes.at(i);
+        int hour = qBound(0, midnight.secsTo(programme.startDateTime) / 3600, HourCount - 1);
+        texts[hour].append(QString("%1 %2").arg(programme.startDateTime.toString("h.mm"), programme.title));
+        ids[hour].append(programme.id);
+    }
+
+    for (int i = 0; i < HourCount; i++) {
+        if (texts[i].isEmpty()) {
+            delete m_tableWidget->takeItem(row, i);
+            continue;
+        }
+
+        QTableWidgetItem *item = new QTableWidgetItem(texts[i].join("\n"));
+        item->setToolTip(item->text());
+        item->setData(Qt::UserRole, ids[i]);
+        m_tableWidget->setItem(row, i, item);
+    }
+}
+
+void ProgrammeGridWindow::loadFinished()
+{
+    m_loadMovie->stop();
+    m_loadLabel->setMovie(0);
+    m_loadLabel->setText(" ");
+}
+
+void ProgrammeGridWindow::cellDoubleClicked(int row, int column)
+{
+    QTableWidgetItem *item = m_tableWidget->item(row, column);
+
+    if (item == 0 || row >= m_channels.size()) {
+        return;
+    }
+
+    QVariantList ids = item->data(Qt::UserRole).toList();
+    emit programmeActivated(m_channels.at(row).id, m_date, ids.isEmpty() ? -1 : ids.first().toInt());
+}
+
+void ProgrammeGridWindow::refresh()
+{
+    fetchProgrammes(m_date, true);
+}
+
+void ProgrammeGridWindow::goToPreviousDay()
+{
+    fetchProgrammes(m_date.addDays(-1), false);
+}
+
+void ProgrammeGridWindow::goToNextDay()
+{
+    fetchProgrammes(m_date.addDays(1), false);
+}
+
+void ProgrammeGridWindow::updateWindowTitle()
+{
+    setWindowTitle(trUtf8("Ohjelmakartta %1").arg(m_date.toString(trUtf8("ddd d.M.yyyy"))));
+}
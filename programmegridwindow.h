@@ -0,0 +1,51 @@
+#ifndef PROGRAMMEGRIDWINDOW_H
+#define PROGRAMMEGRIDWINDOW_H
+
+#include <QDate>
+#include <QMainWindow>
+#include <QMap>
+#include "channel.h"
+#include "programme.h"
+
+class QLabel;
+class QMovie;
+class QSettings;
+class QTableWidget;
+class ProgrammeGridLoader;
+class TvkaistaClient;
+
+class ProgrammeGridWindow : public QMainWindow
+{
+    Q_OBJECT
+public:
+    ProgrammeGridWindow(TvkaistaClient *client, QSettings *settings, QWidget *parent = 0);
+    void setChannels(const QList<Channel> &channels);
+    void fetchProgrammes(const QDate &date, bool refresh);
+
+signals:
+    void programmeActivated(int channelId, const QDate &date, int programmeId);
+
+protected:
+    void closeEvent(QCloseEvent *e);
+
+private slots:
+    void programmesLoaded(int channelId, const QList<Programme> &programmes);
+    void loadFinished();
+    void cellDoubleClicked(int row, int column);
+    void refresh();
+    void goToPreviousDay();
+    void goToNextDay();
+
+private:
+    void updateWindowTitle();
+    QSettings *m_settings;
+    ProgrammeGridLoader *m_loader;
+    QTableWidget *m_tableWidget;
+    QLabel *m_loadLabel;
+    QMovie *m_loadMovie;
+    QList<Channel> m_channels;
+    QMap<int, int> m_rows;
+    QDate m_date;
+};
+
+#endif // PROGRAMMEGRIDWINDOW_H
@@ -1,5 +1,6 @@
 #include <QDebug>
 #include "historymanager.h"
+#include "profiler.h"
 #include "programmetablemodel.h"
 
 ProgrammeTableModel::ProgrammeTableModel(HistoryManager *historyManager,
@@ -152,6 +153,7 @@ bool ProgrammeTableModel::isDescending() const
 
 void ProgrammeTableModel::setProgrammes(const QList<Programme> &programmes)
 {
+    PROFILE_ZONE("ProgrammeTableModel::setProgrammes");
     setInfoText(QString());
     bool numRowsChanged = (m_programmes.size() != programmes.size());
 
@@ -225,6 +227,7 @@ QList<Programme> ProgrammeTableModel::programmes() const
 
 void ProgrammeTableModel::setSeasonPasses(const QMap<QString, int> &seasonPasses)
 {
+    PROFILE_ZONE("ProgrammeTableModel::setSeasonPasses");
     QList<QString> keys = seasonPasses.keys();
     int programmeCount = m_programmes.size();
     int seasonPassCount = seasonPasses.size();
@@ -258,6 +261,23 @@ void ProgrammeTableModel::setRemovedByProgrammeId(int programmeId)
     }
 }
 
+bool ProgrammeTableModel::updateFlags(int programmeId, int flags)
+{
+    int count = m_programmes.size();
+    int lastColumn = columnCount(QModelIndex()) - 1;
+    bool found = false;
+
+    for (int i = 0; i < count; i++) {
+        if (m_programmes.at(i).id == programmeId) {
+            m_programmes[i].flags = flags;
+            emit dataChanged(index(i, 0, QModelIndex()), index(i, lastColumn, QModelIndex()));
+            found = true;
+        }
+    }
+
+    return found;
+}
+
 void ProgrammeTableModel::setRemovedBySeasonPassId(int seasonPassId)
 {
     int count = m_programmes.size();
@@ -28,6 +28,7 @@ public:
     void setSeasonPasses(const QMap<QString, int> &seasonPasses);
     void setRemovedByProgrammeId(int programmeId);
     void setRemovedBySeasonPassId(int seasonPassId);
+    bool updateFlags(int programmeId, int flags);
     int programmeCount() const;
     void setInfoText(const QString &text);
     QString infoText() const;
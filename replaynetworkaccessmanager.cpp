@@ -0,0 +1,493 @@
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QFile>
+#include <QNetworkCookie>
+#include <QNetworkCookieJar>
+#include <QTimer>
+#include "replaynetworkaccessmanager.h"
+
+/* Tallennustilassa jokainen pyyntö ja vastaus tallennetaan hakemistoon kahdeksi
+   tiedostoksi: <avain>-<n>.headers sisältää tilakoodin, otsakkeet ja ajoituksen ja
+   <avain>-<n>.body vastauksen sisällön. Avain lasketaan metodista, osoitteesta ja
+   lähetetystä datasta, ja n erottaa saman pyynnön peräkkäiset vastaukset toisistaan
+   (esim. uudelleenohjaus kirjautumiseen ja sen jälkeinen onnistunut haku).
+
+   Toistotilassa vastaukset luetaan samoista tiedostoista. Jos pyyntö toistetaan useammin
+   kuin se on tallennettu, käytetään viimeisintä vastausta. */
+
+static const qint64 MaxRecordedBodySize = 4 * 1024 * 1024;
+static const int ChunkInterval = 50;
+
+static QByteArray operationName(QNetworkAccessManager::Operation op)
+{
+    switch (op) {
+    case QNetworkAccessManager::HeadOperation:
+        return "HEAD";
+    case QNetworkAccessManager::GetOperation:
+        return "GET";
+    case QNetworkAccessManager::PutOperation:
+        return "PUT";
+    case QNetworkAccessManager::PostOperation:
+        return "POST";
+    case QNetworkAccessManager::DeleteOperation:
+        return "DELETE";
+    default:
+        return "CUSTOM";
+    }
+}
+
+FixtureReply::FixtureReply(QObject *parent) :
+    QNetworkReply(parent)
+{
+}
+
+bool FixtureReply::isSequential() const
+{
+    return true;
+}
+
+qint64 FixtureReply::bytesAvailable() const
+{
+    return m_buffer.size() + QIODevice::bytesAvailable();
+}
+
+qint64 FixtureReply::readData(char *data, qint64 maxSize)
+{
+    qint64 len = qMin(maxSize, (qint64) m_buffer.size());
+
+    if (len == 0) {
+        return isFinished() ? -1 : 0;
+    }
+
+    memcpy(data, m_buffer.constData(), len);
+    m_buffer.remove(0, len);
+    return len;
+}
+
+qint64 FixtureReply::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
+
+void FixtureReply::appendData(const QByteArray &data)
+{
+    m_buffer.append(data);
+}
+
+RecordingReply::RecordingReply(QNetworkReply *reply, const QString &path, const QByteArray &requestLine, QObject *parent) :
+    FixtureReply(parent), m_reply(reply), m_path(path), m_requestLine(requestLine),
+    m_size(0), m_firstByteTime(-1)
+{
+    m_time.start();
+    m_reply->setParent(this);
+    setOperation(reply->operation());
+    setRequest(reply->request());
+    setUrl(reply->url());
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    connect(m_reply, SIGNAL(metaDataChanged()), SLOT(replyMetaDataChanged()));
+    connect(m_reply, SIGNAL(readyRead()), SLOT(replyReadyRead()));
+    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(replyError(QNetworkReply::NetworkError)));
+    connect(m_reply, SIGNAL(finished()), SLOT(replyFinished()));
+    connect(m_reply, SIGNAL(downloadProgress(qint64,qint64)), SIGNAL(downloadProgress(qint64,qint64)));
+    connect(m_reply, SIGNAL(uploadProgress(qint64,qint64)), SIGNAL(uploadProgress(qint64,qint64)));
+}
+
+void RecordingReply::abort()
+{
+    m_reply->abort();
+}
+
+void RecordingReply::replyMetaDataChanged()
+{
+    copyMetaData();
+    emit metaDataChanged();
+}
+
+void RecordingReply::replyReadyRead()
+{
+    QByteArray data = m_reply->readAll();
+
+    if (data.isEmpty()) {
+        return;
+    }
+
+    if (m_firstByteTime < 0) {
+        m_firstByteTime = m_time.elapsed();
+    }
+
+    /* Suurista vastauksista (videot) tallennetaan vain alku. Toistossa loppu täytetään nollilla. */
+    if (m_body.size() < MaxRecordedBodySize) {
+        m_body.append(data.left(MaxRecordedBodySize - m_body.size()));
+    }
+
+    m_size += data.size();
+    appendData(data);
+    emit readyRead();
+}
+
+void RecordingReply::replyError(QNetworkReply::NetworkError error)
+{
+    setError(error, m_reply->errorString());
+    emit this->error(error);
+}
+
+void RecordingReply::replyFinished()
+{
+    replyReadyRead();
+    copyMetaData();
+
+    if (!writeFixture()) {
+        qWarning() << "Could not write network fixture" << m_path;
+    }
+
+    setFinished(true);
+    emit finished();
+}
+
+void RecordingReply::copyMetaData()
+{
+    QList<QByteArray> names = m_reply->rawHeaderList();
+
+    for (int i = 0; i < names.size(); i++) {
+        setRawHeader(names.at(i), m_reply->rawHeader(names.at(i)));
+    }
+
+    setAttribute(QNetworkRequest::HttpStatusCodeAttribute, m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute));
+    setAttribute(QNetworkRequest::HttpReasonPhraseAttribute, m_reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute));
+    setAttribute(QNetworkRequest::RedirectionTargetAttribute, m_reply->attribute(QNetworkRequest::RedirectionTargetAttribute));
+}
+
+bool RecordingReply::writeFixture()
+{
+    QFile headersFile(m_path + ".headers");
+    QFile bodyFile(m_path + ".body");
+
+    if (!headersFile.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+        !bodyFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+
+    QByteArray s;
+    s.append(m_requestLine).append('\n');
+    s.append("status ").append(QByteArray::number(m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt()));
+    s.append(' ').append(m_reply->attribute(QNetworkRequest::HttpReasonPhraseAttribute).toByteArray()).append('\n');
+    s.append("error ").append(QByteArray::number((int) m_reply->error())).append('\n');
+    s.append("ttfb ").append(QByteArray::number(qMax(m_firstByteTime, 0))).append('\n');
+    s.append("elapsed ").append(QByteArray::number(m_time.elapsed())).append('\n');
+    s.append("size ").append(QByteArray::number(m_size)).append('\n');
+    QList<QByteArray> names = m_reply->rawHeaderList();
+
+    for (int i = 0; i < names.size(); i++) {
+        /* Useampi samanniminen otsake (Set-Cookie) on yhdistetty rivinvaihdoilla. */
+        QList<QByteArray> values = m_reply->rawHeader(names.at(i)).split('\n');
+
+        for (int j = 0; j < values.size(); j++) {
+            s.append("header ").append(names.at(i)).append(": ").append(values.at(j)).append('\n');
+        }
+    }
+
+    qDebug() << "WRITE" << headersFile.fileName();
+    return headersFile.write(s) == s.size() && bodyFile.write(m_body) == m_body.size();
+}
+
+ReplayReply::ReplayReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request,
+                         const QString &path, int latency, int bandwidth, QObject *parent) :
+    FixtureReply(parent), m_timer(new QTimer(this)), m_size(0), m_offset(0),
+    m_bandwidth(bandwidth), m_elapsed(0), m_error(QNetworkReply::NoError), m_found(false)
+{
+    setOperation(op);
+    setRequest(request);
+    setUrl(request.url());
+    open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    m_found = readFixture(path);
+    m_timer->setSingleShot(true);
+    connect(m_timer, SIGNAL(timeout()), SLOT(sendMetaData()));
+
+    /* Negatiivinen viive tai kaistanleveys tarkoittaa tallennettua ajoitusta. */
+    if (m_bandwidth < 0) {
+        int transferTime = m_elapsed - latency;
+        m_bandwidth = transferTime > 0 ? m_size * 1000 / transferTime : 0;
+    }
+
+    m_timer->start(qMax(latency, 0));
+}
+
+void ReplayReply::abort()
+{
+    if (isFinished()) {
+        return;
+    }
+
+    m_timer->stop();
+    setError(QNetworkReply::OperationCanceledError, "Operation canceled");
+    emit error(QNetworkReply::OperationCanceledError);
+    setFinished(true);
+    emit finished();
+}
+
+void ReplayReply::sendMetaData()
+{
+    if (!m_found) {
+        qWarning() << "No network fixture for" << url().toString();
+        m_error = QNetworkReply::ContentNotFoundError;
+        finish();
+        return;
+    }
+
+    emit metaDataChanged();
+    disconnect(m_timer, SIGNAL(timeout()), this, SLOT(sendMetaData()));
+    connect(m_timer, SIGNAL(timeout()), SLOT(sendData()));
+    m_timer->setSingleShot(false);
+    m_timer->start(ChunkInterval);
+    sendData();
+}
+
+void ReplayReply::sendData()
+{
+    qint64 len = m_size - m_offset;
+
+    if (m_bandwidth > 0) {
+        len = qMin(len, qMax((qint64) m_bandwidth * ChunkInterval / 1000, (qint64) 1));
+    }
+
+    if (len > 0) {
+        QByteArray data = m_body.mid(m_offset, len);
+
+        if (data.size() < len) {
+            data.append(QByteArray(len - data.size(), '\0'));
+        }
+
+        m_offset += len;
+        appendData(data);
+        emit readyRead();
+        emit downloadProgress(m_offset, m_size);
+    }
+
+    if (m_offset >= m_size) {
+        finish();
+    }
+}
+
+bool ReplayReply::readFixture(const QString &path)
+{
+    QFile headersFile(path + ".headers");
+
+    if (!headersFile.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    qDebug() << "READ" << headersFile.fileName();
+    QList<QByteArray> lines = headersFile.readAll().split('\n');
+    QHash<QByteArray, QByteArray> headers;
+    QList<QByteArray> names;
+
+    /* Ensimmäinen rivi on pyyntö, joka on tiedostossa vain lukijaa varten. */
+    for (int i = 1; i < lines.size(); i++) {
+        QByteArray line = lines.at(i);
+        int pos = line.indexOf(' ');
+        QByteArray key = line.left(pos);
+        QByteArray value = line.mid(pos + 1);
+
+        if (key == "status") {
+            int pos2 = value.indexOf(' ');
+            int status = value.left(pos2).toInt();
+
+            if (status > 0) {
+                setAttribute(QNetworkRequest::HttpStatusCodeAttribute, status);
+                setAttribute(QNetworkRequest::HttpReasonPhraseAttribute, pos2 < 0 ? QByteArray() : value.mid(pos2 + 1));
+            }
+        }
+        else if (key == "error") {
+            m_error = (QNetworkReply::NetworkError) value.toInt();
+        }
+        else if (key == "elapsed") {
+            m_elapsed = value.toInt();
+        }
+        else if (key == "size") {
+            m_size = value.toLongLong();
+        }
+        else if (key == "header") {
+            pos = value.indexOf(": ");
+            QByteArray name = value.left(pos);
+
+            if (!headers.contains(name)) {
+                names.append(name);
+                headers.insert(name, value.mid(pos + 2));
+            }
+            else {
+                headers[name].append('\n').append(value.mid(pos + 2));
+            }
+        }
+    }
+
+    for (int i = 0; i < names.size(); i++) {
+        setRawHeader(names.at(i), headers.value(names.at(i)));
+    }
+
+    if (headers.contains("Location")) {
+        setAttribute(QNetworkRequest::RedirectionTargetAttribute, QUrl::fromEncoded(headers.value("Location")));
+    }
+
+    QFile bodyFile(path + ".body");
+
+    if (bodyFile.open(QIODevice::ReadOnly)) {
+        m_body = bodyFile.readAll();
+    }
+
+    m_size = qMax(m_size, (qint64) m_body.size());
+    return true;
+}
+
+void ReplayReply::finish()
+{
+    m_timer->stop();
+
+    if (m_error != QNetworkReply::NoError) {
+        setError(m_error, QString("Replayed network error %1").arg(m_error));
+        emit error(m_error);
+    }
+
+    setFinished(true);
+    emit finished();
+}
+
+ReplayNetworkAccessManager::ReplayNetworkAccessManager(QObject *parent) :
+    QNetworkAccessManager(parent), m_mode(0), m_latency(-1), m_bandwidth(0)
+{
+}
+
+void ReplayNetworkAccessManager::setRecordDirectory(const QDir &dir)
+{
+    m_dir = dir;
+    m_dir.mkpath(m_dir.absolutePath());
+    m_sequence.clear();
+    m_mode = 1;
+}
+
+void ReplayNetworkAccessManager::setReplayDirectory(const QDir &dir)
+{
+    m_dir = dir;
+    m_sequence.clear();
+    m_mode = 2;
+}
+
+QDir ReplayNetworkAccessManager::directory() const
+{
+    return m_dir;
+}
+
+int ReplayNetworkAccessManager::mode() const
+{
+    return m_mode;
+}
+
+void ReplayNetworkAccessManager::setLatency(int msecs)
+{
+    m_latency = msecs;
+}
+
+int ReplayNetworkAccessManager::latency() const
+{
+    return m_latency;
+}
+
+void ReplayNetworkAccessManager::setBandwidth(int bytesPerSecond)
+{
+    m_bandwidth = bytesPerSecond;
+}
+
+int ReplayNetworkAccessManager::bandwidth() const
+{
+    return m_bandwidth;
+}
+
+QNetworkReply* ReplayNetworkAccessManager::createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
+{
+    if (m_mode == 0) {
+        return QNetworkAccessManager::createRequest(op, request, outgoingData);
+    }
+
+    QByteArray data;
+
+    if (outgoingData != 0) {
+        data = outgoingData->readAll();
+    }
+
+    QByteArray requestLine;
+    QString path = fixturePath(op, request, data, requestLine);
+
+    if (m_mode == 2) {
+        /* Viive luetaan tallenteesta, jos sitä ei ole annettu. */
+        int latency = m_latency;
+
+        if (latency < 0) {
+            QFile file(path + ".headers");
+
+            if (file.open(QIODevice::ReadOnly)) {
+                QList<QByteArray> lines = file.readAll().split('\n');
+
+                for (int i = 0; i < lines.size(); i++) {
+                    if (lines.at(i).startsWith("ttfb ")) {
+                        latency = lines.at(i).mid(5).toInt();
+                    }
+                }
+            }
+        }
+
+        ReplayReply *reply = new ReplayReply(op, request, path, latency, m_bandwidth, this);
+        connect(reply, SIGNAL(metaDataChanged()), SLOT(replayMetaDataChanged()));
+        return reply;
+    }
+
+    QBuffer *buffer = 0;
+
+    if (outgoingData != 0) {
+        buffer = new QBuffer();
+        buffer->setData(data);
+        buffer->open(QIODevice::ReadOnly);
+    }
+
+    QNetworkReply *reply = QNetworkAccessManager::createRequest(op, request, buffer);
+
+    if (buffer != 0) {
+        buffer->setParent(reply);
+    }
+
+    return new RecordingReply(reply, path, requestLine, this);
+}
+
+void ReplayNetworkAccessManager::replayMetaDataChanged()
+{
+    /* Toistetut vastaukset eivät kulje QNetworkAccessManagerin läpi, joten evästeet
+       tallennetaan evästepurkkiin tässä. */
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || !reply->hasRawHeader("Set-Cookie")) {
+        return;
+    }
+
+    cookieJar()->setCookiesFromUrl(QNetworkCookie::parseCookies(reply->rawHeader("Set-Cookie")), reply->url());
+}
+
+QString ReplayNetworkAccessManager::fixturePath(Operation op, const QNetworkRequest &request, const QByteArray &data, QByteArray &requestLine)
+{
+    requestLine = operationName(op) + ' ' + request.url().toEncoded();
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(requestLine);
+    hash.addData("\n");
+    hash.addData(data);
+    QByteArray key = hash.result().toHex().left(16);
+    int n = m_sequence.value(key, 0);
+    m_sequence.insert(key, n + 1);
+
+    if (m_mode == 2) {
+        while (n > 0 && !m_dir.exists(QString("%1-%2.headers").arg(QString(key)).arg(n))) {
+            n--;
+        }
+    }
+
+    return m_dir.filePath(QString("%1-%2").arg(QString(key)).arg(n));
+}
@@ -0,0 +1,108 @@
+#ifndef REPLAYNETWORKACCESSMANAGER_H
+#define REPLAYNETWORKACCESSMANAGER_H
+
+#include <QDir>
+#include <QHash>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QTime>
+
+class QTimer;
+
+class FixtureReply : public QNetworkReply
+{
+    Q_OBJECT
+public:
+    FixtureReply(QObject *parent = 0);
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+    void appendData(const QByteArray &data);
+
+private:
+    QByteArray m_buffer;
+};
+
+class RecordingReply : public FixtureReply
+{
+    Q_OBJECT
+public:
+    RecordingReply(QNetworkReply *reply, const QString &path, const QByteArray &requestLine, QObject *parent = 0);
+    void abort();
+
+private slots:
+    void replyMetaDataChanged();
+    void replyReadyRead();
+    void replyError(QNetworkReply::NetworkError error);
+    void replyFinished();
+
+private:
+    void copyMetaData();
+    bool writeFixture();
+    QNetworkReply *m_reply;
+    QString m_path;
+    QByteArray m_requestLine;
+    QByteArray m_body;
+    qint64 m_size;
+    QTime m_time;
+    int m_firstByteTime;
+};
+
+class ReplayReply : public FixtureReply
+{
+    Q_OBJECT
+public:
+    ReplayReply(QNetworkAccessManager::Operation op, const QNetworkRequest &request,
+                const QString &path, int latency, int bandwidth, QObject *parent = 0);
+    void abort();
+
+private slots:
+    void sendMetaData();
+    void sendData();
+
+private:
+    bool readFixture(const QString &path);
+    void finish();
+    QTimer *m_timer;
+    QByteArray m_body;
+    qint64 m_size;
+    qint64 m_offset;
+    int m_bandwidth;
+    int m_elapsed;
+    QNetworkReply::NetworkError m_error;
+    bool m_found;
+};
+
+class ReplayNetworkAccessManager : public QNetworkAccessManager
+{
+    Q_OBJECT
+public:
+    ReplayNetworkAccessManager(QObject *parent = 0);
+    void setRecordDirectory(const QDir &dir);
+    void setReplayDirectory(const QDir &dir);
+    QDir directory() const;
+    int mode() const;
+    void setLatency(int msecs);
+    int latency() const;
+    void setBandwidth(int bytesPerSecond);
+    int bandwidth() const;
+
+protected:
+    QNetworkReply* createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData);
+
+private slots:
+    void replayMetaDataChanged();
+
+private:
+    QString fixturePath(Operation op, const QNetworkRequest &request, const QByteArray &data, QByteArray &requestLine);
+    QDir m_dir;
+    QHash<QByteArray, int> m_sequence;
+    int m_mode;
+    int m_latency;
+    int m_bandwidth;
+};
+
+#endif // REPLAYNETWORKACCESSMANAGER_H
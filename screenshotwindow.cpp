@@ -4,14 +4,20 @@
 #include <QComboBox>
 #include <QSettings>
 #include <QTimer>
+#include "cache.h"
+#include "imageloader.h"
 #include "programmefeedparser.h"
 #include "screenshotwindow.h"
 #include "tvkaistaclient.h"
 #include "ui_screenshotwindow.h"
 
+static const int MaxParallelRequests = 4;
+static const QSize MaxScreenshotSize(320, 240);
+
 ScreenshotWindow::ScreenshotWindow(QSettings *settings, QWidget *parent) :
     QMainWindow(parent), ui(new Ui::ScreenshotWindow),
-    m_settings(settings), m_reply(0), m_redirections(0)
+    m_settings(settings), m_imageLoader(0), m_reply(0), m_nextIndex(0), m_insertIndex(0),
+    m_hostResolved(false)
 {
     ui->setupUi(this);
     ui->toolBar->setStyleSheet("QLabel { padding-left: 10px; padding-right: 5px; }");
@@ -107,8 +113,19 @@ TvkaistaClient* ScreenshotWindow::client() const
     return m_client;
 }
 
+void ScreenshotWindow::setImageLoader(ImageLoader *imageLoader)
+{
+    if (m_imageLoader != 0) {
+        disconnect(m_imageLoader, 0, this, 0);
+    }
+
+    m_imageLoader = imageLoader;
+    connect(m_imageLoader, SIGNAL(imageLoaded(QString,QImage)), SLOT(imageLoaded(QString,QImage)));
+}
+
 void ScreenshotWindow::fetchScreenshots(const Programme &programme)
 {
+    abortThumbnailRequests();
     m_programme = programme;
     m_numErrors = 0;
     m_thumbnails.clear();
@@ -119,6 +136,14 @@ void ScreenshotWindow::fetchScreenshots(const Programme &programme)
     setWindowTitle(trUtf8("Kuvakaappaukset - %1 %2").arg(programme.title).arg(
             programme.startDateTime.toString(trUtf8("ddd d.M.yyyy 'klo' h.mm"))));
     startLoadingAnimation();
+    bool ok;
+    m_thumbnails = m_client->cache()->loadThumbnails(programme, ok);
+
+    if (ok && !m_thumbnails.isEmpty()) {
+        thumbnailsToQueue();
+        return;
+    }
+
     m_reply = m_client->sendDetailedFeedRequest(programme);
     connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(networkError(QNetworkReply::NetworkError)));
     connect(m_reply, SIGNAL(finished()), SLOT(feedRequestFinished()));
@@ -126,13 +151,12 @@ void ScreenshotWindow::fetchScreenshots(const Programme &programme)
 
 void ScreenshotWindow::stopDownloading()
 {
-    m_queue.clear();
-
     if (m_reply != 0) {
         m_reply->abort();
         m_reply = 0;
     }
 
+    abortThumbnailRequests();
     stopLoadingAnimation();
     ui->actionStop->setEnabled(false);
     ui->statusLabel->setText(QString());
@@ -163,6 +187,13 @@ void ScreenshotWindow::feedRequestFinished()
     m_reply->deleteLater();
     m_reply = 0;
 
+    /* Käynnissä olevan ohjelman kuvakaappauslista on vielä keskeneräinen. */
+    QDateTime endDateTime = m_programme.startDateTime.addSecs(qMax(m_programme.duration, 0));
+
+    if (!m_thumbnails.isEmpty() && m_programme.duration > 0 && endDateTime < QDateTime::currentDateTime()) {
+        m_client->cache()->saveThumbnails(m_programme, m_thumbnails);
+    }
+
     if (m_thumbnails.isEmpty()) {
         screenshotsNotFound();
     }
@@ -198,57 +229,98 @@ void ScreenshotWindow::thumbnailsToQueue()
         m_queue.append(m_thumbnails.at(count - 1));
     }
 
+    m_nextIndex = 0;
+    m_insertIndex = 0;
+    m_hostResolved = false;
     ui->actionStop->setEnabled(true);
     fetchNextScreenshot();
 }
 
 void ScreenshotWindow::thumbnailRequestFinished()
 {
-    if (m_reply == 0 || m_queue.isEmpty()) {
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || !m_replies.contains(reply)) {
         return;
     }
 
-    if (m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute) == 303) {
-        m_redirections++;
+    int index = m_replies.take(reply);
+    reply->deleteLater();
 
-        if (m_redirections > 3) {
-            return;
-        }
+    /* Uudelleenohjaukset lasketaan vastauskohtaisesti, koska pyyntöjä on käynnissä rinnakkain. */
+    int redirections = reply->property("redirections").toInt();
+
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute) == 303 && redirections >= 3) {
+        qWarning() << "Too many redirections" << reply->url().toString();
+        decodeScreenshot(index, QByteArray());
+        fetchNextScreenshot();
+        return;
+    }
 
-        QUrl url = m_reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute) == 303) {
+        QUrl url = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
         qDebug() << "Redirected to" << url.toString();
+
+        /* Jonossa olevat osoitteet ohjataan suoraan välimuistipalvelimelle, minkä jälkeen
+           loput kuvat voidaan hakea rinnakkain. */
         changeHostToUrls(url.host());
-        m_reply = m_client->sendRequestWithAuthHeader(url);
-        connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(networkError(QNetworkReply::NetworkError)));
-        connect(m_reply, SIGNAL(finished()), SLOT(thumbnailRequestFinished()));
+        m_hostResolved = true;
+        QNetworkReply *redirectedReply = m_client->sendRequestWithAuthHeader(url);
+        redirectedReply->setProperty("redirections", redirections + 1);
+        connect(redirectedReply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(networkError(QNetworkReply::NetworkError)));
+        connect(redirectedReply, SIGNAL(finished()), SLOT(thumbnailRequestFinished()));
+        m_replies.insert(redirectedReply, index);
+        fetchNextScreenshot();
         return;
     }
 
-    QPixmap pixmap;
-    Thumbnail thumbnail = m_queue.takeFirst();
-    pixmap.loadFromData(m_reply->readAll());
-    m_reply->deleteLater();
-    m_reply = 0;
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute) == 200) {
+        m_hostResolved = true;
+    }
 
-    if (!pixmap.isNull()) {
-        QIcon icon(pixmap);
+    QByteArray data = reply->readAll();
 
-        if (ui->listWidget->count() == 0) {
-            ui->listWidget->setIconSize(QSize(pixmap.width(), pixmap.height()));
-            ui->listWidget->setGridSize(QSize(pixmap.width() + 10,
-                                              pixmap.height() + ui->listWidget->fontMetrics().height() + 10));
-            ui->stackedWidget->setCurrentIndex(0);
+    if (data.startsWith("\x89PNG")) {
+        m_client->cache()->saveThumbnail(m_programme, m_queue.at(index).time, data);
+    }
+
+    decodeScreenshot(index, data);
+    fetchNextScreenshot();
+}
+
+void ScreenshotWindow::imageLoaded(const QString &key, const QImage &image)
+{
+    /* Välimuistista puuttuva tai vioittunut kuva haetaan verkosta. */
+    if (m_cacheLoads.contains(key)) {
+        int index = m_cacheLoads.take(key);
+
+        if (image.isNull()) {
+            m_networkQueue.append(index);
+        }
+        else {
+            m_results.insert(index, image);
+            insertScreenshots();
         }
 
-        new QListWidgetItem(icon, thumbnail.time.toString("h:mm"), ui->listWidget);
+        fetchNextScreenshot();
+        return;
+    }
+
+    if (!m_decoding.contains(key)) {
+        return;
     }
 
+    m_results.insert(m_decoding.take(key), image);
+    insertScreenshots();
     fetchNextScreenshot();
 }
 
 void ScreenshotWindow::networkError(QNetworkReply::NetworkError error)
 {
-    if (error == QNetworkReply::OperationCanceledError || m_reply == 0) {
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (error == QNetworkReply::OperationCanceledError ||
+        reply == 0 || (reply != m_reply && !m_replies.contains(reply))) {
         return;
     }
 
@@ -273,17 +345,107 @@ void ScreenshotWindow::networkError(QNetworkReply::NetworkError error)
 
 void ScreenshotWindow::fetchNextScreenshot()
 {
-    if (m_queue.isEmpty()) {
+    /* Ensimmäinen kuva haetaan yksin, jotta välimuistipalvelimen osoite saadaan
+       selville ennen kuin pyyntöjä lähetetään rinnakkain. */
+    int maxRequests = m_hostResolved ? MaxParallelRequests : 1;
+
+    while (m_replies.size() < maxRequests && !m_networkQueue.isEmpty()) {
+        sendThumbnailRequest(m_networkQueue.takeFirst());
+    }
+
+    /* Välimuistissa olevat kuvat luetaan ja puretaan ImageLoaderin säikeissä, enintään
+       MaxParallelRequests kerrallaan. Puuttuvat kuvat siirtyvät verkkojonoon. */
+    while (m_cacheLoads.size() < MaxParallelRequests && m_nextIndex < m_queue.size()) {
+        QString key = screenshotKey(m_nextIndex);
+        QImage image = m_imageLoader->image(key);
+
+        if (!image.isNull()) {
+            m_results.insert(m_nextIndex, image);
+        }
+        else {
+            m_cacheLoads.insert(key, m_nextIndex);
+            m_imageLoader->loadThumbnail(key, m_client->cache(), m_programme, m_queue.at(m_nextIndex).time,
+                                         MaxScreenshotSize);
+        }
+
+        m_nextIndex++;
+    }
+
+    insertScreenshots();
+
+    if (m_replies.isEmpty() && m_decoding.isEmpty() && m_cacheLoads.isEmpty() && m_networkQueue.isEmpty() &&
+        m_nextIndex >= m_queue.size()) {
+        m_queue.clear();
         ui->actionStop->setEnabled(false);
         stopLoadingAnimation();
+    }
+}
+
+void ScreenshotWindow::insertScreenshots()
+{
+    /* Kuvat lisätään listaan aikajärjestyksessä, vaikka vastaukset saapuisivat eri järjestyksessä. */
+    while (m_results.contains(m_insertIndex)) {
+        QPixmap pixmap = QPixmap::fromImage(m_results.take(m_insertIndex));
+        Thumbnail thumbnail = m_queue.value(m_insertIndex);
+        m_insertIndex++;
+
+        if (pixmap.isNull()) {
+            continue;
+        }
+
+        if (ui->listWidget->count() == 0) {
+            ui->listWidget->setIconSize(QSize(pixmap.width(), pixmap.height()));
+            ui->listWidget->setGridSize(QSize(pixmap.width() + 10,
+                                              pixmap.height() + ui->listWidget->fontMetrics().height() + 10));
+            ui->stackedWidget->setCurrentIndex(0);
+        }
+
+        new QListWidgetItem(QIcon(pixmap), thumbnail.time.toString("h:mm"), ui->listWidget);
+    }
+}
+
+void ScreenshotWindow::decodeScreenshot(int index, const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        m_results.insert(index, QImage());
+        insertScreenshots();
         return;
     }
 
-    Thumbnail thumbnail = m_queue.first();
-    m_redirections = 0;
-    m_reply = m_client->sendRequestWithAuthHeader(thumbnail.url);
-    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(networkError(QNetworkReply::NetworkError)));
-    connect(m_reply, SIGNAL(finished()), SLOT(thumbnailRequestFinished()));
+    QString key = screenshotKey(index);
+    m_decoding.insert(key, index);
+    m_imageLoader->loadData(key, data, MaxScreenshotSize);
+}
+
+void ScreenshotWindow::sendThumbnailRequest(int index)
+{
+    QNetworkReply *reply = m_client->sendRequestWithAuthHeader(m_queue.at(index).url);
+    connect(reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(networkError(QNetworkReply::NetworkError)));
+    connect(reply, SIGNAL(finished()), SLOT(thumbnailRequestFinished()));
+    m_replies.insert(reply, index);
+}
+
+QString ScreenshotWindow::screenshotKey(int index) const
+{
+    return QString("t%1-%2").arg(m_programme.id).arg(m_queue.at(index).time.toString("hhmmss"));
+}
+
+void ScreenshotWindow::abortThumbnailRequests()
+{
+    m_queue.clear();
+    m_results.clear();
+    m_decoding.clear();
+    m_cacheLoads.clear();
+    m_networkQueue.clear();
+    QList<QNetworkReply*> replies = m_replies.keys();
+    m_replies.clear();
+
+    /* Vastaukset poistetaan taulukosta ennen keskeytystä, jolloin abort()-kutsun
+       lähettämä finished()-signaali ohitetaan. */
+    for (int i = 0; i < replies.size(); i++) {
+        replies.at(i)->abort();
+        replies.at(i)->deleteLater();
+    }
 }
 
 void ScreenshotWindow::startLoadingAnimation()
@@ -321,7 +483,7 @@ void ScreenshotWindow::changeHostToUrls(const QString &host)
     for (int i = 0; i < count; i++) {
         Thumbnail thumbnail = m_queue.at(i);
 
-        if (regexp.indexIn(thumbnail.url.path())) {
+        if (regexp.indexIn(thumbnail.url.path()) >= 0) {
             thumbnail.url = QUrl(QString("http://%1/metadata/%2/thumbs/%3").arg(host, regexp.cap(1), regexp.cap(2)));
             m_queue.replace(i, thumbnail);
         }
@@ -1,7 +1,9 @@
 #ifndef SCREENSHOTWINDOW_H
 #define SCREENSHOTWINDOW_H
 
+#include <QImage>
 #include <QMainWindow>
+#include <QMap>
 #include <QNetworkReply>
 #include "programme.h"
 #include "thumbnail.h"
@@ -13,6 +15,7 @@ namespace Ui {
 class QLabel;
 class QComboBox;
 class QSettings;
+class ImageLoader;
 class TvkaistaClient;
 
 class ScreenshotWindow : public QMainWindow {
@@ -22,6 +25,7 @@ public:
     ~ScreenshotWindow();
     void setClient(TvkaistaClient *client);
     TvkaistaClient* client() const;
+    void setImageLoader(ImageLoader *imageLoader);
     void fetchScreenshots(const Programme &programme);
 
 protected:
@@ -35,9 +39,15 @@ private slots:
     void thumbnailRequestFinished();
     void networkError(QNetworkReply::NetworkError error);
     void thumbnailsToQueue();
+    void imageLoaded(const QString &key, const QImage &image);
 
 private:
     void fetchNextScreenshot();
+    void insertScreenshots();
+    void decodeScreenshot(int index, const QByteArray &data);
+    void sendThumbnailRequest(int index);
+    QString screenshotKey(int index) const;
+    void abortThumbnailRequests();
     void startLoadingAnimation();
     void stopLoadingAnimation();
     void screenshotsNotFound();
@@ -48,10 +58,18 @@ private:
     QComboBox *m_numScreenshotsComboBox;
     QMovie *m_loadMovie;
     TvkaistaClient *m_client;
+    ImageLoader *m_imageLoader;
     QNetworkReply *m_reply;
+    QMap<QNetworkReply*, int> m_replies;
+    QMap<QString, int> m_decoding;
+    QMap<QString, int> m_cacheLoads;
+    QList<int> m_networkQueue;
+    QMap<int, QImage> m_results;
     QList<Thumbnail> m_thumbnails;
     QList<Thumbnail> m_queue;
-    int m_redirections;
+    int m_nextIndex;
+    int m_insertIndex;
+    bool m_hostResolved;
     int m_numErrors;
     Programme m_programme;
 };
@@ -0,0 +1,382 @@
+#include <QDebug>
+#include <QNetworkReply>
+#include <QSettings>
+#include <QTimer>
+#include "availabilitywatcher.h"
+#include "metrics.h"
+#include "serverprober.h"
+#include "sessionmanager.h"
+#include "tvkaistaclient.h"
+
+/* Palvelimet mitataan yksi kerrallaan taustalla. Ensin selvitetään tallenteen osoite
+   kyseisen palvelimen evästeellä, sitten ladataan osoitteesta lyhyt alku Range-pyynnöllä.
+   Viive on aika pyynnöstä ensimmäiseen tavuun ja nopeus lasketaan siitä eteenpäin.
+   Lataus keskeytetään ProbeBytes tavun jälkeen, ja palvelin, joka ei vastaa Range-pyyntöön
+   osittaisella sisällöllä (206), merkitään epäonnistuneeksi ennen kuin se ehtii lähettää
+   koko tallenteen.
+   Mittaukseen käytetään jo päättynyttä ohjelmaa viimeksi näytetystä listauksesta. */
+
+static const int ProbeBytes = 512 * 1024;
+static const int ProbeTimeout = 20 * 1000;
+static const int ProbeInterval = 6 * 60 * 60 * 1000;
+static const int StartDelay = 30 * 1000;
+static const int MinStallInterval = 10 * 60;
+static const int MaxHistory = 20;
+static const int ScoredResults = 3;
+
+ServerProbeResult::ServerProbeResult() : rtt(-1), throughput(0)
+{
+}
+
+ServerProber::ServerProber(TvkaistaClient *client, QSettings *settings, QObject *parent) :
+    QObject(parent), m_client(client), m_settings(settings), m_intervalTimer(new QTimer(this)),
+    m_timeoutTimer(new QTimer(this)), m_reply(0), m_requestTime(0), m_firstByteTime(-1), m_bytes(0),
+    m_loginSent(false), m_waitingForLogin(false)
+{
+    m_programme.id = -1;
+    m_intervalTimer->setSingleShot(true);
+    m_timeoutTimer->setSingleShot(true);
+    m_timeoutTimer->setInterval(ProbeTimeout);
+    connect(m_intervalTimer, SIGNAL(timeout()), SLOT(probe()));
+    connect(m_timeoutTimer, SIGNAL(timeout()), SLOT(timeout()));
+    connect(m_client->session(), SIGNAL(loggedIn()), SLOT(loginFinished()));
+    connect(m_client->session(), SIGNAL(loginFailed(QNetworkReply::NetworkError)), SLOT(loginFinished()));
+    loadHistory();
+}
+
+void ServerProber::addServer(const QString &server)
+{
+    if (!m_servers.contains(server)) {
+        m_servers.append(server);
+    }
+}
+
+void ServerProber::setProgrammes(const QList<Programme> &programmes)
+{
+    /* Tallenne on varmasti valmis, kun ohjelman päättymisestä on kulunut tunti. */
+    QDateTime now = QDateTime::currentDateTime();
+    int format = m_client->format();
+    bool found = m_programme.id >= 0;
+    int count = programmes.size();
+
+    for (int i = 0; i < count; i++) {
+        Programme programme = programmes.at(i);
+
+        if (programme.duration > 0 && programme.startDateTime.addSecs(programme.duration).secsTo(now) > 3600 &&
+            AvailabilityWatcher::isAvailable(programme, format) &&
+            (m_programme.id < 0 || programme.startDateTime > m_programme.startDateTime)) {
+            m_programme = programme;
+        }
+    }
+
+    if (found || m_programme.id < 0 || m_intervalTimer->isActive()) {
+        return;
+    }
+
+    if (m_lastProbe.isNull() || m_lastProbe.secsTo(now) > ProbeInterval / 1000) {
+        m_intervalTimer->start(StartDelay);
+    }
+    else {
+        m_intervalTimer->start(qMax(StartDelay, ProbeInterval - m_lastProbe.secsTo(now) * 1000));
+    }
+}
+
+bool ServerProber::isProbing() const
+{
+    return m_reply != 0 || m_waitingForLogin || !m_queue.isEmpty();
+}
+
+QList<ServerProbeResult> ServerProber::history(const QString &server) const
+{
+    return m_history.value(server);
+}
+
+ServerProbeResult ServerProber::lastResult(const QString &server) const
+{
+    QList<ServerProbeResult> results = m_history.value(server);
+    return results.isEmpty() ? ServerProbeResult() : results.last();
+}
+
+int ServerProber::fastestServer() const
+{
+    /* Palvelimen pisteet ovat viimeisimpien onnistuneiden mittausten nopeuksien keskiarvo. */
+    QDateTime limit = QDateTime::currentDateTime().addDays(-7);
+    int fastest = -1;
+    double fastestThroughput = 0;
+
+    for (int i = 0; i < m_servers.size(); i++) {
+        QList<ServerProbeResult> results = m_history.value(m_servers.at(i));
+        double sum = 0;
+        int n = 0;
+
+        for (int j = results.size() - 1; j >= 0 && n < ScoredResults; j--) {
+            if (results.at(j).dateTime < limit) {
+                break;
+            }
+
+            if (results.at(j).rtt >= 0) {
+                sum += results.at(j).throughput;
+                n++;
+            }
+        }
+
+        if (n > 0 && sum / n > fastestThroughput) {
+            fastest = i;
+            fastestThroughput = sum / n;
+        }
+    }
+
+    return fastest;
+}
+
+void ServerProber::probe()
+{
+    if (isProbing() || m_programme.id < 0 || m_servers.isEmpty() || !m_client->isValidUsernameAndPassword()) {
+        return;
+    }
+
+    qDebug() << "Probing servers" << m_programme.id;
+    m_intervalTimer->stop();
+    m_lastProbe = QDateTime::currentDateTime();
+    m_loginSent = false;
+    m_queue = m_servers;
+    probeNextServer();
+}
+
+void ServerProber::downloadStalled()
+{
+    if (m_lastProbe.isNull() || m_lastProbe.secsTo(QDateTime::currentDateTime()) > MinStallInterval) {
+        probe();
+    }
+}
+
+void ServerProber::probeNextServer()
+{
+    if (m_reply != 0) {
+        return;
+    }
+
+    if (m_queue.isEmpty()) {
+        saveHistory();
+        m_intervalTimer->start(ProbeInterval);
+        emit finished();
+        return;
+    }
+
+    m_server = m_queue.takeFirst();
+    m_firstByteTime = -1;
+    m_bytes = 0;
+    m_timer.start();
+    m_timeoutTimer->start();
+    m_reply = m_client->sendStreamUrlRequest(m_programme, m_client->format(), m_server);
+    connect(m_reply, SIGNAL(finished()), SLOT(urlRequestFinished()));
+}
+
+void ServerProber::loginFinished()
+{
+    if (m_waitingForLogin) {
+        m_waitingForLogin = false;
+        probeNextServer();
+    }
+}
+
+void ServerProber::urlRequestFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || reply != m_reply) {
+        return;
+    }
+
+    m_reply = 0;
+    reply->deleteLater();
+    QUrl location = reply->url().resolved(reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl());
+
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() != 302 || !location.isValid()) {
+        serverFinished(-1, 0);
+        return;
+    }
+
+    if (location.path().startsWith("/login")) {
+        /* Istunto on vanhentunut. Odotetaan kerran yhteistä kirjautumista ja yritetään sitten uudelleen. */
+        if (!m_loginSent) {
+            m_loginSent = true;
+            m_waitingForLogin = true;
+            m_queue.prepend(m_server);
+            m_timeoutTimer->stop();
+            m_client->session()->renew(reply, this, SLOT(loginFinished()));
+        }
+        else {
+            serverFinished(-1, 0);
+        }
+
+        return;
+    }
+
+    QNetworkRequest request(location);
+    request.setRawHeader("Range", QString("bytes=0-%1").arg(ProbeBytes - 1).toAscii());
+    m_requestTime = m_timer.elapsed();
+    m_firstByteTime = -1;
+    m_bytes = 0;
+    m_reply = m_client->sendRequest(request);
+    connect(m_reply, SIGNAL(metaDataChanged()), SLOT(dataMetaDataChanged()));
+    connect(m_reply, SIGNAL(readyRead()), SLOT(dataReadyRead()));
+    connect(m_reply, SIGNAL(finished()), SLOT(dataRequestFinished()));
+}
+
+void ServerProber::dataMetaDataChanged()
+{
+    if (sender() != m_reply) {
+        return;
+    }
+
+    if (m_firstByteTime < 0) {
+        m_firstByteTime = m_timer.elapsed();
+    }
+
+    int status = m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+
+    if (status != 206) {
+        qDebug() << "Probe failed" << m_server << "status" << status;
+        abortReply();
+        serverFinished(-1, 0);
+    }
+}
+
+void ServerProber::dataReadyRead()
+{
+    if (sender() != m_reply) {
+        return;
+    }
+
+    m_bytes += m_reply->readAll().size();
+
+    if (m_bytes >= ProbeBytes) {
+        abortReply();
+        measurementFinished();
+    }
+}
+
+void ServerProber::dataRequestFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || reply != m_reply) {
+        return;
+    }
+
+    m_bytes += reply->readAll().size();
+    m_reply = 0;
+    reply->deleteLater();
+
+    if (reply->error() != QNetworkReply::NoError) {
+        qDebug() << "Probe failed" << m_server << reply->errorString();
+        serverFinished(-1, 0);
+        return;
+    }
+
+    measurementFinished();
+}
+
+void ServerProber::timeout()
+{
+    /* Hidas palvelin arvioidaan siihen mennessä saaduista tavuista. */
+    abortReply();
+    measurementFinished();
+}
+
+void ServerProber::abortReply()
+{
+    if (m_reply != 0) {
+        m_reply->disconnect(this);
+        m_reply->abort();
+        m_reply->deleteLater();
+        m_reply = 0;
+    }
+}
+
+void ServerProber::measurementFinished()
+{
+    if (m_bytes == 0 || m_firstByteTime < 0) {
+        qDebug() << "Probe failed" << m_server << "no data";
+        serverFinished(-1, 0);
+        return;
+    }
+
+    qint64 elapsed = qMax(Q_INT64_C(1), m_timer.elapsed() - m_firstByteTime);
+    serverFinished(m_firstByteTime - m_requestTime, m_bytes * 1000.0 / 1024 / elapsed);
+}
+
+void ServerProber::serverFinished(int rtt, double throughput)
+{
+    m_timeoutTimer->stop();
+    qDebug() << "Probe" << m_server << rtt << "ms" << throughput << "KB/s";
+
+    ServerProbeResult result;
+    result.server = m_server;
+    result.dateTime = QDateTime::currentDateTime();
+    result.rtt = rtt;
+    result.throughput = throughput;
+    QList<ServerProbeResult> &results = m_history[m_server];
+    results.append(result);
+
+    while (results.size() > MaxHistory) {
+        results.removeFirst();
+    }
+
+    if (rtt >= 0) {
+        Metrics::instance()->observe(QString("tvkaista_server_rtt_ms{server=\"%1\"}").arg(m_server), rtt);
+        Metrics::instance()->observe(QString("tvkaista_server_throughput_kbps{server=\"%1\"}").arg(m_server), throughput);
+    }
+
+    emit serverProbed(m_server);
+    probeNextServer();
+}
+
+void ServerProber::loadHistory()
+{
+    m_settings->beginGroup("serverProber");
+    int count = m_settings->beginReadArray("history");
+
+    for (int i = 0; i < count; i++) {
+        m_settings->setArrayIndex(i);
+        ServerProbeResult result;
+        result.server = m_settings->value("server").toString();
+        result.dateTime = m_settings->value("dateTime").toDateTime();
+        result.rtt = m_settings->value("rtt", -1).toInt();
+        result.throughput = m_settings->value("throughput", 0).toDouble();
+        m_history[result.server].append(result);
+
+        if (m_lastProbe.isNull() || result.dateTime > m_lastProbe) {
+            m_lastProbe = result.dateTime;
+        }
+    }
+
+    m_settings->endArray();
+    m_settings->endGroup();
+}
+
+void ServerProber::saveHistory()
+{
+    QList<ServerProbeResult> results;
+    QMapIterator<QString, QList<ServerProbeResult> > i(m_history);
+
+    while (i.hasNext()) {
+        i.next();
+        results.append(i.value());
+    }
+
+    m_settings->beginGroup("serverProber");
+    m_settings->beginWriteArray("history", results.size());
+
+    for (int j = 0; j < results.size(); j++) {
+        m_settings->setArrayIndex(j);
+        m_settings->setValue("server", results.at(j).server);
+        m_settings->setValue("dateTime", results.at(j).dateTime);
+        m_settings->setValue("rtt", results.at(j).rtt);
+        m_settings->setValue("throughput", results.at(j).throughput);
+    }
+
+    m_settings->endArray();
+    m_settings->endGroup();
+}
@@ -0,0 +1,79 @@
+#ifndef SERVERPROBER_H
+#define SERVERPROBER_H
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QMap>
+#include <QObject>
+#include <QStringList>
+#include "programme.h"
+
+class QNetworkReply;
+class QSettings;
+class QTimer;
+class TvkaistaClient;
+
+struct ServerProbeResult
+{
+    ServerProbeResult();
+    QString server;
+    QDateTime dateTime;
+    int rtt;
+    double throughput;
+};
+
+class ServerProber : public QObject
+{
+    Q_OBJECT
+public:
+    ServerProber(TvkaistaClient *client, QSettings *settings, QObject *parent = 0);
+    void addServer(const QString &server);
+    void setProgrammes(const QList<Programme> &programmes);
+    bool isProbing() const;
+    QList<ServerProbeResult> history(const QString &server) const;
+    ServerProbeResult lastResult(const QString &server) const;
+    int fastestServer() const;
+
+public slots:
+    void probe();
+    void downloadStalled();
+
+signals:
+    void serverProbed(const QString &server);
+    void finished();
+
+private slots:
+    void probeNextServer();
+    void urlRequestFinished();
+    void dataMetaDataChanged();
+    void dataReadyRead();
+    void dataRequestFinished();
+    void timeout();
+    void loginFinished();
+
+private:
+    void abortReply();
+    void measurementFinished();
+    void serverFinished(int rtt, double throughput);
+    void loadHistory();
+    void saveHistory();
+    TvkaistaClient *m_client;
+    QSettings *m_settings;
+    QTimer *m_intervalTimer;
+    QTimer *m_timeoutTimer;
+    QNetworkReply *m_reply;
+    QElapsedTimer m_timer;
+    QStringList m_servers;
+    QStringList m_queue;
+    QMap<QString, QList<ServerProbeResult> > m_history;
+    Programme m_programme;
+    QString m_server;
+    QDateTime m_lastProbe;
+    qint64 m_requestTime;
+    qint64 m_firstByteTime;
+    qint64 m_bytes;
+    bool m_loginSent;
+    bool m_waitingForLogin;
+};
+
+#endif // SERVERPROBER_H
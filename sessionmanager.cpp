@@ -0,0 +1,199 @@
+#include <QDebug>
+#include <QNetworkCookie>
+#include <QNetworkRequest>
+#include <QTimer>
+#include "metrics.h"
+#include "sessionmanager.h"
+#include "tvkaistaclient.h"
+
+/* Istunto uusitaan taustalla ennen kuin evästeet vanhenevat, jotta käyttäjän pyyntö ei
+   joudu odottamaan kirjautumista. Kirjautuminen tehdään omilla pyynnöillään, eikä se
+   keskeytä asiakkaan muita pyyntöjä. Jos usea pyyntö saa samaan aikaan uudelleenohjauksen
+   kirjautumissivulle, ne kaikki odottavat samaa kirjautumista. Jos istunto on jo uusittu
+   pyynnön lähettämisen jälkeen, vain pyytäjälle ilmoitetaan, jotta muiden odottajat eivät
+   yritä uudelleen ennen käynnissä olevan kirjautumisen valmistumista. */
+
+static const int RefreshMargin = 5 * 60;
+static const int MinRefreshDelay = 60;
+static const int MaxRefreshDelay = 24 * 60 * 60;
+static const int RetryDelay = 5 * 60;
+
+SessionManager::SessionManager(TvkaistaClient *client, QObject *parent) :
+    QObject(parent), m_client(client), m_refreshTimer(new QTimer(this)), m_reply(0), m_loginStart(0),
+    m_generation(0), m_lifetime(-1)
+{
+    m_refreshTimer->setSingleShot(true);
+    connect(m_refreshTimer, SIGNAL(timeout()), SLOT(refresh()));
+}
+
+bool SessionManager::isLoggingIn() const
+{
+    return m_reply != 0;
+}
+
+int SessionManager::generation() const
+{
+    return m_generation;
+}
+
+QDateTime SessionManager::lastLogin() const
+{
+    return m_lastLogin;
+}
+
+QDateTime SessionManager::expireDateTime() const
+{
+    return m_expireDateTime;
+}
+
+void SessionManager::renew(QNetworkReply *reply, QObject *receiver, const char *member)
+{
+    /* Pyyntö lähetettiin ennen viimeisintä kirjautumista, joten istunto on jo uusittu. */
+    if (reply != 0 && reply->property("sessionGeneration").toInt() < m_generation) {
+        if (receiver != 0 && member != 0) {
+            QTimer::singleShot(0, receiver, member);
+        }
+
+        return;
+    }
+
+    if (m_reply != 0) {
+        return;
+    }
+
+    /* Istunto vanheni, vaikka evästeet olivat voimassa. Arvioidaan istunnon kesto havainnosta.
+       Lyhyt havainto johtuu yleensä palvelimen mitätöimästä istunnosta, joten se ohitetaan,
+       ja pisin havainto säilytetään, jotta uusintaväli ei kutistu kirjautumissilmukaksi. */
+    if (!m_lastLogin.isNull()) {
+        int lifetime = m_lastLogin.secsTo(QDateTime::currentDateTime());
+
+        if (lifetime > RefreshMargin && lifetime > m_lifetime) {
+            m_lifetime = lifetime;
+        }
+    }
+
+    startLogin("expired");
+}
+
+void SessionManager::login()
+{
+    if (m_reply == 0) {
+        startLogin("explicit");
+    }
+}
+
+void SessionManager::updateExpireDateTime()
+{
+    QList<QNetworkCookie> cookies = QNetworkCookie::parseCookies(m_client->cookies());
+    QDateTime expireDateTime;
+    int count = cookies.size();
+
+    for (int i = 0; i < count; i++) {
+        if (!cookies.at(i).isSessionCookie() &&
+            (expireDateTime.isNull() || cookies.at(i).expirationDate() < expireDateTime)) {
+            expireDateTime = cookies.at(i).expirationDate();
+        }
+    }
+
+    if (m_lifetime > 0 && !m_lastLogin.isNull() &&
+        (expireDateTime.isNull() || m_lastLogin.addSecs(m_lifetime) < expireDateTime)) {
+        expireDateTime = m_lastLogin.addSecs(m_lifetime);
+    }
+
+    m_expireDateTime = expireDateTime;
+    m_refreshTimer->stop();
+
+    if (expireDateTime.isNull()) {
+        return;
+    }
+
+    int delay = qBound(MinRefreshDelay, QDateTime::currentDateTime().secsTo(expireDateTime) - RefreshMargin, MaxRefreshDelay);
+    qDebug() << "Session expires" << expireDateTime << "refresh in" << delay << "s";
+    m_refreshTimer->start(delay * 1000);
+}
+
+void SessionManager::refresh()
+{
+    if (m_reply != 0 || !m_client->isValidUsernameAndPassword()) {
+        return;
+    }
+
+    /* Ajastin ei ulotu kauas tulevaisuuteen, joten vanhenemisaika tarkistetaan uudelleen. */
+    if (QDateTime::currentDateTime().secsTo(m_expireDateTime) > RefreshMargin) {
+        updateExpireDateTime();
+        return;
+    }
+
+    startLogin("keepalive");
+}
+
+void SessionManager::startLogin(const QString &reason)
+{
+    qDebug() << "Session login" << reason;
+    Metrics::instance()->increment(QString("tvkaista_session_logins_total{reason=\"%1\"}").arg(reason));
+    m_refreshTimer->stop();
+    m_loginStart = Metrics::instance()->timestamp();
+    m_reply = m_client->sendRequest(QNetworkRequest(QUrl("http://www.tvkaista.fi/")));
+    connect(m_reply, SIGNAL(finished()), SLOT(frontPageRequestFinished()));
+}
+
+void SessionManager::frontPageRequestFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || reply != m_reply) {
+        return;
+    }
+
+    reply->deleteLater();
+
+    if (reply->error() != QNetworkReply::NoError) {
+        m_reply = 0;
+        fail(reply->error());
+        return;
+    }
+
+    m_reply = m_client->sendLoginFormRequest();
+    connect(m_reply, SIGNAL(finished()), SLOT(loginRequestFinished()));
+}
+
+void SessionManager::loginRequestFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0 || reply != m_reply) {
+        return;
+    }
+
+    m_reply = 0;
+    reply->deleteLater();
+
+    if (reply->error() != QNetworkReply::NoError) {
+        fail(reply->error());
+        return;
+    }
+
+    if (reply->readAll().contains("<form")) {
+        fail(QNetworkReply::AuthenticationRequiredError);
+        return;
+    }
+
+    m_lastLogin = QDateTime::currentDateTime();
+    m_generation++;
+    Metrics::instance()->observeElapsed("tvkaista_session_login_duration_ms", m_loginStart);
+    updateExpireDateTime();
+    emit loggedIn();
+}
+
+void SessionManager::fail(QNetworkReply::NetworkError error)
+{
+    qDebug() << "Session login failed" << error;
+    Metrics::instance()->increment("tvkaista_session_login_failures_total");
+
+    /* Väärällä salasanalla ei yritetä uudelleen taustalla. */
+    if (error != QNetworkReply::AuthenticationRequiredError && !m_expireDateTime.isNull()) {
+        m_refreshTimer->start(RetryDelay * 1000);
+    }
+
+    emit loginFailed(error);
+}
@@ -0,0 +1,48 @@
+#ifndef SESSIONMANAGER_H
+#define SESSIONMANAGER_H
+
+#include <QDateTime>
+#include <QNetworkReply>
+#include <QObject>
+
+class QTimer;
+class TvkaistaClient;
+
+class SessionManager : public QObject
+{
+    Q_OBJECT
+public:
+    SessionManager(TvkaistaClient *client, QObject *parent = 0);
+    bool isLoggingIn() const;
+    int generation() const;
+    QDateTime lastLogin() const;
+    QDateTime expireDateTime() const;
+    void renew(QNetworkReply *reply, QObject *receiver = 0, const char *member = 0);
+
+public slots:
+    void login();
+    void updateExpireDateTime();
+
+signals:
+    void loggedIn();
+    void loginFailed(QNetworkReply::NetworkError error);
+
+private slots:
+    void refresh();
+    void frontPageRequestFinished();
+    void loginRequestFinished();
+
+private:
+    void startLogin(const QString &reason);
+    void fail(QNetworkReply::NetworkError error);
+    TvkaistaClient *m_client;
+    QTimer *m_refreshTimer;
+    QNetworkReply *m_reply;
+    QDateTime m_lastLogin;
+    QDateTime m_expireDateTime;
+    qint64 m_loginStart;
+    int m_generation;
+    int m_lifetime;
+};
+
+#endif // SESSIONMANAGER_H
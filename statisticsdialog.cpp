@@ -0,0 +1,148 @@
+#include <QFileDialog>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QScrollBar>
+#include <QSet>
+#include <QTableWidget>
+#include <QTimer>
+#include <QVBoxLayout>
+#include "metrics.h"
+#include "statisticsdialog.h"
+
+static QString number(double value)
+{
+    return QString::number(value, 'f', value < 100 ? 1 : 0);
+}
+
+StatisticsDialog::StatisticsDialog(QWidget *parent) :
+    QDialog(parent), m_tableWidget(new QTableWidget(this)), m_refreshTimer(new QTimer(this))
+{
+    setWindowTitle(trUtf8("Tilastot"));
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    QHBoxLayout *buttonLayout = new QHBoxLayout();
+    QPushButton *saveButton = new QPushButton(trUtf8("T&allenna..."), this);
+    QPushButton *closeButton = new QPushButton(trUtf8("&Sulje"), this);
+    buttonLayout->addStretch();
+    buttonLayout->addWidget(saveButton);
+    buttonLayout->addWidget(closeButton);
+    layout->addWidget(m_tableWidget);
+    layout->addLayout(buttonLayout);
+    resize(760, 480);
+
+    /* Histogrammien mediaani ja 95 %:n arvo ovat lokeroiden ylärajoja, eivät tarkkoja arvoja. */
+    m_tableWidget->setColumnCount(6);
+    m_tableWidget->setHorizontalHeaderLabels(QStringList() << trUtf8("Mittari") << trUtf8("Arvo")
+                                             << trUtf8("Määrä") << trUtf8("Keskiarvo")
+                                             << trUtf8("Mediaani") << trUtf8("95 %"));
+    m_tableWidget->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_tableWidget->setSelectionBehavior(QAbstractItemView::SelectRows);
+    m_tableWidget->verticalHeader()->hide();
+    m_tableWidget->setColumnWidth(0, 380);
+
+    m_refreshTimer->setInterval(2000);
+    connect(m_refreshTimer, SIGNAL(timeout()), SLOT(refresh()));
+    connect(saveButton, SIGNAL(clicked()), SLOT(save()));
+    connect(closeButton, SIGNAL(clicked()), SLOT(close()));
+}
+
+void StatisticsDialog::showEvent(QShowEvent *e)
+{
+    QDialog::showEvent(e);
+    refresh();
+    m_refreshTimer->start();
+}
+
+void StatisticsDialog::hideEvent(QHideEvent *e)
+{
+    QDialog::hideEvent(e);
+    m_refreshTimer->stop();
+}
+
+void StatisticsDialog::refresh()
+{
+    Metrics *metrics = Metrics::instance();
+    QMap<QString, qint64> counters = metrics->counters();
+    QMap<QString, double> values = metrics->values();
+    QMap<QString, MetricHistogram> histograms = metrics->histograms();
+    int scrollValue = m_tableWidget->verticalScrollBar()->value();
+    m_tableWidget->setRowCount(0);
+
+    /* Osumaprosentit lasketaan välimuistin osuma- ja ohituslaskureista luokittain. */
+    QSet<QString> cacheClasses;
+    QMapIterator<QString, qint64> i(counters);
+
+    while (i.hasNext()) {
+        i.next();
+
+        if (i.key().startsWith("tvkaista_cache_hits_total") || i.key().startsWith("tvkaista_cache_misses_total")) {
+            cacheClasses.insert(i.key().section('{', 1));
+        }
+    }
+
+    QStringList classes = cacheClasses.toList();
+    qSort(classes);
+
+    for (int j = 0; j < classes.size(); j++) {
+        qint64 hits = counters.value("tvkaista_cache_hits_total{" + classes.at(j));
+        qint64 misses = counters.value("tvkaista_cache_misses_total{" + classes.at(j));
+        addRow("tvkaista_cache_hit_ratio{" + classes.at(j),
+               QStringList() << QString("%1 %").arg(number(100.0 * hits / qMax(Q_INT64_C(1), hits + misses)))
+                             << QString::number(hits + misses));
+    }
+
+    i.toFront();
+
+    while (i.hasNext()) {
+        i.next();
+        addRow(i.key(), QStringList() << QString::number(i.value()));
+    }
+
+    QMapIterator<QString, double> k(values);
+
+    while (k.hasNext()) {
+        k.next();
+        addRow(k.key(), QStringList() << number(k.value()));
+    }
+
+    QMapIterator<QString, MetricHistogram> l(histograms);
+
+    while (l.hasNext()) {
+        l.next();
+        MetricHistogram histogram = l.value();
+        addRow(l.key(), QStringList() << number(histogram.sum) << QString::number(histogram.count)
+                                      << number(histogram.sum / qMax(Q_INT64_C(1), histogram.count))
+                                      << number(Metrics::quantile(histogram, 0.5))
+                                      << number(Metrics::quantile(histogram, 0.95)));
+    }
+
+    m_tableWidget->verticalScrollBar()->setValue(scrollValue);
+}
+
+void StatisticsDialog::addRow(const QString &name, const QStringList &texts)
+{
+    int row = m_tableWidget->rowCount();
+    m_tableWidget->insertRow(row);
+    m_tableWidget->setItem(row, 0, new QTableWidgetItem(name));
+
+    for (int i = 0; i < texts.size(); i++) {
+        QTableWidgetItem *item = new QTableWidgetItem(texts.at(i));
+        item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        m_tableWidget->setItem(row, i + 1, item);
+    }
+}
+
+void StatisticsDialog::save()
+{
+    QString filename = QFileDialog::getSaveFileName(this, trUtf8("Tallenna"), "metrics.prom",
+                                                    trUtf8("Prometheus (*.prom);;JSON (*.json)"));
+
+    if (filename.isEmpty()) {
+        return;
+    }
+
+    if (!Metrics::instance()->writeFile(filename)) {
+        QMessageBox::warning(this, windowTitle(), trUtf8("Tiedoston %1 tallennus epäonnistui.").arg(filename));
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef STATISTICSDIALOG_H
+#define STATISTICSDIALOG_H
+
+#include <QDialog>
+
+class QTableWidget;
+class QTimer;
+
+class StatisticsDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    StatisticsDialog(QWidget *parent = 0);
+
+protected:
+    void showEvent(QShowEvent *e);
+    void hideEvent(QHideEvent *e);
+
+private slots:
+    void refresh();
+    void save();
+
+private:
+    void addRow(const QString &name, const QStringList &texts);
+    QTableWidget *m_tableWidget;
+    QTimer *m_refreshTimer;
+};
+
+#endif // STATISTICSDIALOG_H
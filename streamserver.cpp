@@ -0,0 +1,362 @@
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QTcpSocket>
+#include "streamserver.h"
+
+/* Jokainen jaettu lataus saa oman tunnisteen, joten saman ohjelman aiemmat tai
+   poistetut lataukset eivät sekoitu siihen. Palvelin lukee vain tiedostoa, jonka
+   Downloader on itse avannut, ja kirjoittaa lisää dataa aina, kun lataus etenee. */
+
+StreamServer::StreamServer(QObject *parent) :
+    QTcpServer(parent), m_nextStreamId(1)
+{
+    m_buf = new char[65536];
+    connect(this, SIGNAL(newConnection()), SLOT(acceptConnection()));
+}
+
+StreamServer::~StreamServer()
+{
+    QList<StreamConnection> connections = m_connections.values();
+
+    for (int i = 0; i < connections.size(); i++) {
+        delete connections.at(i).file;
+    }
+
+    delete [] m_buf;
+}
+
+bool StreamServer::start()
+{
+    if (isListening()) {
+        return true;
+    }
+
+    if (!listen(QHostAddress::LocalHost, 0)) {
+        qWarning() << errorString();
+        return false;
+    }
+
+    qDebug() << "LISTEN" << serverPort();
+    return true;
+}
+
+QUrl StreamServer::url(Downloader *downloader)
+{
+    /* Poistetaan päättyneet lataukset, joita mikään yhteys ei enää lue. */
+    QList<int> streamIds = m_streams.keys();
+    QList<StreamConnection> connections = m_connections.values();
+
+    for (int j = 0; j < connections.size(); j++) {
+        streamIds.removeAll(connections.at(j).streamId);
+    }
+
+    for (int j = 0; j < streamIds.size(); j++) {
+        if (m_streams.value(streamIds.at(j)).downloader.isNull()) {
+            m_streams.remove(streamIds.at(j));
+        }
+    }
+
+    QMap<int, ServedStream>::const_iterator i = m_streams.constBegin();
+    int streamId = -1;
+
+    while (i != m_streams.constEnd()) {
+        if (i.value().downloader == downloader) {
+            streamId = i.key();
+            break;
+        }
+
+        ++i;
+    }
+
+    if (streamId < 0) {
+        streamId = m_nextStreamId++;
+        ServedStream stream;
+        stream.downloader = downloader;
+        stream.filename = downloader->openedFilename();
+        m_streams.insert(streamId, stream);
+        connect(downloader, SIGNAL(progress()), SLOT(downloaderProgress()));
+        connect(downloader, SIGNAL(finished()), SLOT(downloaderProgress()));
+        connect(downloader, SIGNAL(networkError()), SLOT(downloaderProgress()));
+    }
+
+    return QUrl(QString("http://127.0.0.1:%1/%2").arg(serverPort()).arg(streamId));
+}
+
+void StreamServer::acceptConnection()
+{
+    while (hasPendingConnections()) {
+        QTcpSocket *socket = nextPendingConnection();
+        StreamConnection connection;
+        connection.file = 0;
+        connection.streamId = -1;
+        connection.pos = 0;
+        connection.end = -1;
+        connection.partial = false;
+        connection.headOnly = false;
+        connection.headerSent = false;
+        m_connections.insert(socket, connection);
+        connect(socket, SIGNAL(readyRead()), SLOT(readRequest()));
+        connect(socket, SIGNAL(bytesWritten(qint64)), SLOT(writeData()));
+        connect(socket, SIGNAL(disconnected()), SLOT(connectionClosed()));
+    }
+}
+
+void StreamServer::readRequest()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+
+    if (socket == 0 || !m_connections.contains(socket)) {
+        return;
+    }
+
+    StreamConnection &connection = m_connections[socket];
+
+    if (connection.streamId >= 0) {
+        /* Yksi pyyntö yhteyttä kohden, ylimääräinen data ohitetaan. */
+        socket->readAll();
+        return;
+    }
+
+    connection.request.append(socket->readAll());
+
+    if (!connection.request.contains("\r\n\r\n")) {
+        if (connection.request.size() > 8192) {
+            closeConnection(socket);
+        }
+
+        return;
+    }
+
+    if (!parseRequest(socket, connection)) {
+        closeConnection(socket);
+        return;
+    }
+
+    if (!writeToSocket(socket, connection)) {
+        closeConnection(socket);
+    }
+}
+
+void StreamServer::writeData()
+{
+    QList<QTcpSocket*> sockets = m_connections.keys();
+    int count = sockets.size();
+
+    for (int i = 0; i < count; i++) {
+        QTcpSocket *socket = sockets.at(i);
+
+        if (!m_connections.contains(socket) || m_connections.value(socket).streamId < 0) {
+            continue;
+        }
+
+        if (!writeToSocket(socket, m_connections[socket])) {
+            closeConnection(socket);
+        }
+    }
+}
+
+void StreamServer::downloaderProgress()
+{
+    Downloader *downloader = qobject_cast<Downloader*>(sender());
+    QMap<int, ServedStream>::iterator i = m_streams.begin();
+
+    while (i != m_streams.end()) {
+        if (i.value().downloader == downloader && !downloader->openedFilename().isEmpty()) {
+            i.value().filename = downloader->openedFilename();
+        }
+
+        ++i;
+    }
+
+    writeData();
+}
+
+void StreamServer::connectionClosed()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+
+    if (socket == 0 || !m_connections.contains(socket)) {
+        return;
+    }
+
+    delete m_connections.take(socket).file;
+    socket->deleteLater();
+}
+
+bool StreamServer::parseRequest(QTcpSocket *socket, StreamConnection &connection)
+{
+    /* "GET /3 HTTP/1.1", "Range: bytes=1000-" */
+    QStringList lines = QString::fromLatin1(connection.request).split("\r\n");
+    QStringList requestLine = lines.value(0).split(' ');
+    QString method = requestLine.value(0);
+    bool ok;
+    int streamId = requestLine.value(1).mid(1).toInt(&ok);
+    qDebug() << "SERVE" << lines.value(0);
+
+    if ((method != "GET" && method != "HEAD") || !ok || !m_streams.contains(streamId)) {
+        socket->write("HTTP/1.1 404 Not Found\r\nConnection: close\r\n\r\n");
+        return false;
+    }
+
+    connection.streamId = streamId;
+    connection.headOnly = (method == "HEAD");
+    int count = lines.size();
+
+    for (int i = 1; i < count; i++) {
+        QString line = lines.at(i);
+
+        if (!line.startsWith("Range:", Qt::CaseInsensitive)) {
+            continue;
+        }
+
+        QString range = line.mid(6).trimmed();
+
+        if (!range.startsWith("bytes=")) {
+            continue;
+        }
+
+        int pos = range.indexOf('-');
+        qint64 start = range.mid(6, pos - 6).toLongLong(&ok);
+
+        if (pos < 0 || !ok) {
+            continue;
+        }
+
+        qint64 end = range.mid(pos + 1).toLongLong(&ok);
+        connection.pos = start;
+        connection.end = ok ? end : -1;
+        connection.partial = true;
+    }
+
+    return true;
+}
+
+bool StreamServer::sendHeader(QTcpSocket *socket, StreamConnection &connection, qint64 total)
+{
+    QByteArray header;
+
+    if (connection.partial && total > 0 && connection.pos >= total) {
+        header.append("HTTP/1.1 416 Requested Range Not Satisfiable\r\n");
+        header.append(QString("Content-Range: bytes */%1\r\n").arg(total).toAscii());
+        header.append("Connection: close\r\n\r\n");
+        socket->write(header);
+        return false;
+    }
+
+    if (connection.partial && total > 0) {
+        if (connection.end < 0 || connection.end >= total) {
+            connection.end = total - 1;
+        }
+
+        header.append("HTTP/1.1 206 Partial Content\r\n");
+        header.append(QString("Content-Range: bytes %1-%2/%3\r\n").arg(connection.pos)
+                      .arg(connection.end).arg(total).toAscii());
+        header.append(QString("Content-Length: %1\r\n").arg(connection.end - connection.pos + 1).toAscii());
+    }
+    else {
+        connection.pos = 0;
+        connection.end = total > 0 ? total - 1 : -1;
+        header.append("HTTP/1.1 200 OK\r\n");
+
+        if (total > 0) {
+            header.append(QString("Content-Length: %1\r\n").arg(total).toAscii());
+        }
+    }
+
+    QString suffix = QFileInfo(connection.file->fileName()).suffix();
+
+    if (suffix == "mp4") {
+        header.append("Content-Type: video/mp4\r\n");
+    }
+    else if (suffix == "flv") {
+        header.append("Content-Type: video/x-flv\r\n");
+    }
+    else {
+        header.append("Content-Type: video/MP2T\r\n");
+    }
+
+    header.append("Accept-Ranges: bytes\r\nConnection: close\r\n\r\n");
+    socket->write(header);
+    connection.headerSent = true;
+    return true;
+}
+
+bool StreamServer::writeToSocket(QTcpSocket *socket, StreamConnection &connection)
+{
+    if (!m_streams.contains(connection.streamId)) {
+        return false;
+    }
+
+    ServedStream stream = m_streams.value(connection.streamId);
+    Downloader *downloader = stream.downloader;
+    bool downloading = downloader != 0 && !downloader->isFinished() && !downloader->hasError();
+
+    if (connection.file == 0) {
+        /* Downloader ei ehkä ole vielä avannut tiedostoa, jos lataus on juuri käynnistetty. */
+        if (stream.filename.isEmpty()) {
+            return downloading;
+        }
+
+        connection.file = new QFile(stream.filename);
+
+        if (!connection.file->open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+            qWarning() << connection.file->errorString();
+            return false;
+        }
+    }
+
+    if (!connection.headerSent) {
+        qint64 total = downloading ? downloader->bytesTotal() : connection.file->size();
+
+        /* Odotetaan, kunnes tiedoston koko on tiedossa, jotta Range-pyyntöihin voidaan vastata. */
+        if (total <= 0 && downloading) {
+            return true;
+        }
+
+        if (!sendHeader(socket, connection, total) || connection.headOnly) {
+            return false;
+        }
+    }
+
+    while (socket->bytesToWrite() < 256 * 1024) {
+        qint64 available = connection.file->size();
+        qint64 last = connection.end >= 0 ? qMin(connection.end + 1, available) : available;
+
+        if (connection.pos >= last) {
+            if (connection.end >= 0 && connection.pos > connection.end) {
+                return false;
+            }
+
+            /* Pyydettyä aluetta ei ole vielä kirjoitettu levylle. Odotetaan lisää dataa. */
+            return downloading;
+        }
+
+        if (!connection.file->seek(connection.pos)) {
+            return false;
+        }
+
+        qint64 len = connection.file->read(m_buf, qMin(last - connection.pos, (qint64)65536));
+
+        if (len <= 0) {
+            return downloading;
+        }
+
+        socket->write(m_buf, len);
+        connection.pos += len;
+    }
+
+    return true;
+}
+
+void StreamServer::closeConnection(QTcpSocket *socket)
+{
+    if (!m_connections.contains(socket)) {
+        return;
+    }
+
+    delete m_connections.take(socket).file;
+    socket->disconnectFromHost();
+    socket->deleteLater();
+}
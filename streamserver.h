@@ -0,0 +1,58 @@
+#ifndef STREAMSERVER_H
+#define STREAMSERVER_H
+
+#include <QMap>
+#include <QPointer>
+#include <QTcpServer>
+#include <QUrl>
+#include "downloader.h"
+
+class QFile;
+class QTcpSocket;
+
+struct ServedStream
+{
+    QPointer<Downloader> downloader;
+    QString filename;
+};
+
+struct StreamConnection
+{
+    QByteArray request;
+    QFile *file;
+    int streamId;
+    qint64 pos;
+    qint64 end;
+    bool partial;
+    bool headOnly;
+    bool headerSent;
+};
+
+class StreamServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    StreamServer(QObject *parent = 0);
+    ~StreamServer();
+    bool start();
+    QUrl url(Downloader *downloader);
+
+private slots:
+    void acceptConnection();
+    void readRequest();
+    void writeData();
+    void connectionClosed();
+    void downloaderProgress();
+
+private:
+    bool parseRequest(QTcpSocket *socket, StreamConnection &connection);
+    bool sendHeader(QTcpSocket *socket, StreamConnection &connection, qint64 total);
+    bool writeToSocket(QTcpSocket *socket, StreamConnection &connection);
+    void closeConnection(QTcpSocket *socket);
+    QMap<QTcpSocket*, StreamConnection> m_connections;
+    QMap<int, ServedStream> m_streams;
+    int m_nextStreamId;
+    char *m_buf;
+};
+
+#endif // STREAMSERVER_H
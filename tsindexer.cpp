@@ -0,0 +1,336 @@
+#include <QDebug>
+#include <QFileInfo>
+#include "tsindexer.h"
+
+/* Hakemistotiedoston rakenne: otsake (quint32 "TSIX", quint8 versio) ja sen perässä
+   tietueita (quint8 tyyppi, qint64 tavusiirtymä, qint64 PCR 90 kHz:n yksiköissä).
+
+   1 = PCR (enintään kerran sekunnissa)
+   2 = avainkuva, PCR-kenttänä viimeisin PCR
+   3 = latausta jatkettu, PCR-kenttä -1
+   4 = lataus valmis, tavusiirtymänä tiedoston koko ja PCR-kenttänä virheiden määrä
+*/
+
+static const quint32 IndexMagic = 0x54534958;
+static const quint8 IndexVersion = 1;
+static const int PacketSize = 188;
+
+TsIndexer::TsIndexer() : m_continuity(8192, (char)0xff), m_offset(0), m_lastPcr(-1),
+    m_lastIndexedPcr(-1), m_pmtPid(-1), m_pcrPid(-1), m_videoPid(-1), m_videoType(0),
+    m_continuityErrors(0), m_syncErrors(0), m_synced(true)
+{
+}
+
+bool TsIndexer::open(const QString &filename, qint64 byteOffset)
+{
+    m_file.setFileName(filename);
+    QIODevice::OpenMode mode = QIODevice::WriteOnly;
+
+    if (byteOffset > 0) {
+        mode |= QIODevice::Append;
+    }
+
+    if (!m_file.open(mode)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    qDebug() << "WRITE" << filename;
+    m_stream.setDevice(&m_file);
+
+    if (m_file.size() == 0) {
+        m_stream << IndexMagic << IndexVersion;
+    }
+
+    m_offset = byteOffset;
+    m_packet.clear();
+
+    if (byteOffset > 0) {
+        writeEntry(3, byteOffset, -1);
+    }
+
+    return true;
+}
+
+void TsIndexer::close(bool complete)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    if (complete) {
+        writeEntry(4, m_offset + m_packet.size(), m_continuityErrors + m_syncErrors);
+    }
+
+    m_stream.setDevice(0);
+    m_file.close();
+}
+
+bool TsIndexer::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+void TsIndexer::parse(const char *data, int len)
+{
+    const uchar *p = reinterpret_cast<const uchar*>(data);
+    int i = 0;
+
+    /* Täydennetään edellisestä lohkosta kesken jäänyt paketti. */
+    if (!m_packet.isEmpty()) {
+        int n = qMin(PacketSize - m_packet.size(), len);
+        m_packet.append(data, n);
+        i = n;
+
+        if (m_packet.size() < PacketSize) {
+            return;
+        }
+
+        parsePacket(reinterpret_cast<const uchar*>(m_packet.constData()), m_offset);
+        m_offset += PacketSize;
+        m_packet.clear();
+    }
+
+    while (i < len) {
+        if (p[i] != 0x47) {
+            if (m_synced) {
+                m_syncErrors++;
+                m_synced = false;
+            }
+
+            m_offset++;
+            i++;
+            continue;
+        }
+
+        m_synced = true;
+
+        if (len - i < PacketSize) {
+            m_packet = QByteArray(data + i, len - i);
+            break;
+        }
+
+        parsePacket(p + i, m_offset);
+        m_offset += PacketSize;
+        i += PacketSize;
+    }
+}
+
+QString TsIndexer::lastError() const
+{
+    return m_error;
+}
+
+int TsIndexer::continuityErrors() const
+{
+    return m_continuityErrors;
+}
+
+int TsIndexer::syncErrors() const
+{
+    return m_syncErrors;
+}
+
+QString TsIndexer::indexFilename(const QString &filename)
+{
+    return filename + ".idx";
+}
+
+bool TsIndexer::verify(const QString &filename, int &errors)
+{
+    errors = 0;
+    QFile file(indexFilename(filename));
+
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    quint32 magic;
+    quint8 version;
+    stream >> magic >> version;
+
+    if (magic != IndexMagic || version != IndexVersion) {
+        return false;
+    }
+
+    bool complete = false;
+
+    while (!stream.atEnd()) {
+        quint8 type;
+        qint64 offset;
+        qint64 pcr;
+        stream >> type >> offset >> pcr;
+
+        if (stream.status() != QDataStream::Ok) {
+            return false;
+        }
+
+        if (type == 4) {
+            complete = (offset == QFileInfo(filename).size());
+            errors = pcr;
+        }
+        else if (type == 3) {
+            complete = false;
+        }
+    }
+
+    return complete;
+}
+
+void TsIndexer::parsePacket(const uchar *p, qint64 offset)
+{
+    int pid = ((p[1] & 0x1f) << 8) | p[2];
+    bool unitStart = (p[1] & 0x40) != 0;
+    int adaptationFieldControl = (p[3] >> 4) & 0x03;
+    int pos = 4;
+
+    if (pid == 0x1fff) {
+        return;
+    }
+
+    if (adaptationFieldControl & 0x01) {
+        int cc = p[3] & 0x0f;
+        int last = (uchar)m_continuity.at(pid);
+
+        /* Sama laskurin arvo kahdesti peräkkäin on sallittu (toistettu paketti). */
+        if (last != 0xff && cc != last && cc != ((last + 1) & 0x0f)) {
+            m_continuityErrors++;
+        }
+
+        m_continuity[pid] = (char)cc;
+    }
+
+    bool randomAccess = false;
+
+    if (adaptationFieldControl & 0x02) {
+        int length = p[4];
+
+        if (length > 0 && length <= 183) {
+            int flags = p[5];
+            randomAccess = (flags & 0x40) != 0;
+
+            if ((flags & 0x10) && length >= 7 && pid == m_pcrPid) {
+                qint64 pcr = ((qint64)p[6] << 25) | (p[7] << 17) | (p[8] << 9) | (p[9] << 1) | (p[10] >> 7);
+                m_lastPcr = pcr;
+
+                if (m_lastIndexedPcr < 0 || pcr < m_lastIndexedPcr || pcr - m_lastIndexedPcr >= 90000) {
+                    writeEntry(1, offset, pcr);
+                    m_lastIndexedPcr = pcr;
+                }
+            }
+        }
+
+        pos = 5 + length;
+    }
+
+    if ((adaptationFieldControl & 0x01) == 0 || pos >= PacketSize || !unitStart) {
+        return;
+    }
+
+    if (pid == 0) {
+        parsePat(p + pos, PacketSize - pos);
+    }
+    else if (pid == m_pmtPid) {
+        parsePmt(p + pos, PacketSize - pos);
+    }
+    else if (pid == m_videoPid && m_lastPcr >= 0) {
+        if (randomAccess || containsKeyframe(p + pos, PacketSize - pos)) {
+            writeEntry(2, offset, m_lastPcr);
+        }
+    }
+}
+
+void TsIndexer::parsePat(const uchar *p, int len)
+{
+    int start = 1 + p[0];
+
+    if (start + 8 > len || p[start] != 0x00) {
+        return;
+    }
+
+    const uchar *s = p + start;
+    int end = qMin(3 + (((s[1] & 0x0f) << 8) | s[2]) - 4, len - start);
+
+    for (int i = 8; i + 4 <= end; i += 4) {
+        int programNumber = (s[i] << 8) | s[i + 1];
+
+        if (programNumber != 0) {
+            m_pmtPid = ((s[i + 2] & 0x1f) << 8) | s[i + 3];
+            return;
+        }
+    }
+}
+
+void TsIndexer::parsePmt(const uchar *p, int len)
+{
+    int start = 1 + p[0];
+
+    if (start + 12 > len || p[start] != 0x02) {
+        return;
+    }
+
+    const uchar *s = p + start;
+    int end = qMin(3 + (((s[1] & 0x0f) << 8) | s[2]) - 4, len - start);
+    m_pcrPid = ((s[8] & 0x1f) << 8) | s[9];
+    int i = 12 + (((s[10] & 0x0f) << 8) | s[11]);
+
+    while (i + 5 <= end) {
+        int streamType = s[i];
+        int pid = ((s[i + 1] & 0x1f) << 8) | s[i + 2];
+
+        /* MPEG-1/2-video, H.264 tai H.265 */
+        if (streamType == 0x01 || streamType == 0x02 || streamType == 0x1b || streamType == 0x24) {
+            m_videoPid = pid;
+            m_videoType = streamType;
+            return;
+        }
+
+        i += 5 + (((s[i + 3] & 0x0f) << 8) | s[i + 4]);
+    }
+}
+
+bool TsIndexer::containsKeyframe(const uchar *p, int len) const
+{
+    /* PES-otsake: 00 00 01 <stream id> <pituus> <liput> <liput> <otsakkeen pituus> */
+    if (len < 9 || p[0] != 0x00 || p[1] != 0x00 || p[2] != 0x01) {
+        return false;
+    }
+
+    for (int i = 9 + p[8]; i + 3 < len; i++) {
+        if (p[i] != 0x00 || p[i + 1] != 0x00 || p[i + 2] != 0x01) {
+            continue;
+        }
+
+        int code = p[i + 3];
+
+        if (m_videoType == 0x1b) {
+            int nalType = code & 0x1f;
+
+            if (nalType == 5 || nalType == 7) {
+                return true;
+            }
+        }
+        else if (m_videoType == 0x24) {
+            int nalType = (code >> 1) & 0x3f;
+
+            if ((nalType >= 16 && nalType <= 21) || nalType == 32) {
+                return true;
+            }
+        }
+        else if (code == 0xb3) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TsIndexer::writeEntry(quint8 type, qint64 offset, qint64 pcr)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+
+    m_stream << type << offset << pcr;
+}
@@ -0,0 +1,45 @@
+#ifndef TSINDEXER_H
+#define TSINDEXER_H
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+
+class TsIndexer
+{
+public:
+    TsIndexer();
+    bool open(const QString &filename, qint64 byteOffset);
+    void close(bool complete);
+    bool isOpen() const;
+    void parse(const char *data, int len);
+    QString lastError() const;
+    int continuityErrors() const;
+    int syncErrors() const;
+    static QString indexFilename(const QString &filename);
+    static bool verify(const QString &filename, int &errors);
+
+private:
+    void parsePacket(const uchar *p, qint64 offset);
+    void parsePat(const uchar *p, int len);
+    void parsePmt(const uchar *p, int len);
+    bool containsKeyframe(const uchar *p, int len) const;
+    void writeEntry(quint8 type, qint64 offset, qint64 pcr);
+    QFile m_file;
+    QDataStream m_stream;
+    QByteArray m_packet;
+    QByteArray m_continuity;
+    QString m_error;
+    qint64 m_offset;
+    qint64 m_lastPcr;
+    qint64 m_lastIndexedPcr;
+    int m_pmtPid;
+    int m_pcrPid;
+    int m_videoPid;
+    int m_videoType;
+    int m_continuityErrors;
+    int m_syncErrors;
+    bool m_synced;
+};
+
+#endif // TSINDEXER_H
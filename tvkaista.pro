@@ -27,7 +27,29 @@ SOURCES += main.cpp \
     thumbnail.cpp \
     texteditordialog.cpp \
     historyentry.cpp \
-    historymanager.cpp
+    historymanager.cpp \
+    tsindexer.cpp \
+    streamserver.cpp \
+    imageloader.cpp \
+    posterprefetcher.cpp \
+    cacheindex.cpp \
+    cachemanager.cpp \
+    posterpack.cpp \
+    cachewriter.cpp \
+    descriptionstore.cpp \
+    programmegridloader.cpp \
+    programmegridwindow.cpp \
+    availabilitywatcher.cpp \
+    playlisteditor.cpp \
+    replaynetworkaccessmanager.cpp \
+    networktracer.cpp \
+    networktracedock.cpp \
+    profiler.cpp \
+    metrics.cpp \
+    statisticsdialog.cpp \
+    headlessrunner.cpp \
+    serverprober.cpp \
+    sessionmanager.cpp
 HEADERS += mainwindow.h \
     tvkaistaclient.h \
     channelfeedparser.h \
@@ -47,7 +69,29 @@ HEADERS += mainwindow.h \
     thumbnail.h \
     texteditordialog.h \
     historyentry.h \
-    historymanager.h
+    historymanager.h \
+    tsindexer.h \
+    streamserver.h \
+    imageloader.h \
+    posterprefetcher.h \
+    cacheindex.h \
+    cachemanager.h \
+    posterpack.h \
+    cachewriter.h \
+    descriptionstore.h \
+    programmegridloader.h \
+    programmegridwindow.h \
+    availabilitywatcher.h \
+    playlisteditor.h \
+    replaynetworkaccessmanager.h \
+    networktracer.h \
+    networktracedock.h \
+    profiler.h \
+    metrics.h \
+    statisticsdialog.h \
+    headlessrunner.h \
+    serverprober.h \
+    sessionmanager.h
 FORMS += mainwindow.ui \
     settingsdialog.ui \
     aboutdialog.ui \
@@ -60,3 +104,4 @@ VERSION = 1.3.0
 DEFINES += APP_VERSION=\\\"$$VERSION\\\"
 unix:DEFINES += TVKAISTAGUI_TRANSLATIONS_DIR=\\\"/usr/share/tvkaistagui/translations\\\"
 macx:CONFIG += x86 x86_64 ppc 
+profiler:DEFINES += TVKAISTAGUI_PROFILER
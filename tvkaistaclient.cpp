@@ -9,17 +9,28 @@
 #include <QUrl>
 #include <QAuthenticator>
 #include "cache.h"
+#include "metrics.h"
+#include "networktracer.h"
 #include "channelfeedparser.h"
 #include "programmefeedparser.h"
 #include "programmetableparser.h"
+#include "sessionmanager.h"
 #include "tvkaistaclient.h"
 
+/* Tallenteen osoite (uudelleenohjauksen kohde) on voimassa rajallisen ajan. Osoitteet
+   tallennetaan muistiin ohjelman, muodon ja palvelimen mukaan. */
+static const int StreamUrlTtl = 10 * 60;
+static const int MaxStreamUrlRequests = 2;
+
 TvkaistaClient::TvkaistaClient(QObject *parent) :
     QObject(parent), m_networkAccessManager(new QNetworkAccessManager(this)), m_reply(0),
-    m_cache(0), m_programmeTableParser(new ProgrammeTableParser), m_requestType(-1)
+    m_cache(0), m_session(0), m_programmeTableParser(new ProgrammeTableParser), m_listingParseTime(0),
+    m_requestType(-1), m_loginRequestType(-1)
 {
-    m_requestedProgramme.id = -1;
     m_requestedStream.id = -1;
+    m_session = new SessionManager(this, this);
+    connect(m_session, SIGNAL(loggedIn()), SLOT(sessionLoggedIn()));
+    connect(m_session, SIGNAL(loginFailed(QNetworkReply::NetworkError)), SLOT(sessionLoginFailed(QNetworkReply::NetworkError)));
     connect(m_networkAccessManager, SIGNAL(authenticationRequired(QNetworkReply*, QAuthenticator*)), SLOT(requestAuthenticationRequired(QNetworkReply*, QAuthenticator*)));
 }
 
@@ -28,6 +39,17 @@ TvkaistaClient::~TvkaistaClient()
     delete m_programmeTableParser;
 }
 
+void TvkaistaClient::setNetworkAccessManager(QNetworkAccessManager *networkAccessManager)
+{
+    /* Kutsutaan ennen ensimmäistä pyyntöä. Välityspalvelin ja evästeet siirretään uudelle. */
+    networkAccessManager->setParent(this);
+    networkAccessManager->setProxy(m_networkAccessManager->proxy());
+    networkAccessManager->setCookieJar(m_networkAccessManager->cookieJar());
+    connect(networkAccessManager, SIGNAL(authenticationRequired(QNetworkReply*, QAuthenticator*)), SLOT(requestAuthenticationRequired(QNetworkReply*, QAuthenticator*)));
+    delete m_networkAccessManager;
+    m_networkAccessManager = networkAccessManager;
+}
+
 void TvkaistaClient::setCache(Cache *cache)
 {
     m_cache = cache;
@@ -38,6 +60,11 @@ Cache* TvkaistaClient::cache() const
     return m_cache;
 }
 
+SessionManager* TvkaistaClient::session() const
+{
+    return m_session;
+}
+
 void TvkaistaClient::setUsername(const QString &username)
 {
     m_username = username;
@@ -65,6 +92,7 @@ void TvkaistaClient::setCookies(const QByteArray &cookieString)
 
     QList<QNetworkCookie> cookies = QNetworkCookie::parseCookies(cookieString);
     m_networkAccessManager->cookieJar()->setCookiesFromUrl(cookies, QUrl("http://www.tvkaista.fi/"));
+    m_session->updateExpireDateTime();
 }
 
 QByteArray TvkaistaClient::cookies() const
@@ -130,18 +158,15 @@ bool TvkaistaClient::isValidUsernameAndPassword() const
 
 bool TvkaistaClient::isRequestUnfinished() const
 {
-    return m_reply != 0;
+    /* Tallenteen osoitetta voidaan odottaa myös välimuistista tai etukäteisselvitykseltä ilman m_replyä. */
+    return m_reply != 0 || m_loginRequestType >= 0 || !m_requestedStreamKey.isEmpty() || m_requestedStream.id >= 0;
 }
 
 void TvkaistaClient::sendLoginRequest()
 {
     abortRequest();
-    QString urlString = "http://www.tvkaista.fi/";
-    qDebug() << "GET" << urlString;
-    m_reply = m_networkAccessManager->get(QNetworkRequest(QUrl(urlString)));
-    m_requestType = 1;
-    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
-    connect(m_reply, SIGNAL(finished()), SLOT(frontPageRequestFinished()));
+    waitForLogin(0, 0);
+    m_session->login();
 }
 
 void TvkaistaClient::sendChannelRequest()
@@ -151,7 +176,7 @@ void TvkaistaClient::sendChannelRequest()
     qDebug() << "GET" << urlString;
     QUrl url(urlString);
     QNetworkRequest request(url);
-    m_reply = m_networkAccessManager->get(request);
+    m_reply = trace(m_networkAccessManager->get(request), "GET");
     m_requestType = 3;
     connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
     connect(m_reply, SIGNAL(finished()), SLOT(channelRequestFinished()));
@@ -163,41 +188,126 @@ void TvkaistaClient::sendProgrammeRequest(int channelId, const QDate &date)
     QString urlString = QString("http://www.tvkaista.fi/recordings/date/%1/%2/")
                         .arg(date.toString("dd/MM/yyyy")).arg(channelId);
     qDebug() << "GET" << urlString;
-    m_reply = m_networkAccessManager->get(QNetworkRequest(QUrl(urlString)));
+    m_reply = trace(m_networkAccessManager->get(QNetworkRequest(QUrl(urlString))), "GET");
     m_requestType = 4;
     connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
     connect(m_reply, SIGNAL(readyRead()), SLOT(programmeRequestReadyRead()));
     connect(m_reply, SIGNAL(finished()), SLOT(programmeRequestFinished()));
     m_programmeTableParser->setRequestedDate(date);
     m_programmeTableParser->setRequestedChannelId(channelId);
+    m_listingParseTime = 0;
 }
 
-void TvkaistaClient::sendPosterRequest(const Programme &programme)
+QNetworkReply* TvkaistaClient::sendDetailedFeedRequest(const Programme &programme)
 {
-    abortRequest();
-    QString urlString = QString("http://www.tvkaista.fi/resources/recordings/screengrabs/%1.jpg").arg(programme.id);
+    QString urlString = QString("http://www.tvkaista.fi/feed/programs/%1/detailed.mediarss").arg(programme.id);
     qDebug() << "GET" << urlString;
-    m_reply = m_networkAccessManager->get(QNetworkRequest(QUrl(urlString)));
-    m_requestType = 5;
-    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
-    connect(m_reply, SIGNAL(finished()), SLOT(posterRequestFinished()));
-    m_requestedProgramme = programme;
+    QUrl url(urlString);
+    QNetworkRequest request(url);
+    return trace(m_networkAccessManager->get(request), "GET");
 }
 
-QNetworkReply* TvkaistaClient::sendDetailedFeedRequest(const Programme &programme)
+QNetworkReply* TvkaistaClient::sendListingRequest(int channelId, const QDate &date)
 {
-    QString urlString = QString("http://www.tvkaista.fi/feed/programs/%1/detailed.mediarss").arg(programme.id);
+    /* Toisin kuin sendProgrammeRequest(), ei keskeytä muita pyyntöjä. */
+    QString urlString = QString("http://www.tvkaista.fi/recordings/date/%1/%2/")
+                        .arg(date.toString("dd/MM/yyyy")).arg(channelId);
     qDebug() << "GET" << urlString;
-    QUrl url(urlString);
+    return trace(m_networkAccessManager->get(QNetworkRequest(QUrl(urlString))), "GET");
+}
+
+QNetworkReply* TvkaistaClient::sendPlaylistEditRequest(int programmeId, bool add)
+{
+    if (!add) {
+        QString urlString = QString("http://www.tvkaista.fi/feed/playlist/%1/").arg(programmeId);
+        qDebug() << "DELETE" << urlString;
+        return trace(m_networkAccessManager->deleteResource(QNetworkRequest(QUrl(urlString))), "DELETE");
+    }
+
+    QByteArray data("id=");
+    data.append(QString::number(programmeId));
+    QString urlString = "http://www.tvkaista.fi/feed/playlist/";
+    qDebug() << "POST" << urlString << data;
+    QNetworkRequest request((QUrl(urlString)));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    return trace(m_networkAccessManager->post(request, data), "POST");
+}
+
+QNetworkReply* TvkaistaClient::sendSeasonPassEditRequest(int id, bool add)
+{
+    /* Lisättäessä id on ohjelman id, poistettaessa season passin id. */
+    if (!add) {
+        QString urlString = QString("http://www.tvkaista.fi/feed/seasonpasses/%1/").arg(id);
+        qDebug() << "DELETE" << urlString;
+        return trace(m_networkAccessManager->deleteResource(QNetworkRequest(QUrl(urlString))), "DELETE");
+    }
+
+    QByteArray data("id=");
+    data.append(QString::number(id));
+    QString urlString = "http://www.tvkaista.fi/feed/seasonpasses/";
+    qDebug() << "POST" << urlString << data;
+    QNetworkRequest request((QUrl(urlString)));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    return trace(m_networkAccessManager->post(request, data), "POST");
+}
+
+QNetworkReply* TvkaistaClient::sendPlaylistFeedRequest()
+{
+    QString urlString = "http://www.tvkaista.fi/feed/playlist/standard.mediarss";
+    qDebug() << "GET" << urlString;
+    return trace(m_networkAccessManager->get(QNetworkRequest(QUrl(urlString))), "GET");
+}
+
+QNetworkReply* TvkaistaClient::sendSeasonPassFeedRequest(bool index)
+{
+    QString urlString = index ? "http://www.tvkaista.fi/feed/seasonpasses/" :
+                        "http://www.tvkaista.fi/feed/seasonpasses/*/standard.mediarss";
+    qDebug() << "GET" << urlString;
+    return trace(m_networkAccessManager->get(QNetworkRequest(QUrl(urlString))), "GET");
+}
+
+void TvkaistaClient::resolveStreamUrl(const Programme &programme)
+{
+    /* Osoite selvitetään etukäteen, jotta katselu voi alkaa ilman pyyntöä palvelimelle. */
+    QString key = streamUrlKey(programme.id, m_format, m_server);
+
+    if (programme.id < 0 || !isValidUsernameAndPassword() || m_streamUrlReplies.values().contains(key) ||
+        m_streamUrlReplies.size() >= MaxStreamUrlRequests ||
+        (m_streamUrls.contains(key) && m_streamUrls.value(key).expireDateTime > QDateTime::currentDateTime())) {
+        return;
+    }
+
+    QNetworkReply *reply = sendStreamUrlRequest(programme, m_format, m_server);
+    connect(reply, SIGNAL(finished()), SLOT(streamUrlRequestFinished()));
+    m_streamUrlReplies.insert(reply, key);
+}
+
+QNetworkReply* TvkaistaClient::sendStreamUrlRequest(const Programme &programme, int format, const QString &server)
+{
+    /* Toisin kuin sendStreamRequest(), ei keskeytä muita pyyntöjä eikä muuta valittua palvelinta.
+       Palvelinvalinta lähetetään vain tämän pyynnön evästeissä. */
+    QUrl url(streamUrlString(programme.id, format));
+    QList<QNetworkCookie> cookies = m_networkAccessManager->cookieJar()->cookiesForUrl(url);
+
+    for (int i = cookies.size() - 1; i >= 0; i--) {
+        if (cookies.at(i).name() == "preferred_servers") {
+            cookies.removeAt(i);
+        }
+    }
+
+    cookies.append(QNetworkCookie("preferred_servers", server.toAscii()));
     QNetworkRequest request(url);
-    return m_networkAccessManager->get(request);
+    request.setAttribute(QNetworkRequest::CookieLoadControlAttribute, QNetworkRequest::Manual);
+    request.setHeader(QNetworkRequest::CookieHeader, QVariant::fromValue(cookies));
+    qDebug() << "GET" << url.toString() << server;
+    return trace(m_networkAccessManager->get(request), "GET");
 }
 
 QNetworkReply* TvkaistaClient::sendRequest(const QNetworkRequest &request)
 {
     setServerCookie();
     qDebug() << "GET" << request.url().toString();
-    return m_networkAccessManager->get(request);
+    return trace(m_networkAccessManager->get(request), "GET");
 }
 
 QNetworkReply* TvkaistaClient::sendRequestWithAuthHeader(const QUrl &url)
@@ -205,35 +315,55 @@ QNetworkReply* TvkaistaClient::sendRequestWithAuthHeader(const QUrl &url)
     setServerCookie();
     qDebug() << "GET" << url.toString();
     QNetworkRequest request(url);
-    return m_networkAccessManager->get(request);
+    return trace(m_networkAccessManager->get(request), "GET");
 }
 
-void TvkaistaClient::sendStreamRequest(const Programme &programme)
+QNetworkReply* TvkaistaClient::sendLoginFormRequest()
 {
-    abortRequest();
-    QString urlString = QString("http://www.tvkaista.fi/recordings/download/%1/").arg(programme.id);
-
-    switch (m_format) {
-    case 0:
-        urlString.append("3/300000/");
-        break;
-
-    case 1:
-        urlString.append("4/1000000/");
-        break;
+    QByteArray data;
+    data.append("username=");
+    data.append(m_username.toUtf8().toPercentEncoding());
+    data.append("&password=");
+    data.append(m_password.toUtf8().toPercentEncoding());
+    data.append("&rememberme=unlessnot&action=login");
+    QString urlString = "http://www.tvkaista.fi/login/";
+    qDebug() << "POST" << urlString;
+    QUrl url(urlString);
+    QNetworkRequest request(url);
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+    return trace(m_networkAccessManager->post(request, data), "POST");
+}
 
-    case 2:
-        urlString.append("3/2000000/");
-        break;
+void TvkaistaClient::sendStreamRequest(const Programme &requestedProgramme)
+{
+    /* Kopioidaan ennen keskeytystä, koska parametri voi viitata m_requestedStreamiin. */
+    Programme programme = requestedProgramme;
+    abortRequest();
+    QString key = streamUrlKey(programme.id, m_format, m_server);
+    bool cached = m_streamUrls.contains(key) &&
+                  m_streamUrls.value(key).expireDateTime > QDateTime::currentDateTime();
+
+    /* Valmiiksi selvitetty osoite annetaan vasta tapahtumasilmukasta, jotta kutsuja näkee
+       signaalit samassa järjestyksessä kuin verkosta haettaessa. */
+    if (cached || m_streamUrlReplies.values().contains(key)) {
+        Metrics::instance()->increment("tvkaista_cache_hits_total{class=\"streamurls\"}");
+        m_requestedStream = programme;
+        m_requestedFormat = m_format;
+        m_requestedStreamKey = key;
+
+        if (cached) {
+            QTimer::singleShot(0, this, SLOT(cachedStreamUrlReady()));
+        }
 
-    default:
-        urlString.append("0/8000000/");
+        return;
     }
 
+    Metrics::instance()->increment("tvkaista_cache_misses_total{class=\"streamurls\"}");
+    QString urlString = streamUrlString(programme.id, m_format);
     setServerCookie();
     qDebug() << "Server" << m_server;
     qDebug() << "GET" << urlString;
-    m_reply = m_networkAccessManager->get(QNetworkRequest(QUrl(urlString)));
+    m_reply = trace(m_networkAccessManager->get(QNetworkRequest(QUrl(urlString))), "GET");
     m_requestType = 6;
     connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
     connect(m_reply, SIGNAL(finished()), SLOT(streamRequestFinished()));
@@ -247,7 +377,7 @@ void TvkaistaClient::sendSearchRequest(const QString &phrase)
     QString urlString = QString("http://www.tvkaista.fi/feed/search/title/%1/flv.mediarss").arg(phrase);
     qDebug() << "GET" << urlString;
     QNetworkRequest request = QNetworkRequest(QUrl(urlString));
-    m_reply = m_networkAccessManager->get(request);
+    m_reply = trace(m_networkAccessManager->get(request), "GET");
     m_requestType = 7;
     connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
     connect(m_reply, SIGNAL(finished()), SLOT(searchRequestFinished()));
@@ -256,50 +386,16 @@ void TvkaistaClient::sendSearchRequest(const QString &phrase)
 void TvkaistaClient::sendPlaylistRequest()
 {
     abortRequest();
-    QString urlString = "http://www.tvkaista.fi/feed/playlist/standard.mediarss";
-    qDebug() << "GET" << urlString;
-    QNetworkRequest request = QNetworkRequest(QUrl(urlString));
-    m_reply = m_networkAccessManager->get(request);
+    m_reply = sendPlaylistFeedRequest();
     m_requestType = 8;
     connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
     connect(m_reply, SIGNAL(finished()), SLOT(playlistRequestFinished()));
 }
 
-void TvkaistaClient::sendPlaylistAddRequest(int programmeId)
-{
-    abortRequest();
-    QByteArray data("id=");
-    data.append(QString::number(programmeId));
-    QString urlString = "http://www.tvkaista.fi/feed/playlist/";
-    qDebug() << "POST" << urlString << data;
-    QUrl url(urlString);
-    QNetworkRequest request(url);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
-    m_reply = m_networkAccessManager->post(request, data);
-    m_requestType = 9;
-    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
-    connect(m_reply, SIGNAL(finished()), SLOT(playlistAddRequestFinished()));
-}
-
-void TvkaistaClient::sendPlaylistRemoveRequest(int programmeId)
-{
-    abortRequest();
-    QString urlString = QString("http://www.tvkaista.fi/feed/playlist/%1/").arg(programmeId);
-    qDebug() << "DELETE" << urlString;
-    QNetworkRequest request = QNetworkRequest(QUrl(urlString));
-    m_reply = m_networkAccessManager->deleteResource(request);
-    m_requestType = 10;
-    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
-    connect(m_reply, SIGNAL(finished()), SLOT(playlistRemoveRequestFinished()));
-}
-
 void TvkaistaClient::sendSeasonPassListRequest()
 {
     abortRequest();
-    QString urlString = "http://www.tvkaista.fi/feed/seasonpasses/*/standard.mediarss";
-    qDebug() << "GET" << urlString;
-    QNetworkRequest request = QNetworkRequest(QUrl(urlString));
-    m_reply = m_networkAccessManager->get(request);
+    m_reply = sendSeasonPassFeedRequest(false);
     m_requestType = 11;
     connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
     connect(m_reply, SIGNAL(finished()), SLOT(seasonPassListRequestFinished()));
@@ -308,106 +404,78 @@ void TvkaistaClient::sendSeasonPassListRequest()
 void TvkaistaClient::sendSeasonPassIndexRequest()
 {
     abortRequest();
-    QString urlString = "http://www.tvkaista.fi/feed/seasonpasses/";
-    qDebug() << "GET" << urlString;
-    QNetworkRequest request = QNetworkRequest(QUrl(urlString));
-    m_reply = m_networkAccessManager->get(request);
+    m_reply = sendSeasonPassFeedRequest(true);
     m_requestType = 12;
     connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
     connect(m_reply, SIGNAL(finished()), SLOT(seasonPassIndexRequestFinished()));
 }
 
-void TvkaistaClient::sendSeasonPassAddRequest(int programmeId)
+void TvkaistaClient::sessionLoggedIn()
 {
-    abortRequest();
-    QByteArray data("id=");
-    data.append(QString::number(programmeId));
-    QString urlString = "http://www.tvkaista.fi/feed/seasonpasses/";
-    qDebug() << "POST" << urlString << data;
-    QUrl url(urlString);
-    QNetworkRequest request(url);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
-    m_reply = m_networkAccessManager->post(request, data);
-    m_requestType = 13;
-    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
-    connect(m_reply, SIGNAL(finished()), SLOT(seasonPassAddRequestFinished()));
-}
+    /* Yhteinen kirjautuminen valmistui. Toistetaan pyyntö, joka jäi odottamaan sitä. */
+    int requestType = m_loginRequestType;
+    m_loginRequestType = -1;
 
-void TvkaistaClient::sendSeasonPassRemoveRequest(int seasonPassId)
-{
-    abortRequest();
-    QString urlString = QString("http://www.tvkaista.fi/feed/seasonpasses/%1/").arg(seasonPassId);
-    qDebug() << "DELETE" << urlString;
-    QNetworkRequest request = QNetworkRequest(QUrl(urlString));
-    m_reply = m_networkAccessManager->deleteResource(request);
-    m_requestType = 14;
-    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
-    connect(m_reply, SIGNAL(finished()), SLOT(seasonPassRemoveRequestFinished()));
+    if (requestType == 4) {
+        sendProgrammeRequest(m_programmeTableParser->requestedChannelId(),
+                             m_programmeTableParser->requestedDate());
+    }
+    else if (requestType == 6) {
+        sendStreamRequest(m_requestedStream);
+    }
+    else if (requestType == 0) {
+        emit loggedIn();
+    }
 }
 
-void TvkaistaClient::frontPageRequestFinished()
+void TvkaistaClient::sessionLoginFailed(QNetworkReply::NetworkError error)
 {
-    QByteArray data;
-    data.append("username=");
-    data.append(m_username.toUtf8().toPercentEncoding());
-    data.append("&password=");
-    data.append(m_password.toUtf8().toPercentEncoding());
-    data.append("&rememberme=unlessnot&action=login");
-    QString urlString = "http://www.tvkaista.fi/login/";
-    qDebug() << "POST" << urlString;
-    QUrl url(urlString);
-    QNetworkRequest request(url);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
-    m_reply = m_networkAccessManager->post(request, data);
-    m_requestType = 2;
-    connect(m_reply, SIGNAL(error(QNetworkReply::NetworkError)), SLOT(requestNetworkError(QNetworkReply::NetworkError)));
-    connect(m_reply, SIGNAL(finished()), SLOT(loginRequestFinished()));
-}
+    if (m_loginRequestType < 0) {
+        return;
+    }
 
-void TvkaistaClient::loginRequestFinished()
-{
-    QByteArray data = m_reply->readAll();
-    bool invalidPassword = data.contains("<form");
-    m_lastLogin = QDateTime::currentDateTime();
-    m_reply->deleteLater();
-    m_reply = 0;
+    m_loginRequestType = -1;
+    m_requestedStream.id = -1;
 
-    if (invalidPassword) {
+    if (error == QNetworkReply::AuthenticationRequiredError) {
         emit loginError();
     }
-    else if (m_programmeTableParser->requestedChannelId() >= 0) {
-        sendProgrammeRequest(m_programmeTableParser->requestedChannelId(),
-                             m_programmeTableParser->requestedDate());
-    }
-    else if (m_requestedStream.id >= 0) {
-        sendStreamRequest(m_requestedStream);
-    }
     else {
-        emit loggedIn();
+        m_error = networkErrorString(error);
+        emit networkError();
     }
 }
 
 void TvkaistaClient::channelRequestFinished()
 {
     ChannelFeedParser parser;
+    qint64 parseStart = Metrics::instance()->timestamp();
+    bool ok = parser.parse(m_reply);
+    NetworkTracer::instance()->traceParse(m_reply, Metrics::instance()->timestamp() - parseStart);
+    Metrics::instance()->observeElapsed("tvkaista_parse_duration_ms{parser=\"channels\"}", parseStart);
 
-    if (!parser.parse(m_reply)) {
+    if (!ok) {
         qDebug() << parser.lastError();
         m_reply->deleteLater();
         m_reply = 0;
     }
     else {
         QList<Channel> channels = parser.channels();
-        m_cache->saveChannels(channels);
         m_reply->deleteLater();
         m_reply = 0;
         emit channelsFetched(channels);
+        m_cache->saveChannels(channels);
     }
 }
 
 void TvkaistaClient::programmeRequestReadyRead()
 {
+    /* Listaus jäsennetään paloina sitä mukaa kuin sitä saapuu, joten ajat lasketaan yhteen. */
+    qint64 parseStart = Metrics::instance()->timestamp();
     m_programmeTableParser->parse(m_reply);
+    qint64 elapsed = Metrics::instance()->timestamp() - parseStart;
+    m_listingParseTime += elapsed;
+    NetworkTracer::instance()->traceParse(m_reply, elapsed);
 }
 
 void TvkaistaClient::programmeRequestFinished()
@@ -416,134 +484,205 @@ void TvkaistaClient::programmeRequestFinished()
         return;
     }
 
-    if (m_programmeTableParser->isValidResults()) {
-        QDateTime now = QDateTime::currentDateTime();
-        QDate today = now.date();
-
-        for (int i = 0; i < 7; i++) {
-            QList<Programme> programmes = m_programmeTableParser->programmes(i);
+    Metrics::instance()->observe("tvkaista_parse_duration_ms{parser=\"listing\"}", m_listingParseTime / 1000.0);
 
-            if (programmes.isEmpty()) {
-                continue;
-            }
+    int channelId = m_programmeTableParser->requestedChannelId();
+    QDate requestedDate = m_programmeTableParser->requestedDate();
+    QList<Programme> requestedProgrammes = m_programmeTableParser->requestedProgrammes();
+    bool valid = m_programmeTableParser->isValidResults();
+    QList<QDate> dates;
+    QList<QList<Programme> > programmes;
 
-            QDateTime expireDateTime;
-
-            if (m_programmeTableParser->date(i) == today) {
-                expireDateTime = now.addSecs(300);
-            }
-            else if (m_programmeTableParser->date(i) > today) {
-                expireDateTime = QDateTime(m_programmeTableParser->date(i), QTime(0, 0));
-            }
-
-            m_cache->saveProgrammes(m_programmeTableParser->requestedChannelId(),
-                                    m_programmeTableParser->date(i), now,
-                                    expireDateTime, programmes);
-        }
+    for (int i = 0; i < 7 && valid; i++) {
+        dates.append(m_programmeTableParser->date(i));
+        programmes.append(m_programmeTableParser->programmes(i));
     }
 
     m_reply->deleteLater();
     m_reply = 0;
-    emit programmesFetched(m_programmeTableParser->requestedChannelId(),
-                           m_programmeTableParser->requestedDate(),
-                           m_programmeTableParser->requestedProgrammes());
     m_programmeTableParser->clear();
+
+    /* Tulokset näytetään ennen tallennusta. Tallennus tehdään taustasäikeessä. */
+    m_cache->storeDescriptions(requestedProgrammes);
+    emit programmesFetched(channelId, requestedDate, requestedProgrammes);
+    saveProgrammeWeek(channelId, dates, programmes);
 }
 
-void TvkaistaClient::posterRequestFinished()
+void TvkaistaClient::saveProgrammeWeek(int channelId, const ProgrammeTableParser *parser)
 {
-    if (!checkResponse()) {
-        return;
-    }
-
-    QByteArray data = m_reply->readAll();
-    QImage poster = QImage::fromData(data, "JPEG");
+    QList<QDate> dates;
+    QList<QList<Programme> > programmes;
 
-    if (!poster.isNull()) {
-        m_cache->savePoster(m_requestedProgramme, data);
-        emit posterFetched(m_requestedProgramme, poster);
+    for (int i = 0; i < 7 && parser->isValidResults(); i++) {
+        dates.append(parser->date(i));
+        programmes.append(parser->programmes(i));
     }
 
-    m_requestedProgramme.id = -1;
-    m_reply->deleteLater();
-    m_reply = 0;
+    saveProgrammeWeek(channelId, dates, programmes);
 }
 
-void TvkaistaClient::streamRequestFinished()
+void TvkaistaClient::saveProgrammeWeek(int channelId, const QList<QDate> &dates,
+                                       const QList<QList<Programme> > &programmes)
 {
-    if (m_reply == 0) {
-        return;
-    }
+    QDateTime now = QDateTime::currentDateTime();
+    QDate today = now.date();
+    int count = dates.size();
 
-    if (m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 302) {
-        emit streamUrlFetched(m_requestedStream, m_requestedFormat,
-                              m_reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl());
+    for (int i = 0; i < count; i++) {
+        if (programmes.at(i).isEmpty()) {
+            continue;
+        }
+
+        QDateTime expireDateTime;
+
+        if (dates.at(i) == today) {
+            expireDateTime = now.addSecs(300);
+        }
+        else if (dates.at(i) > today) {
+            expireDateTime = QDateTime(dates.at(i), QTime(0, 0));
+        }
+
+        m_cache->saveProgrammes(channelId, dates.at(i), now, expireDateTime, programmes.at(i));
     }
 }
 
-void TvkaistaClient::searchRequestFinished()
+void TvkaistaClient::streamRequestFinished()
 {
     if (m_reply == 0) {
         return;
     }
 
-    ProgrammeFeedParser parser;
+    bool redirected = m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 302;
+    QUrl url = m_reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+    QDateTime lastLogin = m_session->lastLogin();
 
-    if (!parser.parse(m_reply)) {
-        qWarning() << parser.lastError();
+    if (redirected && url.path().startsWith("/login") &&
+        (lastLogin.isNull() || lastLogin < QDateTime::currentDateTime().addSecs(-5))) {
+        waitForLogin(6, m_reply);
+        return;
     }
 
+    /* Pyyntö on valmis, joten isRequestUnfinished() ei enää estä muita pyyntöjä. */
+    Programme programme = m_requestedStream;
     m_reply->deleteLater();
     m_reply = 0;
-    emit searchResultsFetched(parser.programmes());
+    m_requestedStream.id = -1;
+    m_requestType = -1;
+
+    if (redirected) {
+        saveStreamUrl(streamUrlKey(programme.id, m_requestedFormat, m_server), url);
+        emit streamUrlFetched(programme, m_requestedFormat, url);
+    }
 }
 
-void TvkaistaClient::playlistRequestFinished()
+void TvkaistaClient::streamUrlRequestFinished()
 {
-    ProgrammeFeedParser parser;
-    bool ok = parser.parse(m_reply);
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
 
-    if (!ok) {
-        qWarning() << parser.lastError();
+    if (reply == 0 || !m_streamUrlReplies.contains(reply)) {
+        return;
     }
 
-    m_reply->deleteLater();
-    m_reply = 0;
+    QString key = m_streamUrlReplies.take(reply);
+    reply->deleteLater();
 
-    if (ok) {
-        m_cache->savePlaylist(QDateTime::currentDateTime(), parser.programmes());
-        emit playlistFetched(parser.programmes());
+    if (reply->error() == QNetworkReply::NoError &&
+        reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 302) {
+        QUrl url = reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
+        saveStreamUrl(key, url);
+
+        /* Uusitaan vanhentunut istunto jo nyt, ennen kuin käyttäjä pyytää ohjelmaa. */
+        if (url.path().startsWith("/login")) {
+            m_session->renew(reply);
+        }
+    }
+
+    if (m_requestedStreamKey != key) {
+        return;
+    }
+
+    /* Käyttäjä odottaa tätä osoitetta. Jos etukäteisselvitys epäonnistui, osoite haetaan tavalliseen tapaan. */
+    if (m_streamUrls.contains(key)) {
+        cachedStreamUrlReady();
+    }
+    else {
+        sendStreamRequest(m_requestedStream);
     }
 }
 
-void TvkaistaClient::playlistAddRequestFinished()
+void TvkaistaClient::cachedStreamUrlReady()
 {
-    if (m_reply == 0) {
+    if (m_requestedStream.id < 0 || m_requestedStreamKey.isEmpty() || !m_streamUrls.contains(m_requestedStreamKey)) {
         return;
     }
 
-    qDebug() << "REPLY" << m_reply->readAll();
-    m_reply->deleteLater();
-    m_reply = 0;
-    emit editRequestFinished(1, true);
+    Programme programme = m_requestedStream;
+    QUrl url = m_streamUrls.value(m_requestedStreamKey).url;
+    m_requestedStream.id = -1;
+    m_requestedStreamKey.clear();
+    emit streamUrlFetched(programme, m_requestedFormat, url);
+}
+
+void TvkaistaClient::saveStreamUrl(const QString &key, const QUrl &url)
+{
+    /* Kirjautumissivulle ohjaavaa osoitetta ei tallenneta. */
+    if (!url.isValid() || url.path().startsWith("/login")) {
+        return;
+    }
+
+    QDateTime now = QDateTime::currentDateTime();
+    QMap<QString, StreamUrl>::iterator i = m_streamUrls.begin();
+
+    while (i != m_streamUrls.end()) {
+        if (i.value().expireDateTime <= now) {
+            i = m_streamUrls.erase(i);
+        }
+        else {
+            ++i;
+        }
+    }
+
+    StreamUrl streamUrl;
+    streamUrl.url = url;
+    streamUrl.expireDateTime = now.addSecs(StreamUrlTtl);
+    m_streamUrls.insert(key, streamUrl);
 }
 
-void TvkaistaClient::playlistRemoveRequestFinished()
+QString TvkaistaClient::streamUrlKey(int programmeId, int format, const QString &server)
+{
+    return QString("%1/%2/%3").arg(programmeId).arg(format).arg(server);
+}
+
+void TvkaistaClient::searchRequestFinished()
 {
     if (m_reply == 0) {
         return;
     }
 
-    qDebug() << "REPLY" << m_reply->readAll();
+    ProgrammeFeedParser parser;
+    qint64 parseStart = Metrics::instance()->timestamp();
+    bool ok = parser.parse(m_reply);
+    NetworkTracer::instance()->traceParse(m_reply, Metrics::instance()->timestamp() - parseStart);
+    Metrics::instance()->observeElapsed("tvkaista_parse_duration_ms{parser=\"feed\"}", parseStart);
+
+    if (!ok) {
+        qWarning() << parser.lastError();
+    }
+
     m_reply->deleteLater();
     m_reply = 0;
-    emit editRequestFinished(2, true);
+    QList<Programme> programmes = parser.programmes();
+    m_cache->storeDescriptions(programmes);
+    emit searchResultsFetched(programmes);
 }
 
-void TvkaistaClient::seasonPassListRequestFinished()
+void TvkaistaClient::playlistRequestFinished()
 {
     ProgrammeFeedParser parser;
+    qint64 parseStart = Metrics::instance()->timestamp();
     bool ok = parser.parse(m_reply);
+    NetworkTracer::instance()->traceParse(m_reply, Metrics::instance()->timestamp() - parseStart);
+    Metrics::instance()->observeElapsed("tvkaista_parse_duration_ms{parser=\"feed\"}", parseStart);
 
     if (!ok) {
         qWarning() << parser.lastError();
@@ -553,19 +692,21 @@ void TvkaistaClient::seasonPassListRequestFinished()
     m_reply = 0;
 
     if (ok) {
-        m_cache->saveSeasonPasses(QDateTime::currentDateTime(), parser.programmes());
-        emit seasonPassListFetched(parser.programmes());
+        /* Tallennettaessa kuvaukset luetaan takaisin sanakirjasta. */
+        QList<Programme> programmes = parser.programmes();
+        m_cache->storeDescriptions(programmes);
+        emit playlistFetched(programmes);
+        m_cache->savePlaylist(QDateTime::currentDateTime(), programmes);
     }
 }
 
-void TvkaistaClient::seasonPassIndexRequestFinished()
+void TvkaistaClient::seasonPassListRequestFinished()
 {
-    if (m_reply == 0) {
-        return;
-    }
-
     ProgrammeFeedParser parser;
+    qint64 parseStart = Metrics::instance()->timestamp();
     bool ok = parser.parse(m_reply);
+    NetworkTracer::instance()->traceParse(m_reply, Metrics::instance()->timestamp() - parseStart);
+    Metrics::instance()->observeElapsed("tvkaista_parse_duration_ms{parser=\"feed\"}", parseStart);
 
     if (!ok) {
         qWarning() << parser.lastError();
@@ -575,41 +716,52 @@ void TvkaistaClient::seasonPassIndexRequestFinished()
     m_reply = 0;
 
     if (ok) {
-        QMap<QString, int> seasonPassMap;
-        QList<Programme> seasonPasses = parser.programmes();
-        int count = seasonPasses.size();
-
-        for (int i = 0; i < count; i++) {
-            Programme seasonPass = seasonPasses.at(i);
-            seasonPassMap.insert(seasonPass.title, seasonPass.id);
-        }
-
-        emit seasonPassIndexFetched(seasonPassMap);
+        QList<Programme> programmes = parser.programmes();
+        m_cache->storeDescriptions(programmes);
+        emit seasonPassListFetched(programmes);
+        m_cache->saveSeasonPasses(QDateTime::currentDateTime(), programmes);
     }
 }
 
-void TvkaistaClient::seasonPassAddRequestFinished()
+void TvkaistaClient::seasonPassIndexRequestFinished()
 {
     if (m_reply == 0) {
         return;
     }
 
-    qDebug() << "REPLY" << m_reply->readAll();
+    bool ok;
+    qint64 parseStart = Metrics::instance()->timestamp();
+    QMap<QString, int> seasonPassMap = parseSeasonPassIndex(m_reply, ok);
+    NetworkTracer::instance()->traceParse(m_reply, Metrics::instance()->timestamp() - parseStart);
+    Metrics::instance()->observeElapsed("tvkaista_parse_duration_ms{parser=\"seasonpassindex\"}", parseStart);
     m_reply->deleteLater();
     m_reply = 0;
-    emit editRequestFinished(3, true);
+
+    if (ok) {
+        emit seasonPassIndexFetched(seasonPassMap);
+    }
 }
 
-void TvkaistaClient::seasonPassRemoveRequestFinished()
+QMap<QString, int> TvkaistaClient::parseSeasonPassIndex(QIODevice *device, bool &ok)
 {
-    if (m_reply == 0) {
-        return;
+    ProgrammeFeedParser parser;
+    QMap<QString, int> seasonPassMap;
+    ok = parser.parse(device);
+
+    if (!ok) {
+        qWarning() << parser.lastError();
+        return seasonPassMap;
     }
 
-    qDebug() << "REPLY" << m_reply->readAll();
-    m_reply->deleteLater();
-    m_reply = 0;
-    emit editRequestFinished(4, true);
+    QList<Programme> seasonPasses = parser.programmes();
+    int count = seasonPasses.size();
+
+    for (int i = 0; i < count; i++) {
+        Programme seasonPass = seasonPasses.at(i);
+        seasonPassMap.insert(seasonPass.title, seasonPass.id);
+    }
+
+    return seasonPassMap;
 }
 
 void TvkaistaClient::requestNetworkError(QNetworkReply::NetworkError error)
@@ -620,25 +772,12 @@ void TvkaistaClient::requestNetworkError(QNetworkReply::NetworkError error)
         return;
     }
 
-    /* Ei virheilmoituksia kuvakaappausten hakemisesta. */
-    if (m_requestType == 5) {
-        return;
-    }
-
     if (error == QNetworkReply::AuthenticationRequiredError) {
         m_networkError = 1;
     }
     else if (m_requestedStream.id >= 0 && error == QNetworkReply::ContentNotFoundError) {
         m_networkError = 2;
     }
-    else if (m_requestType == 9 && error == QNetworkReply::UnknownContentError) {
-        /* Ohjelma on jo lisätty listaan. */
-        m_networkError = 4;
-    }
-    else if (m_requestType == 13 && error == QNetworkReply::UnknownContentError) {
-        /* Ohjelma on jo lisätty sarjoihin. */
-        m_networkError = 4;
-    }
     else if (m_requestType >= 0) {
         m_networkError = 0;
         m_error = networkErrorString(error);
@@ -658,12 +797,6 @@ void TvkaistaClient::handleNetworkError()
     else if (m_networkError == 2) {
         emit streamNotFound();
     }
-    else if (m_networkError == 3) {
-        emit editRequestFinished(1, false);
-    }
-    else if (m_networkError == 4) {
-        emit editRequestFinished(3, false);
-    }
     else {
         emit networkError();
     }
@@ -690,9 +823,10 @@ void TvkaistaClient::abortRequest()
         reply->deleteLater();
     }
 
-    m_requestedProgramme.id = -1;
     m_requestedStream.id = -1;
+    m_requestedStreamKey.clear();
     m_requestType = -1;
+    m_loginRequestType = -1;
 }
 
 bool TvkaistaClient::checkResponse()
@@ -704,8 +838,10 @@ bool TvkaistaClient::checkResponse()
     if (m_reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 302) {
         QDateTime now = QDateTime::currentDateTime();
 
-        if (m_lastLogin.isNull() || m_lastLogin < now.addSecs(-5)) {
-            sendLoginRequest();
+        QDateTime lastLogin = m_session->lastLogin();
+
+        if (lastLogin.isNull() || lastLogin < now.addSecs(-5)) {
+            waitForLogin(m_requestType, m_reply);
             return false;
         }
     }
@@ -713,6 +849,86 @@ bool TvkaistaClient::checkResponse()
     return true;
 }
 
+void TvkaistaClient::waitForLogin(int requestType, QNetworkReply *reply)
+{
+    /* Pyyntö jää odottamaan yhteistä kirjautumista, joka voi olla jo käynnissä. */
+    if (reply != 0) {
+        m_session->renew(reply, this, SLOT(sessionLoggedIn()));
+        reply->deleteLater();
+        m_reply = 0;
+    }
+
+    m_requestType = -1;
+    m_loginRequestType = requestType;
+}
+
+QNetworkReply* TvkaistaClient::trace(QNetworkReply *reply, const QByteArray &method)
+{
+    NetworkTracer::instance()->traceRequest(reply, method);
+    reply->setProperty("metricsStart", Metrics::instance()->timestamp());
+    reply->setProperty("sessionGeneration", m_session->generation());
+    connect(reply, SIGNAL(downloadProgress(qint64,qint64)), SLOT(replyDownloadProgress(qint64,qint64)));
+    connect(reply, SIGNAL(finished()), SLOT(replyFinished()));
+    return reply;
+}
+
+void TvkaistaClient::replyDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
+{
+    Q_UNUSED(bytesTotal);
+
+    if (sender() != 0) {
+        sender()->setProperty("metricsBytes", bytesReceived);
+    }
+}
+
+void TvkaistaClient::replyFinished()
+{
+    /* Tämä yhteys on tehty ennen käsittelijöitä, joten m_reply on vielä asetettu.
+       Itsenäiset pyynnöt eivät käytä m_requestTypea, vaan ne luokitellaan polun mukaan. */
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+
+    if (reply == 0) {
+        return;
+    }
+
+    QString type = reply == m_reply ? QString::number(m_requestType) : reply->url().path().section('/', 1, 1);
+
+    if (type.isEmpty()) {
+        type = reply->url().host();
+    }
+
+    Metrics *metrics = Metrics::instance();
+    metrics->increment(QString("tvkaista_network_requests_total{type=\"%1\"}").arg(type));
+    metrics->increment(QString("tvkaista_network_received_bytes_total{type=\"%1\"}").arg(type),
+                       reply->property("metricsBytes").toLongLong());
+    metrics->observeElapsed(QString("tvkaista_network_request_duration_ms{type=\"%1\"}").arg(type),
+                            reply->property("metricsStart").toLongLong());
+}
+
+QString TvkaistaClient::streamUrlString(int programmeId, int format)
+{
+    QString urlString = QString("http://www.tvkaista.fi/recordings/download/%1/").arg(programmeId);
+
+    switch (format) {
+    case 0:
+        urlString.append("3/300000/");
+        break;
+
+    case 1:
+        urlString.append("4/1000000/");
+        break;
+
+    case 2:
+        urlString.append("3/2000000/");
+        break;
+
+    default:
+        urlString.append("0/8000000/");
+    }
+
+    return urlString;
+}
+
 void TvkaistaClient::setServerCookie()
 {
     QNetworkCookie serverCookie("preferred_servers", m_server.toAscii());
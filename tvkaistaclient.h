@@ -13,6 +13,13 @@ class QNetworkRequest;
 class Cache;
 class ProgrammeFeedParser;
 class ProgrammeTableParser;
+class SessionManager;
+
+struct StreamUrl
+{
+    QUrl url;
+    QDateTime expireDateTime;
+};
 
 class TvkaistaClient : public QObject
 {
@@ -20,8 +27,10 @@ class TvkaistaClient : public QObject
 public:
     TvkaistaClient(QObject *parent = 0);
     ~TvkaistaClient();
+    void setNetworkAccessManager(QNetworkAccessManager *networkAccessManager);
     void setCache(Cache *cache);
     Cache* cache() const;
+    SessionManager* session() const;
     void setUsername(const QString &username);
     QString username() const;
     void setPassword(const QString &password);
@@ -40,75 +49,87 @@ public:
     void sendLoginRequest();
     void sendChannelRequest();
     void sendProgrammeRequest(int channelId, const QDate &date);
-    void sendPosterRequest(const Programme &programme);
     void sendStreamRequest(const Programme &programme);
+    void resolveStreamUrl(const Programme &programme);
     void sendSearchRequest(const QString &phrase);
     void sendPlaylistRequest();
-    void sendPlaylistAddRequest(int programmeId);
-    void sendPlaylistRemoveRequest(int programmeId);
     void sendSeasonPassListRequest();
     void sendSeasonPassIndexRequest();
-    void sendSeasonPassAddRequest(int programmeId);
-    void sendSeasonPassRemoveRequest(int seasonPassId);
     QNetworkReply* sendDetailedFeedRequest(const Programme &programme);
+    QNetworkReply* sendListingRequest(int channelId, const QDate &date);
+    QNetworkReply* sendPlaylistEditRequest(int programmeId, bool add);
+    QNetworkReply* sendSeasonPassEditRequest(int id, bool add);
+    QNetworkReply* sendPlaylistFeedRequest();
+    QNetworkReply* sendSeasonPassFeedRequest(bool index);
+    QNetworkReply* sendStreamUrlRequest(const Programme &programme, int format, const QString &server);
+    void saveProgrammeWeek(int channelId, const ProgrammeTableParser *parser);
     QNetworkReply* sendRequest(const QNetworkRequest &request);
     QNetworkReply* sendRequestWithAuthHeader(const QUrl &url);
+    QNetworkReply* sendLoginFormRequest();
     static QString networkErrorString(QNetworkReply::NetworkError error);
+    static QMap<QString, int> parseSeasonPassIndex(QIODevice *device, bool &ok);
 
 signals:
     void loggedIn();
     void channelsFetched(const QList<Channel> &channels);
     void programmesFetched(int channelId, const QDate &date, const QList<Programme> &programmes);
-    void posterFetched(const Programme &programme, const QImage &poster);
     void streamUrlFetched(const Programme &programme, int format, const QUrl &url);
     void searchResultsFetched(const QList<Programme> &programmes);
     void playlistFetched(const QList<Programme> &programmes);
     void seasonPassListFetched(const QList<Programme> &programmes);
     void seasonPassIndexFetched(const QMap<QString, int> &seasonPasses);
-    void editRequestFinished(int type, bool ok);
     void streamNotFound();
     void loginError();
     void networkError();
 
 private slots:
-    void frontPageRequestFinished();
-    void loginRequestFinished();
+    void sessionLoggedIn();
+    void sessionLoginFailed(QNetworkReply::NetworkError error);
     void channelRequestFinished();
     void programmeRequestReadyRead();
     void programmeRequestFinished();
-    void posterRequestFinished();
     void streamRequestFinished();
     void searchRequestFinished();
     void playlistRequestFinished();
-    void playlistAddRequestFinished();
-    void playlistRemoveRequestFinished();
     void seasonPassListRequestFinished();
     void seasonPassIndexRequestFinished();
-    void seasonPassAddRequestFinished();
-    void seasonPassRemoveRequestFinished();
     void requestAuthenticationRequired(QNetworkReply *reply, QAuthenticator* authenticator);
     void requestNetworkError(QNetworkReply::NetworkError error);
     void handleNetworkError();
+    void streamUrlRequestFinished();
+    void cachedStreamUrlReady();
+    void replyDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
+    void replyFinished();
 
 private:
     void abortRequest();
     bool checkResponse();
+    void waitForLogin(int requestType, QNetworkReply *reply);
     void setServerCookie();
+    static QString streamUrlString(int programmeId, int format);
+    static QString streamUrlKey(int programmeId, int format, const QString &server);
+    void saveStreamUrl(const QString &key, const QUrl &url);
+    QNetworkReply* trace(QNetworkReply *reply, const QByteArray &method);
+    void saveProgrammeWeek(int channelId, const QList<QDate> &dates, const QList<QList<Programme> > &programmes);
     QNetworkAccessManager *m_networkAccessManager;
     QNetworkReply *m_reply;
     Cache *m_cache;
+    SessionManager *m_session;
     ProgrammeTableParser *m_programmeTableParser;
-    Programme m_requestedProgramme;
     Programme m_requestedStream;
+    QString m_requestedStreamKey;
+    QMap<QString, StreamUrl> m_streamUrls;
+    QMap<QNetworkReply*, QString> m_streamUrlReplies;
     int m_requestedFormat;
-    QDateTime m_lastLogin;
     QString m_username;
     QString m_password;
     QString m_server;
     QString m_error;
     int m_networkError;
+    qint64 m_listingParseTime;
     int m_format;
     int m_requestType;
+    int m_loginRequestType;
 };
 
 #endif // TVKAISTACLIENT_H